@@ -0,0 +1,552 @@
+
+#include "benchmark/benchmark.h"
+#include "common/bench/perf_bench.h"
+#include "common/bitop.h"
+#include "common/cpu.h"
+#include "common/hash.h"
+#include "common/hash64.h"
+#include "common/log.h"
+#include "common/metrics.h"
+#include "common/perfect_hash.h"
+#include "common/profiler.h"
+#include "common/simd.h"
+#include "common/simd_math.h"
+#include "common/vertex_pack.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+/**
+ * find_mask_bits as it was before the shift and fold version: test a
+ * window, on conflict skip past the highest set bit in it.
+ */
+static int32_t find_mask_bits_loop(uint64_t mask, int32_t bit_len) {
+  const int32_t bit_len_n = (bit_len - 1);
+  const int32_t bit_end = sizeof64 - bit_len_n;
+  const uint64_t test = ((2ul << bit_len_n) - 1ul);
+
+  int32_t i = 0;
+  while (i < bit_end) {
+    uint64_t res = (mask & (test << i));
+    if (res == 0)
+      return i;
+    i = sizeof64 - __builtin_clzl(res);
+  }
+  return -1;
+}
+
+enum mask_pattern {
+  PATTERN_RANDOM_10,
+  PATTERN_RANDOM_50,
+  PATTERN_RANDOM_90,
+  PATTERN_STRIDE_4,
+  PATTERN_LOW_HALF_FULL,
+};
+
+static std::vector<uint64_t> make_masks(mask_pattern pattern) {
+  std::vector<uint64_t> masks(1024);
+  uint64_t state = 0x9e3779b97f4a7c15ul;
+  for (uint64_t &mask : masks) {
+    mask = 0;
+    for (int32_t bit = 0; bit < sizeof64; bit++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      const uint64_t roll = state % 100;
+      bool set = false;
+      switch (pattern) {
+      case PATTERN_RANDOM_10:
+        set = roll < 10;
+        break;
+      case PATTERN_RANDOM_50:
+        set = roll < 50;
+        break;
+      case PATTERN_RANDOM_90:
+        set = roll < 90;
+        break;
+      case PATTERN_STRIDE_4:
+        set = bit % 4 == 3;
+        break;
+      case PATTERN_LOW_HALF_FULL:
+        set = bit < 32 || roll < 10;
+        break;
+      }
+      if (set)
+        mask |= 1ul << bit;
+    }
+  }
+  return masks;
+}
+
+template <int32_t (*find)(uint64_t, int32_t)>
+static void find_mask(benchmark::State &state) {
+  const std::vector<uint64_t> masks =
+      make_masks(static_cast<mask_pattern>(state.range(0)));
+  const int32_t bit_len = static_cast<int32_t>(state.range(1));
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(find(masks[i], bit_len));
+    i = (i + 1) & 1023;
+  }
+}
+
+static void patterns(benchmark::internal::Benchmark *b) {
+  const int32_t lengths[] = {1, 4, 16, 48};
+  for (int32_t p = PATTERN_RANDOM_10; p <= PATTERN_LOW_HALF_FULL; p++) {
+    for (int32_t len : lengths)
+      b->Args({p, len});
+  }
+}
+
+static std::vector<uint8_t> hash_input(size_t length) {
+  std::vector<uint8_t> data(length + 1);
+  for (size_t i = 0; i < length; i++)
+    data[i] = static_cast<uint8_t>('a' + i % 26);
+  data[length] = 0;
+  return data;
+}
+
+/**
+ * The constexpr crc32 evaluated at runtime, one recursive call per byte.
+ */
+static void crc32_constexpr(benchmark::State &state) {
+  const size_t length = static_cast<size_t>(state.range(0));
+  const std::vector<uint8_t> data = hash_input(length);
+  const char *str = reinterpret_cast<const char *>(data.data());
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(
+        common::internal::crc32(str, static_cast<uint32_t>(length)));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(length));
+}
+
+static void crc32_slice8(benchmark::State &state) {
+  const size_t length = static_cast<size_t>(state.range(0));
+  const std::vector<uint8_t> data = hash_input(length);
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(
+        common::internal::crc32_update_slice8(~0u, data.data(), length));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(length));
+}
+
+static void crc32_runtime_hash(benchmark::State &state) {
+  const size_t length = static_cast<size_t>(state.range(0));
+  const std::vector<uint8_t> data = hash_input(length);
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(common::runtime_hash(data.data(), length));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(length));
+}
+
+static void hash64_runtime(benchmark::State &state) {
+  const size_t length = static_cast<size_t>(state.range(0));
+  const std::vector<uint8_t> data = hash_input(length);
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(common::runtime_hash64(data.data(), length));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(length));
+}
+
+/**
+ * Streaming in 64Kb pieces, as when hashing a file through a read buffer.
+ */
+static void hash64_streaming(benchmark::State &state) {
+  const size_t length = static_cast<size_t>(state.range(0));
+  const std::vector<uint8_t> data = hash_input(length);
+  const size_t piece = 64 * 1024;
+  while (state.KeepRunning()) {
+    common::hash64_state h;
+    common::hash64_begin(&h);
+    for (size_t done = 0; done < length; done += piece) {
+      common::hash64_update(&h, data.data() + done,
+                            length - done < piece ? length - done : piece);
+    }
+    benchmark::DoNotOptimize(common::hash64_end(&h));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(length));
+}
+
+declare_id_set(bench_extensions, "VK_KHR_swapchain", "VK_KHR_maintenance1",
+               "VK_KHR_maintenance2", "VK_KHR_maintenance3",
+               "VK_KHR_multiview", "VK_KHR_dedicated_allocation",
+               "VK_KHR_get_memory_requirements2", "VK_KHR_bind_memory2",
+               "VK_KHR_descriptor_update_template", "VK_KHR_push_descriptor",
+               "VK_KHR_sampler_mirror_clamp_to_edge", "VK_KHR_16bit_storage",
+               "VK_KHR_shader_draw_parameters", "VK_KHR_variable_pointers",
+               "VK_EXT_debug_marker", "VK_AMD_rasterization_order");
+declare_perfect_hash(bench_extension_table, bench_extensions);
+
+// What a device reports: half of the set and as many other names.
+static const char *const bench_queries[]{
+    "VK_KHR_swapchain",       "VK_KHR_external_memory", "VK_KHR_multiview",
+    "VK_KHR_external_fence",  "VK_KHR_bind_memory2",    "VK_NV_glsl_shader",
+    "VK_KHR_16bit_storage",   "VK_EXT_depth_range",     "VK_EXT_debug_marker",
+    "VK_KHR_image_list",      "VK_KHR_maintenance2",    "VK_NV_dedicated",
+    "VK_KHR_push_descriptor", "VK_AMD_gcn_shader",      "VK_KHR_maintenance3",
+    "VK_EXT_blend_operation_advanced"};
+
+static void lookup_strcmp(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    int32_t found = 0;
+    for (const char *query : bench_queries) {
+      for (size_t i = 0; i < bench_extensions.size(); i++) {
+        if (!strcmp(bench_extensions.names[i], query)) {
+          found++;
+          break;
+        }
+      }
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 16);
+}
+
+static void lookup_perfect_hash(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    int32_t found = 0;
+    for (const char *query : bench_queries)
+      found += bench_extension_table.find(query) >= 0;
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 16);
+}
+
+struct point_streams {
+  std::vector<float> x, y, z;
+};
+
+static point_streams make_points(size_t count) {
+  point_streams res;
+  for (size_t i = 0; i < count; i++) {
+    res.x.push_back(static_cast<float>(i % 97) + 1.0f);
+    res.y.push_back(static_cast<float>(i % 13) * 0.5f);
+    res.z.push_back(static_cast<float>(i % 31) - 15.0f);
+  }
+  return res;
+}
+
+static glm::mat4 bench_matrix() {
+  glm::mat4 m(1.0f);
+  m[0][1] = 0.5f;
+  m[2][0] = -0.25f;
+  m[3] = glm::vec4(10.0f, 20.0f, 30.0f, 1.0f);
+  return m;
+}
+
+static void transform_points_glm(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  const point_streams p = make_points(count);
+  point_streams out = make_points(count);
+  const glm::mat4 m = bench_matrix();
+  perf_bench perf;
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < count; i++) {
+      const glm::vec4 r = m * glm::vec4(p.x[i], p.y[i], p.z[i], 1.0f);
+      out.x[i] = r.x;
+      out.y[i] = r.y;
+      out.z[i] = r.z;
+    }
+    benchmark::ClobberMemory();
+  }
+  perf.report(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+static void transform_points_simd(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  const point_streams p = make_points(count);
+  point_streams out = make_points(count);
+  const glm::mat4 m = bench_matrix();
+  perf_bench perf;
+  while (state.KeepRunning()) {
+    common::simd::transform_points(m, p.x.data(), p.y.data(), p.z.data(),
+                                   out.x.data(), out.y.data(), out.z.data(),
+                                   count);
+    benchmark::ClobberMemory();
+  }
+  perf.report(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+static void compose_glm(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  std::vector<glm::mat4> a(count, bench_matrix());
+  const std::vector<glm::mat4> b(count, glm::inverse(bench_matrix()));
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < count; i++)
+      a[i] = a[i] * b[i];
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+static void compose_simd(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  std::vector<glm::mat4> a(count, bench_matrix());
+  const std::vector<glm::mat4> b(count, glm::inverse(bench_matrix()));
+  while (state.KeepRunning()) {
+    common::simd::compose(a.data(), b.data(), a.data(), count);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+static void normalize_glm(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  point_streams p = make_points(count);
+  perf_bench perf;
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < count; i++) {
+      const glm::vec3 n = glm::normalize(glm::vec3(p.x[i], p.y[i], p.z[i]));
+      p.x[i] = n.x;
+      p.y[i] = n.y;
+      p.z[i] = n.z;
+    }
+    benchmark::ClobberMemory();
+  }
+  perf.report(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+static void normalize_simd(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  point_streams p = make_points(count);
+  perf_bench perf;
+  while (state.KeepRunning()) {
+    common::simd::normalize(p.x.data(), p.y.data(), p.z.data(), count);
+    benchmark::ClobberMemory();
+  }
+  perf.report(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+static std::vector<float> math_input(size_t count, float lo, float hi) {
+  std::vector<float> res(count);
+  for (size_t i = 0; i < count; i++)
+    res[i] = lo + (hi - lo) * static_cast<float>(i) / static_cast<float>(count);
+  return res;
+}
+
+template <float (*Fn)(float)>
+static void math_std(benchmark::State &state) {
+  const std::vector<float> in = math_input(4096, 0.001f, 80.0f);
+  std::vector<float> out(in.size());
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < in.size(); i++)
+      out[i] = Fn(in[i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * in.size()));
+}
+
+template <void (*Fn)(const float *, float *, size_t,
+                     common::simd::math_precision)>
+static void math_simd(benchmark::State &state) {
+  const std::vector<float> in = math_input(4096, 0.001f, 80.0f);
+  std::vector<float> out(in.size());
+  const common::simd::math_precision precision =
+      static_cast<common::simd::math_precision>(state.range(0));
+  while (state.KeepRunning()) {
+    Fn(in.data(), out.data(), in.size(), precision);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * in.size()));
+}
+
+static float std_sin(float x) { return std::sin(x); }
+static float std_cos(float x) { return std::cos(x); }
+static float std_exp(float x) { return std::exp(x); }
+static float std_log(float x) { return std::log(x); }
+static float std_rsqrt(float x) { return 1.0f / std::sqrt(x); }
+
+static void atan2_std(benchmark::State &state) {
+  const std::vector<float> y = math_input(4096, -50.0f, 50.0f);
+  const std::vector<float> x = math_input(4096, 30.0f, -30.0f);
+  std::vector<float> out(y.size());
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < y.size(); i++)
+      out[i] = std::atan2(y[i], x[i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * y.size()));
+}
+
+static void atan2_simd(benchmark::State &state) {
+  const std::vector<float> y = math_input(4096, -50.0f, 50.0f);
+  const std::vector<float> x = math_input(4096, 30.0f, -30.0f);
+  std::vector<float> out(y.size());
+  const common::simd::math_precision precision =
+      static_cast<common::simd::math_precision>(state.range(0));
+  while (state.KeepRunning()) {
+    common::simd::atan2(y.data(), x.data(), out.data(), y.size(), precision);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * y.size()));
+}
+
+/**
+ * Arg 0 runs the baseline kernels, 1 whatever the CPU has.
+ */
+static void restrict_vertex_pack(benchmark::State &state) {
+  cpu_restrict_features(
+      state.range(0) ? ~0u
+                     : ~static_cast<uint32_t>(CPU_AVX | CPU_AVX2 | CPU_F16C));
+}
+
+static void pack_half(benchmark::State &state) {
+  const std::vector<float> in = math_input(4096, -100.0f, 100.0f);
+  std::vector<uint16_t> out(in.size());
+  restrict_vertex_pack(state);
+  while (state.KeepRunning()) {
+    common::pack_half(in.data(), out.data(), in.size());
+    benchmark::ClobberMemory();
+  }
+  cpu_restrict_features(~0u);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+}
+
+static void pack_snorm16(benchmark::State &state) {
+  const std::vector<float> in = math_input(4096, -1.5f, 1.5f);
+  std::vector<int16_t> out(in.size());
+  restrict_vertex_pack(state);
+  while (state.KeepRunning()) {
+    common::pack_snorm16(in.data(), out.data(), in.size());
+    benchmark::ClobberMemory();
+  }
+  cpu_restrict_features(~0u);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+}
+
+static void pack_octahedral(benchmark::State &state) {
+  const std::vector<float> in = math_input(3 * 4096, -1.0f, 1.0f);
+  std::vector<int16_t> out(in.size() / 3 * 2);
+  restrict_vertex_pack(state);
+  while (state.KeepRunning()) {
+    common::pack_octahedral(in.data(), out.data(), in.size() / 3);
+    benchmark::ClobberMemory();
+  }
+  cpu_restrict_features(~0u);
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * in.size() / 3));
+}
+
+static std::atomic<uint64_t> shared_count{0};
+
+/**
+ * One counter every thread adds to, what metric_add's shards avoid.
+ */
+static void shared_atomic_add(benchmark::State &state) {
+  while (state.KeepRunning())
+    shared_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void metric_add(benchmark::State &state) {
+  const common::metric_counter counter =
+      common::register_counter("bench.metric_add");
+  while (state.KeepRunning())
+    common::metric_add(counter);
+}
+
+static void histogram_record(benchmark::State &state) {
+  const common::metric_histogram histogram =
+      common::register_histogram("bench.histogram_record");
+  uint64_t value = 16000000;
+  while (state.KeepRunning())
+    common::histogram_record(histogram, value++);
+}
+
+static void profile_scope(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    common::profile_scope zone{"bench"};
+  }
+  common::profile_clear();
+}
+
+static void log_fprintf(benchmark::State &state) {
+  FILE *null = fopen("/dev/null", "w");
+  int32_t i = 0;
+  while (state.KeepRunning()) {
+    fprintf(null, "[%s] Code %d : %s\n", "layer", i++, "validation message");
+    fflush(null);
+  }
+  fclose(null);
+}
+
+static void log_async(benchmark::State &state) {
+  FILE *null = fopen("/dev/null", "w");
+  common::log_start(null);
+  const uint64_t dropped = common::log_dropped();
+  int32_t i = 0;
+  while (state.KeepRunning()) {
+    common::log_write(common::LOG_WARNING, "[%s] Code %d : %s", "layer", i++,
+                      "validation message");
+    // Keep the ring from filling up, that would time the drop path.
+    if (i % 512 == 0) {
+      state.PauseTiming();
+      common::log_flush();
+      state.ResumeTiming();
+    }
+  }
+  common::log_stop();
+  state.counters["dropped"] =
+      static_cast<double>(common::log_dropped() - dropped);
+  fclose(null);
+}
+
+BENCHMARK_TEMPLATE(find_mask, find_mask_bits_loop)->Apply(patterns);
+BENCHMARK_TEMPLATE(find_mask, find_mask_bits)->Apply(patterns);
+
+BENCHMARK(crc32_constexpr)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(crc32_slice8)->Arg(16)->Arg(256)->Arg(4096)->Arg(1 << 20);
+BENCHMARK(crc32_runtime_hash)->Arg(16)->Arg(256)->Arg(4096)->Arg(1 << 20);
+BENCHMARK(hash64_runtime)
+    ->Arg(8)
+    ->Arg(16)
+    ->Arg(32)
+    ->Arg(100)
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(1 << 20)
+    ->Arg(16 << 20);
+BENCHMARK(hash64_streaming)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(lookup_strcmp);
+BENCHMARK(lookup_perfect_hash);
+
+BENCHMARK(transform_points_glm)->Arg(4096);
+BENCHMARK(transform_points_simd)->Arg(4096);
+BENCHMARK(compose_glm)->Arg(1024);
+BENCHMARK(compose_simd)->Arg(1024);
+BENCHMARK(normalize_glm)->Arg(4096);
+BENCHMARK(normalize_simd)->Arg(4096);
+
+// Arg 0 is MATH_PRECISE, 1 MATH_FAST.
+BENCHMARK_TEMPLATE(math_std, std_sin);
+BENCHMARK_TEMPLATE(math_simd, common::simd::sin)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(math_std, std_cos);
+BENCHMARK_TEMPLATE(math_simd, common::simd::cos)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(math_std, std_exp);
+BENCHMARK_TEMPLATE(math_simd, common::simd::exp)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(math_std, std_log);
+BENCHMARK_TEMPLATE(math_simd, common::simd::log)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(math_std, std_rsqrt);
+BENCHMARK_TEMPLATE(math_simd, common::simd::rsqrt)->Arg(0)->Arg(1);
+BENCHMARK(atan2_std);
+BENCHMARK(atan2_simd)->Arg(0)->Arg(1);
+
+BENCHMARK(pack_half)->Arg(0)->Arg(1);
+BENCHMARK(pack_snorm16)->Arg(0)->Arg(1);
+BENCHMARK(pack_octahedral)->Arg(0)->Arg(1);
+BENCHMARK(profile_scope);
+BENCHMARK(shared_atomic_add)->ThreadRange(1, 8);
+BENCHMARK(metric_add)->ThreadRange(1, 8);
+BENCHMARK(histogram_record)->ThreadRange(1, 8);
+BENCHMARK(log_fprintf);
+BENCHMARK(log_async);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,54 @@
+#ifndef PERF_BENCH_H
+#define PERF_BENCH_H
+
+#include "benchmark/benchmark.h"
+#include "common/perf_counters.h"
+
+/**
+ * Hardware counters for a benchmark. Create it right before the timed
+ * loop and call report after it, each event then shows up per iteration
+ * next to the time, with ipc when cycles and instructions both counted.
+ * Events the machine refuses are left out. PauseTiming does not pause the
+ * counters.
+ */
+class perf_bench {
+public:
+  explicit perf_bench(uint32_t events = common::PERF_ALL) {
+    common::perf_open(&counters_, events);
+    common::perf_start(&counters_);
+  }
+
+  ~perf_bench() { common::perf_close(&counters_); }
+
+  perf_bench(const perf_bench &) = delete;
+  perf_bench &operator=(const perf_bench &) = delete;
+
+  void report(benchmark::State &state) {
+    using namespace common;
+    perf_stop(&counters_);
+    perf_values values;
+    if (!perf_read(&counters_, &values) || !state.iterations())
+      return;
+
+    const double iterations = static_cast<double>(state.iterations());
+    for (uint32_t i = 0; i < perf_event_count; i++) {
+      if (counters_.events & (1u << i)) {
+        state.counters[perf_event_name(1u << i)] = benchmark::Counter(
+            static_cast<double>(values.counts[i]) / iterations,
+            benchmark::Counter::kAvgThreads);
+      }
+    }
+    const uint64_t cycles = perf_count(values, PERF_CYCLES);
+    if (cycles && (counters_.events & PERF_INSTRUCTIONS)) {
+      state.counters["ipc"] = benchmark::Counter(
+          static_cast<double>(perf_count(values, PERF_INSTRUCTIONS)) /
+              static_cast<double>(cycles),
+          benchmark::Counter::kAvgThreads);
+    }
+  }
+
+private:
+  common::perf_counters counters_;
+};
+
+#endif // PERF_BENCH_H
@@ -53,31 +53,25 @@ constexpr bool test_mask(uint64_t mask, int32_t start_bit, int32_t bit_len) {
   return (mask & (test)) != 0;
 }
 
-int32_t find_mask_bits(uint64_t mask, int32_t bit_len) {
+/**
+ * Index of the lowest run of bit_len unset bits in mask, -1 when there is
+ * none. Bit i of the inverted mask is and-ed with the bits above it,
+ * doubling the covered width each step and closing the remainder with one
+ * last shift, so bit i survives only if bits i .. i + bit_len - 1 are all
+ * unset. The work depends on bit_len only, never on the mask.
+ */
+inline int32_t find_mask_bits(uint64_t mask, int32_t bit_len) {
+  assert(bit_len > 0 && "Bit length is zero");
+  assert(bit_len - 1 < sizeof64 && "Bit length exceeded 64");
 
-  const int32_t bit_len_n = (bit_len - 1);
-  assert(bit_len_n < sizeof64 && "Bit length exceeded 64");
-  const int32_t bit_end = sizeof64 - bit_len_n;
-  const uint64_t test = ((2ul << bit_len_n) - 1ul);
-
-  int32_t idx = -1;
-  int32_t i = 0;
-  while (i < bit_end) {
-    uint64_t res = (mask & (test << i));
-    if (res == 0) {
-      idx = i;
-      break;
-    }
-    /**
-     * @brief Built-in Function: int __builtin_clzl (unsigned long)
-     *
-     * @return the number of leading 0-bits in x, starting at the most
-     * significant bit position.
-     * @warning If x is 0, the result is undefined.
-     **/
-    i = sizeof64 - __builtin_clzl(res);
+  uint64_t free = ~mask;
+  int32_t covered = 1;
+  while (covered * 2 <= bit_len) {
+    free &= free >> covered;
+    covered *= 2;
   }
-  return idx;
+  free &= free >> (bit_len - covered);
+  return free ? __builtin_ctzl(free) : -1;
 }
 
 #endif // BITOP_H
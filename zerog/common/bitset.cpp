@@ -0,0 +1,210 @@
+#include "bitset.h"
+
+#include "bitop.h"
+#include "cpu.h"
+
+#include <cassert>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static uint64_t tail_mask(size_t bit_count) {
+  const size_t rem = bit_count & 63;
+  return rem ? (1ul << rem) - 1ul : ~0ul;
+}
+
+void set_bits(uint64_t *words, size_t first, size_t count) {
+  if (!count)
+    return;
+  size_t w = first / 64;
+  const size_t last = (first + count - 1) / 64;
+  const uint64_t head = ~0ul << (first & 63);
+  const uint64_t tail = ~0ul >> (63 - ((first + count - 1) & 63));
+  if (w == last) {
+    words[w] |= head & tail;
+    return;
+  }
+  words[w++] |= head;
+  for (; w < last; w++)
+    words[w] = ~0ul;
+  words[last] |= tail;
+}
+
+void unset_bits(uint64_t *words, size_t first, size_t count) {
+  if (!count)
+    return;
+  size_t w = first / 64;
+  const size_t last = (first + count - 1) / 64;
+  const uint64_t head = ~0ul << (first & 63);
+  const uint64_t tail = ~0ul >> (63 - ((first + count - 1) & 63));
+  if (w == last) {
+    words[w] &= ~(head & tail);
+    return;
+  }
+  words[w++] &= ~head;
+  for (; w < last; w++)
+    words[w] = 0;
+  words[last] &= ~tail;
+}
+
+typedef size_t (*count_words_fn)(const uint64_t *words, size_t count);
+
+/**
+ * Built once without flags and once with popcnt, where the builtin turns
+ * into the instruction instead of a bit twiddling sequence.
+ */
+cpu_inline size_t count_words_generic(const uint64_t *words, size_t count) {
+  size_t res = 0;
+  for (size_t i = 0; i < count; i++)
+    res += static_cast<size_t>(__builtin_popcountl(words[i]));
+  return res;
+}
+
+#if defined(__x86_64__)
+cpu_clone(count_words_generic, popcnt, "popcnt", size_t,
+          (const uint64_t *words, size_t count), (words, count))
+
+/**
+ * Nibble lookup with pshufb, per byte counts are summed with psadbw before
+ * they can overflow (31 rounds of at most 8).
+ */
+cpu_target("avx2,popcnt") static size_t
+count_words_avx2(const uint64_t *words, size_t count) {
+  const __m256i lut =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+                       1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+
+  size_t i = 0;
+  while (i + 4 <= count) {
+    const size_t end = count - i > 4 * 31 ? i + 4 * 31 : count;
+    __m256i bytes = _mm256_setzero_si256();
+    for (; i + 4 <= end; i += 4) {
+      const __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i));
+      const __m256i lo = _mm256_and_si256(v, low);
+      const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+      bytes = _mm256_add_epi8(bytes, _mm256_shuffle_epi8(lut, lo));
+      bytes = _mm256_add_epi8(bytes, _mm256_shuffle_epi8(lut, hi));
+    }
+    acc = _mm256_add_epi64(acc,
+                           _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+  }
+
+  size_t res = static_cast<size_t>(_mm256_extract_epi64(acc, 0)) +
+               static_cast<size_t>(_mm256_extract_epi64(acc, 1)) +
+               static_cast<size_t>(_mm256_extract_epi64(acc, 2)) +
+               static_cast<size_t>(_mm256_extract_epi64(acc, 3));
+  for (; i < count; i++)
+    res += static_cast<size_t>(_mm_popcnt_u64(words[i]));
+  return res;
+}
+#endif
+
+static const cpu_variant<count_words_fn> count_words_variants[]{
+#if defined(__x86_64__)
+    {CPU_AVX2 | CPU_POPCNT, count_words_avx2},
+    {CPU_POPCNT, count_words_generic_popcnt},
+#endif
+    {0, count_words_generic},
+};
+
+static size_t count_words(const uint64_t *words, size_t count) {
+  static cpu_dispatch<count_words_fn> fn{count_words_variants};
+  return fn(words, count);
+}
+
+size_t count_bits(const uint64_t *words, size_t bit_count) {
+  const size_t full = bit_count / 64;
+  size_t res = count_words(words, full);
+  if (bit_count & 63)
+    res += static_cast<size_t>(
+        __builtin_popcountl(words[full] & tail_mask(bit_count)));
+  return res;
+}
+
+size_t rank_bits(const uint64_t *words, size_t pos) {
+  return count_bits(words, pos);
+}
+
+size_t select_bit(const uint64_t *words, size_t bit_count, size_t n) {
+  const size_t count = bit_words(bit_count);
+  for (size_t w = 0; w < count; w++) {
+    uint64_t word = words[w];
+    if (w == count - 1)
+      word &= tail_mask(bit_count);
+    const size_t set = static_cast<size_t>(__builtin_popcountl(word));
+    if (n < set) {
+      for (; n; n--)
+        word &= word - 1;
+      return w * 64 + static_cast<size_t>(__builtin_ctzl(word));
+    }
+    n -= set;
+  }
+  return no_bit;
+}
+
+/**
+ * Shared scan for find_set_bit and find_unset_bit, flip is xor-ed into
+ * every word so both look for set bits.
+ */
+static size_t find_bit(const uint64_t *words, size_t bit_count, size_t from,
+                       uint64_t flip) {
+  if (from >= bit_count)
+    return no_bit;
+  const size_t count = bit_words(bit_count);
+  size_t w = from / 64;
+  uint64_t word = (words[w] ^ flip) & (~0ul << (from & 63));
+  for (;;) {
+    if (w == count - 1)
+      word &= tail_mask(bit_count);
+    if (word)
+      return w * 64 + static_cast<size_t>(__builtin_ctzl(word));
+    if (++w == count)
+      return no_bit;
+    word = words[w] ^ flip;
+  }
+}
+
+size_t find_set_bit(const uint64_t *words, size_t bit_count, size_t from) {
+  return find_bit(words, bit_count, from, 0);
+}
+
+size_t find_unset_bit(const uint64_t *words, size_t bit_count, size_t from) {
+  return find_bit(words, bit_count, from, ~0ul);
+}
+
+size_t find_unset_bits(const uint64_t *words, size_t bit_count, size_t len) {
+  assert(len && "Bit length is zero");
+  const size_t count = bit_words(bit_count);
+  // Unset bits carried over from the top of the previous words.
+  size_t run = 0;
+  size_t run_start = 0;
+  for (size_t w = 0; w < count; w++) {
+    uint64_t word = words[w];
+    if (w == count - 1)
+      word |= ~tail_mask(bit_count);
+
+    if (!word) {
+      if (!run)
+        run_start = w * 64;
+      run += 64;
+      if (run >= len)
+        return run_start;
+      continue;
+    }
+
+    if (run && run + static_cast<size_t>(__builtin_ctzl(word)) >= len)
+      return run_start;
+    if (len <= 64) {
+      const int32_t idx = find_mask_bits(word, static_cast<int32_t>(len));
+      if (idx >= 0)
+        return w * 64 + static_cast<size_t>(idx);
+    }
+    run = static_cast<size_t>(__builtin_clzl(word));
+    run_start = w * 64 + 64 - run;
+  }
+  return no_bit;
+}
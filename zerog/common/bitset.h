@@ -0,0 +1,47 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Operations on bit arrays of any length stored as uint64_t words, bit i
+ * is bit (i % 64) of word i / 64. Callers own the words; the functions
+ * never look past bit_count, bits above it in the last word are ignored.
+ *
+ * Searches return no_bit when nothing matches.
+ */
+constexpr size_t no_bit{~static_cast<size_t>(0)};
+
+constexpr size_t bit_words(size_t bit_count) { return (bit_count + 63) / 64; }
+
+void set_bits(uint64_t *words, size_t first, size_t count);
+void unset_bits(uint64_t *words, size_t first, size_t count);
+
+/**
+ * Set bits in [0, bit_count).
+ */
+size_t count_bits(const uint64_t *words, size_t bit_count);
+
+/**
+ * Set bits in [0, pos).
+ */
+size_t rank_bits(const uint64_t *words, size_t pos);
+
+/**
+ * Position of the set bit with rank n, counting from 0.
+ */
+size_t select_bit(const uint64_t *words, size_t bit_count, size_t n);
+
+/**
+ * First set (unset) bit at or after from.
+ */
+size_t find_set_bit(const uint64_t *words, size_t bit_count, size_t from);
+size_t find_unset_bit(const uint64_t *words, size_t bit_count, size_t from);
+
+/**
+ * Start of the first run of len unset bits, runs may cross words.
+ */
+size_t find_unset_bits(const uint64_t *words, size_t bit_count, size_t len);
+
+#endif // BITSET_H
@@ -0,0 +1,121 @@
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+static std::atomic<uint32_t> feature_mask{~0u};
+static std::atomic<uint32_t> generation{0};
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t read_xcr0() {
+  uint32_t lo;
+  uint32_t hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+static uint32_t detect() {
+  uint32_t res = 0;
+  uint32_t eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return res;
+
+  if (edx & bit_SSE2)
+    res |= CPU_SSE2;
+  if (ecx & bit_SSE4_1)
+    res |= CPU_SSE41;
+  if (ecx & bit_SSE4_2)
+    res |= CPU_SSE42;
+  if (ecx & bit_POPCNT)
+    res |= CPU_POPCNT;
+  if (ecx & bit_PCLMUL)
+    res |= CPU_PCLMUL;
+
+  // AVX state has to be enabled by the OS, not just present.
+  const bool os_avx = (ecx & bit_OSXSAVE) && (read_xcr0() & 0x6) == 0x6;
+  const bool os_avx512 = os_avx && (read_xcr0() & 0xe0) == 0xe0;
+  if (os_avx && (ecx & bit_AVX)) {
+    res |= CPU_AVX;
+    if (ecx & bit_FMA)
+      res |= CPU_FMA;
+    if (ecx & bit_F16C)
+      res |= CPU_F16C;
+  }
+
+  if (__get_cpuid_max(0, nullptr) >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if (ebx & bit_BMI)
+      res |= CPU_BMI1;
+    if (ebx & bit_BMI2)
+      res |= CPU_BMI2;
+    if (os_avx && (ebx & bit_AVX2))
+      res |= CPU_AVX2;
+    if (os_avx512 && (ebx & bit_AVX512F)) {
+      res |= CPU_AVX512F;
+      if (ebx & bit_AVX512BW)
+        res |= CPU_AVX512BW;
+      if (ebx & bit_AVX512DQ)
+        res |= CPU_AVX512DQ;
+      if (ebx & bit_AVX512VL)
+        res |= CPU_AVX512VL;
+    }
+  }
+  return res;
+}
+#else
+static uint32_t detect() { return 0; }
+#endif
+
+uint32_t cpu_detected_features() {
+  static const uint32_t features = detect();
+  return features;
+}
+
+uint32_t cpu_features() {
+  return cpu_detected_features() &
+         feature_mask.load(std::memory_order_relaxed);
+}
+
+void cpu_restrict_features(uint32_t mask) {
+  feature_mask.store(mask, std::memory_order_relaxed);
+  generation.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t cpu_generation() { return generation.load(std::memory_order_acquire); }
+
+const char *cpu_feature_name(cpu_feature feature) {
+  switch (feature) {
+  case CPU_SSE2:
+    return "sse2";
+  case CPU_SSE41:
+    return "sse4.1";
+  case CPU_SSE42:
+    return "sse4.2";
+  case CPU_POPCNT:
+    return "popcnt";
+  case CPU_PCLMUL:
+    return "pclmul";
+  case CPU_AVX:
+    return "avx";
+  case CPU_AVX2:
+    return "avx2";
+  case CPU_FMA:
+    return "fma";
+  case CPU_F16C:
+    return "f16c";
+  case CPU_BMI1:
+    return "bmi";
+  case CPU_BMI2:
+    return "bmi2";
+  case CPU_AVX512F:
+    return "avx512f";
+  case CPU_AVX512BW:
+    return "avx512bw";
+  case CPU_AVX512DQ:
+    return "avx512dq";
+  case CPU_AVX512VL:
+    return "avx512vl";
+  }
+  return "unknown";
+}
@@ -0,0 +1,140 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Instruction set extensions the engine has kernels for. AVX and AVX-512
+ * bits are only reported when the OS saves the wider registers.
+ */
+enum cpu_feature : uint32_t {
+  CPU_SSE2 = 0x1,
+  CPU_SSE41 = 0x2,
+  CPU_SSE42 = 0x4,
+  CPU_POPCNT = 0x8,
+  CPU_PCLMUL = 0x10,
+  CPU_AVX = 0x20,
+  CPU_AVX2 = 0x40,
+  CPU_FMA = 0x80,
+  CPU_F16C = 0x100,
+  CPU_BMI1 = 0x200,
+  CPU_BMI2 = 0x400,
+  CPU_AVX512F = 0x800,
+  CPU_AVX512BW = 0x1000,
+  CPU_AVX512DQ = 0x2000,
+  CPU_AVX512VL = 0x4000,
+};
+
+/**
+ * Features of the running CPU, read with cpuid on first use, limited by
+ * cpu_restrict_features.
+ */
+uint32_t cpu_features();
+uint32_t cpu_detected_features();
+
+inline bool cpu_has(uint32_t features) {
+  return (cpu_features() & features) == features;
+}
+
+/**
+ * Hides every feature outside mask, pass ~0u to undo. Dispatchers pick
+ * their kernel again on the next call, so tests can run each variant on
+ * one machine.
+ */
+void cpu_restrict_features(uint32_t mask);
+
+/**
+ * Bumped by cpu_restrict_features, dispatchers compare it to re-resolve.
+ */
+uint32_t cpu_generation();
+
+/**
+ * Kernels are written once as a cpu_inline function and compiled per ISA
+ * by thin cpu_target wrappers that inline the body, cpu_clone writes such
+ * a wrapper:
+ *
+ *   cpu_inline size_t sum(const float *p, size_t n) { ... }
+ *   cpu_clone(sum, avx2, "avx2,fma", size_t, (const float *p, size_t n),
+ *             (p, n))
+ *
+ * defines sum_avx2 built for AVX2 and FMA.
+ */
+#define cpu_target(isa) __attribute__((target(isa)))
+#define cpu_inline static inline __attribute__((always_inline))
+#define cpu_clone(name, suffix, isa, ret, params, args)                        \
+  cpu_target(isa) static ret name##_##suffix params { return name args; }
+
+/**
+ * One implementation of a dispatched function and the features it needs.
+ */
+template <typename __F> struct cpu_variant {
+  uint32_t features;
+  __F fn;
+};
+
+/**
+ * Function pointer resolved from a table of variants ordered best first,
+ * the last entry must need no features. Resolution happens on the first
+ * call and after cpu_restrict_features; other calls are a relaxed load
+ * and an indirect call. Meant for function local statics, which are safe
+ * to use from other static initialisers.
+ */
+template <typename __F> struct cpu_dispatch {
+  template <size_t N>
+  explicit cpu_dispatch(const cpu_variant<__F> (&variants)[N])
+      : variants_{variants}, count_{N}, generation_{~0u}, fn_{nullptr} {
+    assert(variants[N - 1].features == 0 && "Dispatch needs a fallback");
+  }
+
+  cpu_dispatch(const cpu_dispatch &) = delete;
+  cpu_dispatch &operator=(const cpu_dispatch &) = delete;
+
+  __F get() {
+    const uint32_t generation = cpu_generation();
+    if (generation_.load(std::memory_order_acquire) != generation) {
+      fn_.store(select(), std::memory_order_relaxed);
+      generation_.store(generation, std::memory_order_release);
+    }
+    return fn_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Feature set of the variant get() returns.
+   */
+  uint32_t features() {
+    const __F fn = get();
+    for (size_t i = 0; i < count_; i++) {
+      if (variants_[i].fn == fn)
+        return variants_[i].features;
+    }
+    return 0;
+  }
+
+  template <typename... Args> auto operator()(Args &&... args) {
+    return get()(static_cast<Args &&>(args)...);
+  }
+
+private:
+  __F select() const {
+    for (size_t i = 0; i < count_; i++) {
+      if (cpu_has(variants_[i].features))
+        return variants_[i].fn;
+    }
+    return variants_[count_ - 1].fn;
+  }
+
+  const cpu_variant<__F> *variants_;
+  size_t count_;
+  std::atomic<uint32_t> generation_;
+  std::atomic<__F> fn_;
+};
+
+/**
+ * Name of a single feature as used in target attributes, e.g. "avx2".
+ */
+const char *cpu_feature_name(cpu_feature feature);
+
+#endif // CPU_H
@@ -0,0 +1,154 @@
+#include "hash.h"
+
+#include "cpu.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace common {
+namespace internal {
+
+/**
+ * slice[k][b] is the crc of byte b followed by k zero bytes, so eight
+ * table lookups advance the crc by eight bytes at once.
+ */
+struct crc_slices {
+  uint32_t slice[8][256];
+};
+
+static constexpr crc_slices make_crc_slices() {
+  crc_slices res{};
+  for (uint32_t i = 0; i < 256; i++)
+    res.slice[0][i] = crc_table[i];
+  for (uint32_t k = 1; k < 8; k++) {
+    for (uint32_t i = 0; i < 256; i++) {
+      const uint32_t prev = res.slice[k - 1][i];
+      res.slice[k][i] = (prev >> 8) ^ crc_table[prev & 0xff];
+    }
+  }
+  return res;
+}
+
+static constexpr crc_slices slices = make_crc_slices();
+
+uint32_t crc32_update_slice8(uint32_t crc, const uint8_t *data,
+                             size_t length) {
+  const uint32_t(*t)[256] = slices.slice;
+  for (; length >= 8; length -= 8, data += 8) {
+    uint32_t lo;
+    uint32_t hi;
+    memcpy(&lo, data, 4);
+    memcpy(&hi, data + 4, 4);
+    lo ^= crc;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+          t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^ t[3][hi & 0xff] ^
+          t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+  }
+  for (; length; length--, data++)
+    crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+  return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * Folding with carry-less multiplies after Gopal et al, "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction", with
+ * the bit reflected constants for the crc32 polynomial. Four lanes of 16
+ * bytes are folded 64 bytes ahead, merged into one lane, then reduced to
+ * 32 bits with a Barrett step.
+ */
+cpu_target("pclmul,sse4.1") uint32_t
+crc32_update_pclmul(uint32_t crc, const uint8_t *data, size_t length) {
+  alignas(16) static const uint64_t k1k2[]{0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[]{0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[]{0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[]{0x01db710641, 0x01f7011641};
+
+  const __m128i *p = reinterpret_cast<const __m128i *>(data);
+  __m128i x1 = _mm_loadu_si128(p + 0);
+  __m128i x2 = _mm_loadu_si128(p + 1);
+  __m128i x3 = _mm_loadu_si128(p + 2);
+  __m128i x4 = _mm_loadu_si128(p + 3);
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int32_t>(crc)));
+  p += 4;
+  length -= 64;
+
+  __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+  for (; length >= 64; length -= 64, p += 4) {
+    const __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+    const __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+    const __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+    const __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(p + 0));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(p + 1));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(p + 2));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(p + 3));
+  }
+
+  // Fold the four lanes, then any remaining 16 byte blocks, into one.
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+  const __m128i lanes[]{x2, x3, x4};
+  for (const __m128i &next : lanes) {
+    const __m128i lo = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, next), lo);
+  }
+  for (; length >= 16; length -= 16, p++) {
+    const __m128i lo = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(p)), lo);
+  }
+
+  // 128 to 64 bits.
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x0 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x0);
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+  x0 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00);
+  x1 = _mm_xor_si128(x1, x0);
+
+  // Barrett reduction to 32 bits.
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+  x0 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+  x0 = _mm_clmulepi64_si128(_mm_and_si128(x0, mask32), k, 0x00);
+  x1 = _mm_xor_si128(x1, x0);
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+bool crc32_has_pclmul() { return cpu_has(CPU_PCLMUL | CPU_SSE41); }
+#else
+uint32_t crc32_update_pclmul(uint32_t crc, const uint8_t *data,
+                             size_t length) {
+  return crc32_update_slice8(crc, data, length);
+}
+
+bool crc32_has_pclmul() { return false; }
+#endif
+
+} // namespace internal
+
+uint32_t runtime_hash(const void *data, size_t length) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  uint32_t crc = ~0u;
+  if (length >= 64 && internal::crc32_has_pclmul()) {
+    const size_t blocks = length & ~static_cast<size_t>(15);
+    crc = internal::crc32_update_pclmul(crc, p, blocks);
+    p += blocks;
+    length -= blocks;
+  }
+  return ~internal::crc32_update_slice8(crc, p, length);
+}
+
+uint32_t runtime_hash(const char *str) {
+  return runtime_hash(str, strlen(str));
+}
+
+} // namespace common
@@ -67,11 +67,28 @@ constexpr uint32_t crc32(const char *data, uint32_t length) {
 constexpr uint32_t strlen_c(const char *str) {
   return *str ? 1 + strlen_c(str + 1) : 0;
 }
+
+/**
+ * Runtime crc32 kernels on the inverted crc state, exposed for tests and
+ * benches. The pclmul kernel needs length >= 64 and a multiple of 16.
+ */
+uint32_t crc32_update_slice8(uint32_t crc, const uint8_t *data, size_t length);
+uint32_t crc32_update_pclmul(uint32_t crc, const uint8_t *data, size_t length);
+bool crc32_has_pclmul();
 }
 
 constexpr uint32_t hash(const char *str) {
   return internal::crc32(str, internal::strlen_c(str));
 }
+
+/**
+ * Same values as hash() and _h for strings only known at runtime. The
+ * constexpr form recurses once per byte; these walk 8 bytes per step with
+ * slicing tables and fold 64 byte blocks with carry-less multiplies when
+ * the CPU has them.
+ */
+uint32_t runtime_hash(const void *data, size_t length);
+uint32_t runtime_hash(const char *str);
 }
 
 constexpr uint32_t operator"" _h(const char *source, size_t length) {
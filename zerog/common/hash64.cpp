@@ -0,0 +1,239 @@
+#include "hash64.h"
+
+#include "cpu.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace common {
+namespace internal {
+
+/**
+ * Accumulates count full stripes, the first one being stripe number first
+ * of the input, and scrambles after every block.
+ */
+typedef void (*stripes_fn)(uint64_t *acc, const uint8_t *p, size_t count,
+                           size_t first);
+
+static void stripes_scalar(uint64_t *acc, const uint8_t *p, size_t count,
+                           size_t first) {
+  for (size_t s = first; s < first + count; s++, p += hash64_stripe) {
+    const uint64_t *keys = hash64_secret + s % hash64_block_stripes;
+    for (size_t i = 0; i < hash64_lanes; i++) {
+      uint64_t d;
+      memcpy(&d, p + i * 8, 8);
+      const uint64_t k = d ^ keys[i];
+      acc[i ^ 1] += d;
+      acc[i] += (k & 0xffffffffull) * (k >> 32);
+    }
+    if ((s + 1) % hash64_block_stripes == 0)
+      hash64_scramble(acc, s / hash64_block_stripes);
+  }
+}
+
+#if defined(__SSE2__)
+static void stripes_sse2(uint64_t *acc, const uint8_t *p, size_t count,
+                         size_t first) {
+  __m128i a[4];
+  __m128i scramble[4];
+  for (int i = 0; i < 4; i++) {
+    a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc) + i);
+    scramble[i] = _mm_load_si128(
+        reinterpret_cast<const __m128i *>(hash64_scramble_keys) + i);
+  }
+  const __m128i prime = _mm_set1_epi32(static_cast<int32_t>(prime32_1));
+
+  const size_t end = first + count;
+  for (size_t s = first; s < end;) {
+    // Up to the end of the block, the keys slide one word per stripe.
+    const size_t block = s / hash64_block_stripes;
+    const size_t stop = std::min(end, (block + 1) * hash64_block_stripes);
+    for (; s < stop; s++, p += hash64_stripe) {
+      const __m128i *keys = reinterpret_cast<const __m128i *>(
+          hash64_secret + s % hash64_block_stripes);
+      for (int i = 0; i < 4; i++) {
+        const __m128i d =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(p) + i);
+        const __m128i k = _mm_xor_si128(d, _mm_loadu_si128(keys + i));
+        const __m128i product = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+        const __m128i swapped =
+            _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+      }
+    }
+    if (s % hash64_block_stripes == 0) {
+      const __m128i position =
+          _mm_set1_epi64x(static_cast<int64_t>(block * prime64_5));
+      for (int i = 0; i < 4; i++) {
+        __m128i x = _mm_xor_si128(a[i], _mm_srli_epi64(a[i], 47));
+        x = _mm_xor_si128(x, _mm_xor_si128(scramble[i], position));
+        const __m128i lo = _mm_mul_epu32(x, prime);
+        const __m128i hi = _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+        a[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+      }
+    }
+  }
+
+  for (int i = 0; i < 4; i++)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(acc) + i, a[i]);
+}
+#endif
+
+#if defined(__x86_64__)
+cpu_target("avx2") static void
+stripes_avx2(uint64_t *acc, const uint8_t *p, size_t count, size_t first) {
+  __m256i a[2];
+  __m256i scramble[2];
+  for (int i = 0; i < 2; i++) {
+    a[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc) + i);
+    scramble[i] = _mm256_load_si256(
+        reinterpret_cast<const __m256i *>(hash64_scramble_keys) + i);
+  }
+  const __m256i prime = _mm256_set1_epi32(static_cast<int32_t>(prime32_1));
+
+  const size_t end = first + count;
+  for (size_t s = first; s < end;) {
+    // Up to the end of the block, the keys slide one word per stripe.
+    const size_t block = s / hash64_block_stripes;
+    const size_t stop = std::min(end, (block + 1) * hash64_block_stripes);
+    for (; s < stop; s++, p += hash64_stripe) {
+      const __m256i *keys = reinterpret_cast<const __m256i *>(
+          hash64_secret + s % hash64_block_stripes);
+      for (int i = 0; i < 2; i++) {
+        const __m256i d =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p) + i);
+        const __m256i k = _mm256_xor_si256(d, _mm256_loadu_si256(keys + i));
+        const __m256i product =
+            _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32));
+        const __m256i swapped =
+            _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        a[i] = _mm256_add_epi64(a[i], _mm256_add_epi64(product, swapped));
+      }
+    }
+    if (s % hash64_block_stripes == 0) {
+      const __m256i position =
+          _mm256_set1_epi64x(static_cast<int64_t>(block * prime64_5));
+      for (int i = 0; i < 2; i++) {
+        __m256i x = _mm256_xor_si256(a[i], _mm256_srli_epi64(a[i], 47));
+        x = _mm256_xor_si256(x, _mm256_xor_si256(scramble[i], position));
+        const __m256i lo = _mm256_mul_epu32(x, prime);
+        const __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+        a[i] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+      }
+    }
+  }
+
+  for (int i = 0; i < 2; i++)
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc) + i, a[i]);
+}
+#endif
+
+static const cpu_variant<stripes_fn> stripes_variants[]{
+#if defined(__x86_64__)
+    {CPU_AVX2, stripes_avx2},
+#endif
+#if defined(__SSE2__)
+    {CPU_SSE2, stripes_sse2},
+#endif
+    {0, stripes_scalar},
+};
+
+static void accumulate_stripes(uint64_t *acc, const uint8_t *p, size_t count,
+                               size_t first) {
+  static cpu_dispatch<stripes_fn> fn{stripes_variants};
+  fn(acc, p, count, first);
+}
+
+/**
+ * Zero padded last stripe, then the block scramble it may complete.
+ */
+static void accumulate_tail(uint64_t *acc, const uint8_t *p, size_t length,
+                            size_t stripe) {
+  hash64_accumulate(acc, reinterpret_cast<const char *>(p), length, stripe);
+  if ((stripe + 1) % hash64_block_stripes == 0)
+    hash64_scramble(acc, stripe / hash64_block_stripes);
+}
+
+} // namespace internal
+
+uint64_t runtime_hash64(const void *data, size_t length) {
+  using namespace internal;
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  if (length <= hash64_short_max)
+    return hash64_short(reinterpret_cast<const char *>(p), length);
+
+  uint64_t acc[hash64_lanes];
+  memcpy(acc, hash64_acc_init, sizeof(acc));
+  const size_t stripes = length / hash64_stripe;
+  accumulate_stripes(acc, p, stripes, 0);
+  if (length % hash64_stripe) {
+    accumulate_tail(acc, p + stripes * hash64_stripe, length % hash64_stripe,
+                    stripes);
+  }
+  return hash64_merge(acc, length);
+}
+
+void hash64_begin(hash64_state *state) {
+  memcpy(state->acc, internal::hash64_acc_init, sizeof(state->acc));
+  state->length = 0;
+  state->stripes = 0;
+  state->buffered = 0;
+}
+
+void hash64_update(hash64_state *state, const void *data, size_t length) {
+  using namespace internal;
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  state->length += length;
+  if (state->length <= hash64_short_max) {
+    // Still short enough for the short hash, which needs every byte.
+    memcpy(state->buffer + state->buffered, p, length);
+    state->buffered += length;
+    return;
+  }
+
+  // Drain the buffer, it may still hold a whole short input.
+  while (state->buffered) {
+    const size_t room = hash64_stripe - state->buffered % hash64_stripe;
+    const size_t take =
+        state->buffered >= hash64_stripe ? 0 : (length < room ? length : room);
+    memcpy(state->buffer + state->buffered, p, take);
+    state->buffered += take;
+    p += take;
+    length -= take;
+    if (state->buffered < hash64_stripe)
+      return;
+
+    accumulate_stripes(state->acc, state->buffer, 1, state->stripes++);
+    state->buffered -= hash64_stripe;
+    memmove(state->buffer, state->buffer + hash64_stripe, state->buffered);
+  }
+
+  const size_t stripes = length / hash64_stripe;
+  accumulate_stripes(state->acc, p, stripes, state->stripes);
+  state->stripes += stripes;
+  p += stripes * hash64_stripe;
+  length -= stripes * hash64_stripe;
+
+  memcpy(state->buffer, p, length);
+  state->buffered = length;
+}
+
+uint64_t hash64_end(const hash64_state *state) {
+  using namespace internal;
+  if (state->length <= hash64_short_max) {
+    return hash64_short(reinterpret_cast<const char *>(state->buffer),
+                        state->buffered);
+  }
+
+  uint64_t acc[hash64_lanes];
+  memcpy(acc, state->acc, sizeof(acc));
+  if (state->buffered)
+    accumulate_tail(acc, state->buffer, state->buffered, state->stripes);
+  return hash64_merge(acc, state->length);
+}
+
+} // namespace common
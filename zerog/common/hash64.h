@@ -0,0 +1,218 @@
+#ifndef HASH64_H
+#define HASH64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 64 bit non-cryptographic hash for large tables and content addressing.
+ * Inputs up to 128 bytes are mixed with 64x64->128 multiplies, longer
+ * inputs run 8 accumulator lanes over 64 byte stripes with 32x32->64
+ * multiplies so the lanes map onto SSE2/AVX2 registers. The constexpr
+ * functions below are the reference; runtime_hash64 and the streaming
+ * functions return the same values.
+ */
+namespace common {
+namespace internal {
+constexpr uint64_t prime64_1{0x9e3779b185ebca87ull};
+constexpr uint64_t prime64_2{0xc2b2ae3d27d4eb4full};
+constexpr uint64_t prime64_3{0x165667b19e3779f9ull};
+constexpr uint64_t prime64_4{0x85ebca77c2b2ae63ull};
+constexpr uint64_t prime64_5{0x27d4eb2f165667c5ull};
+constexpr uint64_t prime32_1{0x9e3779b1ull};
+
+constexpr size_t hash64_lanes{8};
+constexpr size_t hash64_stripe{64};
+constexpr size_t hash64_block_stripes{16};
+constexpr size_t hash64_short_max{128};
+
+/**
+ * Lane keys of stripe s of a block, and of 16 byte chunk c of a short
+ * input, start at word s and 2 * c of the secret. Equal data at different
+ * positions is therefore keyed differently, or swapping stripes or chunks
+ * would leave the sums unchanged.
+ */
+constexpr size_t hash64_secret_words{hash64_lanes + hash64_block_stripes - 1};
+alignas(64) constexpr uint64_t hash64_secret[hash64_secret_words]{
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull,
+    0x1f67b3b7a4a44072ull, 0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull,
+    0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull, 0x38b8170fabfd0419ull,
+    0x55c277b348123660ull, 0xdf9b246544363380ull, 0xa13b2040bf08f1c5ull,
+    0x1442a11d2f43a550ull, 0xe27689959243520bull, 0xaef3ba58696177e9ull,
+    0x41696b3312be435eull, 0x19da6da7b6066b52ull, 0x5474084ea7cfacc8ull,
+    0x278ab6c1b5b8e889ull, 0x4064b01fff1fcd1full, 0x0ae88ca708e9db5aull,
+    0xcd3fb13a411ba85eull, 0x33f83d7bcf3c34e5ull};
+alignas(64) constexpr uint64_t hash64_scramble_keys[hash64_lanes]{
+    0xcb00c391bb52283cull, 0xa32e531b8b65d088ull, 0x4ef90da297486471ull,
+    0xd8acdea946ef1938ull, 0x3f349ce33f76faa8ull, 0x1d4f0bc7c7bbdcf9ull,
+    0x3159b4cd4be0518aull, 0x647378d9c97e9fc8ull};
+constexpr uint64_t hash64_merge_keys[hash64_lanes]{
+    0xc3ebd33483acc5eaull, 0xeb6313faffa081c5ull, 0x49daf0b751dd0d17ull,
+    0x9e68d429265516d3ull, 0xfca1477d58be162bull, 0xce31d07ad1b8f88full,
+    0x280416958f3acb45ull, 0x7e404bbbcafbd7afull};
+constexpr uint64_t hash64_acc_init[hash64_lanes]{
+    prime32_1, prime64_1, prime64_2, prime64_3,
+    prime64_4, prime64_5, prime64_1 ^ prime64_2, prime64_3 ^ prime64_4};
+
+constexpr uint64_t byte_at(const char *p, size_t i) {
+  return static_cast<uint8_t>(p[i]);
+}
+
+// Written out so compilers merge the bytes into a single load at runtime.
+constexpr uint64_t read32(const char *p) {
+  return byte_at(p, 0) | byte_at(p, 1) << 8 | byte_at(p, 2) << 16 |
+         byte_at(p, 3) << 24;
+}
+
+constexpr uint64_t read64(const char *p) {
+  return byte_at(p, 0) | byte_at(p, 1) << 8 | byte_at(p, 2) << 16 |
+         byte_at(p, 3) << 24 | byte_at(p, 4) << 32 | byte_at(p, 5) << 40 |
+         byte_at(p, 6) << 48 | byte_at(p, 7) << 56;
+}
+
+constexpr uint64_t mum(uint64_t a, uint64_t b) {
+  const unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+constexpr uint64_t avalanche64(uint64_t h) {
+  h ^= h >> 33;
+  h *= prime64_2;
+  h ^= h >> 29;
+  h *= prime64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+constexpr uint64_t hash64_short(const char *p, size_t len) {
+  if (len <= 16) {
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (len >= 8) {
+      a = read64(p);
+      b = read64(p + len - 8);
+    } else if (len >= 4) {
+      a = read32(p);
+      b = read32(p + len - 4);
+    } else if (len) {
+      a = (static_cast<uint64_t>(static_cast<uint8_t>(p[0])) << 16) |
+          (static_cast<uint64_t>(static_cast<uint8_t>(p[len >> 1])) << 8) |
+          static_cast<uint8_t>(p[len - 1]);
+    }
+    return avalanche64(mum(a ^ prime64_1, b ^ prime64_2 ^ len) ^
+                       (len * prime64_5));
+  }
+
+  // 16 byte chunks from the front, the last chunk overlaps the end.
+  uint64_t h = len * prime64_1;
+  size_t key = 0;
+  for (size_t off = 0; off + 16 < len; off += 16, key += 2) {
+    h += mum(read64(p + off) ^ hash64_secret[key],
+             read64(p + off + 8) ^ hash64_secret[key + 1]);
+  }
+  h += mum(read64(p + len - 16) ^ hash64_secret[key],
+           read64(p + len - 8) ^ hash64_secret[key + 1]);
+  return avalanche64(h);
+}
+
+/**
+ * Stripe number stripe of the input, bytes at or past end read as zero.
+ * Each lane adds the product of the halves of its keyed word and the raw
+ * word of its neighbour.
+ */
+constexpr void hash64_accumulate(uint64_t *acc, const char *p, size_t end,
+                                 size_t stripe) {
+  const uint64_t *keys = hash64_secret + stripe % hash64_block_stripes;
+  for (size_t i = 0; i < hash64_lanes; i++) {
+    uint64_t d = 0;
+    for (size_t b = 8; b-- > 0;) {
+      const size_t at = i * 8 + b;
+      d = (d << 8) | (at < end ? static_cast<uint8_t>(p[at]) : 0u);
+    }
+    const uint64_t k = d ^ keys[i];
+    acc[i ^ 1] += d;
+    acc[i] += (k & 0xffffffffull) * (k >> 32);
+  }
+}
+
+/**
+ * End of block number block. The block number is mixed in so that whole
+ * blocks do not commute either.
+ */
+constexpr void hash64_scramble(uint64_t *acc, size_t block) {
+  const uint64_t position = block * prime64_5;
+  for (size_t i = 0; i < hash64_lanes; i++) {
+    const uint64_t a =
+        acc[i] ^ (acc[i] >> 47) ^ hash64_scramble_keys[i] ^ position;
+    acc[i] = a * prime32_1;
+  }
+}
+
+constexpr uint64_t hash64_merge(const uint64_t *acc, uint64_t len) {
+  uint64_t h = len * prime64_1;
+  for (size_t i = 0; i < hash64_lanes; i += 2) {
+    h += mum(acc[i] ^ hash64_merge_keys[i],
+             acc[i + 1] ^ hash64_merge_keys[i + 1]);
+  }
+  return avalanche64(h);
+}
+
+constexpr uint64_t hash64_long(const char *p, size_t len) {
+  uint64_t acc[hash64_lanes]{};
+  for (size_t i = 0; i < hash64_lanes; i++)
+    acc[i] = hash64_acc_init[i];
+  size_t stripe = 0;
+  for (size_t off = 0; off < len; off += hash64_stripe, stripe++) {
+    hash64_accumulate(acc, p + off, len - off, stripe);
+    if ((stripe + 1) % hash64_block_stripes == 0)
+      hash64_scramble(acc, stripe / hash64_block_stripes);
+  }
+  return hash64_merge(acc, len);
+}
+
+constexpr size_t strlen64_c(const char *str) {
+  size_t res = 0;
+  while (str[res])
+    res++;
+  return res;
+}
+} // namespace internal
+
+constexpr uint64_t hash64(const char *data, size_t length) {
+  return length <= internal::hash64_short_max
+             ? internal::hash64_short(data, length)
+             : internal::hash64_long(data, length);
+}
+
+constexpr uint64_t hash64(const char *str) {
+  return hash64(str, internal::strlen64_c(str));
+}
+
+/**
+ * Same value as hash64, long inputs run through the widest stripe kernel
+ * the CPU supports.
+ */
+uint64_t runtime_hash64(const void *data, size_t length);
+
+/**
+ * Incremental hashing, e.g. of a file read in pieces. The result equals
+ * runtime_hash64 over the concatenation of every update.
+ */
+struct hash64_state {
+  uint64_t acc[internal::hash64_lanes];
+  uint64_t length;
+  size_t stripes;
+  size_t buffered;
+  alignas(16) uint8_t buffer[internal::hash64_short_max];
+};
+
+void hash64_begin(hash64_state *state);
+void hash64_update(hash64_state *state, const void *data, size_t length);
+uint64_t hash64_end(const hash64_state *state);
+} // namespace common
+
+constexpr uint64_t operator"" _h64(const char *source, size_t length) {
+  return common::hash64(source, length);
+}
+
+#endif // HASH64_H
@@ -0,0 +1,92 @@
+#ifndef ID_SET_H
+#define ID_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash.h"
+#include "zerog_def.h"
+
+/**
+ * Sets of names hashed at compile time, for code that switches on or looks
+ * up _h ids. declare_id_set fails the build when two names of a set share
+ * a crc32 or a name is listed twice, so ids within the set can stand in
+ * for the strings:
+ *
+ *   declare_id_set(vertex_semantics, "position", "normal", "uv0");
+ *
+ *   switch (common::runtime_hash(name)) {
+ *   case vertex_semantics[0]: ...
+ *
+ * The names are kept next to the ids, register_id_set in
+ * utils/string_table.h maps the ids back to them in debug builds.
+ */
+namespace common {
+namespace internal {
+
+constexpr bool str_equal(const char *a, const char *b) {
+  return *a == *b && (!*a || str_equal(a + 1, b + 1));
+}
+
+} // namespace internal
+
+template <size_t __N> struct id_set {
+  const char *names[__N];
+  uint32_t ids[__N];
+
+  constexpr size_t size() const { return __N; }
+  constexpr uint32_t operator[](size_t i) const { return ids[i]; }
+
+  constexpr int32_t index_of(uint32_t id) const {
+    for (size_t i = 0; i < __N; i++) {
+      if (ids[i] == id)
+        return static_cast<int32_t>(i);
+    }
+    return -1;
+  }
+
+  constexpr bool contains(uint32_t id) const { return index_of(id) >= 0; }
+
+  /**
+   * Two different names with the same id.
+   */
+  constexpr bool collides() const {
+    for (size_t i = 0; i < __N; i++) {
+      for (size_t j = i + 1; j < __N; j++) {
+        if (ids[i] == ids[j] && !internal::str_equal(names[i], names[j]))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  constexpr bool has_duplicates() const {
+    for (size_t i = 0; i < __N; i++) {
+      for (size_t j = i + 1; j < __N; j++) {
+        if (internal::str_equal(names[i], names[j]))
+          return true;
+      }
+    }
+    return false;
+  }
+};
+
+template <size_t __N>
+constexpr id_set<__N> make_id_set(const char *const (&names)[__N]) {
+  id_set<__N> res{{}, {}};
+  for (size_t i = 0; i < __N; i++) {
+    res.names[i] = names[i];
+    res.ids[i] = hash(names[i]);
+  }
+  return res;
+}
+
+} // namespace common
+
+#define declare_id_set(name, ...)                                              \
+  constexpr const char *cpp_concat(name, _names)[]{__VA_ARGS__};               \
+  constexpr auto name = common::make_id_set(cpp_concat(name, _names));         \
+  static_assert(!name.collides(), "Names of " #name " collide on their id");   \
+  static_assert(!name.has_duplicates(), "A name is listed twice in " #name)
+
+#endif // ID_SET_H
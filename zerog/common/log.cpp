@@ -0,0 +1,365 @@
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#ifndef __clang__
+// stb_sprintf reads and writes a word at a time, unaligned and past the
+// end of strings. It opts out of the sanitizers through __has_feature,
+// which GCC does not have.
+#define STBI__ASAN __attribute__((no_sanitize("address", "alignment")))
+#endif
+#define STB_SPRINTF_STATIC
+#define STB_SPRINTF_IMPLEMENTATION
+#include "stb_sprintf.h"
+#pragma GCC diagnostic pop
+
+namespace common {
+namespace internal {
+
+/**
+ * Single producer, single consumer byte ring. Records never wrap: one that
+ * does not fit before the end is preceded by a padding record, or by
+ * nothing when not even a header fits there.
+ */
+struct log_ring {
+  log_ring *next;
+  // Next on the free list, under free_lock.
+  log_ring *next_free;
+  std::atomic<uint64_t> head;
+  std::atomic<uint64_t> tail;
+  // Where the record being written ends, only the owner uses it.
+  uint64_t reserved;
+  uint8_t data[log_ring_size];
+};
+
+static std::atomic<log_ring *> rings{nullptr};
+static std::atomic<uint64_t> dropped{0};
+static thread_local log_ring *local_ring
+    __attribute__((tls_model("initial-exec"))){nullptr};
+
+// The consumer side: the background thread or a flushing caller.
+static std::mutex consumer_lock;
+static FILE *output{stdout};
+static uint64_t reported_drops{0};
+static uint64_t origin_ticks{profile_ticks()};
+static double ticks_per_s{0.0};
+
+// The writer is detached, a joinable std::thread left at exit would abort.
+static std::atomic<bool> running{false};
+static std::atomic<bool> writer_done{true};
+
+// Rings of exited threads. They stay on the rings list too, the consumer
+// walks it without a lock, so they are reused rather than freed.
+static std::mutex free_lock;
+static log_ring *free_rings{nullptr};
+
+/**
+ * Returns the ring of the thread to the free list when the thread exits.
+ * Only touched when a ring is taken, so logging stays a plain load.
+ */
+struct log_ring_owner {
+  ~log_ring_owner() {
+    if (!local_ring)
+      return;
+    std::lock_guard<std::mutex> lock{free_lock};
+    local_ring->next_free = free_rings;
+    free_rings = local_ring;
+    local_ring = nullptr;
+  }
+};
+
+static thread_local log_ring_owner local_owner;
+
+/**
+ * A reused ring keeps what its last thread logged, the new owner appends
+ * after it and the consumer drains both in order.
+ */
+static log_ring *take_ring() {
+  {
+    std::lock_guard<std::mutex> lock{free_lock};
+    log_ring *ring = free_rings;
+    if (ring) {
+      free_rings = ring->next_free;
+      return ring;
+    }
+  }
+
+  void *raw = malloc(sizeof(log_ring));
+  assert(raw && "Out of memory for a log ring");
+  log_ring *ring = new (raw) log_ring;
+  ring->next_free = nullptr;
+  ring->head.store(0, std::memory_order_relaxed);
+  ring->tail.store(0, std::memory_order_relaxed);
+  ring->reserved = 0;
+  ring->next = rings.load(std::memory_order_relaxed);
+  while (!rings.compare_exchange_weak(ring->next, ring,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+  return ring;
+}
+
+static size_t align_record(size_t size) {
+  return (size + alignof(log_record) - 1) & ~(alignof(log_record) - 1);
+}
+
+/**
+ * Formats one conversion, spec holds its flags, width and precision.
+ */
+static const uint8_t *format_arg(char *out, int32_t size, const char *spec,
+                                 size_t spec_len, char conversion,
+                                 const uint8_t *arg, const uint8_t *end,
+                                 int32_t *written) {
+  char fmt[32];
+  spec_len = spec_len < 24 ? spec_len : 24;
+  memcpy(fmt, spec, spec_len);
+  if (arg >= end) {
+    *written = stbsp_snprintf(out, size, "%s", "<missing>");
+    return arg;
+  }
+
+  const log_arg_type type = static_cast<log_arg_type>(*arg++);
+  uint64_t bits = 0;
+  if (type != LOG_ARG_STRING) {
+    memcpy(&bits, arg, sizeof(bits));
+    arg += sizeof(bits);
+  }
+
+  switch (type) {
+  case LOG_ARG_INT:
+  case LOG_ARG_UINT: {
+    // The record holds 64 bits whatever length the format asked for.
+    const bool is_char = conversion == 'c';
+    const bool is_int = strchr("diouxXb", conversion) && conversion;
+    const char conv = is_char || is_int ? conversion
+                                        : (type == LOG_ARG_INT ? 'd' : 'u');
+    if (is_char) {
+      memcpy(fmt + spec_len, "c", 2);
+      *written = stbsp_snprintf(out, size, fmt, static_cast<int>(bits));
+    } else {
+      const char tail[]{'l', 'l', conv, '\0'};
+      memcpy(fmt + spec_len, tail, sizeof(tail));
+      *written = stbsp_snprintf(out, size, fmt, bits);
+    }
+    break;
+  }
+  case LOG_ARG_DOUBLE: {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    const char tail[]{strchr("fFeEgGaA", conversion) && conversion
+                          ? conversion
+                          : 'g',
+                      '\0'};
+    memcpy(fmt + spec_len, tail, sizeof(tail));
+    *written = stbsp_snprintf(out, size, fmt, value);
+    break;
+  }
+  case LOG_ARG_STRING: {
+    uint16_t len;
+    memcpy(&len, arg, sizeof(len));
+    arg += sizeof(len);
+    memcpy(fmt + spec_len, "s", 2);
+    *written = stbsp_snprintf(out, size, fmt,
+                              reinterpret_cast<const char *>(arg));
+    arg += len + 1;
+    break;
+  }
+  case LOG_ARG_POINTER: {
+    memcpy(fmt + spec_len, "p", 2);
+    *written =
+        stbsp_snprintf(out, size, fmt, reinterpret_cast<void *>(bits));
+    break;
+  }
+  }
+  return arg;
+}
+
+static const char *const severity_names[]{"debug", "info", "warning",
+                                          "error"};
+
+static void format_record(const log_record &record, const uint8_t *args,
+                          const uint8_t *end) {
+  // Under consumer_lock, and too big for the stack of a logging thread.
+  static char line[log_string_max * 2];
+  const int32_t size = static_cast<int32_t>(sizeof(line)) - 1;
+  const double seconds =
+      static_cast<double>(static_cast<int64_t>(record.ticks - origin_ticks)) /
+      ticks_per_s;
+  int32_t len = stbsp_snprintf(line, size, "[%.6f] %s: ", seconds,
+                               severity_names[record.severity]);
+
+  for (const char *f = record.format; *f && len < size; f++) {
+    if (*f != '%') {
+      line[len++] = *f;
+      continue;
+    }
+    if (f[1] == '%') {
+      line[len++] = '%';
+      f++;
+      continue;
+    }
+
+    const char *spec = f++;
+    while (*f && strchr("-+ #0", *f))
+      f++;
+    while (*f >= '0' && *f <= '9')
+      f++;
+    if (*f == '.') {
+      f++;
+      while (*f >= '0' && *f <= '9')
+        f++;
+    }
+    const size_t spec_len = static_cast<size_t>(f - spec);
+    while (*f && strchr("hlLqjzt", *f))
+      f++;
+    if (!*f)
+      break;
+
+    int32_t written = 0;
+    args = format_arg(line + len, size - len, spec, spec_len, *f, args, end,
+                      &written);
+    len = std::min(len + written, size);
+  }
+  line[len++] = '\n';
+  fwrite(line, 1, static_cast<size_t>(len), output);
+}
+
+/**
+ * Formats what the rings hold, true when there was anything.
+ */
+static bool drain() {
+  bool any = false;
+  for (log_ring *ring = rings.load(std::memory_order_acquire); ring;
+       ring = ring->next) {
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    while (tail < head) {
+      const size_t offset = tail % log_ring_size;
+      if (log_ring_size - offset < sizeof(log_record)) {
+        tail += log_ring_size - offset;
+        continue;
+      }
+      log_record record;
+      memcpy(&record, ring->data + offset, sizeof(record));
+      if (record.format) {
+        format_record(record, ring->data + offset + sizeof(record),
+                      ring->data + offset + record.size);
+        any = true;
+      }
+      tail += align_record(record.size);
+      ring->tail.store(tail, std::memory_order_release);
+    }
+    ring->tail.store(tail, std::memory_order_release);
+  }
+
+  const uint64_t drops = dropped.load(std::memory_order_relaxed);
+  if (drops != reported_drops) {
+    fprintf(output, "logger dropped %llu records\n",
+            static_cast<unsigned long long>(drops - reported_drops));
+    reported_drops = drops;
+    any = true;
+  }
+  return any;
+}
+
+static void write_records() {
+  while (running.load(std::memory_order_acquire)) {
+    bool any;
+    {
+      std::lock_guard<std::mutex> lock{consumer_lock};
+      any = drain();
+      if (any)
+        fflush(output);
+    }
+    if (!any)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  writer_done.store(true, std::memory_order_release);
+}
+
+uint8_t *log_reserve(size_t size) {
+  if (!local_ring) {
+    local_ring = take_ring();
+    // Odr-use registers the destructor for this thread.
+    (void)&local_owner;
+  }
+  log_ring *ring = local_ring;
+
+  size = align_record(size);
+  if (size > log_ring_size / 4) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  const size_t offset = head % log_ring_size;
+  const size_t room = log_ring_size - offset;
+  const size_t skip = room < size ? room : 0;
+  if (head + skip + size - tail > log_ring_size) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  if (skip >= sizeof(log_record)) {
+    const log_record padding{nullptr, 0, static_cast<uint32_t>(skip),
+                             LOG_DEBUG};
+    memcpy(ring->data + offset, &padding, sizeof(padding));
+  }
+  ring->reserved = head + skip + size;
+  return ring->data + (head + skip) % log_ring_size;
+}
+
+void log_commit() {
+  local_ring->head.store(local_ring->reserved, std::memory_order_release);
+}
+
+} // namespace internal
+
+void log_start(FILE *out) {
+  using namespace internal;
+  assert(!running.load() && "Logger is already running");
+  {
+    std::lock_guard<std::mutex> lock{consumer_lock};
+    output = out;
+    ticks_per_s = profile_ticks_per_ns() * 1e9;
+  }
+  writer_done.store(false, std::memory_order_relaxed);
+  running.store(true, std::memory_order_release);
+  std::thread(write_records).detach();
+}
+
+void log_stop() {
+  using namespace internal;
+  if (running.exchange(false)) {
+    while (!writer_done.load(std::memory_order_acquire))
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  log_flush();
+  std::lock_guard<std::mutex> lock{consumer_lock};
+  output = stdout;
+}
+
+void log_flush() {
+  using namespace internal;
+  std::lock_guard<std::mutex> lock{consumer_lock};
+  if (ticks_per_s == 0.0)
+    ticks_per_s = profile_ticks_per_ns() * 1e9;
+  drain();
+  fflush(output);
+}
+
+uint64_t log_dropped() {
+  return internal::dropped.load(std::memory_order_relaxed);
+}
+
+} // namespace common
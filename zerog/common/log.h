@@ -0,0 +1,213 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include "profiler.h"
+
+/**
+ * Asynchronous logger. log_debug, log_info, log_warning and log_error copy
+ * the format pointer and the arguments into a ring of the calling thread
+ * and return, a background thread formats the records with stb_sprintf
+ * and writes them out. Writers never block or take a lock: when their ring
+ * is full the record is dropped and counted. log_error is the exception,
+ * it writes out every record logged so far before returning, as the
+ * program may well abort next.
+ *
+ *   log_warning("[%s] Code %d : %s", layer, code, message);
+ *
+ * The format has to be a string literal, string arguments are copied up
+ * to log_string_max bytes, enough for validation layer messages.
+ * Integers, floating point numbers, strings and pointers are supported,
+ * '*' widths are not. Severities below the
+ * log_severity value ZEROG_LOG_LEVEL compile to nothing, it defaults to
+ * LOG_INFO in release builds and LOG_DEBUG otherwise.
+ */
+namespace common {
+
+enum log_severity : uint8_t { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR };
+
+constexpr size_t log_ring_size{1u << 16};
+constexpr size_t log_string_max{8192};
+
+/**
+ * Starts the background thread writing to out. Records logged before the
+ * start wait in their rings.
+ */
+void log_start(FILE *out);
+
+/**
+ * Writes what is left and stops the background thread. Errors logged
+ * afterwards go to stdout, so out may be closed.
+ */
+void log_stop();
+
+/**
+ * Writes every record logged so far before returning.
+ */
+void log_flush();
+
+/**
+ * Records dropped on full rings since the process started.
+ */
+uint64_t log_dropped();
+
+namespace internal {
+
+enum log_arg_type : uint8_t {
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_DOUBLE,
+  LOG_ARG_STRING,
+  LOG_ARG_POINTER
+};
+
+struct log_record {
+  const char *format;
+  uint64_t ticks;
+  uint32_t size;
+  log_severity severity;
+};
+
+/**
+ * Space for size bytes in the calling thread's ring, nullptr when it is
+ * full. log_commit publishes the record written there.
+ */
+uint8_t *log_reserve(size_t size);
+void log_commit();
+
+inline size_t log_string_size(const char *str) {
+  return str ? strnlen(str, log_string_max) : 0;
+}
+
+template <typename __T> struct log_is_number {
+  static constexpr bool value =
+      std::is_arithmetic<__T>::value || std::is_enum<__T>::value;
+};
+
+template <typename __T>
+inline typename std::enable_if<log_is_number<__T>::value, size_t>::type
+log_arg_size(__T) {
+  return 1 + sizeof(uint64_t);
+}
+
+// Strings keep their terminator, the writer formats them in place.
+inline size_t log_arg_size(const char *str) {
+  return 1 + sizeof(uint16_t) + log_string_size(str) + 1;
+}
+
+inline size_t log_arg_size(const void *) { return 1 + sizeof(uint64_t); }
+
+template <typename __T>
+inline uint8_t *log_put(uint8_t *p, log_arg_type type, __T value) {
+  *p = type;
+  memcpy(p + 1, &value, sizeof(value));
+  return p + 1 + sizeof(value);
+}
+
+template <typename __T>
+inline typename std::enable_if<log_is_number<__T>::value, uint8_t *>::type
+log_encode(uint8_t *p, __T value) {
+  if (std::is_floating_point<__T>::value)
+    return log_put(p, LOG_ARG_DOUBLE, static_cast<double>(value));
+  if (std::is_signed<__T>::value)
+    return log_put(p, LOG_ARG_INT, static_cast<int64_t>(value));
+  return log_put(p, LOG_ARG_UINT, static_cast<uint64_t>(value));
+}
+
+inline uint8_t *log_encode(uint8_t *p, const char *str) {
+  const uint16_t len = static_cast<uint16_t>(log_string_size(str));
+  p = log_put(p, LOG_ARG_STRING, len);
+  if (len)
+    memcpy(p, str, len);
+  p[len] = '\0';
+  return p + len + 1;
+}
+
+inline uint8_t *log_encode(uint8_t *p, const void *ptr) {
+  return log_put(p, LOG_ARG_POINTER, reinterpret_cast<uint64_t>(ptr));
+}
+
+inline size_t log_args_size() { return 0; }
+
+template <typename __T, typename... __Args>
+inline size_t log_args_size(const __T &arg, const __Args &... args) {
+  return log_arg_size(arg) + log_args_size(args...);
+}
+
+inline void log_encode_args(uint8_t *) {}
+
+template <typename __T, typename... __Args>
+inline void log_encode_args(uint8_t *p, const __T &arg,
+                            const __Args &... args) {
+  log_encode_args(log_encode(p, arg), args...);
+}
+
+/**
+ * Never called, lets the compiler check the arguments against the format.
+ */
+__attribute__((format(printf, 1, 2))) inline void
+log_check_format(const char *, ...) {}
+
+} // namespace internal
+
+template <typename... __Args>
+void log_write(log_severity severity, const char *format,
+               const __Args &... args) {
+  using namespace internal;
+  const size_t size = sizeof(log_record) + log_args_size(args...);
+  uint8_t *p = log_reserve(size);
+  if (!p)
+    return;
+
+  log_record record{format, profile_ticks(), static_cast<uint32_t>(size),
+                    severity};
+  memcpy(p, &record, sizeof(record));
+  log_encode_args(p + sizeof(record), args...);
+  log_commit();
+  if (severity == LOG_ERROR)
+    log_flush();
+}
+
+} // namespace common
+
+#ifndef ZEROG_LOG_LEVEL
+#ifdef NDEBUG
+#define ZEROG_LOG_LEVEL 1
+#else
+#define ZEROG_LOG_LEVEL 0
+#endif
+#endif
+
+#define log_at(severity, ...)                                                  \
+  do {                                                                         \
+    if (false)                                                                 \
+      common::internal::log_check_format(__VA_ARGS__);                         \
+    common::log_write(severity, __VA_ARGS__);                                  \
+  } while (false)
+
+#if ZEROG_LOG_LEVEL <= 0
+#define log_debug(...) log_at(common::LOG_DEBUG, __VA_ARGS__)
+#else
+#define log_debug(...)
+#endif
+
+#if ZEROG_LOG_LEVEL <= 1
+#define log_info(...) log_at(common::LOG_INFO, __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#if ZEROG_LOG_LEVEL <= 2
+#define log_warning(...) log_at(common::LOG_WARNING, __VA_ARGS__)
+#else
+#define log_warning(...)
+#endif
+
+#define log_error(...) log_at(common::LOG_ERROR, __VA_ARGS__)
+
+#endif // LOG_H
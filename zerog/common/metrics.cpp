@@ -0,0 +1,295 @@
+#include "metrics.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace common {
+namespace internal {
+
+struct metric_shard {
+  metric_shard *next;
+  // Next on the free list, under free_lock.
+  metric_shard *next_free;
+  std::atomic<uint64_t> values[metrics_max_counters + 1];
+};
+
+__thread std::atomic<uint64_t> *local_metric_shard
+    __attribute__((tls_model("initial-exec"))){nullptr};
+std::atomic<int64_t> gauge_values[metrics_max_gauges + 1];
+std::atomic<uint64_t> histogram_buckets[metrics_max_histograms + 1]
+                                       [histogram_bucket_count];
+
+static std::atomic<metric_shard *> shards{nullptr};
+
+// Shards of exited threads. They stay on the shards list too, readers
+// walk it without a lock, so they are reused rather than freed.
+static std::mutex free_lock;
+static metric_shard *free_shards{nullptr};
+
+/**
+ * Returns the shard of the thread to the free list when the thread exits.
+ * Only touched when a shard is taken, so metric_add stays a plain load.
+ */
+struct metric_shard_owner {
+  metric_shard *shard;
+
+  ~metric_shard_owner() {
+    if (!shard)
+      return;
+    std::lock_guard<std::mutex> lock{free_lock};
+    shard->next_free = free_shards;
+    free_shards = shard;
+    local_metric_shard = nullptr;
+  }
+};
+
+static thread_local metric_shard_owner local_owner{nullptr};
+
+/**
+ * Names of one kind of metric. count is published after the name it
+ * covers is written, readers take it with acquire. Index __Max is the
+ * sink, it has no name and count never reaches past it.
+ */
+template <uint32_t __Max> struct metric_names {
+  char names[__Max][metric_name_max];
+  std::atomic<uint32_t> count;
+};
+
+static std::mutex register_lock;
+static metric_names<metrics_max_counters> counter_names;
+static metric_names<metrics_max_gauges> gauge_names;
+static metric_names<metrics_max_histograms> histogram_names;
+
+// The export thread is detached, like the logger's.
+static std::mutex export_lock;
+static char export_path[256];
+static uint32_t export_period_ms{0};
+static std::atomic<bool> exporting{false};
+static std::atomic<bool> export_done{true};
+
+static metric_shard *reuse_shard() {
+  std::lock_guard<std::mutex> lock{free_lock};
+  metric_shard *shard = free_shards;
+  if (shard)
+    free_shards = shard->next_free;
+  return shard;
+}
+
+/**
+ * A reused shard keeps the counts of its last thread, the new owner adds
+ * to them, so sums stay exact and never go down.
+ */
+std::atomic<uint64_t> *create_metric_shard() {
+  metric_shard *shard = reuse_shard();
+  if (shard) {
+    local_owner.shard = shard;
+    local_metric_shard = shard->values;
+    return shard->values;
+  }
+
+  void *raw = malloc(sizeof(metric_shard));
+  assert(raw && "Out of memory for a metric shard");
+  shard = new (raw) metric_shard;
+  shard->next_free = nullptr;
+  for (std::atomic<uint64_t> &value : shard->values)
+    value.store(0, std::memory_order_relaxed);
+  shard->next = shards.load(std::memory_order_relaxed);
+  while (!shards.compare_exchange_weak(shard->next, shard,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+  }
+  local_owner.shard = shard;
+  local_metric_shard = shard->values;
+  return shard->values;
+}
+
+template <uint32_t __Max>
+static uint32_t register_name(metric_names<__Max> *names, const char *name) {
+  assert(strlen(name) < metric_name_max && "Metric name is too long");
+  std::lock_guard<std::mutex> lock{register_lock};
+  const uint32_t count = names->count.load(std::memory_order_relaxed);
+  for (uint32_t i = 0; i < count; i++) {
+    if (!strcmp(names->names[i], name))
+      return i;
+  }
+  assert(count < __Max && "Too many metrics of this kind");
+  if (count == __Max)
+    return __Max;
+  strncpy(names->names[count], name, metric_name_max - 1);
+  names->count.store(count + 1, std::memory_order_release);
+  return count;
+}
+
+/**
+ * Value at quantile q of the first total recorded values.
+ */
+static uint64_t percentile(const uint64_t *buckets, uint64_t total, double q) {
+  uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+  rank = rank < total ? rank : total - 1;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < histogram_bucket_count; i++) {
+    seen += buckets[i];
+    if (seen > rank)
+      return histogram_bucket_low(i) + histogram_bucket_width(i) / 2;
+  }
+  return 0;
+}
+
+static bool write_snapshot(const char *path) {
+  char tmp_path[sizeof(export_path) + 4];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  FILE *file = fopen(tmp_path, "w");
+  if (!file)
+    return false;
+  const bool written = write_metrics(file);
+  if (fclose(file) != 0 || !written) {
+    remove(tmp_path);
+    return false;
+  }
+  return rename(tmp_path, path) == 0;
+}
+
+static void export_metrics() {
+  while (exporting.load(std::memory_order_acquire)) {
+    {
+      std::lock_guard<std::mutex> lock{export_lock};
+      write_snapshot(export_path);
+    }
+    // Short sleeps keep metrics_export_stop from waiting a whole period.
+    const auto next = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(export_period_ms);
+    while (exporting.load(std::memory_order_acquire) &&
+           std::chrono::steady_clock::now() < next)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  export_done.store(true, std::memory_order_release);
+}
+
+} // namespace internal
+
+metric_counter register_counter(const char *name) {
+  return metric_counter{internal::register_name(&internal::counter_names,
+                                                name)};
+}
+
+metric_gauge register_gauge(const char *name) {
+  return metric_gauge{internal::register_name(&internal::gauge_names, name)};
+}
+
+metric_histogram register_histogram(const char *name) {
+  return metric_histogram{
+      internal::register_name(&internal::histogram_names, name)};
+}
+
+uint64_t metric_read(metric_counter counter) {
+  using namespace internal;
+  uint64_t sum = 0;
+  for (metric_shard *shard = shards.load(std::memory_order_acquire); shard;
+       shard = shard->next)
+    sum += shard->values[counter.index].load(std::memory_order_relaxed);
+  return sum;
+}
+
+int64_t gauge_read(metric_gauge gauge) {
+  return internal::gauge_values[gauge.index].load(std::memory_order_relaxed);
+}
+
+histogram_summary histogram_read(metric_histogram histogram) {
+  using namespace internal;
+  // A copy, so the percentiles agree with one count while threads record.
+  uint64_t buckets[histogram_bucket_count];
+  histogram_summary res{};
+  uint32_t first = histogram_bucket_count;
+  uint32_t last = 0;
+  for (uint32_t i = 0; i < histogram_bucket_count; i++) {
+    buckets[i] = histogram_buckets[histogram.index][i].load(
+        std::memory_order_relaxed);
+    if (buckets[i]) {
+      first = first < i ? first : i;
+      last = i;
+      res.count += buckets[i];
+    }
+  }
+  if (!res.count)
+    return res;
+
+  res.min = histogram_bucket_low(first) + histogram_bucket_width(first) / 2;
+  res.p50 = percentile(buckets, res.count, 0.5);
+  res.p90 = percentile(buckets, res.count, 0.9);
+  res.p99 = percentile(buckets, res.count, 0.99);
+  res.p999 = percentile(buckets, res.count, 0.999);
+  res.max = histogram_bucket_low(last) + histogram_bucket_width(last) / 2;
+  return res;
+}
+
+void histogram_reset(metric_histogram histogram) {
+  for (std::atomic<uint64_t> &bucket :
+       internal::histogram_buckets[histogram.index])
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+bool write_metrics(FILE *file) {
+  using namespace internal;
+  const uint32_t counters = counter_names.count.load(std::memory_order_acquire);
+  for (uint32_t i = 0; i < counters; i++) {
+    fprintf(file, "counter %s %llu\n", counter_names.names[i],
+            static_cast<unsigned long long>(metric_read(metric_counter{i})));
+  }
+
+  const uint32_t gauges = gauge_names.count.load(std::memory_order_acquire);
+  for (uint32_t i = 0; i < gauges; i++) {
+    fprintf(file, "gauge %s %lld\n", gauge_names.names[i],
+            static_cast<long long>(gauge_read(metric_gauge{i})));
+  }
+
+  const uint32_t histograms =
+      histogram_names.count.load(std::memory_order_acquire);
+  for (uint32_t i = 0; i < histograms; i++) {
+    const histogram_summary s = histogram_read(metric_histogram{i});
+    fprintf(file,
+            "histogram %s count %llu min %llu p50 %llu p90 %llu p99 %llu "
+            "p999 %llu max %llu\n",
+            histogram_names.names[i], static_cast<unsigned long long>(s.count),
+            static_cast<unsigned long long>(s.min),
+            static_cast<unsigned long long>(s.p50),
+            static_cast<unsigned long long>(s.p90),
+            static_cast<unsigned long long>(s.p99),
+            static_cast<unsigned long long>(s.p999),
+            static_cast<unsigned long long>(s.max));
+  }
+  return !ferror(file);
+}
+
+bool metrics_export_start(const char *path, uint32_t period_ms) {
+  using namespace internal;
+  assert(!exporting.load() && "Metrics are already exported");
+  assert(strlen(path) < sizeof(export_path) && "Export path is too long");
+  {
+    std::lock_guard<std::mutex> lock{export_lock};
+    strncpy(export_path, path, sizeof(export_path) - 1);
+    export_period_ms = period_ms;
+    if (!write_snapshot(export_path))
+      return false;
+  }
+  export_done.store(false, std::memory_order_relaxed);
+  exporting.store(true, std::memory_order_release);
+  std::thread(export_metrics).detach();
+  return true;
+}
+
+void metrics_export_stop() {
+  using namespace internal;
+  if (!exporting.exchange(false))
+    return;
+  while (!export_done.load(std::memory_order_acquire))
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  std::lock_guard<std::mutex> lock{export_lock};
+  write_snapshot(export_path);
+}
+
+} // namespace common
@@ -0,0 +1,178 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * Engine wide counters, gauges and histograms, registered once by name
+ * and then updated from any thread:
+ *
+ *   static const metric_counter uploads{register_counter("uploaded_bytes")};
+ *   ...
+ *   metric_add(uploads, size);
+ *
+ * Counters are sharded per thread and summed when read: an update is a
+ * relaxed load and store to a slot only the calling thread writes, no
+ * locked instruction and no shared cache line. Gauges hold one value set
+ * or moved with a relaxed atomic. Histograms bucket values the way HDR
+ * histograms do, exactly below 64 and in 32 steps per power of two above,
+ * so percentiles come back within 1/64 of what was recorded; recording is
+ * one relaxed add to a bucket shared by all threads.
+ *
+ * write_metrics prints a snapshot while threads keep updating, and
+ * metrics_export_start has a thread do that periodically into a file.
+ * Registering a name again returns the metric it already names. Past the
+ * caps below registering asserts, release builds hand out a sink metric
+ * that takes updates and is never written. A finished thread hands its
+ * shard, counts included, to the next thread that needs one, so counts of
+ * finished threads stay and reads walk one shard per thread alive at once.
+ */
+namespace common {
+
+constexpr uint32_t metrics_max_counters{256};
+constexpr uint32_t metrics_max_gauges{64};
+constexpr uint32_t metrics_max_histograms{16};
+constexpr uint32_t metric_name_max{48};
+
+constexpr uint32_t histogram_sub_bits{5};
+// Larger values land in the last bucket.
+constexpr uint32_t histogram_max_bits{40};
+constexpr uint32_t histogram_bucket_count{
+    (histogram_max_bits - histogram_sub_bits + 1) << histogram_sub_bits};
+
+struct metric_counter {
+  uint32_t index;
+};
+
+struct metric_gauge {
+  uint32_t index;
+};
+
+struct metric_histogram {
+  uint32_t index;
+};
+
+struct histogram_summary {
+  uint64_t count;
+  uint64_t min;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+  uint64_t max;
+};
+
+metric_counter register_counter(const char *name);
+metric_gauge register_gauge(const char *name);
+metric_histogram register_histogram(const char *name);
+
+namespace internal {
+
+// __thread rather than thread_local: an extern thread_local makes every
+// access check for a dynamic initializer first.
+extern __thread std::atomic<uint64_t> *local_metric_shard
+    __attribute__((tls_model("initial-exec")));
+// One more slot of each kind is the sink.
+extern std::atomic<int64_t> gauge_values[metrics_max_gauges + 1];
+extern std::atomic<uint64_t> histogram_buckets[metrics_max_histograms + 1]
+                                              [histogram_bucket_count];
+
+std::atomic<uint64_t> *create_metric_shard();
+
+inline uint32_t histogram_bucket(uint64_t value) {
+  constexpr uint64_t largest{(uint64_t{1} << histogram_max_bits) - 1};
+  value = value < largest ? value : largest;
+  if (value < (2u << histogram_sub_bits))
+    return static_cast<uint32_t>(value);
+  const uint32_t shift = 63 - __builtin_clzll(value) - histogram_sub_bits;
+  return (shift << histogram_sub_bits) + static_cast<uint32_t>(value >> shift);
+}
+
+/**
+ * Smallest value of a bucket, histogram_bucket_width values share it.
+ */
+inline uint64_t histogram_bucket_low(uint32_t bucket) {
+  if (bucket < (2u << histogram_sub_bits))
+    return bucket;
+  const uint32_t shift = (bucket >> histogram_sub_bits) - 1;
+  return static_cast<uint64_t>(bucket - (shift << histogram_sub_bits))
+         << shift;
+}
+
+inline uint64_t histogram_bucket_width(uint32_t bucket) {
+  if (bucket < (2u << histogram_sub_bits))
+    return 1;
+  return uint64_t{1} << ((bucket >> histogram_sub_bits) - 1);
+}
+
+} // namespace internal
+
+inline void metric_add(metric_counter counter, uint64_t n = 1) {
+  std::atomic<uint64_t> *shard = internal::local_metric_shard;
+  if (!shard)
+    shard = internal::create_metric_shard();
+  // The owning thread is the only writer, readers need the value whole.
+  std::atomic<uint64_t> &value = shard[counter.index];
+  value.store(value.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+}
+
+inline void gauge_set(metric_gauge gauge, int64_t value) {
+  internal::gauge_values[gauge.index].store(value, std::memory_order_relaxed);
+}
+
+inline void gauge_add(metric_gauge gauge, int64_t delta) {
+  internal::gauge_values[gauge.index].fetch_add(delta,
+                                                std::memory_order_relaxed);
+}
+
+inline void histogram_record(metric_histogram histogram, uint64_t value) {
+  internal::histogram_buckets[histogram.index]
+                             [internal::histogram_bucket(value)]
+                                 .fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Sum over the shards of every thread that added to counter.
+ */
+uint64_t metric_read(metric_counter counter);
+int64_t gauge_read(metric_gauge gauge);
+
+/**
+ * Percentiles are the middle of the bucket they fall in, zero for an empty
+ * histogram.
+ */
+histogram_summary histogram_read(metric_histogram histogram);
+
+/**
+ * Empties the histogram, to summarize one period at a time.
+ */
+void histogram_reset(metric_histogram histogram);
+
+/**
+ * Writes every registered metric, one per line:
+ *
+ *   counter uploaded_bytes 1048576
+ *   gauge upload_queue_depth 3
+ *   histogram frame_ns count 600 min 15872 p50 16640 p90 17152 p99 ...
+ */
+bool write_metrics(FILE *file);
+
+/**
+ * Rewrites path with write_metrics every period_ms from a background
+ * thread. Each snapshot goes to path.tmp first and is renamed over path,
+ * so readers only see whole snapshots. A path under /dev/shm keeps it in
+ * memory.
+ */
+bool metrics_export_start(const char *path, uint32_t period_ms);
+
+/**
+ * Writes a last snapshot and stops the export thread.
+ */
+void metrics_export_stop();
+
+} // namespace common
+
+#endif // METRICS_H
@@ -0,0 +1,154 @@
+#include "perf_counters.h"
+
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace common {
+namespace internal {
+
+static const char *const event_names[perf_event_count]{
+    "cycles",        "instructions", "cache_misses", "l1d_misses",
+    "branch_misses", "dtlb_misses",  "page_faults",
+};
+
+#if defined(__linux__)
+struct event_config {
+  uint32_t type;
+  uint64_t config;
+};
+
+static constexpr uint64_t cache_read_miss(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+static const event_config event_configs[perf_event_count]{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+static int32_t open_event(const event_config &config, int32_t leader) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.disabled = leader < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int32_t>(
+      syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+}
+#endif
+
+} // namespace internal
+
+bool perf_open(perf_counters *counters, uint32_t events) {
+  counters->leader = -1;
+  counters->events = 0;
+  for (uint32_t i = 0; i < perf_event_count; i++)
+    counters->fds[i] = -1;
+
+#if defined(__linux__)
+  for (uint32_t i = 0; i < perf_event_count; i++) {
+    if (!(events & (1u << i)))
+      continue;
+    const int32_t fd =
+        internal::open_event(internal::event_configs[i], counters->leader);
+    if (fd < 0)
+      continue;
+    if (counters->leader < 0)
+      counters->leader = fd;
+    counters->fds[i] = fd;
+    counters->events |= 1u << i;
+  }
+#else
+  (void)events;
+#endif
+  return counters->events != 0;
+}
+
+void perf_close(perf_counters *counters) {
+#if defined(__linux__)
+  // Members first, closing the leader would promote them to their own
+  // groups.
+  for (uint32_t i = 0; i < perf_event_count; i++) {
+    if (counters->fds[i] >= 0 && counters->fds[i] != counters->leader)
+      close(counters->fds[i]);
+  }
+  if (counters->leader >= 0)
+    close(counters->leader);
+#endif
+  perf_open(counters, 0);
+}
+
+void perf_start(perf_counters *counters) {
+#if defined(__linux__)
+  if (counters->leader < 0)
+    return;
+  ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+  (void)counters;
+#endif
+}
+
+void perf_stop(perf_counters *counters) {
+#if defined(__linux__)
+  if (counters->leader >= 0)
+    ioctl(counters->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#else
+  (void)counters;
+#endif
+}
+
+bool perf_read(const perf_counters *counters, perf_values *values) {
+  memset(values, 0, sizeof(*values));
+#if defined(__linux__)
+  if (counters->leader < 0)
+    return false;
+
+  // nr, time enabled, time running and a count per member in open order.
+  uint64_t data[3 + perf_event_count];
+  const ssize_t size = read(counters->leader, data, sizeof(data));
+  if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+    return false;
+
+  const double scale =
+      data[2] ? static_cast<double>(data[1]) / static_cast<double>(data[2])
+              : 0.0;
+  uint64_t member = 0;
+  for (uint32_t i = 0; i < perf_event_count && member < data[0]; i++) {
+    if (counters->fds[i] < 0)
+      continue;
+    values->counts[i] =
+        static_cast<uint64_t>(static_cast<double>(data[3 + member]) * scale);
+    member++;
+  }
+  return true;
+#else
+  (void)counters;
+  return false;
+#endif
+}
+
+const char *perf_event_name(uint32_t event) {
+  if (!event || (event & (event - 1)) || event > PERF_ALL)
+    return "unknown";
+  return internal::event_names[__builtin_ctz(event)];
+}
+
+} // namespace common
@@ -0,0 +1,109 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+
+/**
+ * Hardware counters of the calling thread through perf_event_open, opened
+ * as one group so they cover the same instructions. Containers, virtual
+ * machines without a PMU and a strict perf_event_paranoid refuse some or
+ * all events: those are left out of perf_counters::events and read as
+ * zero, nothing fails.
+ */
+namespace common {
+
+enum perf_event : uint32_t {
+  PERF_CYCLES = 0x1,
+  PERF_INSTRUCTIONS = 0x2,
+  PERF_CACHE_MISSES = 0x4,
+  PERF_L1D_MISSES = 0x8,
+  PERF_BRANCH_MISSES = 0x10,
+  PERF_DTLB_MISSES = 0x20,
+  // A kernel software event, there even without a PMU.
+  PERF_PAGE_FAULTS = 0x40,
+  PERF_ALL = 0x7f,
+};
+
+constexpr uint32_t perf_event_count{7};
+
+struct perf_counters {
+  int32_t fds[perf_event_count];
+  int32_t leader;
+  // The requested events that opened.
+  uint32_t events;
+};
+
+/**
+ * Counts indexed by the bit of their event. Events that shared the PMU
+ * with others are scaled up to the whole time they were enabled.
+ */
+struct perf_values {
+  uint64_t counts[perf_event_count];
+};
+
+/**
+ * Opens the counters disabled, true when at least one event opened.
+ */
+bool perf_open(perf_counters *counters, uint32_t events);
+void perf_close(perf_counters *counters);
+
+/**
+ * Zeroes and enables the group, perf_stop disables it again.
+ */
+void perf_start(perf_counters *counters);
+void perf_stop(perf_counters *counters);
+
+/**
+ * Reads the group while it counts or after perf_stop.
+ */
+bool perf_read(const perf_counters *counters, perf_values *values);
+
+const char *perf_event_name(uint32_t event);
+
+inline uint64_t perf_count(const perf_values &values, perf_event event) {
+  return values.counts[__builtin_ctz(event)];
+}
+
+/**
+ * Adds the events of a scope to sum, next to a profile_zone when a zone
+ * needs counters as well as time:
+ *
+ *   perf_values upload_counts{};
+ *   ...
+ *   {
+ *     profile_zone("upload");
+ *     perf_zone counts{&counters, &upload_counts};
+ *     ...
+ *   }
+ *
+ * Each end reads the group with a system call, so zones should be coarse.
+ */
+class perf_zone {
+public:
+  perf_zone(const perf_counters *counters, perf_values *sum)
+      : counters_{counters}, sum_{sum}, begin_{} {
+    perf_read(counters_, &begin_);
+  }
+
+  ~perf_zone() {
+    perf_values end{};
+    perf_read(counters_, &end);
+    // Scaling may take a multiplexed count back a little.
+    for (uint32_t i = 0; i < perf_event_count; i++) {
+      if (end.counts[i] > begin_.counts[i])
+        sum_->counts[i] += end.counts[i] - begin_.counts[i];
+    }
+  }
+
+  perf_zone(const perf_zone &) = delete;
+  perf_zone &operator=(const perf_zone &) = delete;
+
+private:
+  const perf_counters *counters_;
+  perf_values *sum_;
+  perf_values begin_;
+};
+
+} // namespace common
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,160 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hash.h"
+#include "id_set.h"
+#include "zerog_def.h"
+
+/**
+ * Collision free tables for fixed keys, built while compiling. A key maps
+ * to its slot with one multiply and shift, the slot holds the index of the
+ * only key that can be there, so a lookup is one hash, one load and one
+ * compare. The multiplier and the table size are searched for at compile
+ * time, starting at twice the key count:
+ *
+ *   declare_id_set(vertex_semantics, "position", "normal", "uv0");
+ *   declare_perfect_hash(semantic_table, vertex_semantics);
+ *
+ *   int32_t i = semantic_table.find(name); // -1 when absent
+ *
+ * Tables over id sets keep the names and find() confirms a string with one
+ * strcmp, tables over integer keys only compare the key.
+ */
+namespace common {
+namespace internal {
+
+struct perfect_params {
+  uint32_t seed;
+  // log2 of the slot count, 0 when no multiplier was found.
+  uint32_t bits;
+};
+
+constexpr uint32_t perfect_max_bits{16};
+constexpr uint32_t perfect_attempts{64};
+
+constexpr uint32_t perfect_seed(uint32_t attempt) {
+  return (attempt * 0x9e3779b9u + 0x7f4a7c15u) | 1u;
+}
+
+constexpr uint32_t perfect_slot(uint32_t key, uint32_t seed, uint32_t bits) {
+  return (key * seed) >> (32 - bits);
+}
+
+constexpr uint32_t ceil_log2(size_t n) {
+  uint32_t bits = 0;
+  while ((size_t{1} << bits) < n)
+    bits++;
+  return bits;
+}
+
+template <size_t __N>
+constexpr bool perfect_seed_fits(const uint32_t (&keys)[__N], uint32_t seed,
+                                 uint32_t bits) {
+  for (size_t i = 0; i < __N; i++) {
+    for (size_t j = i + 1; j < __N; j++) {
+      if (perfect_slot(keys[i], seed, bits) ==
+          perfect_slot(keys[j], seed, bits))
+        return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * The smallest table, and the first multiplier for it, that separates the
+ * keys. Repeated keys never separate and leave bits at 0.
+ */
+template <size_t __N>
+constexpr perfect_params find_perfect_params(const uint32_t (&keys)[__N]) {
+  const uint32_t min_bits = ceil_log2(__N * 2);
+  for (uint32_t bits = min_bits; bits <= perfect_max_bits; bits++) {
+    for (uint32_t attempt = 0; attempt < perfect_attempts; attempt++) {
+      if (perfect_seed_fits(keys, perfect_seed(attempt), bits))
+        return perfect_params{perfect_seed(attempt), bits};
+    }
+  }
+  return perfect_params{0, 0};
+}
+
+template <size_t __N>
+constexpr perfect_params find_perfect_params(const id_set<__N> &set) {
+  return find_perfect_params(set.ids);
+}
+
+} // namespace internal
+
+template <size_t __N, uint32_t __Bits> struct perfect_hash {
+  static_assert(__Bits > 0 && __Bits <= internal::perfect_max_bits,
+                "Slot count out of range");
+  static_assert(__N < 0xffff, "Too many keys for 16 bit slots");
+
+  uint32_t keys[__N];
+  // nullptr for integer keys.
+  const char *names[__N];
+  uint32_t seed;
+  // Index of the key plus one, 0 for empty slots.
+  uint16_t slots[1u << __Bits];
+
+  constexpr size_t size() const { return __N; }
+  constexpr size_t slot_count() const { return size_t{1} << __Bits; }
+
+  constexpr int32_t index_of(uint32_t key) const {
+    const uint32_t slot = slots[internal::perfect_slot(key, seed, __Bits)];
+    return slot && keys[slot - 1] == key ? static_cast<int32_t>(slot) - 1 : -1;
+  }
+
+  constexpr bool contains(uint32_t key) const { return index_of(key) >= 0; }
+
+  /**
+   * Index of str among the names, -1 when it is not one of them. Only
+   * tables over id sets have names, integer tables never find a string.
+   */
+  int32_t find(const char *str) const {
+    assert(names[0] && "Finding a string in a table of integer keys");
+    const int32_t i = index_of(runtime_hash(str));
+    return i >= 0 && names[i] && !strcmp(names[i], str) ? i : -1;
+  }
+};
+
+template <uint32_t __Bits, size_t __N>
+constexpr perfect_hash<__N, __Bits>
+make_perfect_hash(const uint32_t (&keys)[__N], uint32_t seed) {
+  perfect_hash<__N, __Bits> res{{}, {}, seed, {}};
+  for (size_t i = 0; i < __N; i++) {
+    res.keys[i] = keys[i];
+    res.names[i] = nullptr;
+    res.slots[internal::perfect_slot(keys[i], seed, __Bits)] =
+        static_cast<uint16_t>(i + 1);
+  }
+  return res;
+}
+
+template <uint32_t __Bits, size_t __N>
+constexpr perfect_hash<__N, __Bits> make_perfect_hash(const id_set<__N> &set,
+                                                      uint32_t seed) {
+  perfect_hash<__N, __Bits> res = make_perfect_hash<__Bits>(set.ids, seed);
+  for (size_t i = 0; i < __N; i++)
+    res.names[i] = set.names[i];
+  return res;
+}
+
+} // namespace common
+
+/**
+ * Declares name as the perfect hash of keys, an id set or an array of
+ * distinct uint32_t. Fails the build when the keys repeat.
+ */
+#define declare_perfect_hash(name, keys)                                       \
+  constexpr common::internal::perfect_params cpp_concat(name, _params) =       \
+      common::internal::find_perfect_params(keys);                             \
+  static_assert(cpp_concat(name, _params).bits,                                \
+                "No perfect hash separates the keys of " #name);               \
+  constexpr auto name = common::make_perfect_hash<cpp_concat(                  \
+      name, _params).bits>(keys, cpp_concat(name, _params).seed)
+
+#endif // PERFECT_HASH_H
@@ -0,0 +1,227 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace common {
+namespace internal {
+
+/**
+ * Fields are relaxed atomics so the exporter may read a slot the owner is
+ * rewriting, it throws such slots away by looking at head afterwards.
+ */
+struct profile_event {
+  std::atomic<const char *> name;
+  std::atomic<uint64_t> begin;
+  std::atomic<uint64_t> end;
+};
+
+struct profile_ring {
+  profile_ring *next;
+  // Next on the free list, under free_lock.
+  profile_ring *next_free;
+  std::atomic<uint32_t> tid;
+  std::atomic<const char *> name;
+  // Only the owner thread moves head, tail is where profile_clear left it.
+  std::atomic<uint64_t> head;
+  std::atomic<uint64_t> tail;
+  profile_event events[profile_ring_size];
+};
+
+typedef std::chrono::steady_clock steady_clock;
+
+struct clock_origin {
+  uint64_t ticks;
+  steady_clock::time_point time;
+};
+
+static const clock_origin origin{profile_ticks(), steady_clock::now()};
+static std::atomic<profile_ring *> rings{nullptr};
+static std::atomic<uint32_t> ring_count{0};
+// Initial exec keeps the lookup a single load in the -fPIC builds.
+static thread_local profile_ring *local_ring
+    __attribute__((tls_model("initial-exec"))){nullptr};
+
+// Rings of exited threads. They stay on the rings list too, the exporter
+// walks it without a lock, so they are reused rather than freed.
+static std::mutex free_lock;
+static profile_ring *free_rings{nullptr};
+
+/**
+ * Returns the ring of the thread to the free list when the thread exits.
+ * Only touched when a ring is taken, so recording stays a plain load.
+ */
+struct ring_owner {
+  ~ring_owner() {
+    if (!local_ring)
+      return;
+    std::lock_guard<std::mutex> lock{free_lock};
+    local_ring->next_free = free_rings;
+    free_rings = local_ring;
+    local_ring = nullptr;
+  }
+};
+
+static thread_local ring_owner local_owner;
+
+static profile_ring *reuse_ring() {
+  std::lock_guard<std::mutex> lock{free_lock};
+  profile_ring *ring = free_rings;
+  if (ring)
+    free_rings = ring->next_free;
+  return ring;
+}
+
+/**
+ * Rings come from malloc rather than the engine allocators, whose slow
+ * paths are profiled themselves. A reused ring drops the events of its
+ * last thread and gets a new tid, so the trace keeps threads apart.
+ */
+static profile_ring *take_ring() {
+  const uint32_t tid = ring_count.fetch_add(1, std::memory_order_relaxed) + 1;
+  profile_ring *ring = reuse_ring();
+  if (ring) {
+    ring->tail.store(ring->head.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    ring->name.store(nullptr, std::memory_order_relaxed);
+    ring->tid.store(tid, std::memory_order_relaxed);
+    return ring;
+  }
+
+  void *raw = malloc(sizeof(profile_ring));
+  assert(raw && "Out of memory for a profiler ring");
+  ring = new (raw) profile_ring;
+  ring->next_free = nullptr;
+  ring->tid.store(tid, std::memory_order_relaxed);
+  ring->name.store(nullptr, std::memory_order_relaxed);
+  ring->head.store(0, std::memory_order_relaxed);
+  ring->tail.store(0, std::memory_order_relaxed);
+  ring->next = rings.load(std::memory_order_relaxed);
+  while (!rings.compare_exchange_weak(ring->next, ring,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+  return ring;
+}
+
+static profile_ring *thread_ring() {
+  if (!local_ring) {
+    local_ring = take_ring();
+    // Odr-use registers the destructor for this thread.
+    (void)&local_owner;
+  }
+  return local_ring;
+}
+
+/**
+ * Zone names come from the source, quotes and backslashes are all that
+ * need escaping in practice.
+ */
+static void write_json_string(FILE *file, const char *str) {
+  fputc('"', file);
+  for (; *str; str++) {
+    const char c = *str;
+    if (c == '"' || c == '\\')
+      fputc('\\', file);
+    if (static_cast<unsigned char>(c) >= 0x20)
+      fputc(c, file);
+  }
+  fputc('"', file);
+}
+
+} // namespace internal
+
+double profile_ticks_per_ns() {
+  using namespace internal;
+  // Short runs have to wait a little for a usable measurement.
+  const steady_clock::duration min_span = std::chrono::milliseconds(10);
+  steady_clock::time_point now = steady_clock::now();
+  uint64_t ticks = profile_ticks();
+  while (now - origin.time < min_span) {
+    now = steady_clock::now();
+    ticks = profile_ticks();
+  }
+  const double ns = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - origin.time)
+          .count());
+  return static_cast<double>(ticks - origin.ticks) / ns;
+}
+
+void profile_record(const char *name, uint64_t begin, uint64_t end) {
+  internal::profile_ring *ring = internal::thread_ring();
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  internal::profile_event &event = ring->events[head % profile_ring_size];
+  event.name.store(name, std::memory_order_relaxed);
+  event.begin.store(begin, std::memory_order_relaxed);
+  event.end.store(end, std::memory_order_relaxed);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void profile_thread_name(const char *name) {
+  internal::thread_ring()->name.store(name, std::memory_order_relaxed);
+}
+
+void profile_clear() {
+  using namespace internal;
+  for (profile_ring *ring = rings.load(std::memory_order_acquire); ring;
+       ring = ring->next)
+    ring->tail.store(ring->head.load(std::memory_order_acquire),
+                     std::memory_order_relaxed);
+}
+
+bool write_profile_trace(FILE *file) {
+  using namespace internal;
+  const double us_per_tick = 1.0 / (profile_ticks_per_ns() * 1000.0);
+  bool first = true;
+  fputs("{\"traceEvents\":[\n", file);
+  for (profile_ring *ring = rings.load(std::memory_order_acquire); ring;
+       ring = ring->next) {
+    const uint32_t tid = ring->tid.load(std::memory_order_relaxed);
+    const char *name = ring->name.load(std::memory_order_relaxed);
+    if (name) {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":%u,\"args\":{\"name\":",
+              first ? "" : ",\n", tid);
+      write_json_string(file, name);
+      fputs("}}", file);
+      first = false;
+    }
+
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    // The oldest slot is the one the owner writes next.
+    uint64_t start =
+        head >= profile_ring_size ? head - profile_ring_size + 1 : 0;
+    start = std::max(start, tail);
+    for (uint64_t i = start; i < head; i++) {
+      const profile_event &event = ring->events[i % profile_ring_size];
+      // Acquire keeps the copy ahead of the second look at head, the owner
+      // may have lapped the reader meanwhile.
+      const char *event_name = event.name.load(std::memory_order_acquire);
+      const uint64_t begin = event.begin.load(std::memory_order_acquire);
+      const uint64_t end = event.end.load(std::memory_order_acquire);
+      if (ring->head.load(std::memory_order_relaxed) - i >= profile_ring_size)
+        continue;
+
+      const double ts =
+          static_cast<double>(static_cast<int64_t>(begin - origin.ticks)) *
+          us_per_tick;
+      const double dur = static_cast<double>(end - begin) * us_per_tick;
+      fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+      write_json_string(file, event_name);
+      fprintf(file,
+              ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+              tid, ts, dur);
+      first = false;
+    }
+  }
+  fputs("\n]}\n", file);
+  return !ferror(file);
+}
+
+} // namespace common
@@ -0,0 +1,89 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "zerog_def.h"
+
+#include <cstdint>
+#include <cstdio>
+
+#include <x86intrin.h>
+
+/**
+ * Scoped zone profiler. A zone stamps the time stamp counter when it opens
+ * and appends one event to a ring of the calling thread when it closes,
+ * with no locks. The profile_scope bench measures 50 to 60 ns a zone in a
+ * virtual machine, nearly all of it the two counter reads. Rings keep the
+ * newest profile_ring_size - 1 events per thread. When a thread exits its
+ * ring goes back to a free list and the next new thread takes it over,
+ * so the events of finished threads stay until then.
+ *
+ * The macros compile to nothing unless the build has ZEROG_PROFILE:
+ *
+ *   void load_level() {
+ *     profile_function();
+ *     ...
+ *     {
+ *       profile_zone("upload");
+ *       ...
+ *     }
+ *   }
+ *
+ * Zone names must outlive the export, string literals do.
+ */
+namespace common {
+
+constexpr uint32_t profile_ring_size{1u << 16};
+
+inline uint64_t profile_ticks() { return __rdtsc(); }
+
+/**
+ * Time stamp counter rate, measured against the steady clock since the
+ * process started.
+ */
+double profile_ticks_per_ns();
+
+void profile_record(const char *name, uint64_t begin, uint64_t end);
+
+/**
+ * Name shown for the calling thread in the trace viewer.
+ */
+void profile_thread_name(const char *name);
+
+/**
+ * Drops the events recorded so far on every thread.
+ */
+void profile_clear();
+
+/**
+ * Writes every thread's events as Chrome trace event JSON, which
+ * chrome://tracing and Perfetto open. Threads may keep recording, events
+ * they overwrite meanwhile are left out.
+ */
+bool write_profile_trace(FILE *file);
+
+class profile_scope {
+public:
+  explicit profile_scope(const char *name)
+      : name_{name}, begin_{profile_ticks()} {}
+  ~profile_scope() { profile_record(name_, begin_, profile_ticks()); }
+
+  profile_scope(const profile_scope &) = delete;
+  profile_scope &operator=(const profile_scope &) = delete;
+
+private:
+  const char *name_;
+  uint64_t begin_;
+};
+
+} // namespace common
+
+#ifdef ZEROG_PROFILE
+#define profile_zone(name)                                                     \
+  common::profile_scope cpp_concat(profile_zone_, __LINE__) { name }
+#else
+#define profile_zone(name)
+#endif
+
+#define profile_function() profile_zone(__func__)
+
+#endif // PROFILER_H
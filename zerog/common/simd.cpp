@@ -0,0 +1,209 @@
+#include "simd.h"
+
+#include "cpu.h"
+
+namespace common {
+namespace simd {
+namespace internal {
+
+/**
+ * The vector loops finish with these, they use the same operation order so
+ * every element comes out bit identical whichever kernel ran.
+ */
+static void transform_points_tail(const float *m, const float *x,
+                                  const float *y, const float *z,
+                                  float *out_x, float *out_y, float *out_z,
+                                  size_t i, size_t count) {
+  for (; i < count; i++) {
+    const float px = x[i];
+    const float py = y[i];
+    const float pz = z[i];
+    out_x[i] = m[0] * px + m[4] * py + m[8] * pz + m[12];
+    out_y[i] = m[1] * px + m[5] * py + m[9] * pz + m[13];
+    out_z[i] = m[2] * px + m[6] * py + m[10] * pz + m[14];
+  }
+}
+
+static void normalize_tail(float *x, float *y, float *z, size_t i,
+                           size_t count) {
+  for (; i < count; i++) {
+    const float len = sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+    x[i] /= len;
+    y[i] /= len;
+    z[i] /= len;
+  }
+}
+
+typedef void (*transform_points_fn)(const float *m, const float *x,
+                                    const float *y, const float *z,
+                                    float *out_x, float *out_y, float *out_z,
+                                    size_t count);
+typedef void (*compose_fn)(const float *a, const float *b, float *out,
+                           size_t count);
+typedef void (*normalize_fn)(float *x, float *y, float *z, size_t count);
+
+static void transform_points_sse2(const float *m, const float *x,
+                                  const float *y, const float *z,
+                                  float *out_x, float *out_y, float *out_z,
+                                  size_t count) {
+  __m128 k[12];
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 3; r++)
+      k[c * 3 + r] = _mm_set1_ps(m[c * 4 + r]);
+  }
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 px = _mm_loadu_ps(x + i);
+    const __m128 py = _mm_loadu_ps(y + i);
+    const __m128 pz = _mm_loadu_ps(z + i);
+    float *out[]{out_x, out_y, out_z};
+    for (int r = 0; r < 3; r++) {
+      __m128 v = _mm_mul_ps(k[r], px);
+      v = _mm_add_ps(v, _mm_mul_ps(k[3 + r], py));
+      v = _mm_add_ps(v, _mm_mul_ps(k[6 + r], pz));
+      _mm_storeu_ps(out[r] + i, _mm_add_ps(v, k[9 + r]));
+    }
+  }
+  transform_points_tail(m, x, y, z, out_x, out_y, out_z, i, count);
+}
+
+cpu_target("avx") static void transform_points_avx(
+    const float *m, const float *x, const float *y, const float *z,
+    float *out_x, float *out_y, float *out_z, size_t count) {
+  __m256 k[12];
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 3; r++)
+      k[c * 3 + r] = _mm256_set1_ps(m[c * 4 + r]);
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 px = _mm256_loadu_ps(x + i);
+    const __m256 py = _mm256_loadu_ps(y + i);
+    const __m256 pz = _mm256_loadu_ps(z + i);
+    float *out[]{out_x, out_y, out_z};
+    for (int r = 0; r < 3; r++) {
+      __m256 v = _mm256_mul_ps(k[r], px);
+      v = _mm256_add_ps(v, _mm256_mul_ps(k[3 + r], py));
+      v = _mm256_add_ps(v, _mm256_mul_ps(k[6 + r], pz));
+      _mm256_storeu_ps(out[r] + i, _mm256_add_ps(v, k[9 + r]));
+    }
+  }
+  transform_points_tail(m, x, y, z, out_x, out_y, out_z, i, count);
+}
+
+/**
+ * Every column of out is a combination of the columns of a weighted by a
+ * column of b. All of a is loaded first and each b column is read before
+ * the matching out column is written, which makes aliasing safe.
+ */
+static void compose_sse2(const float *a, const float *b, float *out,
+                         size_t count) {
+  for (size_t i = 0; i < count; i++, a += 16, b += 16, out += 16) {
+    const mat4 ma{{_mm_loadu_ps(a), _mm_loadu_ps(a + 4), _mm_loadu_ps(a + 8),
+                   _mm_loadu_ps(a + 12)}};
+    for (int c = 0; c < 4; c++)
+      _mm_storeu_ps(out + c * 4, combine(ma, _mm_loadu_ps(b + c * 4)));
+  }
+}
+
+/**
+ * Two columns per register, the columns of a are repeated in both halves
+ * and the weights splatted within each half.
+ */
+cpu_target("avx") static void compose_avx(const float *a, const float *b,
+                                          float *out, size_t count) {
+  for (size_t i = 0; i < count; i++, a += 16, b += 16, out += 16) {
+    const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a));
+    const __m256 a1 =
+        _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 4));
+    const __m256 a2 =
+        _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 8));
+    const __m256 a3 =
+        _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 12));
+    for (int c = 0; c < 4; c += 2) {
+      const __m256 w = _mm256_loadu_ps(b + c * 4);
+      __m256 v = _mm256_mul_ps(a0, _mm256_shuffle_ps(w, w, 0x00));
+      v = _mm256_add_ps(v, _mm256_mul_ps(a1, _mm256_shuffle_ps(w, w, 0x55)));
+      v = _mm256_add_ps(v, _mm256_mul_ps(a2, _mm256_shuffle_ps(w, w, 0xaa)));
+      v = _mm256_add_ps(v, _mm256_mul_ps(a3, _mm256_shuffle_ps(w, w, 0xff)));
+      _mm256_storeu_ps(out + c * 4, v);
+    }
+  }
+}
+
+static void normalize_sse2(float *x, float *y, float *z, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 vx = _mm_loadu_ps(x + i);
+    const __m128 vy = _mm_loadu_ps(y + i);
+    const __m128 vz = _mm_loadu_ps(z + i);
+    __m128 len = _mm_mul_ps(vx, vx);
+    len = _mm_add_ps(len, _mm_mul_ps(vy, vy));
+    len = _mm_sqrt_ps(_mm_add_ps(len, _mm_mul_ps(vz, vz)));
+    _mm_storeu_ps(x + i, _mm_div_ps(vx, len));
+    _mm_storeu_ps(y + i, _mm_div_ps(vy, len));
+    _mm_storeu_ps(z + i, _mm_div_ps(vz, len));
+  }
+  normalize_tail(x, y, z, i, count);
+}
+
+cpu_target("avx") static void normalize_avx(float *x, float *y, float *z,
+                                            size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 vx = _mm256_loadu_ps(x + i);
+    const __m256 vy = _mm256_loadu_ps(y + i);
+    const __m256 vz = _mm256_loadu_ps(z + i);
+    __m256 len = _mm256_mul_ps(vx, vx);
+    len = _mm256_add_ps(len, _mm256_mul_ps(vy, vy));
+    len = _mm256_sqrt_ps(_mm256_add_ps(len, _mm256_mul_ps(vz, vz)));
+    _mm256_storeu_ps(x + i, _mm256_div_ps(vx, len));
+    _mm256_storeu_ps(y + i, _mm256_div_ps(vy, len));
+    _mm256_storeu_ps(z + i, _mm256_div_ps(vz, len));
+  }
+  normalize_tail(x, y, z, i, count);
+}
+
+static const cpu_variant<transform_points_fn> transform_points_variants[]{
+    {CPU_AVX, transform_points_avx},
+    {0, transform_points_sse2},
+};
+
+static const cpu_variant<compose_fn> compose_variants[]{
+    {CPU_AVX, compose_avx},
+    {0, compose_sse2},
+};
+
+static const cpu_variant<normalize_fn> normalize_variants[]{
+    {CPU_AVX, normalize_avx},
+    {0, normalize_sse2},
+};
+
+} // namespace internal
+
+void transform_points(const glm::mat4 &m, const float *x, const float *y,
+                      const float *z, float *out_x, float *out_y,
+                      float *out_z, size_t count) {
+  using namespace internal;
+  static cpu_dispatch<transform_points_fn> fn{transform_points_variants};
+  fn(&m[0][0], x, y, z, out_x, out_y, out_z, count);
+}
+
+void compose(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out,
+             size_t count) {
+  using namespace internal;
+  static cpu_dispatch<compose_fn> fn{compose_variants};
+  fn(reinterpret_cast<const float *>(a), reinterpret_cast<const float *>(b),
+     reinterpret_cast<float *>(out), count);
+}
+
+void normalize(float *x, float *y, float *z, size_t count) {
+  using namespace internal;
+  static cpu_dispatch<normalize_fn> fn{normalize_variants};
+  fn(x, y, z, count);
+}
+
+} // namespace simd
+} // namespace common
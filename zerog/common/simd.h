@@ -0,0 +1,263 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <math.h>
+#include <stddef.h>
+
+#include <immintrin.h>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+/**
+ * SSE backed vector math for hot loops. The types hold registers and are
+ * meant to live in locals, storage and interfaces keep using glm and
+ * convert with load and to_glm. The batch functions at the end work on
+ * structure of arrays streams, e.g. the ones of soa, 8 elements at a time
+ * with AVX and 4 otherwise.
+ */
+namespace common {
+namespace simd {
+
+struct vec4 {
+  __m128 v;
+};
+
+/**
+ * The unused w lane is kept at zero so dot products can use all four.
+ */
+struct vec3 {
+  __m128 v;
+};
+
+/**
+ * x, y, z, w order like glm::quat.
+ */
+struct quat {
+  __m128 v;
+};
+
+/**
+ * Column major like glm::mat4.
+ */
+struct mat4 {
+  __m128 col[4];
+};
+
+namespace internal {
+template <int X, int Y, int Z, int W> inline __m128 swizzle(__m128 v) {
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+inline __m128 splat(__m128 v, int i) {
+  switch (i) {
+  case 0:
+    return swizzle<0, 0, 0, 0>(v);
+  case 1:
+    return swizzle<1, 1, 1, 1>(v);
+  case 2:
+    return swizzle<2, 2, 2, 2>(v);
+  default:
+    return swizzle<3, 3, 3, 3>(v);
+  }
+}
+
+/**
+ * Sum of all four lanes in every lane.
+ */
+inline __m128 hsum(__m128 v) {
+  v = _mm_add_ps(v, swizzle<1, 0, 3, 2>(v));
+  return _mm_add_ps(v, swizzle<2, 3, 0, 1>(v));
+}
+
+/**
+ * (a * b.yzx - a.yzx * b).yzx, three shuffles instead of four. The w lane
+ * of the result is zero.
+ */
+inline __m128 cross(__m128 a, __m128 b) {
+  const __m128 a_yzx = swizzle<1, 2, 0, 3>(a);
+  const __m128 b_yzx = swizzle<1, 2, 0, 3>(b);
+  const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+  return swizzle<1, 2, 0, 3>(c);
+}
+
+inline __m128 xyz_mask() {
+  return _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+}
+
+inline __m128 combine(const mat4 &m, __m128 v) {
+  __m128 res = _mm_mul_ps(m.col[0], splat(v, 0));
+  res = _mm_add_ps(res, _mm_mul_ps(m.col[1], splat(v, 1)));
+  res = _mm_add_ps(res, _mm_mul_ps(m.col[2], splat(v, 2)));
+  return _mm_add_ps(res, _mm_mul_ps(m.col[3], splat(v, 3)));
+}
+} // namespace internal
+
+inline vec4 load(const glm::vec4 &v) { return {_mm_loadu_ps(&v.x)}; }
+inline vec3 load(const glm::vec3 &v) {
+  return {_mm_setr_ps(v.x, v.y, v.z, 0.0f)};
+}
+inline quat load(const glm::quat &q) { return {_mm_loadu_ps(&q.x)}; }
+inline mat4 load(const glm::mat4 &m) {
+  return {{_mm_loadu_ps(&m[0][0]), _mm_loadu_ps(&m[1][0]),
+           _mm_loadu_ps(&m[2][0]), _mm_loadu_ps(&m[3][0])}};
+}
+
+inline glm::vec4 to_glm(vec4 v) {
+  glm::vec4 res;
+  _mm_storeu_ps(&res.x, v.v);
+  return res;
+}
+
+inline glm::vec3 to_glm(vec3 v) {
+  alignas(16) float f[4];
+  _mm_store_ps(f, v.v);
+  return glm::vec3(f[0], f[1], f[2]);
+}
+
+inline glm::quat to_glm(quat q) {
+  glm::quat res;
+  _mm_storeu_ps(&res.x, q.v);
+  return res;
+}
+
+inline glm::mat4 to_glm(const mat4 &m) {
+  glm::mat4 res;
+  for (int i = 0; i < 4; i++)
+    _mm_storeu_ps(&res[i][0], m.col[i]);
+  return res;
+}
+
+inline vec4 operator+(vec4 a, vec4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline vec4 operator-(vec4 a, vec4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline vec4 operator*(vec4 a, vec4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline vec4 operator*(vec4 a, float s) {
+  return {_mm_mul_ps(a.v, _mm_set1_ps(s))};
+}
+
+inline vec3 operator+(vec3 a, vec3 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline vec3 operator-(vec3 a, vec3 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline vec3 operator*(vec3 a, vec3 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline vec3 operator*(vec3 a, float s) {
+  return {_mm_mul_ps(a.v, _mm_set1_ps(s))};
+}
+
+inline float dot(vec4 a, vec4 b) {
+  return _mm_cvtss_f32(internal::hsum(_mm_mul_ps(a.v, b.v)));
+}
+
+inline float dot(vec3 a, vec3 b) {
+  return _mm_cvtss_f32(internal::hsum(_mm_mul_ps(a.v, b.v)));
+}
+
+inline vec3 cross(vec3 a, vec3 b) { return {internal::cross(a.v, b.v)}; }
+
+inline float length(vec4 v) { return sqrtf(dot(v, v)); }
+inline float length(vec3 v) { return sqrtf(dot(v, v)); }
+
+/**
+ * Exact square root and division, zero vectors give NaN like glm.
+ */
+inline vec4 normalize(vec4 v) {
+  const __m128 len = _mm_sqrt_ps(internal::hsum(_mm_mul_ps(v.v, v.v)));
+  return {_mm_div_ps(v.v, len)};
+}
+
+inline vec3 normalize(vec3 v) {
+  const __m128 len = _mm_sqrt_ps(internal::hsum(_mm_mul_ps(v.v, v.v)));
+  return {_mm_div_ps(v.v, len)};
+}
+
+inline vec4 operator*(const mat4 &m, vec4 v) {
+  return {internal::combine(m, v.v)};
+}
+
+inline mat4 operator*(const mat4 &a, const mat4 &b) {
+  return {{internal::combine(a, b.col[0]), internal::combine(a, b.col[1]),
+           internal::combine(a, b.col[2]), internal::combine(a, b.col[3])}};
+}
+
+inline mat4 transpose(const mat4 &m) {
+  mat4 res = m;
+  _MM_TRANSPOSE4_PS(res.col[0], res.col[1], res.col[2], res.col[3]);
+  return res;
+}
+
+/**
+ * Affine transforms, the point picks up the translation, the vector not.
+ */
+inline vec3 transform_point(const mat4 &m, vec3 p) {
+  __m128 res = _mm_mul_ps(m.col[0], internal::splat(p.v, 0));
+  res = _mm_add_ps(res, _mm_mul_ps(m.col[1], internal::splat(p.v, 1)));
+  res = _mm_add_ps(res, _mm_mul_ps(m.col[2], internal::splat(p.v, 2)));
+  res = _mm_add_ps(res, m.col[3]);
+  return {_mm_and_ps(res, internal::xyz_mask())};
+}
+
+inline vec3 transform_vector(const mat4 &m, vec3 v) {
+  __m128 res = _mm_mul_ps(m.col[0], internal::splat(v.v, 0));
+  res = _mm_add_ps(res, _mm_mul_ps(m.col[1], internal::splat(v.v, 1)));
+  res = _mm_add_ps(res, _mm_mul_ps(m.col[2], internal::splat(v.v, 2)));
+  return {_mm_and_ps(res, internal::xyz_mask())};
+}
+
+/**
+ * Hamilton product, a applied after b.
+ */
+inline quat operator*(quat a, quat b) {
+  const __m128 aw = internal::splat(a.v, 3);
+  const __m128 bw = internal::splat(b.v, 3);
+  // xyz = aw * b.xyz + bw * a.xyz + cross(a.xyz, b.xyz)
+  __m128 xyz = _mm_add_ps(_mm_mul_ps(aw, b.v), _mm_mul_ps(bw, a.v));
+  xyz = _mm_add_ps(xyz, internal::cross(a.v, b.v));
+  // w = aw * bw - dot(a.xyz, b.xyz)
+  const __m128 mask = internal::xyz_mask();
+  const __m128 d = internal::hsum(_mm_and_ps(_mm_mul_ps(a.v, b.v), mask));
+  const __m128 w = _mm_sub_ps(_mm_mul_ps(aw, bw), d);
+  return {_mm_or_ps(_mm_and_ps(mask, xyz), _mm_andnot_ps(mask, w))};
+}
+
+inline quat conjugate(quat q) {
+  return {_mm_xor_ps(q.v, _mm_setr_ps(-0.0f, -0.0f, -0.0f, 0.0f))};
+}
+
+inline quat normalize(quat q) {
+  const __m128 len = _mm_sqrt_ps(internal::hsum(_mm_mul_ps(q.v, q.v)));
+  return {_mm_div_ps(q.v, len)};
+}
+
+/**
+ * v + 2w (q x v) + 2 q x (q x v) for a unit quaternion.
+ */
+inline vec3 rotate(quat q, vec3 v) {
+  const __m128 qxyz = _mm_and_ps(q.v, internal::xyz_mask());
+  const __m128 t = internal::cross(qxyz, v.v);
+  const __m128 t2 = _mm_add_ps(t, t);
+  const __m128 w = internal::splat(q.v, 3);
+  __m128 res = _mm_add_ps(v.v, _mm_mul_ps(w, t2));
+  return {_mm_add_ps(res, internal::cross(qxyz, t2))};
+}
+
+/**
+ * out = m * (x, y, z, 1) for every point, m has to be affine. Output
+ * streams may alias the input ones.
+ */
+void transform_points(const glm::mat4 &m, const float *x, const float *y,
+                      const float *z, float *out_x, float *out_y,
+                      float *out_z, size_t count);
+
+/**
+ * out[i] = a[i] * b[i], out may alias a or b.
+ */
+void compose(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out,
+             size_t count);
+
+/**
+ * Normalizes the vectors in place, zero vectors become NaN like glm.
+ */
+void normalize(float *x, float *y, float *z, size_t count);
+
+} // namespace simd
+} // namespace common
+
+#endif // SIMD_H
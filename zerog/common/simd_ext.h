@@ -0,0 +1,66 @@
+#ifndef SIMD_EXT_H
+#define SIMD_EXT_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <immintrin.h>
+
+#include "cpu.h"
+
+/**
+ * Vector extension types and helpers shared by the batch kernels. Kernels
+ * are written once with them and compiled per ISA through cpu_target, for
+ * AVX2 the 8 lanes fill a ymm register, otherwise they are split over two
+ * SSE2 registers. Only for translation units, never for interfaces; the
+ * ones that pass the types between kernels silence -Wpsabi themselves.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi" // Kernels are always inlined.
+
+namespace common {
+namespace internal {
+
+typedef float f32x4 __attribute__((vector_size(16)));
+typedef float f32x8 __attribute__((vector_size(32)));
+typedef int32_t i32x8 __attribute__((vector_size(32)));
+typedef uint32_t u32x8 __attribute__((vector_size(32)));
+typedef double f64x8 __attribute__((vector_size(64)));
+
+cpu_inline i32x8 as_int(f32x8 v) { return (i32x8)v; }
+cpu_inline f32x8 as_float(i32x8 v) { return (f32x8)v; }
+
+cpu_inline f32x8 splat(float f) { return f32x8{} + f; }
+
+cpu_inline f32x8 abs(f32x8 x) { return as_float(as_int(x) & 0x7fffffff); }
+
+/**
+ * Round to nearest even for |x| < 2^22 by pushing the fraction out of the
+ * mantissa.
+ */
+cpu_inline f32x8 round_nearest(f32x8 x) {
+  const float magic = 12582912.0f;
+  return (x + magic) - magic;
+}
+
+/**
+ * Vector extensions have no square root, SSE is there on every build.
+ */
+cpu_inline f32x8 sqrt(f32x8 x) {
+  f32x4 lo;
+  f32x4 hi;
+  memcpy(&lo, &x, sizeof(lo));
+  memcpy(&hi, reinterpret_cast<const char *>(&x) + 16, sizeof(hi));
+  lo = _mm_sqrt_ps(lo);
+  hi = _mm_sqrt_ps(hi);
+  memcpy(&x, &lo, sizeof(lo));
+  memcpy(reinterpret_cast<char *>(&x) + 16, &hi, sizeof(hi));
+  return x;
+}
+
+} // namespace internal
+} // namespace common
+
+#pragma GCC diagnostic pop
+
+#endif // SIMD_EXT_H
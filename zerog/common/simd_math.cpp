@@ -0,0 +1,445 @@
+#include "simd_math.h"
+
+#include "cpu.h"
+#include "simd_ext.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <immintrin.h>
+
+namespace common {
+namespace simd {
+namespace internal {
+
+// Kernels are built on simd_ext.h for AVX2 and SSE2. Both builds run the
+// same operations in the same order and give identical results.
+using namespace common::internal;
+#pragma GCC diagnostic ignored "-Wpsabi" // Kernels are always inlined.
+
+template <size_t N> cpu_inline f32x8 horner(f32x8 x, const float (&c)[N]) {
+  f32x8 res = splat(c[N - 1]);
+  for (size_t i = N - 1; i-- > 0;)
+    res = res * x + c[i];
+  return res;
+}
+
+// Minimax fits for the relative error, precise ones reach about 28 bits.
+constexpr float sin_precise[]{-1.666665461e-1f, 8.332160762e-3f,
+                              -1.951528322e-4f};
+constexpr float sin_fast[]{-1.666339038e-1f, 8.163281926e-3f};
+constexpr float cos_precise[]{-4.999999969e-1f, 4.166662036e-2f,
+                              -1.388668165e-3f, 2.438356738e-5f};
+constexpr float cos_fast[]{-4.999988475e-1f, 4.165577704e-2f,
+                           -1.359185357e-3f};
+constexpr float atan_precise[]{-3.333294914e-1f, 1.997771003e-1f,
+                               -1.387767877e-1f, 8.053722801e-2f};
+constexpr float atan_fast[]{-3.332550779e-1f, 1.971414375e-1f,
+                            -1.122516296e-1f};
+constexpr float exp_precise[]{4.999999345e-1f, 1.666652069e-1f,
+                              4.166838736e-2f, 8.368709832e-3f,
+                              1.381461309e-3f};
+constexpr float exp_fast[]{5.000511603e-1f, 1.675351393e-1f,
+                           4.127774709e-2f};
+constexpr float log_precise[]{3.333333171e-1f, -2.500082103e-1f,
+                              2.000122688e-1f, -1.662335734e-1f,
+                              1.420175800e-1f, -1.316018240e-1f,
+                              1.276157704e-1f, -7.634496528e-2f};
+constexpr float log_fast[]{3.332086087e-1f, -2.494383275e-1f,
+                           2.044218801e-1f, -1.840718965e-1f,
+                           1.178189582e-1f};
+
+/**
+ * x = k pi/2 + r with |r| <= pi/4. The precise path reduces in double,
+ * which stays exact for |k| < 2^20, the fast one with a three part pi/2
+ * in float.
+ */
+template <bool Fast>
+cpu_inline void reduce_quadrant(f32x8 x, f32x8 *r, i32x8 *k) {
+  if (Fast) {
+    const f32x8 kf = round_nearest(x * 0.636619772f);
+    *r = ((x - kf * 1.5703125f) - kf * 4.837512969970703125e-4f) -
+         kf * 7.54978995489188216e-8f;
+    *k = __builtin_convertvector(kf, i32x8);
+  } else {
+    const f64x8 xd = __builtin_convertvector(x, f64x8);
+    const double magic = 6755399441055744.0;
+    const f64x8 kd = (xd * 0.63661977236758134 + magic) - magic;
+    const f64x8 rd =
+        (xd - kd * 1.57079632673412561417) - kd * 6.07710050650619224932e-11;
+    *r = __builtin_convertvector(rd, f32x8);
+    *k = __builtin_convertvector(kd, i32x8);
+  }
+}
+
+/**
+ * sin on the reduced argument for even quadrants, cos for odd ones, the
+ * sign flips in the upper two.
+ */
+template <bool Fast> cpu_inline f32x8 sin_quadrant(f32x8 r, i32x8 k) {
+  const f32x8 z = r * r;
+  const f32x8 s =
+      r + r * z * (Fast ? horner(z, sin_fast) : horner(z, sin_precise));
+  const f32x8 c =
+      1.0f + z * (Fast ? horner(z, cos_fast) : horner(z, cos_precise));
+  const f32x8 res = (k & 1) ? c : s;
+  return as_float(as_int(res) ^ ((k & 2) << 30));
+}
+
+template <bool Fast> struct sin_op {
+  cpu_inline f32x8 run(f32x8 x) {
+    f32x8 r;
+    i32x8 k;
+    reduce_quadrant<Fast>(x, &r, &k);
+    return sin_quadrant<Fast>(r, k);
+  }
+};
+
+template <bool Fast> struct cos_op {
+  cpu_inline f32x8 run(f32x8 x) {
+    f32x8 r;
+    i32x8 k;
+    reduce_quadrant<Fast>(x, &r, &k);
+    return sin_quadrant<Fast>(r, k + 1);
+  }
+};
+
+/**
+ * Octant reduction: the smaller of |x|, |y| over the larger gives t in
+ * [0, 1], above tan(pi/8) atan(t) = pi/4 + atan((t - 1) / (t + 1)).
+ */
+template <bool Fast> struct atan2_op {
+  cpu_inline f32x8 run(f32x8 y, f32x8 x) {
+    const i32x8 abs_mask = i32x8{} + 0x7fffffff;
+    const f32x8 ax = as_float(as_int(x) & abs_mask);
+    const f32x8 ay = as_float(as_int(y) & abs_mask);
+    const i32x8 swap = ay > ax;
+    const f32x8 num = swap ? ax : ay;
+    const f32x8 den = swap ? ay : ax;
+    // 0 / 0 gives 0 and inf / inf gives 1 like libm.
+    f32x8 t = num == den ? splat(1.0f) : num / den;
+    t = den == 0.0f ? splat(0.0f) : t;
+
+    const i32x8 upper = t > 0.414213562f;
+    t = upper ? (t - 1.0f) / (t + 1.0f) : t;
+    const f32x8 z = t * t;
+    f32x8 a =
+        t + t * z * (Fast ? horner(z, atan_fast) : horner(z, atan_precise));
+    // The quadrant offsets are split in two floats to keep the last bit.
+    a = upper ? (a + -2.18556941e-8f) + 0.785398185f : a;
+    a = swap ? (1.57079637f - a) + -4.37113883e-8f : a;
+    a = as_int(x) < 0 ? (3.14159274f - a) + -8.74227766e-8f : a;
+    return as_float(as_int(a) | (as_int(y) & ~abs_mask));
+  }
+};
+
+/**
+ * exp(x) = 2^n exp(r) with r = x - n ln2 in [-ln2/2, ln2/2]. 2^n is
+ * applied as two factors so n = 128 and n = -126 stay representable.
+ */
+template <bool Fast> struct exp_op {
+  cpu_inline f32x8 run(f32x8 x) {
+    const f32x8 nf = round_nearest(x * 1.442695041f);
+    const f32x8 r = (x - nf * 0.693359375f) - nf * -2.12194440e-4f;
+    const f32x8 p = 1.0f + r + r * r * (Fast ? horner(r, exp_fast)
+                                             : horner(r, exp_precise));
+
+    const i32x8 n = __builtin_convertvector(nf, i32x8);
+    const i32x8 n1 = n >> 1;
+    const f32x8 s1 = as_float((n1 + 127) << 23);
+    const f32x8 s2 = as_float((n - n1 + 127) << 23);
+    const f32x8 res = p * s1 * s2;
+
+    const f32x8 inf = splat(__builtin_inff());
+    return x > 88.7228394f ? inf : (x < -87.3365479f ? splat(0.0f) : res);
+  }
+};
+
+/**
+ * x = m 2^e with m in [sqrt(1/2), sqrt(2)), log(x) = e ln2 + log1p(m - 1).
+ * Denormals are scaled into the normal range first.
+ */
+template <bool Fast> struct log_op {
+  cpu_inline f32x8 run(f32x8 x) {
+    const i32x8 tiny = x < 1.17549435e-38f;
+    const f32x8 xs = tiny ? x * 8388608.0f : x;
+    const i32x8 bits = as_int(xs);
+    i32x8 e = (bits >> 23) - 127 + (tiny & -23);
+    f32x8 m = as_float((bits & 0x7fffff) | 0x3f800000);
+    const i32x8 high = m > 1.414213562f;
+    m = high ? m * 0.5f : m;
+    e = e - high;
+
+    const f32x8 f = m - 1.0f;
+    const f32x8 ef = __builtin_convertvector(e, f32x8);
+    const f32x8 p =
+        f * f * f * (Fast ? horner(f, log_fast) : horner(f, log_precise));
+    f32x8 res = (p - 0.5f * f * f + ef * -2.12194440e-4f) + f;
+    res = res + ef * 0.693359375f;
+
+    const f32x8 inf = splat(__builtin_inff());
+    res = x == inf ? inf : res;
+    res = x == 0.0f ? -inf : res;
+    return (x < 0.0f) | (x != x) ? splat(__builtin_nanf("")) : res;
+  }
+};
+
+/**
+ * Runs whole vectors, then the tail through one zero padded vector.
+ */
+template <typename Op>
+cpu_inline void unary(const float *in, float *out, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    f32x8 v;
+    memcpy(&v, in + i, sizeof(v));
+    v = Op::run(v);
+    memcpy(out + i, &v, sizeof(v));
+  }
+  if (i < count) {
+    f32x8 v{};
+    memcpy(&v, in + i, (count - i) * sizeof(float));
+    v = Op::run(v);
+    memcpy(out + i, &v, (count - i) * sizeof(float));
+  }
+}
+
+template <typename Op>
+cpu_inline void binary(const float *a, const float *b, float *out,
+                       size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    f32x8 va;
+    f32x8 vb;
+    memcpy(&va, a + i, sizeof(va));
+    memcpy(&vb, b + i, sizeof(vb));
+    va = Op::run(va, vb);
+    memcpy(out + i, &va, sizeof(va));
+  }
+  if (i < count) {
+    f32x8 va{};
+    f32x8 vb{};
+    memcpy(&va, a + i, (count - i) * sizeof(float));
+    memcpy(&vb, b + i, (count - i) * sizeof(float));
+    va = Op::run(va, vb);
+    memcpy(out + i, &va, (count - i) * sizeof(float));
+  }
+}
+
+typedef void (*unary_fn)(const float *in, float *out, size_t count);
+typedef void (*binary_fn)(const float *a, const float *b, float *out,
+                          size_t count);
+
+template <typename Op>
+static void unary_generic(const float *in, float *out, size_t count) {
+  unary<Op>(in, out, count);
+}
+
+template <typename Op>
+cpu_target("avx2") static void unary_avx2(const float *in, float *out,
+                                          size_t count) {
+  unary<Op>(in, out, count);
+}
+
+template <typename Op>
+static void binary_generic(const float *a, const float *b, float *out,
+                           size_t count) {
+  binary<Op>(a, b, out, count);
+}
+
+template <typename Op>
+cpu_target("avx2") static void binary_avx2(const float *a, const float *b,
+                                           float *out, size_t count) {
+  binary<Op>(a, b, out, count);
+}
+
+template <typename Op>
+static void run_unary(const float *in, float *out, size_t count) {
+  static const cpu_variant<unary_fn> variants[]{
+      {CPU_AVX2, unary_avx2<Op>},
+      {0, unary_generic<Op>},
+  };
+  static cpu_dispatch<unary_fn> fn{variants};
+  fn(in, out, count);
+}
+
+template <typename Op>
+static void run_binary(const float *a, const float *b, float *out,
+                       size_t count) {
+  static const cpu_variant<binary_fn> variants[]{
+      {CPU_AVX2, binary_avx2<Op>},
+      {0, binary_generic<Op>},
+  };
+  static cpu_dispatch<binary_fn> fn{variants};
+  fn(a, b, out, count);
+}
+
+/**
+ * Vector extensions have no square root, so rsqrt is written per ISA.
+ * The Newton step is skipped for 0 and inf, where it would give NaN.
+ */
+static void rsqrt_sse2(const float *in, float *out, size_t count,
+                       bool fast) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 x = _mm_loadu_ps(in + i);
+    __m128 y;
+    if (fast) {
+      const __m128 e = _mm_rsqrt_ps(x);
+      const __m128 h = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), e);
+      y = _mm_mul_ps(e, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(h, e)));
+      const __m128 keep =
+          _mm_or_ps(_mm_cmpeq_ps(x, _mm_setzero_ps()),
+                    _mm_cmpeq_ps(x, _mm_set1_ps(__builtin_inff())));
+      y = _mm_or_ps(_mm_and_ps(keep, e), _mm_andnot_ps(keep, y));
+    } else {
+      y = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(x));
+    }
+    _mm_storeu_ps(out + i, y);
+  }
+  if (i < count) {
+    float pad[4]{1.0f, 1.0f, 1.0f, 1.0f};
+    memcpy(pad, in + i, (count - i) * sizeof(float));
+    rsqrt_sse2(pad, pad, 4, fast);
+    memcpy(out + i, pad, (count - i) * sizeof(float));
+  }
+}
+
+cpu_target("avx") static void rsqrt_avx(const float *in, float *out,
+                                        size_t count, bool fast) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 x = _mm256_loadu_ps(in + i);
+    __m256 y;
+    if (fast) {
+      const __m256 e = _mm256_rsqrt_ps(x);
+      const __m256 h =
+          _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), x), e);
+      y = _mm256_mul_ps(
+          e, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(h, e)));
+      const __m256 keep = _mm256_or_ps(
+          _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_EQ_OQ),
+          _mm256_cmp_ps(x, _mm256_set1_ps(__builtin_inff()), _CMP_EQ_OQ));
+      y = _mm256_or_ps(_mm256_and_ps(keep, e), _mm256_andnot_ps(keep, y));
+    } else {
+      y = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(x));
+    }
+    _mm256_storeu_ps(out + i, y);
+  }
+  rsqrt_sse2(in + i, out + i, count - i, fast);
+}
+
+typedef void (*rsqrt_fn)(const float *in, float *out, size_t count,
+                         bool fast);
+
+static const cpu_variant<rsqrt_fn> rsqrt_variants[]{
+    {CPU_AVX, rsqrt_avx},
+    {0, rsqrt_sse2},
+};
+
+/**
+ * Whether any of the count floats at p has a magnitude above limit.
+ */
+static bool beyond(const float *p, size_t count, float limit) {
+  // SSE2 directly, the 8 lane compare spills its mask when not inlined.
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 bound = _mm_set1_ps(limit);
+  __m128 outside = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 x = _mm_and_ps(_mm_loadu_ps(p + i), abs_mask);
+    outside = _mm_or_ps(outside, _mm_cmpgt_ps(x, bound));
+  }
+  bool res = _mm_movemask_ps(outside) != 0;
+  for (; i < count; i++)
+    res |= std::fabs(p[i]) > limit;
+  return res;
+}
+
+/**
+ * sin and cos keep the vector kernels to their documented domain, other
+ * elements are redone with libm in double. Reducing huge arguments
+ * exactly takes hundreds of bits of pi, which is not worth vectorizing
+ * for inputs this rare. Blocks are small enough to copy the inputs of an
+ * in place call before the kernel overwrites them.
+ */
+template <typename Op>
+static void trig(const float *in, float *out, size_t count, float limit,
+                 double (*ref)(double)) {
+  constexpr size_t block{256};
+  for (size_t i = 0; i < count; i += block) {
+    const size_t n = count - i < block ? count - i : block;
+    if (!beyond(in + i, n, limit)) {
+      run_unary<Op>(in + i, out + i, n);
+      continue;
+    }
+    float x[block];
+    memcpy(x, in + i, n * sizeof(float));
+    run_unary<Op>(x, out + i, n);
+    for (size_t j = 0; j < n; j++) {
+      if (std::fabs(x[j]) > limit)
+        out[i + j] = static_cast<float>(ref(static_cast<double>(x[j])));
+    }
+  }
+}
+
+static double sin_ref(double x) { return std::sin(x); }
+static double cos_ref(double x) { return std::cos(x); }
+
+} // namespace internal
+
+void sin(const float *in, float *out, size_t count,
+         math_precision precision) {
+  using namespace internal;
+  if (precision == MATH_FAST)
+    trig<sin_op<true>>(in, out, count, 1e4f, sin_ref);
+  else
+    trig<sin_op<false>>(in, out, count, 1e6f, sin_ref);
+}
+
+void cos(const float *in, float *out, size_t count,
+         math_precision precision) {
+  using namespace internal;
+  if (precision == MATH_FAST)
+    trig<cos_op<true>>(in, out, count, 1e4f, cos_ref);
+  else
+    trig<cos_op<false>>(in, out, count, 1e6f, cos_ref);
+}
+
+void atan2(const float *y, const float *x, float *out, size_t count,
+           math_precision precision) {
+  using namespace internal;
+  if (precision == MATH_FAST)
+    run_binary<atan2_op<true>>(y, x, out, count);
+  else
+    run_binary<atan2_op<false>>(y, x, out, count);
+}
+
+void exp(const float *in, float *out, size_t count,
+         math_precision precision) {
+  using namespace internal;
+  if (precision == MATH_FAST)
+    run_unary<exp_op<true>>(in, out, count);
+  else
+    run_unary<exp_op<false>>(in, out, count);
+}
+
+void log(const float *in, float *out, size_t count,
+         math_precision precision) {
+  using namespace internal;
+  if (precision == MATH_FAST)
+    run_unary<log_op<true>>(in, out, count);
+  else
+    run_unary<log_op<false>>(in, out, count);
+}
+
+void rsqrt(const float *in, float *out, size_t count,
+           math_precision precision) {
+  using namespace internal;
+  static cpu_dispatch<rsqrt_fn> fn{rsqrt_variants};
+  fn(in, out, count, precision == MATH_FAST);
+}
+
+} // namespace simd
+} // namespace common
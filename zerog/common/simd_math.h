@@ -0,0 +1,51 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <stddef.h>
+
+/**
+ * Batch versions of the libm functions the animation, particle and light
+ * loops spend their time in. Each takes count floats and writes count
+ * results, out may alias the input. Errors are the largest seen against
+ * a double precision reference, in units in the last place of the float
+ * result, over the domain given or all finite inputs:
+ *
+ *                precise                 fast
+ *   sin, cos     2 ulp, |x| <= 1e6       26 ulp, |x| <= 1e4
+ *   atan2        3 ulp                   12 ulp
+ *   exp          2 ulp                   70 ulp
+ *   log          1 ulp                   25 ulp
+ *   rsqrt        2 ulp                   4 ulp
+ *
+ * sin and cos compute elements outside their domain with libm in double,
+ * accurate but far slower. exp flushes results below FLT_MIN to zero and
+ * fast rsqrt treats denormal inputs as zero, otherwise zeros, infinities
+ * and NaN give what libm gives.
+ */
+namespace common {
+namespace simd {
+
+enum math_precision { MATH_PRECISE, MATH_FAST };
+
+void sin(const float *in, float *out, size_t count,
+         math_precision precision = MATH_PRECISE);
+void cos(const float *in, float *out, size_t count,
+         math_precision precision = MATH_PRECISE);
+void atan2(const float *y, const float *x, float *out, size_t count,
+           math_precision precision = MATH_PRECISE);
+void exp(const float *in, float *out, size_t count,
+         math_precision precision = MATH_PRECISE);
+void log(const float *in, float *out, size_t count,
+         math_precision precision = MATH_PRECISE);
+
+/**
+ * 1 / sqrt(x), the fast version is the hardware estimate refined with one
+ * Newton step.
+ */
+void rsqrt(const float *in, float *out, size_t count,
+           math_precision precision = MATH_PRECISE);
+
+} // namespace simd
+} // namespace common
+
+#endif // SIMD_MATH_H
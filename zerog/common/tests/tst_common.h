@@ -2,6 +2,32 @@
 #include <gtest/gtest.h>
 
 #include "common/bitop.h"
+#include "common/bitset.h"
+#include "common/cpu.h"
+#include "common/hash.h"
+#include "common/hash64.h"
+#include "common/id_set.h"
+#include "common/log.h"
+#include "common/metrics.h"
+#include "common/perf_counters.h"
+#include "common/perfect_hash.h"
+#include "common/profiler.h"
+#include "common/simd.h"
+#include "common/simd_math.h"
+#include "common/vertex_pack.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
 
 using namespace testing;
 
@@ -115,3 +141,1346 @@ TEST(bitop, multi_set_overflow_size) {
 }
 
 #endif
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static bool naive_test(const std::vector<uint64_t> &words, size_t i) {
+  return (words[i / 64] >> (i & 63)) & 1ul;
+}
+
+TEST(bitset, set_and_unset_ranges) {
+  std::vector<uint64_t> words(4);
+  set_bits(words.data(), 3, 200);
+  for (size_t i = 0; i < 256; i++)
+    EXPECT_EQ(naive_test(words, i), i >= 3 && i < 203);
+  unset_bits(words.data(), 60, 70);
+  for (size_t i = 0; i < 256; i++) {
+    const bool expected = (i >= 3 && i < 60) || (i >= 130 && i < 203);
+    EXPECT_EQ(naive_test(words, i), expected);
+  }
+  set_bits(words.data(), 64, 64);
+  EXPECT_EQ(words[1], ~0ul);
+  unset_bits(words.data(), 0, 256);
+  EXPECT_EQ(count_bits(words.data(), 256), 0);
+}
+
+TEST(bitset, queries_match_naive_scan) {
+  uint64_t state = 0x9e3779b97f4a7c15ul;
+  const size_t sizes[] = {1, 63, 64, 65, 300, 1000, 4099, 20000};
+  for (size_t bit_count : sizes) {
+    for (int density = 0; density < 4; density++) {
+      std::vector<uint64_t> words(bit_words(bit_count));
+      for (uint64_t &w : words) {
+        w = next_random(&state);
+        for (int d = 0; d < density; d++)
+          w |= next_random(&state);
+      }
+
+      size_t set = 0;
+      for (size_t i = 0; i < bit_count; i++)
+        set += naive_test(words, i);
+      ASSERT_EQ(count_bits(words.data(), bit_count), set);
+
+      size_t rank = 0;
+      for (size_t i = 0; i < bit_count; i++) {
+        ASSERT_EQ(rank_bits(words.data(), i), rank);
+        if (naive_test(words, i)) {
+          ASSERT_EQ(select_bit(words.data(), bit_count, rank), i);
+          rank++;
+        }
+      }
+      ASSERT_EQ(select_bit(words.data(), bit_count, rank), no_bit);
+
+      for (size_t from = 0; from < bit_count; from += 7) {
+        size_t next_set = no_bit;
+        size_t next_unset = no_bit;
+        for (size_t i = bit_count; i-- > from;) {
+          if (naive_test(words, i))
+            next_set = i;
+          else
+            next_unset = i;
+        }
+        ASSERT_EQ(find_set_bit(words.data(), bit_count, from), next_set);
+        ASSERT_EQ(find_unset_bit(words.data(), bit_count, from), next_unset);
+      }
+    }
+  }
+}
+
+TEST(bitset, zero_runs_cross_words) {
+  uint64_t state = 0x2545f4914f6cdd1dul;
+  const size_t bit_count = 1000;
+  const size_t lengths[] = {1, 2, 5, 17, 63, 64, 65, 130};
+  for (int round = 0; round < 50; round++) {
+    std::vector<uint64_t> words(bit_words(bit_count), ~0ul);
+    // Punch a few holes of random length.
+    for (int h = 0; h < 6; h++) {
+      const size_t first = next_random(&state) % bit_count;
+      size_t len = next_random(&state) % 150;
+      if (first + len > bit_count)
+        len = bit_count - first;
+      unset_bits(words.data(), first, len);
+    }
+
+    for (size_t len : lengths) {
+      size_t expected = no_bit;
+      size_t run = 0;
+      for (size_t i = 0; i < bit_count; i++) {
+        run = naive_test(words, i) ? 0 : run + 1;
+        if (run == len) {
+          expected = i + 1 - len;
+          break;
+        }
+      }
+      ASSERT_EQ(find_unset_bits(words.data(), bit_count, len), expected)
+          << "round " << round << " len " << len;
+    }
+  }
+}
+
+TEST(bitset, searches_ignore_bits_past_the_end) {
+  std::vector<uint64_t> words{0ul, ~0ul << 10};
+  EXPECT_EQ(find_set_bit(words.data(), 74, 0), no_bit);
+  EXPECT_EQ(count_bits(words.data(), 74), 0);
+  words[1] = 0;
+  EXPECT_EQ(find_unset_bits(words.data(), 74, 74), 0);
+  EXPECT_EQ(find_unset_bits(words.data(), 74, 75), no_bit);
+  words[0] = ~0ul;
+  EXPECT_EQ(find_unset_bit(words.data(), 74, 0), 64);
+  EXPECT_EQ(find_unset_bits(words.data(), 74, 10), 64);
+  EXPECT_EQ(find_unset_bits(words.data(), 74, 11), no_bit);
+}
+
+TEST(bitop, find_mask_bits_matches_window_scan) {
+  uint64_t state = 0x853c49e6748fea9bul;
+  for (int round = 0; round < 2000; round++) {
+    uint64_t mask = next_random(&state);
+    for (int d = round % 4; d > 0; d--)
+      mask &= next_random(&state);
+    for (int32_t len = 1; len <= 64; len++) {
+      int32_t expected = -1;
+      for (int32_t i = 0; i + len <= 64; i++) {
+        const uint64_t window = len == 64 ? ~0ul : ((1ul << len) - 1) << i;
+        if (!(mask & window)) {
+          expected = i;
+          break;
+        }
+      }
+      ASSERT_EQ(find_mask_bits(mask, len), expected)
+          << std::hex << mask << std::dec << " len " << len;
+    }
+  }
+  EXPECT_EQ(find_mask_bits(0, 64), 0);
+  EXPECT_EQ(find_mask_bits(1ul << 63, 63), 0);
+  EXPECT_EQ(find_mask_bits(1, 63), 1);
+  EXPECT_EQ(find_mask_bits(~0ul, 1), -1);
+}
+
+static uint32_t naive_crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = ~0u;
+  for (size_t i = 0; i < length; i++)
+    crc = (crc >> 8) ^ common::internal::crc_table[(crc ^ data[i]) & 0xff];
+  return ~crc;
+}
+
+TEST(hash, runtime_hash_matches_literals) {
+  EXPECT_EQ(common::runtime_hash(""), ""_h);
+  EXPECT_EQ(common::runtime_hash("VK_KHR_swapchain"), "VK_KHR_swapchain"_h);
+  EXPECT_EQ(common::runtime_hash("The quick brown fox jumps over the lazy "
+                                 "dog, then does it again and again."),
+            "The quick brown fox jumps over the lazy dog, then does it again "
+            "and again."_h);
+  EXPECT_EQ(common::runtime_hash("123456789"), 0xcbf43926);
+}
+
+TEST(hash, runtime_hash_every_length_and_offset) {
+  uint64_t state = 0x1234567887654321ul;
+  std::vector<uint8_t> data(4096 + 16);
+  for (uint8_t &b : data)
+    b = static_cast<uint8_t>(next_random(&state));
+
+  for (size_t offset = 0; offset < 16; offset += 5) {
+    for (size_t length = 0; length < 300; length++) {
+      ASSERT_EQ(common::runtime_hash(data.data() + offset, length),
+                naive_crc32(data.data() + offset, length))
+          << "offset " << offset << " length " << length;
+    }
+  }
+  ASSERT_EQ(common::runtime_hash(data.data() + 3, 4096),
+            naive_crc32(data.data() + 3, 4096));
+}
+
+TEST(hash, pclmul_matches_slicing) {
+  if (!common::internal::crc32_has_pclmul())
+    return;
+  uint64_t state = 0xdeadbeefcafef00dul;
+  std::vector<uint8_t> data(1 << 16);
+  for (uint8_t &b : data)
+    b = static_cast<uint8_t>(next_random(&state));
+  for (size_t length = 64; length <= data.size(); length = length * 2 + 16) {
+    ASSERT_EQ(common::internal::crc32_update_pclmul(0x5a5a5a5a, data.data(),
+                                                    length),
+              common::internal::crc32_update_slice8(0x5a5a5a5a, data.data(),
+                                                    length))
+        << "length " << length;
+  }
+}
+
+declare_id_set(test_semantics, "position", "normal", "tangent", "uv0");
+
+TEST(id_set, ids_are_compile_time_hashes) {
+  static_assert(test_semantics.size() == 4, "");
+  static_assert(test_semantics[1] == "normal"_h, "");
+  static_assert(test_semantics.index_of("uv0"_h) == 3, "");
+  static_assert(!test_semantics.contains("color"_h), "");
+
+  uint32_t id = common::runtime_hash("tangent");
+  switch (id) {
+  case test_semantics[2]:
+    break;
+  default:
+    ADD_FAILURE() << "tangent did not match its case";
+  }
+  EXPECT_STREQ(test_semantics.names[test_semantics.index_of(id)], "tangent");
+}
+
+TEST(id_set, collisions_and_duplicates_are_found) {
+  // Both strings have the crc32 0x4ddb0c25.
+  constexpr const char *colliding[]{"position", "plumless", "buckeroo"};
+  static_assert(common::make_id_set(colliding).collides(), "");
+  static_assert(!common::make_id_set(colliding).has_duplicates(), "");
+
+  constexpr const char *twice[]{"normal", "uv0", "normal"};
+  static_assert(!common::make_id_set(twice).collides(), "");
+  static_assert(common::make_id_set(twice).has_duplicates(), "");
+}
+
+declare_perfect_hash(test_semantic_table, test_semantics);
+
+TEST(perfect_hash, finds_every_name_and_nothing_else) {
+  static_assert(test_semantic_table.index_of("normal"_h) == 1, "");
+  static_assert(!test_semantic_table.contains("color"_h), "");
+  EXPECT_EQ(test_semantic_table.slot_count(), 8u);
+
+  for (size_t i = 0; i < test_semantics.size(); i++)
+    EXPECT_EQ(test_semantic_table.find(test_semantics.names[i]),
+              static_cast<int32_t>(i));
+  EXPECT_EQ(test_semantic_table.find("uv1"), -1);
+  EXPECT_EQ(test_semantic_table.find(""), -1);
+}
+
+constexpr uint32_t test_keys[]{
+    3,    7,    12,   44,   45,   46,   100,  101,  129,  130,  131,
+    1000, 1001, 1002, 4096, 4097, 8191, 8192, 8193, 9999, 10000, 65535,
+    65536, 65537, 1u << 20, (1u << 20) + 1, 1u << 31, 0xffffffff};
+declare_perfect_hash(test_key_table, test_keys);
+
+TEST(perfect_hash, integer_keys) {
+  EXPECT_GE(test_key_table.slot_count(), 2 * test_key_table.size());
+  for (size_t i = 0; i < test_key_table.size(); i++)
+    EXPECT_EQ(test_key_table.index_of(test_keys[i]), static_cast<int32_t>(i));
+
+  size_t members = 0;
+  for (uint32_t key = 0; key <= 70000; key++)
+    members += test_key_table.contains(key);
+  EXPECT_EQ(members, 24u);
+  EXPECT_EQ(test_key_table.names[0], nullptr);
+}
+
+#ifndef NDEBUG
+TEST(perfect_hash, integer_keys_find_no_strings) {
+  EXPECT_DEATH(test_key_table.find("position"),
+               "Finding a string in a table of integer keys");
+}
+#endif
+
+TEST(hash64, literals_are_compile_time) {
+  constexpr uint64_t short_id = "materials/stone"_h64;
+  constexpr uint64_t long_id =
+      "shaders/deferred/lighting/clustered/point_lights_with_shadows_and_"
+      "volumetric_fog_and_screen_space_reflections_and_a_long_tail_to_pass_"
+      "the_one_hundred_and_twenty_eight_byte_limit.frag"_h64;
+  static_assert(short_id != long_id, "Literal ids differ");
+  EXPECT_EQ(short_id, common::runtime_hash64("materials/stone", 15));
+  EXPECT_EQ(common::hash64("materials/stone"), short_id);
+  EXPECT_NE("a"_h64, "b"_h64);
+  EXPECT_NE(""_h64, "\0"_h64);
+}
+
+TEST(hash64, runtime_matches_constexpr_reference) {
+  uint64_t state = 0x0123456789abcdeful;
+  std::vector<char> data(5000);
+  for (char &c : data)
+    c = static_cast<char>(next_random(&state));
+  for (size_t length = 0; length < 1200; length++) {
+    ASSERT_EQ(common::runtime_hash64(data.data() + 1, length),
+              common::hash64(data.data() + 1, length))
+        << "length " << length;
+  }
+  ASSERT_EQ(common::runtime_hash64(data.data(), data.size()),
+            common::hash64(data.data(), data.size()));
+}
+
+TEST(hash64, streaming_matches_one_shot) {
+  uint64_t state = 0xfeedfacecafebeeful;
+  std::vector<uint8_t> data(70000);
+  for (uint8_t &b : data)
+    b = static_cast<uint8_t>(next_random(&state));
+
+  const size_t lengths[] = {0, 5, 100, 128, 129, 200, 1024, 1100, 70000};
+  for (size_t length : lengths) {
+    const uint64_t expected = common::runtime_hash64(data.data(), length);
+    for (int round = 0; round < 20; round++) {
+      common::hash64_state h;
+      common::hash64_begin(&h);
+      size_t done = 0;
+      while (done < length) {
+        size_t piece = next_random(&state) % (round < 10 ? 9 : 300);
+        if (piece > length - done)
+          piece = length - done;
+        common::hash64_update(&h, data.data() + done, piece);
+        done += piece;
+      }
+      ASSERT_EQ(common::hash64_end(&h), expected)
+          << "length " << length << " round " << round;
+    }
+  }
+}
+
+TEST(hash64, small_changes_flip_half_the_bits) {
+  uint64_t state = 0x5555aaaa5555aaaaul;
+  const size_t lengths[] = {4, 16, 64, 256, 2048};
+  for (size_t length : lengths) {
+    std::vector<uint8_t> data(length);
+    for (uint8_t &b : data)
+      b = static_cast<uint8_t>(next_random(&state));
+    const uint64_t base = common::runtime_hash64(data.data(), length);
+    double flipped = 0;
+    for (size_t bit = 0; bit < length * 8; bit++) {
+      data[bit / 8] ^= static_cast<uint8_t>(1u << (bit & 7));
+      flipped += __builtin_popcountl(
+          base ^ common::runtime_hash64(data.data(), length));
+      data[bit / 8] ^= static_cast<uint8_t>(1u << (bit & 7));
+    }
+    const double average = flipped / static_cast<double>(length * 8);
+    EXPECT_GT(average, 28.0) << "length " << length;
+    EXPECT_LT(average, 36.0) << "length " << length;
+  }
+}
+
+/**
+ * Swaps size bytes at a and b and checks the hash changed, for short
+ * chunks, stripes within a block and stripes or blocks across blocks.
+ */
+TEST(hash64, swapped_chunks_and_stripes_differ) {
+  uint64_t state = 0x1234fedc5678ba98ul;
+  std::vector<uint8_t> data(1 << 20);
+  for (uint8_t &b : data)
+    b = static_cast<uint8_t>(next_random(&state));
+
+  struct swap {
+    size_t length, a, b, size;
+  };
+  const swap swaps[] = {{96, 0, 64, 16},        {128, 0, 16, 16},
+                        {128, 32, 96, 16},      {1100, 0, 1024, 64},
+                        {1 << 20, 0, 320, 64},  {1 << 20, 0, 960, 64},
+                        {1 << 20, 0, 1024, 64}, {1 << 20, 64, 5184, 64},
+                        {1 << 20, 0, 1024, 1024}};
+  for (const swap &s : swaps) {
+    const uint64_t base = common::runtime_hash64(data.data(), s.length);
+    std::swap_ranges(data.begin() + s.a, data.begin() + s.a + s.size,
+                     data.begin() + s.b);
+    EXPECT_NE(common::runtime_hash64(data.data(), s.length), base)
+        << s.length << " " << s.a << " " << s.b;
+    std::swap_ranges(data.begin() + s.a, data.begin() + s.a + s.size,
+                     data.begin() + s.b);
+  }
+}
+
+TEST(cpu, detection_is_consistent) {
+  const uint32_t detected = cpu_detected_features();
+  // Every x86_64 CPU has SSE2, wider sets imply the narrower ones.
+#if defined(__x86_64__)
+  EXPECT_TRUE(detected & CPU_SSE2);
+#endif
+  if (detected & CPU_AVX2) {
+    EXPECT_TRUE(detected & CPU_AVX);
+  }
+  if (detected & CPU_AVX512VL) {
+    EXPECT_TRUE(detected & CPU_AVX512F);
+  }
+  EXPECT_EQ(cpu_features(), detected);
+  EXPECT_STREQ(cpu_feature_name(CPU_AVX2), "avx2");
+}
+
+static uint32_t pick_scalar() { return 0; }
+static uint32_t pick_sse2() { return CPU_SSE2; }
+static uint32_t pick_avx2() { return CPU_AVX2; }
+
+TEST(cpu, dispatch_follows_restrictions) {
+  typedef uint32_t (*pick_fn)();
+  static const cpu_variant<pick_fn> variants[]{
+      {CPU_AVX2, pick_avx2}, {CPU_SSE2, pick_sse2}, {0, pick_scalar}};
+  cpu_dispatch<pick_fn> dispatch{variants};
+
+  const uint32_t detected = cpu_detected_features();
+  const uint32_t best = detected & CPU_AVX2   ? CPU_AVX2
+                        : detected & CPU_SSE2 ? CPU_SSE2
+                                              : 0;
+  EXPECT_EQ(dispatch(), best);
+  EXPECT_EQ(dispatch.features(), best);
+
+  cpu_restrict_features(CPU_SSE2);
+  EXPECT_EQ(dispatch(), detected & CPU_SSE2);
+  cpu_restrict_features(0);
+  EXPECT_EQ(dispatch(), 0u);
+  EXPECT_FALSE(cpu_has(CPU_SSE2));
+  cpu_restrict_features(~0u);
+  EXPECT_EQ(dispatch(), best);
+}
+
+/**
+ * Runs the dispatched kernels with features taken away one at a time, so
+ * every variant this machine can execute is checked against the others.
+ */
+TEST(cpu, every_variant_gives_the_same_results) {
+  uint64_t state = 0x0f1e2d3c4b5a6978ul;
+  std::vector<uint64_t> words(300);
+  for (uint64_t &w : words)
+    w = next_random(&state);
+  const char *bytes = reinterpret_cast<const char *>(words.data());
+  const size_t size = words.size() * 8;
+
+  const size_t bits = count_bits(words.data(), size * 8 - 3);
+  const uint32_t crc = common::runtime_hash(bytes + 1, size - 1);
+  const uint64_t h64 = common::runtime_hash64(bytes + 1, size - 1);
+
+  const uint32_t masks[] = {~CPU_AVX2, ~(CPU_AVX2 | CPU_PCLMUL),
+                            ~(CPU_AVX2 | CPU_POPCNT | CPU_PCLMUL), 0};
+  for (uint32_t mask : masks) {
+    cpu_restrict_features(mask);
+    EXPECT_EQ(count_bits(words.data(), size * 8 - 3), bits) << mask;
+    EXPECT_EQ(common::runtime_hash(bytes + 1, size - 1), crc) << mask;
+    EXPECT_EQ(common::runtime_hash64(bytes + 1, size - 1), h64) << mask;
+  }
+  cpu_restrict_features(~0u);
+}
+
+static float random_float(uint64_t *state) {
+  return static_cast<float>(next_random(state) >> 40) /
+             static_cast<float>(1 << 23) -
+         1.0f;
+}
+
+static glm::mat4 random_affine(uint64_t *state) {
+  const glm::vec3 axis = glm::normalize(glm::vec3(
+      random_float(state), random_float(state), random_float(state) + 2.0f));
+  glm::mat4 m = glm::translate(
+      glm::mat4(1.0f), glm::vec3(random_float(state) * 10.0f,
+                                 random_float(state), random_float(state)));
+  m = glm::rotate(m, random_float(state) * 3.0f, axis);
+  return glm::scale(m, glm::vec3(1.5f, 0.5f, 2.0f));
+}
+
+static void expect_near(const glm::vec4 &a, const glm::vec4 &b) {
+  for (int i = 0; i < 4; i++)
+    EXPECT_NEAR(a[i], b[i], 1e-5f * (1.0f + fabsf(b[i])));
+}
+
+TEST(simd, matches_glm) {
+  using namespace common;
+  uint64_t state = 0x1234abcd5678ef90ul;
+  for (int round = 0; round < 100; round++) {
+    const glm::vec4 a(random_float(&state), random_float(&state),
+                      random_float(&state), random_float(&state));
+    const glm::vec4 b(random_float(&state), random_float(&state),
+                      random_float(&state), random_float(&state));
+    const glm::vec3 a3(a);
+    const glm::vec3 b3(b);
+    const glm::mat4 m = random_affine(&state);
+    const glm::mat4 n = random_affine(&state);
+
+    EXPECT_NEAR(simd::dot(simd::load(a), simd::load(b)), glm::dot(a, b),
+                1e-6f);
+    expect_near(simd::to_glm(simd::load(a) + simd::load(b) * 2.0f),
+                a + b * 2.0f);
+    expect_near(simd::to_glm(simd::normalize(simd::load(a))),
+                glm::normalize(a));
+    expect_near(
+        glm::vec4(simd::to_glm(simd::cross(simd::load(a3), simd::load(b3))),
+                  0),
+        glm::vec4(glm::cross(a3, b3), 0));
+    expect_near(simd::to_glm(simd::load(m) * simd::load(a)), m * a);
+    const glm::mat4 mn = simd::to_glm(simd::load(m) * simd::load(n));
+    const glm::mat4 mt = simd::to_glm(simd::transpose(simd::load(m)));
+    for (int c = 0; c < 4; c++) {
+      expect_near(mn[c], (m * n)[c]);
+      expect_near(mt[c], glm::transpose(m)[c]);
+    }
+    expect_near(glm::vec4(simd::to_glm(simd::transform_point(
+                              simd::load(m), simd::load(a3))),
+                          1),
+                m * glm::vec4(a3, 1));
+    expect_near(glm::vec4(simd::to_glm(simd::transform_vector(
+                              simd::load(m), simd::load(a3))),
+                          0),
+                m * glm::vec4(a3, 0));
+
+    const glm::quat q = glm::normalize(glm::quat(a.w, a.x, a.y, a.z));
+    const glm::quat r = glm::normalize(glm::quat(b.w, b.x, b.y, b.z));
+    const glm::quat qr = simd::to_glm(simd::load(q) * simd::load(r));
+    expect_near(glm::vec4(qr.x, qr.y, qr.z, qr.w),
+                glm::vec4((q * r).x, (q * r).y, (q * r).z, (q * r).w));
+    expect_near(
+        glm::vec4(simd::to_glm(simd::rotate(simd::load(q), simd::load(b3))),
+                  0),
+        glm::vec4(q * b3, 0));
+  }
+}
+
+TEST(simd, batches_match_glm_in_every_variant) {
+  using namespace common;
+  uint64_t state = 0xfeedfacecafebeeful;
+  const size_t count = 203;
+  const glm::mat4 m = random_affine(&state);
+  std::vector<float> x(count), y(count), z(count);
+  std::vector<glm::mat4> a(count), b(count);
+  for (size_t i = 0; i < count; i++) {
+    x[i] = random_float(&state) * 100.0f;
+    y[i] = random_float(&state);
+    z[i] = random_float(&state) + 0.5f;
+    a[i] = random_affine(&state);
+    b[i] = random_affine(&state);
+  }
+
+  std::vector<float> first;
+  const uint32_t masks[] = {~0u, ~static_cast<uint32_t>(CPU_AVX)};
+  for (uint32_t mask : masks) {
+    cpu_restrict_features(mask);
+    std::vector<float> ox(count), oy(count), oz(count);
+    simd::transform_points(m, x.data(), y.data(), z.data(), ox.data(),
+                           oy.data(), oz.data(), count);
+    std::vector<glm::mat4> ab(count);
+    simd::compose(a.data(), b.data(), ab.data(), count);
+    std::vector<float> nx = x, ny = y, nz = z;
+    simd::normalize(nx.data(), ny.data(), nz.data(), count);
+
+    std::vector<float> all;
+    for (size_t i = 0; i < count; i++) {
+      const glm::vec4 p = m * glm::vec4(x[i], y[i], z[i], 1);
+      expect_near(glm::vec4(ox[i], oy[i], oz[i], 1), p);
+      const glm::vec3 n = glm::normalize(glm::vec3(x[i], y[i], z[i]));
+      expect_near(glm::vec4(nx[i], ny[i], nz[i], 0), glm::vec4(n, 0));
+      for (int c = 0; c < 4; c++)
+        expect_near(ab[i][c], (a[i] * b[i])[c]);
+      all.insert(all.end(), {ox[i], oy[i], oz[i], nx[i], ny[i], nz[i]});
+      all.insert(all.end(), &ab[i][0][0], &ab[i][0][0] + 16);
+    }
+    // Same operation order in every kernel, so the results are identical.
+    if (first.empty())
+      first = all;
+    else
+      EXPECT_EQ(all, first);
+  }
+  cpu_restrict_features(~0u);
+}
+
+/**
+ * Error of got against a double precision reference in units in the last
+ * place of the float result.
+ */
+static double ulp_error(float got, double ref) {
+  if (std::isnan(ref))
+    return std::isnan(got) ? 0.0 : HUGE_VAL;
+  const float rounded = static_cast<float>(ref);
+  if (std::isinf(rounded))
+    return got == rounded ? 0.0 : HUGE_VAL;
+  int exponent;
+  frexp(rounded == 0.0f ? 1e-45 : static_cast<double>(rounded), &exponent);
+  const double ulp = ldexp(1.0, exponent < -125 ? -149 : exponent - 24);
+  return fabs(static_cast<double>(got) - ref) / ulp;
+}
+
+/**
+ * Floats from 0 to hi and -hi to 0, evenly spaced in bit pattern so every
+ * binade of the domain is covered.
+ */
+static std::vector<float> float_sweep(float hi, bool negative, size_t count) {
+  uint32_t last;
+  memcpy(&last, &hi, sizeof(last));
+  const uint32_t step = last / static_cast<uint32_t>(count) + 1;
+  std::vector<float> res;
+  for (uint64_t bits = 0; bits <= last; bits += step) {
+    float f;
+    const uint32_t b = static_cast<uint32_t>(bits);
+    memcpy(&f, &b, sizeof(f));
+    res.push_back(f);
+    if (negative)
+      res.push_back(-f);
+  }
+  res.push_back(hi);
+  return res;
+}
+
+typedef void (*simd_unary_fn)(const float *, float *, size_t,
+                              common::simd::math_precision);
+
+static double max_ulp_error(simd_unary_fn fn, double (*ref)(double),
+                            const std::vector<float> &in,
+                            common::simd::math_precision precision) {
+  std::vector<float> out(in.size());
+  fn(in.data(), out.data(), in.size(), precision);
+  double res = 0;
+  for (size_t i = 0; i < in.size(); i++)
+    res = std::max(res, ulp_error(out[i], ref(in[i])));
+  return res;
+}
+
+static double rsqrt_ref(double x) { return 1.0 / sqrt(x); }
+
+TEST(simd_math, within_documented_ulp) {
+  using namespace common::simd;
+  const size_t samples = 1 << 17;
+  const std::vector<float> trig = float_sweep(1e6f, true, samples);
+  const std::vector<float> trig_fast = float_sweep(1e4f, true, samples);
+  EXPECT_LE(max_ulp_error(sin, ::sin, trig, MATH_PRECISE), 2.0);
+  EXPECT_LE(max_ulp_error(cos, ::cos, trig, MATH_PRECISE), 2.0);
+  EXPECT_LE(max_ulp_error(sin, ::sin, trig_fast, MATH_FAST), 26.0);
+  EXPECT_LE(max_ulp_error(cos, ::cos, trig_fast, MATH_FAST), 26.0);
+
+  std::vector<float> exp_in = float_sweep(88.72f, false, samples / 2);
+  for (float f : float_sweep(87.33f, false, samples / 2))
+    exp_in.push_back(-f);
+  EXPECT_LE(max_ulp_error(exp, ::exp, exp_in, MATH_PRECISE), 2.0);
+  EXPECT_LE(max_ulp_error(exp, ::exp, exp_in, MATH_FAST), 70.0);
+
+  const float max = std::numeric_limits<float>::max();
+  const std::vector<float> positive = float_sweep(max, false, samples);
+  EXPECT_LE(max_ulp_error(log, ::log, positive, MATH_PRECISE), 1.0);
+  EXPECT_LE(max_ulp_error(log, ::log, positive, MATH_FAST), 25.0);
+
+  std::vector<float> normal;
+  for (float f : positive) {
+    if (f >= std::numeric_limits<float>::min())
+      normal.push_back(f);
+  }
+  EXPECT_LE(max_ulp_error(rsqrt, rsqrt_ref, positive, MATH_PRECISE), 2.0);
+  EXPECT_LE(max_ulp_error(rsqrt, rsqrt_ref, normal, MATH_FAST), 4.0);
+}
+
+TEST(simd_math, sin_cos_beyond_the_domain) {
+  using namespace common::simd;
+  const float max = std::numeric_limits<float>::max();
+  const float inf = std::numeric_limits<float>::infinity();
+  const float in[] = {1e4f,  -2e4f,  1e6f,   3e6f,   1e10f, -1e10f,
+                      1e20f, -1e25f, 1e30f, 3e38f, max,    0.5f};
+  const size_t count = sizeof(in) / sizeof(in[0]);
+  for (math_precision precision : {MATH_PRECISE, MATH_FAST}) {
+    float s[count];
+    float c[count];
+    sin(in, s, count, precision);
+    cos(in, c, count, precision);
+    for (size_t i = 0; i < count; i++) {
+      const double x = in[i];
+      EXPECT_LE(ulp_error(s[i], ::sin(x)), 26.0) << in[i];
+      EXPECT_LE(ulp_error(c[i], ::cos(x)), 26.0) << in[i];
+    }
+
+    // In place, with the infinities in the middle of a vector.
+    float v[count];
+    memcpy(v, in, sizeof(v));
+    v[3] = inf;
+    v[4] = -inf;
+    sin(v, v, count, precision);
+    EXPECT_TRUE(std::isnan(v[3]));
+    EXPECT_TRUE(std::isnan(v[4]));
+    EXPECT_EQ(v[9], s[9]);
+    EXPECT_EQ(v[11], s[11]);
+  }
+}
+
+TEST(simd_math, atan2_every_quadrant) {
+  using namespace common::simd;
+  const std::vector<float> ys = float_sweep(1e6f, true, 1 << 14);
+  const float xs[] = {-1e6f, -100.0f, -1.0f, -1e-3f, -0.0f, 0.0f,
+                      1e-30f, 1e-3f, 0.7f, 1.0f, 50.0f, 1e5f};
+  for (math_precision precision : {MATH_PRECISE, MATH_FAST}) {
+    double worst = 0;
+    for (float x : xs) {
+      const std::vector<float> x_in(ys.size(), x);
+      std::vector<float> out(ys.size());
+      atan2(ys.data(), x_in.data(), out.data(), ys.size(), precision);
+      for (size_t i = 0; i < ys.size(); i++) {
+        worst = std::max(
+            worst, ulp_error(out[i], ::atan2(static_cast<double>(ys[i]),
+                                             static_cast<double>(x))));
+      }
+    }
+    EXPECT_LE(worst, precision == MATH_FAST ? 12.0 : 3.0);
+  }
+}
+
+TEST(simd_math, special_values_follow_libm) {
+  using namespace common::simd;
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float in[] = {0.0f, -0.0f, inf, -inf, nan, -1.0f, 1e-40f, 100.0f};
+  const size_t count = sizeof(in) / sizeof(in[0]);
+  for (math_precision precision : {MATH_PRECISE, MATH_FAST}) {
+    float out[count];
+    log(in, out, count, precision);
+    for (size_t i = 0; i < count; i++) {
+      const float ref = logf(in[i]);
+      if (std::isnan(ref)) {
+        EXPECT_TRUE(std::isnan(out[i])) << in[i];
+      } else if (std::isinf(ref)) {
+        EXPECT_EQ(out[i], ref) << in[i];
+      }
+    }
+
+    exp(in, out, count, precision);
+    EXPECT_EQ(out[0], 1.0f);
+    EXPECT_EQ(out[2], inf);
+    EXPECT_EQ(out[3], 0.0f);
+    EXPECT_TRUE(std::isnan(out[4]));
+    EXPECT_EQ(out[7], inf);
+
+    rsqrt(in, out, 4, precision);
+    EXPECT_EQ(out[0], inf);
+    EXPECT_EQ(out[2], 0.0f);
+
+    const float y[] = {0.0f, -0.0f, 0.0f, inf, -inf, 1.0f};
+    const float x[] = {0.0f, -0.0f, -1.0f, inf, -inf, -inf};
+    float a[6];
+    atan2(y, x, a, 6, precision);
+    for (size_t i = 0; i < 6; i++) {
+      EXPECT_LE(ulp_error(a[i], ::atan2(static_cast<double>(y[i]),
+                                        static_cast<double>(x[i]))),
+                12.0)
+          << y[i] << " " << x[i];
+      EXPECT_EQ(std::signbit(a[i]), std::signbit(y[i]));
+    }
+  }
+}
+
+TEST(simd_math, every_variant_gives_the_same_results) {
+  using namespace common::simd;
+  const std::vector<float> in = float_sweep(100.0f, true, 1001);
+  const simd_unary_fn fns[] = {sin, cos, exp, log, rsqrt};
+  std::vector<float> first;
+  for (uint32_t mask : {~0u, ~static_cast<uint32_t>(CPU_AVX2 | CPU_AVX)}) {
+    cpu_restrict_features(mask);
+    std::vector<float> all;
+    for (simd_unary_fn fn : fns) {
+      for (math_precision precision : {MATH_PRECISE, MATH_FAST}) {
+        std::vector<float> out(in.size());
+        fn(in.data(), out.data(), in.size(), precision);
+        // The fast rsqrt estimate may differ between SSE and AVX units.
+        if (fn != rsqrt || precision == MATH_PRECISE)
+          all.insert(all.end(), out.begin(), out.end());
+      }
+    }
+    std::vector<float> out(in.size());
+    atan2(in.data(), in.data() + 1, out.data(), in.size() - 1);
+    all.insert(all.end(), out.begin(), out.end());
+    if (first.empty())
+      first = all;
+    else
+      EXPECT_EQ(0, memcmp(first.data(), all.data(),
+                          all.size() * sizeof(float)));
+  }
+  cpu_restrict_features(~0u);
+}
+
+static uint32_t vertex_pack_scalar_mask() {
+  return ~static_cast<uint32_t>(CPU_AVX | CPU_AVX2 | CPU_F16C);
+}
+
+TEST(vertex_pack, half_round_trips_every_value) {
+  using namespace common;
+  for (uint32_t mask : {~0u, vertex_pack_scalar_mask()}) {
+    cpu_restrict_features(mask);
+    std::vector<uint16_t> halves(1 << 16);
+    for (size_t i = 0; i < halves.size(); i++)
+      halves[i] = static_cast<uint16_t>(i);
+    std::vector<float> floats(halves.size());
+    unpack_half(halves.data(), floats.data(), halves.size());
+    std::vector<uint16_t> back(halves.size());
+    pack_half(floats.data(), back.data(), floats.size());
+    for (size_t i = 0; i < halves.size(); i++) {
+      if ((i & 0x7c00) == 0x7c00 && (i & 0x3ff)) {
+        ASSERT_TRUE(std::isnan(floats[i])) << i;
+        // NaN come back quiet with the same payload.
+        EXPECT_EQ(i | 0x200, back[i]) << i;
+      } else {
+        EXPECT_EQ(i, back[i]) << i;
+      }
+    }
+    EXPECT_EQ(1.0f, floats[0x3c00]);
+    EXPECT_EQ(-2.0f, floats[0xc000]);
+    EXPECT_EQ(65504.0f, floats[0x7bff]);
+    EXPECT_EQ(std::ldexp(1.0f, -24), floats[0x0001]);
+  }
+  cpu_restrict_features(~0u);
+}
+
+TEST(vertex_pack, half_rounds_to_nearest_even) {
+  using namespace common;
+  const float in[] = {1.0f + std::ldexp(1.0f, -11),
+                      1.0f + 3 * std::ldexp(1.0f, -11),
+                      1.0f + std::ldexp(1.0f, -11) + std::ldexp(1.0f, -20),
+                      65520.0f,
+                      65519.0f,
+                      std::ldexp(1.0f, -25),
+                      std::ldexp(3.0f, -26),
+                      -0.0f,
+                      std::numeric_limits<float>::infinity()};
+  const uint16_t expected[] = {0x3c00, 0x3c02, 0x3c01, 0x7c00, 0x7bff,
+                               0x0000, 0x0001, 0x8000, 0x7c00};
+  for (uint32_t mask : {~0u, vertex_pack_scalar_mask()}) {
+    cpu_restrict_features(mask);
+    uint16_t out[9];
+    pack_half(in, out, 9);
+    for (size_t i = 0; i < 9; i++)
+      EXPECT_EQ(expected[i], out[i]) << i;
+  }
+  cpu_restrict_features(~0u);
+}
+
+TEST(vertex_pack, norm_formats_round_and_clamp) {
+  using namespace common;
+  const float in[] = {0.0f, 1.0f,  -1.0f, 2.0f,  -2.0f, 0.5f,
+                      NAN,  -0.5f, 0.25f, 1e-6f, 0.75f};
+  const size_t n = sizeof(in) / sizeof(in[0]);
+  int16_t s16[n];
+  pack_snorm16(in, s16, n);
+  const int16_t s16_expected[] = {0,     32767, -32767, 32767, -32767, 16384,
+                                  0,     -16384, 8192,  0,     24575};
+  uint8_t u8[n];
+  pack_unorm8(in, u8, n);
+  const uint8_t u8_expected[] = {0, 255, 0, 255, 0, 128, 0, 0, 64, 0, 191};
+  for (size_t i = 0; i < n; i++) {
+    EXPECT_EQ(s16_expected[i], s16[i]) << i;
+    EXPECT_EQ(u8_expected[i], u8[i]) << i;
+  }
+
+  const int8_t s8[] = {-128, -127, 0, 127, 64};
+  float out[5];
+  unpack_snorm8(s8, out, 5);
+  EXPECT_EQ(-1.0f, out[0]);
+  EXPECT_EQ(-1.0f, out[1]);
+  EXPECT_EQ(0.0f, out[2]);
+  EXPECT_EQ(1.0f, out[3]);
+  EXPECT_FLOAT_EQ(64.0f / 127.0f, out[4]);
+}
+
+TEST(vertex_pack, norm_formats_round_trip) {
+  using namespace common;
+  std::vector<uint16_t> u16(1 << 16);
+  std::vector<int16_t> s16(1 << 16);
+  for (size_t i = 0; i < u16.size(); i++) {
+    u16[i] = static_cast<uint16_t>(i);
+    s16[i] = static_cast<int16_t>(i);
+  }
+  std::vector<float> floats(u16.size());
+  std::vector<uint16_t> u16_back(u16.size());
+  unpack_unorm16(u16.data(), floats.data(), u16.size());
+  pack_unorm16(floats.data(), u16_back.data(), floats.size());
+  EXPECT_EQ(u16, u16_back);
+
+  std::vector<int16_t> s16_back(s16.size());
+  unpack_snorm16(s16.data(), floats.data(), s16.size());
+  pack_snorm16(floats.data(), s16_back.data(), floats.size());
+  for (size_t i = 0; i < s16.size(); i++)
+    EXPECT_EQ(std::max<int16_t>(s16[i], -32767), s16_back[i]) << i;
+
+  uint8_t u8[256];
+  uint8_t u8_back[256];
+  int8_t s8[256];
+  int8_t s8_back[256];
+  for (int i = 0; i < 256; i++) {
+    u8[i] = static_cast<uint8_t>(i);
+    s8[i] = static_cast<int8_t>(i);
+  }
+  unpack_unorm8(u8, floats.data(), 256);
+  pack_unorm8(floats.data(), u8_back, 256);
+  EXPECT_EQ(0, memcmp(u8, u8_back, sizeof(u8)));
+  unpack_snorm8(s8, floats.data(), 256);
+  pack_snorm8(floats.data(), s8_back, 256);
+  for (int i = 0; i < 256; i++)
+    EXPECT_EQ(std::max<int8_t>(s8[i], -127), s8_back[i]) << i;
+}
+
+TEST(vertex_pack, a2b10g10r10_round_trips) {
+  using namespace common;
+  const float rgba[] = {1.0f, 0.0f, 0.5f, 1.0f, 0.25f, 1.0f, 0.0f, 0.33f};
+  uint32_t packed[2];
+  pack_a2b10g10r10(rgba, packed, 2);
+  EXPECT_EQ(0xc0000000u | (512u << 20) | 1023u, packed[0]);
+  EXPECT_EQ((1u << 30) | (1023u << 10) | 256u, packed[1]);
+
+  std::vector<uint32_t> words(4099);
+  uint64_t state = 1;
+  for (uint32_t &w : words)
+    w = static_cast<uint32_t>(next_random(&state) >> 32);
+  std::vector<float> floats(words.size() * 4);
+  std::vector<uint32_t> back(words.size());
+  unpack_a2b10g10r10(words.data(), floats.data(), words.size());
+  pack_a2b10g10r10(floats.data(), back.data(), floats.size() / 4);
+  EXPECT_EQ(words, back);
+  EXPECT_EQ(static_cast<float>(words[0] & 1023) / 1023.0f, floats[0]);
+  EXPECT_EQ(static_cast<float>(words[0] >> 30) / 3.0f, floats[3]);
+}
+
+TEST(vertex_pack, octahedral_keeps_normals_within_bound) {
+  using namespace common;
+  uint64_t state = 7;
+  std::vector<float> xyz;
+  for (int i = 0; i < 20000; i++)
+    for (int j = 0; j < 3; j++)
+      xyz.push_back(random_float(&state));
+  const float axes[] = {1, 0, 0, 0, -1, 0, 0, 0, 1, 0, 0, -1, 0, 0, 0};
+  xyz.insert(xyz.end(), std::begin(axes), std::end(axes));
+  const size_t n = xyz.size() / 3;
+
+  std::vector<int16_t> packed(n * 2);
+  std::vector<float> out(n * 3);
+  pack_octahedral(xyz.data(), packed.data(), n);
+  unpack_octahedral(packed.data(), out.data(), n);
+  double worst = 0.0;
+  for (size_t i = 0; i + 1 < n; i++) {
+    const glm::dvec3 a(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2]);
+    const glm::dvec3 b(out[i * 3], out[i * 3 + 1], out[i * 3 + 2]);
+    EXPECT_NEAR(1.0, glm::length(b), 1e-6);
+    const double angle = atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+    worst = std::max(worst, angle * 180.0 / M_PI);
+  }
+  EXPECT_LT(worst, 0.004);
+  for (size_t i = n - 5; i < n - 1; i++) {
+    EXPECT_EQ(xyz[i * 3], out[i * 3]);
+    EXPECT_EQ(xyz[i * 3 + 1], out[i * 3 + 1]);
+    EXPECT_EQ(xyz[i * 3 + 2], out[i * 3 + 2]);
+  }
+  // The zero normal.
+  EXPECT_EQ(0.0f, out[(n - 1) * 3]);
+  EXPECT_EQ(0.0f, out[(n - 1) * 3 + 1]);
+  EXPECT_EQ(1.0f, out[(n - 1) * 3 + 2]);
+}
+
+TEST(vertex_pack, every_variant_gives_the_same_results) {
+  using namespace common;
+  const std::vector<float> in = float_sweep(3.0f, true, 1003);
+  std::vector<uint8_t> first;
+  for (uint32_t mask : {~0u, vertex_pack_scalar_mask()}) {
+    cpu_restrict_features(mask);
+    std::vector<uint8_t> all;
+    const auto append = [&all](const void *p, size_t size) {
+      all.insert(all.end(), static_cast<const uint8_t *>(p),
+                 static_cast<const uint8_t *>(p) + size);
+    };
+    std::vector<uint16_t> half(in.size());
+    pack_half(in.data(), half.data(), in.size());
+    append(half.data(), half.size() * 2);
+    std::vector<int16_t> s16(in.size());
+    pack_snorm16(in.data(), s16.data(), in.size());
+    append(s16.data(), s16.size() * 2);
+    std::vector<uint8_t> u8(in.size());
+    pack_unorm8(in.data(), u8.data(), in.size());
+    append(u8.data(), u8.size());
+    std::vector<uint32_t> rgb10(in.size() / 4);
+    pack_a2b10g10r10(in.data(), rgb10.data(), rgb10.size());
+    append(rgb10.data(), rgb10.size() * 4);
+    std::vector<int16_t> oct(in.size() / 3 * 2);
+    pack_octahedral(in.data(), oct.data(), in.size() / 3);
+    append(oct.data(), oct.size() * 2);
+    std::vector<float> out(in.size());
+    unpack_octahedral(oct.data(), out.data(), in.size() / 3);
+    append(out.data(), out.size() * 4);
+    unpack_snorm16(s16.data(), out.data(), s16.size());
+    append(out.data(), out.size() * 4);
+    if (first.empty())
+      first = all;
+    else
+      EXPECT_EQ(first, all);
+  }
+  cpu_restrict_features(~0u);
+}
+
+static std::string profile_trace() {
+  FILE *file = tmpfile();
+  EXPECT_TRUE(common::write_profile_trace(file));
+  std::string res(static_cast<size_t>(ftell(file)), '\0');
+  rewind(file);
+  EXPECT_EQ(res.size(), fread(&res[0], 1, res.size(), file));
+  fclose(file);
+  return res;
+}
+
+static size_t count_of(const std::string &str, const std::string &what) {
+  size_t res = 0;
+  for (size_t at = str.find(what); at != std::string::npos;
+       at = str.find(what, at + what.size()))
+    res++;
+  return res;
+}
+
+static double trace_field(const std::string &trace, const std::string &name,
+                          const char *field) {
+  const size_t at = trace.find("{\"name\":\"" + name + "\"");
+  EXPECT_NE(std::string::npos, at) << name;
+  const size_t value = trace.find(std::string("\"") + field + "\":", at);
+  return atof(trace.c_str() + value + strlen(field) + 3);
+}
+
+TEST(profiler, records_zones_of_every_thread) {
+  using namespace common;
+  EXPECT_GT(profile_ticks_per_ns(), 0.1);
+  profile_clear();
+  {
+    profile_scope outer{"outer"};
+    {
+      profile_scope inner{"inner \"quoted\""};
+    }
+  }
+  std::thread worker([] {
+    profile_thread_name("worker");
+    for (int i = 0; i < 100; i++)
+      profile_scope zone{"worker_zone"};
+  });
+  worker.join();
+
+  const std::string trace = profile_trace();
+  EXPECT_EQ(0u, trace.find("{\"traceEvents\":["));
+  EXPECT_EQ(102u, count_of(trace, "\"ph\":\"X\""));
+  EXPECT_EQ(100u, count_of(trace, "\"name\":\"worker_zone\""));
+  EXPECT_EQ(1u, count_of(trace, "\"args\":{\"name\":\"worker\"}"));
+  const std::string inner = "inner \\\"quoted\\\"";
+  EXPECT_LE(trace_field(trace, "outer", "ts"), trace_field(trace, inner, "ts"));
+  EXPECT_GE(trace_field(trace, "outer", "dur"),
+            trace_field(trace, inner, "dur"));
+
+  profile_clear();
+  EXPECT_EQ(0u, count_of(profile_trace(), "\"ph\":\"X\""));
+}
+
+TEST(profiler, ring_keeps_the_newest_events) {
+  using namespace common;
+  profile_clear();
+  std::thread worker([] {
+    for (int i = 0; i < 10; i++)
+      profile_record("old", profile_ticks(), profile_ticks());
+    for (uint32_t i = 0; i < profile_ring_size; i++)
+      profile_record("new", profile_ticks(), profile_ticks());
+  });
+  worker.join();
+
+  const std::string trace = profile_trace();
+  EXPECT_EQ(0u, count_of(trace, "\"name\":\"old\""));
+  EXPECT_EQ(profile_ring_size - 1, count_of(trace, "\"name\":\"new\""));
+  profile_clear();
+}
+
+TEST(profiler, exited_threads_give_their_rings_back) {
+  using namespace common;
+  profile_clear();
+  for (int t = 0; t < 16; t++) {
+    std::thread worker([] {
+      profile_thread_name("short_lived");
+      for (int i = 0; i < 10; i++)
+        profile_scope zone{"short_lived_zone"};
+    });
+    worker.join();
+  }
+
+  // Each thread took over the ring of the one before and dropped its
+  // events.
+  const std::string trace = profile_trace();
+  EXPECT_EQ(1u, count_of(trace, "\"args\":{\"name\":\"short_lived\"}"));
+  EXPECT_EQ(10u, count_of(trace, "\"name\":\"short_lived_zone\""));
+  profile_clear();
+}
+
+TEST(perf_counters, open_what_the_machine_allows) {
+  using namespace common;
+  perf_counters counters;
+  perf_open(&counters, PERF_ALL);
+  EXPECT_EQ(0u, counters.events & ~PERF_ALL);
+  for (uint32_t i = 0; i < perf_event_count; i++)
+    EXPECT_EQ(counters.fds[i] >= 0, (counters.events & (1u << i)) != 0);
+  EXPECT_STREQ("page_faults", perf_event_name(PERF_PAGE_FAULTS));
+  EXPECT_STREQ("unknown", perf_event_name(PERF_CYCLES | PERF_INSTRUCTIONS));
+
+  // Counters that did not open read as zero through every call.
+  perf_start(&counters);
+  const size_t page = 4096;
+  const size_t pages = 256;
+  std::vector<char> data(page * pages + page);
+  perf_values zone_counts{};
+  {
+    perf_zone zone{&counters, &zone_counts};
+    char *p = data.data();
+    for (size_t i = 0; i < pages; i++)
+      p[i * page] = 1;
+  }
+  perf_stop(&counters);
+  perf_values values;
+  const bool read = perf_read(&counters, &values);
+  EXPECT_EQ(counters.events != 0, read);
+  for (uint32_t i = 0; i < perf_event_count; i++) {
+    if (!(counters.events & (1u << i))) {
+      EXPECT_EQ(0u, values.counts[i]);
+      EXPECT_EQ(0u, zone_counts.counts[i]);
+    }
+    EXPECT_LE(zone_counts.counts[i], values.counts[i]);
+  }
+  if (counters.events & PERF_INSTRUCTIONS) {
+    EXPECT_GT(perf_count(values, PERF_INSTRUCTIONS), pages);
+  }
+
+  perf_close(&counters);
+  EXPECT_EQ(0u, counters.events);
+  EXPECT_EQ(-1, counters.leader);
+}
+
+static std::string read_file(FILE *file) {
+  std::string res(static_cast<size_t>(ftell(file)), '\0');
+  rewind(file);
+  EXPECT_EQ(res.size(), fread(&res[0], 1, res.size(), file));
+  fclose(file);
+  return res;
+}
+
+TEST(log, formats_records_on_the_writer_thread) {
+  using namespace common;
+  FILE *file = tmpfile();
+  log_start(file);
+  char message[32] = "copied";
+  log_error("[%s] Code %d : %s", "layer", -42, message);
+  strcpy(message, "overwritten");
+  log_write(LOG_WARNING, "%5.2f|%-4u|%04x|%c|%llu|%%|%.3s", 3.14159, 7u, 255,
+            'z', 18446744073709551615ull, "abcdef");
+  log_write(LOG_INFO, "%s and %s", static_cast<const char *>(nullptr), "");
+  std::thread worker([] {
+    for (int i = 0; i < 100; i++)
+      log_write(LOG_DEBUG, "worker %d", i);
+  });
+  worker.join();
+  log_stop();
+
+  const std::string out = read_file(file);
+  EXPECT_EQ(103u, count_of(out, "\n"));
+  EXPECT_NE(std::string::npos, out.find("error: [layer] Code -42 : copied\n"));
+  EXPECT_NE(
+      std::string::npos,
+      out.find("warning:  3.14|7   |00ff|z|18446744073709551615|%|abc\n"));
+  EXPECT_NE(std::string::npos, out.find("info:  and \n"));
+  EXPECT_NE(std::string::npos, out.find("debug: worker 0\n"));
+  EXPECT_NE(std::string::npos, out.find("debug: worker 99\n"));
+  EXPECT_LT(out.find("worker 41\n"), out.find("worker 42\n"));
+}
+
+TEST(log, drops_records_when_a_ring_is_full) {
+  using namespace common;
+  const uint64_t dropped = log_dropped();
+  std::thread worker([] {
+    // Nothing drains the ring until the logger starts.
+    for (int i = 0; i < 5000; i++)
+      log_write(LOG_INFO, "record %d", i);
+  });
+  worker.join();
+  const uint64_t lost = log_dropped() - dropped;
+  EXPECT_GT(lost, 0u);
+
+  FILE *file = tmpfile();
+  log_start(file);
+  log_stop();
+  const std::string out = read_file(file);
+  EXPECT_EQ(5000 - lost, count_of(out, "info: record "));
+  EXPECT_NE(std::string::npos,
+            out.find("logger dropped " + std::to_string(lost) + " records"));
+  EXPECT_NE(std::string::npos, out.find("record 0\n"));
+}
+
+TEST(log, errors_are_written_before_returning) {
+  using namespace common;
+  FILE *file = tmpfile();
+  log_start(file);
+  std::thread worker([] {
+    for (int i = 0; i < 1000; i++)
+      log_write(LOG_INFO, "before %d", i);
+    log_error("[%s] Code %d : %s", "layer", 7, "the device is lost");
+  });
+  worker.join();
+
+  // Read behind the logger's back, the writer thread may not have woken.
+  std::string out(4096 * 16, '\0');
+  const ssize_t read = pread(fileno(file), &out[0], out.size(), 0);
+  ASSERT_GT(read, 0);
+  out.resize(static_cast<size_t>(read));
+  EXPECT_EQ(1000u, count_of(out, "info: before "));
+  EXPECT_NE(std::string::npos,
+            out.find("error: [layer] Code 7 : the device is lost\n"));
+  log_stop();
+  fclose(file);
+}
+
+TEST(log, long_strings_are_kept_whole) {
+  using namespace common;
+  FILE *file = tmpfile();
+  log_start(file);
+  std::string message(5000, 'v');
+  message.back() = '!';
+  log_warning("[%s] Code %d : %s", "layer", 1, message.c_str());
+  log_stop();
+
+  const std::string out = read_file(file);
+  EXPECT_NE(std::string::npos, out.find(" : " + message + "\n"));
+}
+
+TEST(log, exited_threads_give_their_rings_back) {
+  using namespace common;
+  const uint64_t dropped = log_dropped();
+  // About 48KB each, two of them only fit in separate rings.
+  for (int t = 0; t < 2; t++) {
+    std::thread worker([t] {
+      for (int i = 0; i < 1000; i++)
+        log_write(LOG_INFO, "thread %d record %d", t, i);
+    });
+    worker.join();
+  }
+  EXPECT_GT(log_dropped() - dropped, 0u);
+
+  FILE *file = tmpfile();
+  log_start(file);
+  log_stop();
+  const std::string out = read_file(file);
+  EXPECT_NE(std::string::npos, out.find("thread 0 record 999\n"));
+  EXPECT_LT(out.find("thread 0 record 999\n"),
+            out.find("thread 1 record 0\n"));
+}
+
+TEST(metrics, counters_sum_the_shards_of_every_thread) {
+  using namespace common;
+  const metric_counter counter = register_counter("test.sharded");
+  EXPECT_EQ(register_counter("test.sharded").index, counter.index);
+  EXPECT_EQ(metric_read(counter), 0u);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([counter] {
+      for (int i = 0; i < 10000; i++)
+        metric_add(counter);
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+  metric_add(counter, 5);
+  // Shards of the finished threads still count.
+  EXPECT_EQ(metric_read(counter), 40005u);
+
+  const metric_gauge gauge = register_gauge("test.depth");
+  gauge_set(gauge, 10);
+  gauge_add(gauge, -3);
+  EXPECT_EQ(gauge_read(gauge), 7);
+}
+
+TEST(metrics, exited_threads_give_their_shards_back) {
+  using namespace common;
+  const metric_counter counter = register_counter("test.short_lived");
+  std::vector<const void *> shards;
+  for (int t = 0; t < 16; t++) {
+    std::thread worker([counter, &shards] {
+      metric_add(counter, 3);
+      shards.push_back(common::internal::local_metric_shard);
+    });
+    worker.join();
+  }
+
+  // Each thread took over the shard of the one before, counts included.
+  for (const void *shard : shards)
+    EXPECT_EQ(shards[0], shard);
+  EXPECT_EQ(metric_read(counter), 48u);
+}
+
+#ifndef NDEBUG
+TEST(metrics, registering_past_the_cap_asserts) {
+  using namespace common;
+  EXPECT_DEATH(
+      {
+        char name[metric_name_max];
+        for (uint32_t i = 0; i <= metrics_max_gauges; i++) {
+          snprintf(name, sizeof(name), "test.gauge_%u", i);
+          register_gauge(name);
+        }
+      },
+      "Too many metrics of this kind");
+}
+#endif
+
+TEST(metrics, histogram_buckets_cover_every_value) {
+  using namespace common::internal;
+  uint32_t expected = 0;
+  for (uint64_t value = 0; value < (1u << 20); value++) {
+    const uint32_t bucket = histogram_bucket(value);
+    ASSERT_TRUE(bucket == expected || bucket == expected + 1) << value;
+    expected = bucket;
+    ASSERT_GE(value, histogram_bucket_low(bucket));
+    ASSERT_LT(value, histogram_bucket_low(bucket) +
+                         histogram_bucket_width(bucket));
+    ASSERT_LE(histogram_bucket_width(bucket) * 32, value < 64 ? 32 : value);
+  }
+  EXPECT_EQ(histogram_bucket(~0ull), common::histogram_bucket_count - 1);
+}
+
+TEST(metrics, histogram_percentiles) {
+  using namespace common;
+  const metric_histogram histogram = register_histogram("test.frame_ns");
+  EXPECT_EQ(histogram_read(histogram).count, 0u);
+  for (uint64_t value = 1; value <= 100000; value++)
+    histogram_record(histogram, value);
+
+  const histogram_summary s = histogram_read(histogram);
+  EXPECT_EQ(s.count, 100000u);
+  EXPECT_EQ(s.min, 1u);
+  EXPECT_NEAR(s.p50, 50000.0, 50000.0 / 64);
+  EXPECT_NEAR(s.p90, 90000.0, 90000.0 / 64);
+  EXPECT_NEAR(s.p99, 99000.0, 99000.0 / 64);
+  EXPECT_NEAR(s.p999, 99900.0, 99900.0 / 64);
+  EXPECT_NEAR(s.max, 100000.0, 100000.0 / 64);
+
+  histogram_reset(histogram);
+  EXPECT_EQ(histogram_read(histogram).count, 0u);
+  histogram_record(histogram, 42);
+  EXPECT_EQ(histogram_read(histogram).p999, 42u);
+}
+
+TEST(metrics, export_writes_whole_snapshots) {
+  using namespace common;
+  const metric_counter counter = register_counter("test.exported");
+  register_histogram("test.export_ns");
+  metric_add(counter, 3);
+
+  FILE *file = tmpfile();
+  EXPECT_TRUE(write_metrics(file));
+  EXPECT_NE(std::string::npos,
+            read_file(file).find("counter test.exported 3\n"));
+
+  char path[] = "/tmp/zerog_metricsXXXXXX";
+  close(mkstemp(path));
+  ASSERT_TRUE(metrics_export_start(path, 1));
+  metric_add(counter, 4);
+  metrics_export_stop();
+
+  file = fopen(path, "r");
+  ASSERT_NE(file, nullptr);
+  fseek(file, 0, SEEK_END);
+  const std::string out = read_file(file);
+  remove(path);
+  EXPECT_NE(std::string::npos, out.find("counter test.exported 7\n"));
+  EXPECT_NE(std::string::npos, out.find("histogram test.export_ns count 0 "));
+}
@@ -0,0 +1,383 @@
+#include "vertex_pack.h"
+
+#include "cpu.h"
+#include "simd_ext.h"
+
+#include <cstring>
+
+#include <immintrin.h>
+
+namespace common {
+namespace internal {
+
+static uint32_t float_bits(float f) {
+  uint32_t res;
+  memcpy(&res, &f, sizeof(res));
+  return res;
+}
+
+static float bits_float(uint32_t u) {
+  float res;
+  memcpy(&res, &u, sizeof(res));
+  return res;
+}
+
+/**
+ * Round to nearest even without a table, after Fabian Giesen's
+ * float_to_half_fast3_rtne. NaN keep the top of their payload and become
+ * quiet, like vcvtps2ph.
+ */
+static uint16_t float_to_half(float f) {
+  uint32_t x = float_bits(f);
+  const uint32_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  uint32_t res;
+  if (x >= 0x47800000) {
+    // 2^16 and up is inf, NaN keep their payload.
+    res = x > 0x7f800000 ? 0x7e00 | ((x >> 13) & 0x3ff) : 0x7c00;
+  } else if (x < 0x38800000) {
+    // Denormal half, adding 0.5 lines the mantissa up and rounds it.
+    res = float_bits(bits_float(x) + 0.5f) - 0x3f000000;
+  } else {
+    const uint32_t odd = (x >> 13) & 1;
+    res = (x + 0xc8000fff + odd) >> 13;
+  }
+  return static_cast<uint16_t>(res | sign);
+}
+
+static float half_to_float(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  const uint32_t em = h & 0x7fff;
+  float res;
+  if (em >= 0x7c00)
+    res = bits_float((em << 13) | 0x7f800000);
+  else if (em >= 0x400)
+    res = bits_float((em << 13) + (112u << 23));
+  else
+    res = static_cast<float>(em) * 5.9604644775390625e-8f;
+  return bits_float(float_bits(res) | sign);
+}
+
+static void pack_half_scalar(const float *in, uint16_t *out, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    out[i] = float_to_half(in[i]);
+}
+
+static void unpack_half_scalar(const uint16_t *in, float *out,
+                               size_t count) {
+  for (size_t i = 0; i < count; i++)
+    out[i] = half_to_float(in[i]);
+}
+
+cpu_target("avx,f16c") static void pack_half_f16c(const float *in,
+                                                  uint16_t *out,
+                                                  size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i h =
+        _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), h);
+  }
+  pack_half_scalar(in + i, out + i, count - i);
+}
+
+cpu_target("avx,f16c") static void unpack_half_f16c(const uint16_t *in,
+                                                    float *out,
+                                                    size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+  }
+  unpack_half_scalar(in + i, out + i, count - i);
+}
+
+typedef void (*pack_half_fn)(const float *in, uint16_t *out, size_t count);
+typedef void (*unpack_half_fn)(const uint16_t *in, float *out, size_t count);
+
+static const cpu_variant<pack_half_fn> pack_half_variants[]{
+    {CPU_AVX | CPU_F16C, pack_half_f16c},
+    {0, pack_half_scalar},
+};
+
+static const cpu_variant<unpack_half_fn> unpack_half_variants[]{
+    {CPU_AVX | CPU_F16C, unpack_half_f16c},
+    {0, unpack_half_scalar},
+};
+
+/**
+ * The other formats are written once with vector extensions and built for
+ * AVX2 and the SSE2 baseline, 8 items per block. A partial last block
+ * goes through the same code zero padded.
+ */
+#pragma GCC diagnostic ignored "-Wpsabi" // Kernels are always inlined.
+template <typename __T> struct lanes8 {
+  typedef __T type __attribute__((vector_size(8 * sizeof(__T))));
+};
+
+/**
+ * NaN to zero, then into [lo, hi].
+ */
+cpu_inline f32x8 clamp(f32x8 x, float lo, float hi) {
+  x = x == x ? x : f32x8{};
+  x = x < lo ? splat(lo) : x;
+  return x > hi ? splat(hi) : x;
+}
+
+cpu_inline i32x8 round_int(f32x8 x) {
+  return __builtin_convertvector(round_nearest(x), i32x8);
+}
+
+/**
+ * Component j of the 8 items in a block of items of size n.
+ */
+template <typename __T>
+cpu_inline f32x8 gather(const __T *p, size_t n, size_t j) {
+  f32x8 res;
+  for (size_t i = 0; i < 8; i++)
+    res[i] = static_cast<float>(p[i * n + j]);
+  return res;
+}
+
+template <typename __T, typename __V>
+cpu_inline void scatter(__T *p, size_t n, size_t j, __V v) {
+  for (size_t i = 0; i < 8; i++)
+    p[i * n + j] = static_cast<__T>(v[i]);
+}
+
+/**
+ * Runs Op over count items of In components each, Out components are
+ * written per item.
+ */
+template <typename __Op>
+cpu_inline void convert(const typename __Op::in_type *in,
+                        typename __Op::out_type *out, size_t count) {
+  typedef typename __Op::in_type in_type;
+  typedef typename __Op::out_type out_type;
+  const size_t in_n = __Op::in_per_item;
+  const size_t out_n = __Op::out_per_item;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    __Op::run(in + i * in_n, out + i * out_n);
+  if (i < count) {
+    in_type pad_in[8 * __Op::in_per_item]{};
+    out_type pad_out[8 * __Op::out_per_item];
+    memcpy(pad_in, in + i * in_n, (count - i) * in_n * sizeof(in_type));
+    __Op::run(pad_in, pad_out);
+    memcpy(out + i * out_n, pad_out, (count - i) * out_n * sizeof(out_type));
+  }
+}
+
+/**
+ * Signed formats map to [-max, max] and decode -max - 1 as -1 too.
+ */
+template <typename __T> struct norm {
+  static constexpr bool is_signed = static_cast<__T>(-1) < 0;
+  static constexpr float max =
+      static_cast<float>((1u << (8 * sizeof(__T) - is_signed)) - 1);
+  typedef typename lanes8<__T>::type vec;
+};
+
+template <typename __T> struct norm_pack {
+  typedef float in_type;
+  typedef __T out_type;
+  static constexpr size_t in_per_item = 1;
+  static constexpr size_t out_per_item = 1;
+
+  cpu_inline void run(const float *in, __T *out) {
+    f32x8 x;
+    memcpy(&x, in, sizeof(x));
+    const float lo = norm<__T>::is_signed ? -1.0f : 0.0f;
+    const typename norm<__T>::vec c = __builtin_convertvector(
+        round_int(clamp(x, lo, 1.0f) * norm<__T>::max),
+        typename norm<__T>::vec);
+    memcpy(out, &c, sizeof(c));
+  }
+};
+
+template <typename __T> struct norm_unpack {
+  typedef __T in_type;
+  typedef float out_type;
+  static constexpr size_t in_per_item = 1;
+  static constexpr size_t out_per_item = 1;
+
+  cpu_inline void run(const __T *in, float *out) {
+    typename norm<__T>::vec c;
+    memcpy(&c, in, sizeof(c));
+    f32x8 x = __builtin_convertvector(c, f32x8) / norm<__T>::max;
+    x = x < -1.0f ? splat(-1.0f) : x;
+    memcpy(out, &x, sizeof(x));
+  }
+};
+
+struct a2b10g10r10_pack {
+  typedef float in_type;
+  typedef uint32_t out_type;
+  static constexpr size_t in_per_item = 4;
+  static constexpr size_t out_per_item = 1;
+
+  cpu_inline void run(const float *in, uint32_t *out) {
+    u32x8 res = (u32x8)round_int(clamp(gather(in, 4, 0), 0, 1) * 1023.0f);
+    res |= (u32x8)round_int(clamp(gather(in, 4, 1), 0, 1) * 1023.0f) << 10;
+    res |= (u32x8)round_int(clamp(gather(in, 4, 2), 0, 1) * 1023.0f) << 20;
+    res |= (u32x8)round_int(clamp(gather(in, 4, 3), 0, 1) * 3.0f) << 30;
+    memcpy(out, &res, sizeof(res));
+  }
+};
+
+struct a2b10g10r10_unpack {
+  typedef uint32_t in_type;
+  typedef float out_type;
+  static constexpr size_t in_per_item = 1;
+  static constexpr size_t out_per_item = 4;
+
+  cpu_inline void run(const uint32_t *in, float *out) {
+    u32x8 v;
+    memcpy(&v, in, sizeof(v));
+    for (size_t j = 0; j < 3; j++) {
+      const i32x8 c = (i32x8)((v >> (10 * j)) & 1023);
+      scatter(out, 4, j, __builtin_convertvector(c, f32x8) / 1023.0f);
+    }
+    const i32x8 a = (i32x8)(v >> 30);
+    scatter(out, 4, 3, __builtin_convertvector(a, f32x8) / 3.0f);
+  }
+};
+
+/**
+ * Cigolle et al, "A Survey of Efficient Representations for Independent
+ * Unit Vectors": project onto the octahedron |x| + |y| + |z| = 1 and fold
+ * the lower half over the diagonals.
+ */
+struct octahedral_pack {
+  typedef float in_type;
+  typedef int16_t out_type;
+  static constexpr size_t in_per_item = 3;
+  static constexpr size_t out_per_item = 2;
+
+  cpu_inline void run(const float *in, int16_t *out) {
+    const f32x8 x = gather(in, 3, 0);
+    const f32x8 y = gather(in, 3, 1);
+    const f32x8 z = gather(in, 3, 2);
+    const f32x8 s = abs(x) + abs(y) + abs(z);
+    f32x8 px = x / s;
+    f32x8 py = y / s;
+    const f32x8 fx = (1.0f - abs(py)) * (px >= 0.0f ? splat(1) : splat(-1));
+    const f32x8 fy = (1.0f - abs(px)) * (py >= 0.0f ? splat(1) : splat(-1));
+    px = z < 0.0f ? fx : px;
+    py = z < 0.0f ? fy : py;
+    scatter(out, 2, 0, round_int(clamp(px, -1.0f, 1.0f) * 32767.0f));
+    scatter(out, 2, 1, round_int(clamp(py, -1.0f, 1.0f) * 32767.0f));
+  }
+};
+
+struct octahedral_unpack {
+  typedef int16_t in_type;
+  typedef float out_type;
+  static constexpr size_t in_per_item = 2;
+  static constexpr size_t out_per_item = 3;
+
+  cpu_inline void run(const int16_t *in, float *out) {
+    f32x8 x = gather(in, 2, 0) / 32767.0f;
+    f32x8 y = gather(in, 2, 1) / 32767.0f;
+    x = x < -1.0f ? splat(-1.0f) : x;
+    y = y < -1.0f ? splat(-1.0f) : y;
+    const f32x8 z = 1.0f - abs(x) - abs(y);
+    const f32x8 t = z < 0.0f ? -z : f32x8{};
+    x = x >= 0.0f ? x - t : x + t;
+    y = y >= 0.0f ? y - t : y + t;
+    const f32x8 len = sqrt(x * x + y * y + z * z);
+    scatter(out, 3, 0, x / len);
+    scatter(out, 3, 1, y / len);
+    scatter(out, 3, 2, z / len);
+  }
+};
+
+template <typename __Op>
+static void convert_generic(const typename __Op::in_type *in,
+                            typename __Op::out_type *out, size_t count) {
+  convert<__Op>(in, out, count);
+}
+
+template <typename __Op>
+cpu_target("avx2") static void convert_avx2(const typename __Op::in_type *in,
+                                           typename __Op::out_type *out,
+                                           size_t count) {
+  convert<__Op>(in, out, count);
+}
+
+template <typename __Op>
+static void run(const typename __Op::in_type *in,
+                typename __Op::out_type *out, size_t count) {
+  typedef void (*fn_type)(const typename __Op::in_type *,
+                          typename __Op::out_type *, size_t);
+  static const cpu_variant<fn_type> variants[]{
+      {CPU_AVX2, convert_avx2<__Op>},
+      {0, convert_generic<__Op>},
+  };
+  static cpu_dispatch<fn_type> fn{variants};
+  fn(in, out, count);
+}
+
+} // namespace internal
+
+void pack_half(const float *in, uint16_t *out, size_t count) {
+  static cpu_dispatch<internal::pack_half_fn> fn{internal::pack_half_variants};
+  fn(in, out, count);
+}
+
+void unpack_half(const uint16_t *in, float *out, size_t count) {
+  static cpu_dispatch<internal::unpack_half_fn> fn{
+      internal::unpack_half_variants};
+  fn(in, out, count);
+}
+
+void pack_snorm16(const float *in, int16_t *out, size_t count) {
+  internal::run<internal::norm_pack<int16_t>>(in, out, count);
+}
+
+void unpack_snorm16(const int16_t *in, float *out, size_t count) {
+  internal::run<internal::norm_unpack<int16_t>>(in, out, count);
+}
+
+void pack_unorm16(const float *in, uint16_t *out, size_t count) {
+  internal::run<internal::norm_pack<uint16_t>>(in, out, count);
+}
+
+void unpack_unorm16(const uint16_t *in, float *out, size_t count) {
+  internal::run<internal::norm_unpack<uint16_t>>(in, out, count);
+}
+
+void pack_snorm8(const float *in, int8_t *out, size_t count) {
+  internal::run<internal::norm_pack<int8_t>>(in, out, count);
+}
+
+void unpack_snorm8(const int8_t *in, float *out, size_t count) {
+  internal::run<internal::norm_unpack<int8_t>>(in, out, count);
+}
+
+void pack_unorm8(const float *in, uint8_t *out, size_t count) {
+  internal::run<internal::norm_pack<uint8_t>>(in, out, count);
+}
+
+void unpack_unorm8(const uint8_t *in, float *out, size_t count) {
+  internal::run<internal::norm_unpack<uint8_t>>(in, out, count);
+}
+
+void pack_a2b10g10r10(const float *rgba, uint32_t *out, size_t count) {
+  internal::run<internal::a2b10g10r10_pack>(rgba, out, count);
+}
+
+void unpack_a2b10g10r10(const uint32_t *in, float *rgba, size_t count) {
+  internal::run<internal::a2b10g10r10_unpack>(in, rgba, count);
+}
+
+void pack_octahedral(const float *xyz, int16_t *out, size_t count) {
+  internal::run<internal::octahedral_pack>(xyz, out, count);
+}
+
+void unpack_octahedral(const int16_t *in, float *xyz, size_t count) {
+  internal::run<internal::octahedral_unpack>(in, xyz, count);
+}
+
+} // namespace common
@@ -0,0 +1,49 @@
+#ifndef VERTEX_PACK_H
+#define VERTEX_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Encoders and decoders for the packed vertex attribute formats of the
+ * renderer's DataType, meant for mesh loading and cooking. The encoders
+ * round to nearest even, clamp to the range of the format and turn NaN
+ * into zero, the decoders follow the Vulkan conversion rules so the CPU
+ * sees the values the vertex shader will. count is the number of encoded
+ * components unless noted otherwise.
+ */
+namespace common {
+
+/**
+ * IEEE half floats, with F16C when the CPU has it.
+ */
+void pack_half(const float *in, uint16_t *out, size_t count);
+void unpack_half(const uint16_t *in, float *out, size_t count);
+
+void pack_snorm16(const float *in, int16_t *out, size_t count);
+void unpack_snorm16(const int16_t *in, float *out, size_t count);
+void pack_unorm16(const float *in, uint16_t *out, size_t count);
+void unpack_unorm16(const uint16_t *in, float *out, size_t count);
+void pack_snorm8(const float *in, int8_t *out, size_t count);
+void unpack_snorm8(const int8_t *in, float *out, size_t count);
+void pack_unorm8(const float *in, uint8_t *out, size_t count);
+void unpack_unorm8(const uint8_t *in, float *out, size_t count);
+
+/**
+ * count rgba quadruples to and from A2B10G10R10 words, red in the low
+ * bits.
+ */
+void pack_a2b10g10r10(const float *rgba, uint32_t *out, size_t count);
+void unpack_a2b10g10r10(const uint32_t *in, float *rgba, size_t count);
+
+/**
+ * count xyz normals to and from octahedral snorm16 pairs. The normals do
+ * not need to be unit length, a zero normal decodes as +z. Decoded
+ * normals are unit length and within 0.004 degrees of the original.
+ */
+void pack_octahedral(const float *xyz, int16_t *out, size_t count);
+void unpack_octahedral(const int16_t *in, float *xyz, size_t count);
+
+} // namespace common
+
+#endif // VERTEX_PACK_H
@@ -8,6 +8,9 @@
 #define cpp_do_pragma(x) _Pragma(#x)
 #define todo(x) cpp_do_pragma(message("TODO - " #x))
 
+#define cpp_concat_impl(a, b) a##b
+#define cpp_concat(a, b) cpp_concat_impl(a, b)
+
 template <typename T, typename _Res = int32_t> _Res size_of() {
   return static_cast<_Res>(sizeof(T));
 }
@@ -1,8 +1,11 @@
 #include "engine.h"
 
 #include "common/hash.h"
+#include "common/log.h"
+#include "common/profiler.h"
 #include "renderer/renderer.h"
 
+#include "memory/heap_snapshot.h"
 #include "memory/memory.h"
 
 namespace ZeroG {
@@ -15,6 +18,8 @@ struct engine {
 } // namespace ZeroG
 
 ZeroG::engine *ZeroG::init_engine(app_info *app) {
+  profile_function();
+  common::log_start(stdout);
   allocator *core = create_bitmapped_allocator(Mb * 16);
   allocator *base = create_stack_allocator(Mb * 16, core);
   blk b = allocate(base, sizeof(engine));
@@ -49,4 +54,14 @@ void ZeroG::deinit_engine(ZeroG::engine *instance) {
   destry_kernel(instance->render);
   deinit_renderer(instance->render);
   destroy_allocator(instance->core_allocator);
+  common::log_stop();
+}
+
+bool ZeroG::snapshot_heap(ZeroG::engine *instance, const char *path) {
+  FILE *file = fopen(path, "ab");
+  if (!file)
+    return false;
+  bool res = write_heap_snapshot(instance->core_allocator, file);
+  fclose(file);
+  return res;
 }
@@ -10,6 +10,12 @@ struct engine;
 engine *init_engine(app_info *app);
 void deinit_engine(engine *instance);
 
+/**
+ * Appends a snapshot of the allocator tree rooted at the core allocator to
+ * path, see memory/heap_snapshot.h.
+ */
+bool snapshot_heap(engine *instance, const char *path);
+
 } // namespace ZeroG
 
 #endif // ENGINE_H
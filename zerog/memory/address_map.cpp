@@ -0,0 +1,192 @@
+#include "address_map.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+
+/**
+ * Three level radix tree over 64Kb chunks of a 48 bit address space. Every
+ * chunk a range touches gets a copy of the range in one of its slots, so
+ * a lookup is three dependent loads plus a scan of a few candidates. Ranges
+ * sharing a chunk (neighbours or nested allocators) use separate slots, a
+ * chunk with more of them than a row holds chains further rows.
+ *
+ * Slots hold copies rather than pointers because ranges live in allocator
+ * headers, which another thread may free mid lookup. Each row is a
+ * seqlock: writers make its sequence odd while they change slots and
+ * readers retry a row whose sequence was odd or moved. Interior nodes and
+ * rows are never released so readers need no other reclamation.
+ */
+
+static constexpr uint32_t chunk_shift{16};
+static constexpr uint32_t address_bits{48};
+static constexpr uint32_t leaf_bits{10};
+static constexpr uint32_t mid_bits{10};
+static constexpr uint32_t root_bits{address_bits - chunk_shift - leaf_bits -
+                                    mid_bits};
+static constexpr uint32_t slot_count{8};
+
+// begin is null for an empty slot.
+struct range_slot {
+  std::atomic<const uint8_t *> begin;
+  std::atomic<const uint8_t *> end;
+  std::atomic<void *> owner;
+};
+
+struct slot_row {
+  std::atomic<uint32_t> sequence;
+  range_slot slots[slot_count];
+  std::atomic<slot_row *> next;
+};
+
+struct leaf_node {
+  slot_row rows[1u << leaf_bits];
+};
+
+struct mid_node {
+  std::atomic<leaf_node *> leaves[1u << mid_bits];
+};
+
+static std::atomic<mid_node *> root[1u << root_bits];
+static std::atomic_flag write_lock = ATOMIC_FLAG_INIT;
+
+static uintptr_t chunk_of(const void *ptr) {
+  uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+  assert((addr >> address_bits) == 0 && "Address exceeded 48 bits");
+  return addr >> chunk_shift;
+}
+
+static slot_row *row_of(uintptr_t chunk, bool create) {
+  const uintptr_t r = chunk >> (leaf_bits + mid_bits);
+  const uintptr_t m = (chunk >> leaf_bits) & ((1u << mid_bits) - 1);
+  const uintptr_t l = chunk & ((1u << leaf_bits) - 1);
+
+  mid_node *mid = root[r].load(std::memory_order_acquire);
+  if (!mid) {
+    if (!create)
+      return nullptr;
+    mid = static_cast<mid_node *>(calloc(1, sizeof(mid_node)));
+    assert(mid && "Failed to allocated data");
+    root[r].store(mid, std::memory_order_release);
+  }
+
+  leaf_node *leaf = mid->leaves[m].load(std::memory_order_acquire);
+  if (!leaf) {
+    if (!create)
+      return nullptr;
+    leaf = static_cast<leaf_node *>(calloc(1, sizeof(leaf_node)));
+    assert(leaf && "Failed to allocated data");
+    mid->leaves[m].store(leaf, std::memory_order_release);
+  }
+  return &leaf->rows[l];
+}
+
+static void lock() {
+  while (write_lock.test_and_set(std::memory_order_acquire)) {
+  }
+}
+
+static void unlock() { write_lock.clear(std::memory_order_release); }
+
+/**
+ * Rewrites a slot of row under the write lock.
+ */
+static void write_slot(slot_row *row, range_slot *slot,
+                       const address_range &range) {
+  const uint32_t sequence = row->sequence.load(std::memory_order_relaxed);
+  row->sequence.store(sequence + 1, std::memory_order_relaxed);
+  // Release keeps the odd sequence ahead of the fields, a reader that
+  // sees any of them new sees the sequence moved.
+  slot->begin.store(range.begin, std::memory_order_release);
+  slot->end.store(range.end, std::memory_order_release);
+  slot->owner.store(range.owner, std::memory_order_release);
+  row->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+static bool slot_holds(const range_slot &slot, const address_range &range) {
+  return slot.begin.load(std::memory_order_relaxed) == range.begin &&
+         slot.end.load(std::memory_order_relaxed) == range.end &&
+         slot.owner.load(std::memory_order_relaxed) == range.owner;
+}
+
+void register_address_range(address_range *range) {
+  assert(range && range->begin < range->end && "Address range is empty");
+
+  lock();
+  const uintptr_t first = chunk_of(range->begin);
+  const uintptr_t last = chunk_of(range->end - 1);
+  for (uintptr_t c = first; c <= last; c++) {
+    slot_row *row = row_of(c, true);
+    for (;;) {
+      uint32_t i = 0;
+      while (i < slot_count &&
+             row->slots[i].begin.load(std::memory_order_relaxed))
+        i++;
+      if (i < slot_count) {
+        write_slot(row, &row->slots[i], *range);
+        break;
+      }
+      slot_row *next = row->next.load(std::memory_order_relaxed);
+      if (!next) {
+        next = static_cast<slot_row *>(calloc(1, sizeof(slot_row)));
+        assert(next && "Failed to allocated data");
+        row->next.store(next, std::memory_order_release);
+      }
+      row = next;
+    }
+  }
+  unlock();
+}
+
+void unregister_address_range(address_range *range) {
+  assert(range && "Address range is null");
+
+  lock();
+  const uintptr_t first = chunk_of(range->begin);
+  const uintptr_t last = chunk_of(range->end - 1);
+  for (uintptr_t c = first; c <= last; c++) {
+    slot_row *row = row_of(c, false);
+    assert(row && "Address range was not registered");
+    bool found = false;
+    for (; row && !found; row = row->next.load(std::memory_order_relaxed)) {
+      for (uint32_t i = 0; i < slot_count; i++) {
+        if (slot_holds(row->slots[i], *range)) {
+          write_slot(row, &row->slots[i], address_range{});
+          found = true;
+          break;
+        }
+      }
+    }
+  }
+  unlock();
+}
+
+bool find_address_range(const void *ptr, address_range *range) {
+  const uint8_t *p = static_cast<const uint8_t *>(ptr);
+  address_range best{};
+  for (slot_row *row = row_of(chunk_of(ptr), false); row;
+       row = row->next.load(std::memory_order_acquire)) {
+    address_range hit{};
+    uint32_t sequence;
+    do {
+      sequence = row->sequence.load(std::memory_order_acquire);
+      hit = address_range{};
+      for (const range_slot &slot : row->slots) {
+        const uint8_t *begin = slot.begin.load(std::memory_order_acquire);
+        const uint8_t *end = slot.end.load(std::memory_order_acquire);
+        if (begin && p >= begin && p < end &&
+            (!hit.begin || end - begin < hit.end - hit.begin))
+          hit = {begin, end, slot.owner.load(std::memory_order_acquire)};
+      }
+    } while ((sequence & 1) ||
+             row->sequence.load(std::memory_order_relaxed) != sequence);
+
+    if (hit.begin &&
+        (!best.begin || hit.end - hit.begin < best.end - best.begin))
+      best = hit;
+  }
+  if (!best.begin)
+    return false;
+  *range = best;
+  return true;
+}
@@ -0,0 +1,29 @@
+#ifndef ADDRESS_MAP_H
+#define ADDRESS_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Process wide map from an address to the registered range that contains
+ * it. Ranges may nest, a lookup returns the innermost one. Lookups are lock
+ * free; registration is expected to be rare (allocator create/destroy).
+ * The map keeps copies of the ranges, so a range may be unregistered and
+ * freed while other threads look up addresses, its own included.
+ */
+struct address_range {
+  const uint8_t *begin;
+  const uint8_t *end;
+  void *owner;
+};
+
+void register_address_range(address_range *range);
+void unregister_address_range(address_range *range);
+
+/**
+ * Copies the innermost range containing ptr into range, false when there
+ * is none.
+ */
+bool find_address_range(const void *ptr, address_range *range);
+
+#endif // ADDRESS_MAP_H
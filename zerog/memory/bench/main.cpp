@@ -1,13 +1,18 @@
 
 #include "benchmark/benchmark.h"
+#include "common/bench/perf_bench.h"
+#include "memory/device_memory.h"
 #include "memory/memory.h"
+#include "memory/numa.h"
 
 static void malloc_allocate_small(benchmark::State &state) {
+  perf_bench perf;
   while (state.KeepRunning()) {
     auto data = malloc(75);
     benchmark::DoNotOptimize(data);
     free(data);
   }
+  perf.report(state);
 }
 
 static void malloc_allocate_mid(benchmark::State &state) {
@@ -100,20 +105,24 @@ static void malloc_allocate_large_a8_d1(benchmark::State &state) {
 }
 
 static void stack_allocator_cd(benchmark::State &state) {
+  perf_bench perf;
   while (state.KeepRunning()) {
     allocator *alloc = create_stack_allocator(Gb);
     benchmark::DoNotOptimize(alloc);
     destroy_allocator(alloc);
   }
+  perf.report(state);
 }
 
 static void stack_allocator_allocate_small(benchmark::State &state) {
   allocator *alloc = create_stack_allocator(Gb);
+  perf_bench perf;
   while (state.KeepRunning()) {
     auto blk = allocate(alloc, 75);
     benchmark::DoNotOptimize(blk);
     deallocate(alloc, blk);
   }
+  perf.report(state);
   destroy_allocator(alloc);
 }
 
@@ -187,20 +196,24 @@ static void stack_allocator_allocate_parts_a8_d1(benchmark::State &state) {
 }
 
 static void pool_allocator_cd(benchmark::State &state) {
+  perf_bench perf;
   while (state.KeepRunning()) {
     allocator *alloc = create_pool_allocator(Mb, 1024);
     benchmark::DoNotOptimize(alloc);
     destroy_allocator(alloc);
   }
+  perf.report(state);
 }
 
 static void pool_allocator_allocate_small(benchmark::State &state) {
   allocator *alloc = create_pool_allocator(128, 8196);
+  perf_bench perf;
   while (state.KeepRunning()) {
     auto blk = allocate(alloc, 75);
     benchmark::DoNotOptimize(blk);
     deallocate(alloc, blk);
   }
+  perf.report(state);
   destroy_allocator(alloc);
 }
 
@@ -274,20 +287,24 @@ static void pool_allocator_allocate_parts_a8_d1(benchmark::State &state) {
 }
 
 static void bitmapped_allocator_cd(benchmark::State &state) {
+  perf_bench perf;
   while (state.KeepRunning()) {
     allocator *alloc = create_bitmapped_allocator(Mb * 16);
     benchmark::DoNotOptimize(alloc);
     destroy_allocator(alloc);
   }
+  perf.report(state);
 }
 
 static void bitmapped_allocator_allocate_small(benchmark::State &state) {
   allocator *alloc = create_bitmapped_allocator(Kb * 256);
+  perf_bench perf;
   while (state.KeepRunning()) {
     auto blk = allocate(alloc, 75);
     benchmark::DoNotOptimize(blk);
     deallocate(alloc, blk);
   }
+  perf.report(state);
   destroy_allocator(alloc);
 }
 
@@ -370,6 +387,142 @@ static void bitmapped_allocator_allocate_parts_a8_d1(benchmark::State &state) {
   destroy_allocator(alloc);
 }
 
+static allocator *concurrent_alloc{nullptr};
+
+static void pool_allocator_deallocate_any(benchmark::State &state) {
+  allocator *alloc = create_pool_allocator(128, 1024);
+  while (state.KeepRunning()) {
+    blk b = allocate(alloc, 75);
+    benchmark::DoNotOptimize(b);
+    deallocate_any(b.ptr);
+  }
+  destroy_allocator(alloc);
+}
+
+static void bitmapped_allocator_deallocate_any(benchmark::State &state) {
+  allocator *alloc = create_bitmapped_allocator(Kb);
+  while (state.KeepRunning()) {
+    blk b = allocate(alloc, Kb * 5);
+    benchmark::DoNotOptimize(b);
+    deallocate_any(b.ptr);
+  }
+  destroy_allocator(alloc);
+}
+
+/**
+ * Shared arenas can not be reset while other threads allocate, so these
+ * runs have a fixed iteration count and arenas that hold all of it: 8
+ * threads of 80 byte blocks plus a chunk each, even when every thread
+ * lands on the same node.
+ */
+static constexpr size_t shared_arena_iterations{1 << 20};
+
+static void concurrent_stack_allocator_allocate_small(benchmark::State &state) {
+  if (state.thread_index == 0)
+    concurrent_alloc = create_concurrent_stack_allocator(Gb, Kb * 64);
+  perf_bench perf;
+  while (state.KeepRunning()) {
+    auto blk = allocate(concurrent_alloc, 75);
+    benchmark::DoNotOptimize(blk);
+    if (!blk.ptr) {
+      state.SkipWithError("Arena is too small for the run");
+      break;
+    }
+  }
+  perf.report(state);
+  if (state.thread_index == 0)
+    destroy_allocator(concurrent_alloc);
+}
+
+static void concurrent_stack_allocator_no_chunks(benchmark::State &state) {
+  if (state.thread_index == 0)
+    concurrent_alloc = create_concurrent_stack_allocator(Gb, 0);
+  while (state.KeepRunning()) {
+    auto blk = allocate(concurrent_alloc, 75);
+    benchmark::DoNotOptimize(blk);
+    if (!blk.ptr) {
+      state.SkipWithError("Arena is too small for the run");
+      break;
+    }
+  }
+  if (state.thread_index == 0)
+    destroy_allocator(concurrent_alloc);
+}
+
+static node_arenas *bench_arenas;
+
+static void node_arenas_local_allocate_small(benchmark::State &state) {
+  if (state.thread_index == 0)
+    bench_arenas = create_node_arenas(Gb, Kb * 64);
+  while (state.KeepRunning()) {
+    auto blk = allocate(local_arena(bench_arenas), 75);
+    benchmark::DoNotOptimize(blk);
+    if (!blk.ptr) {
+      state.SkipWithError("Arena is too small for the run");
+      break;
+    }
+  }
+  if (state.thread_index == 0)
+    destroy_node_arenas(bench_arenas);
+}
+
+static bool bench_device_allocate(void *, uint32_t, size_t, uint64_t *memory) {
+  static uint64_t handle{0};
+  *memory = ++handle;
+  return true;
+}
+
+static void bench_device_free(void *, uint32_t, uint64_t) {}
+
+static device_memory *create_bench_device_memory(allocator *alloc) {
+  device_memory_create_info info{};
+  info.backend = {nullptr, bench_device_allocate, bench_device_free, nullptr,
+                  nullptr};
+  info.memory_type_count = 1;
+  info.block_size = Mb * 256;
+  info.buffer_image_granularity = Kb;
+  info.max_allocations_per_block = 4096;
+  return create_device_memory(alloc, &info);
+}
+
+static void device_memory_allocate_small(benchmark::State &state) {
+  allocator *alloc =
+      create_pool_allocator(device_memory_block_footprint(4096), 8);
+  device_memory *memory = create_bench_device_memory(alloc);
+  while (state.KeepRunning()) {
+    auto a = device_allocate(memory, 0, Kb * 4, 256, DEVICE_RESOURCE_LINEAR);
+    benchmark::DoNotOptimize(a);
+    device_deallocate(memory, a);
+  }
+  destroy_device_memory(memory);
+  destroy_allocator(alloc);
+}
+
+static void device_memory_allocate_mixed(benchmark::State &state) {
+  allocator *alloc =
+      create_pool_allocator(device_memory_block_footprint(4096), 8);
+  device_memory *memory = create_bench_device_memory(alloc);
+  device_allocation live[1024]{};
+  uint32_t seed = 1;
+  while (state.KeepRunning()) {
+    seed = seed * 1664525u + 1013904223u;
+    auto &a = live[(seed >> 8) & 1023];
+    if (a.memory) {
+      device_deallocate(memory, a);
+      a = {};
+    } else {
+      a = device_allocate(memory, 0, ((seed >> 12) & (Kb * 64 - 1)) + 1, 256,
+                          (seed & 1) ? DEVICE_RESOURCE_OPTIMAL
+                                     : DEVICE_RESOURCE_LINEAR);
+      benchmark::DoNotOptimize(a);
+    }
+  }
+  for (auto &a : live)
+    device_deallocate(memory, a);
+  destroy_device_memory(memory);
+  destroy_allocator(alloc);
+}
+
 BENCHMARK(malloc_allocate_small);
 BENCHMARK(malloc_allocate_mid);
 BENCHMARK(malloc_allocate_large);
@@ -394,5 +547,18 @@ BENCHMARK(bitmapped_allocator_allocate_large);
 BENCHMARK(bitmapped_allocator_allocate_large_ext);
 BENCHMARK(bitmapped_allocator_allocate_parts_a6_d0);
 BENCHMARK(bitmapped_allocator_allocate_parts_a8_d1);
+BENCHMARK(pool_allocator_deallocate_any);
+BENCHMARK(bitmapped_allocator_deallocate_any);
+BENCHMARK(concurrent_stack_allocator_allocate_small)
+    ->ThreadRange(1, 8)
+    ->Iterations(shared_arena_iterations);
+BENCHMARK(concurrent_stack_allocator_no_chunks)
+    ->ThreadRange(1, 8)
+    ->Iterations(shared_arena_iterations);
+BENCHMARK(node_arenas_local_allocate_small)
+    ->ThreadRange(1, 8)
+    ->Iterations(shared_arena_iterations);
+BENCHMARK(device_memory_allocate_small);
+BENCHMARK(device_memory_allocate_mixed);
 
 BENCHMARK_MAIN();
@@ -0,0 +1,542 @@
+#include "device_memory.h"
+
+#include "common/math.h"
+
+#include <cassert>
+#include <cstring>
+
+/**
+ * Every device block is sub-allocated by a two level segregated fit
+ * structure. Free ranges are binned by a small float encoding of their size
+ * (3 mantissa bits), bins are tracked by a 32 bit top mask and 8 bit leaf
+ * masks, so finding a fitting free range is two bit scans. Neighbour links
+ * let a freed range merge with adjacent free ranges in O(1).
+ *
+ * All bookkeeping lives in host memory taken from the parent allocator; the
+ * device memory is never touched by the CPU side.
+ */
+
+static constexpr uint32_t invalid_node{0xffffffff};
+static constexpr uint32_t mantissa_bits{3};
+static constexpr uint32_t mantissa_value{1u << mantissa_bits};
+static constexpr uint32_t mantissa_mask{mantissa_value - 1};
+static constexpr uint32_t top_bin_count{32};
+static constexpr uint32_t leaf_bin_count{8};
+static constexpr uint32_t bin_count{top_bin_count * leaf_bin_count};
+
+static constexpr size_t default_block_size{64 * Mb};
+static constexpr uint32_t default_max_allocations{1024};
+static constexpr size_t max_block_size{2 * Gb};
+
+struct device_node {
+  uint32_t offset;
+  uint32_t size;
+  uint32_t bin_prev;
+  uint32_t bin_next;
+  uint32_t neighbor_prev;
+  uint32_t neighbor_next;
+  uint32_t used;
+};
+
+struct device_block {
+  device_block *next;
+  blk storage;
+  uint64_t memory;
+  uint8_t *mapped;
+  uint32_t size;
+  uint32_t free_storage;
+  uint32_t memory_type;
+  uint32_t allocation_count;
+  uint32_t max_nodes;
+  uint32_t free_offset;
+  uint32_t used_bins_top;
+  uint8_t used_bins[top_bin_count];
+  uint32_t bin_indices[bin_count];
+  device_node *nodes;
+  uint32_t *free_nodes;
+};
+
+struct device_memory {
+  allocator *alloc;
+  blk storage;
+  device_memory_backend backend;
+  device_block *blocks[device_memory_max_types];
+  uint32_t memory_type_flags[device_memory_max_types];
+  uint32_t memory_type_count;
+  uint32_t max_nodes;
+  size_t block_size;
+  size_t granularity;
+  size_t dedicated_threshold;
+  size_t dedicated_count;
+  size_t dedicated_bytes;
+  size_t allocation_count;
+  size_t bytes_used;
+};
+
+static uint32_t bin_round_up(uint32_t size) {
+  uint32_t exp = 0;
+  uint32_t mantissa = 0;
+  if (size < mantissa_value) {
+    mantissa = size;
+  } else {
+    const uint32_t highest = 31 - static_cast<uint32_t>(__builtin_clz(size));
+    const uint32_t mantissa_start = highest - mantissa_bits;
+    exp = mantissa_start + 1;
+    mantissa = (size >> mantissa_start) & mantissa_mask;
+    const uint32_t low_mask = (1u << mantissa_start) - 1;
+    if (size & low_mask) {
+      mantissa++;
+    }
+  }
+  // A mantissa overflow carries into the exponent, which is what we want.
+  return (exp << mantissa_bits) + mantissa;
+}
+
+static uint32_t bin_round_down(uint32_t size) {
+  uint32_t exp = 0;
+  uint32_t mantissa = 0;
+  if (size < mantissa_value) {
+    mantissa = size;
+  } else {
+    const uint32_t highest = 31 - static_cast<uint32_t>(__builtin_clz(size));
+    const uint32_t mantissa_start = highest - mantissa_bits;
+    exp = mantissa_start + 1;
+    mantissa = (size >> mantissa_start) & mantissa_mask;
+  }
+  return (exp << mantissa_bits) | mantissa;
+}
+
+static uint32_t lowest_bit_after(uint32_t mask, uint32_t start) {
+  const uint32_t mask_before = start < 32 ? (1u << start) - 1 : ~0u;
+  const uint32_t bits = mask & ~mask_before;
+  return bits ? static_cast<uint32_t>(__builtin_ctz(bits)) : invalid_node;
+}
+
+static uint32_t find_bin(const device_block *block, uint32_t size) {
+  const uint32_t min_bin = bin_round_up(size);
+  uint32_t top = min_bin >> mantissa_bits;
+  const uint32_t leaf = min_bin & mantissa_mask;
+
+  if (top >= top_bin_count)
+    return invalid_node;
+
+  uint32_t leaf_idx = invalid_node;
+  if (block->used_bins_top & (1u << top)) {
+    leaf_idx = lowest_bit_after(block->used_bins[top], leaf);
+  }
+  if (leaf_idx == invalid_node) {
+    top = lowest_bit_after(block->used_bins_top, top + 1);
+    if (top == invalid_node)
+      return invalid_node;
+    leaf_idx = static_cast<uint32_t>(__builtin_ctz(block->used_bins[top]));
+  }
+  return (top << mantissa_bits) | leaf_idx;
+}
+
+static uint32_t insert_node(device_block *block, uint32_t offset,
+                            uint32_t size) {
+  assert(block->free_offset > 0 && "Device block ran out of nodes");
+
+  const uint32_t bin = bin_round_down(size);
+  const uint32_t top = bin >> mantissa_bits;
+  const uint32_t leaf = bin & mantissa_mask;
+
+  if (block->bin_indices[bin] == invalid_node) {
+    block->used_bins[top] |= static_cast<uint8_t>(1u << leaf);
+    block->used_bins_top |= 1u << top;
+  }
+
+  const uint32_t head = block->bin_indices[bin];
+  const uint32_t idx = block->free_nodes[--block->free_offset];
+  device_node &node = block->nodes[idx];
+  node.offset = offset;
+  node.size = size;
+  node.bin_prev = invalid_node;
+  node.bin_next = head;
+  node.neighbor_prev = invalid_node;
+  node.neighbor_next = invalid_node;
+  node.used = 0;
+
+  if (head != invalid_node)
+    block->nodes[head].bin_prev = idx;
+  block->bin_indices[bin] = idx;
+  block->free_storage += size;
+  return idx;
+}
+
+static void unlink_node(device_block *block, uint32_t idx) {
+  device_node &node = block->nodes[idx];
+
+  if (node.bin_prev != invalid_node) {
+    block->nodes[node.bin_prev].bin_next = node.bin_next;
+    if (node.bin_next != invalid_node)
+      block->nodes[node.bin_next].bin_prev = node.bin_prev;
+  } else {
+    const uint32_t bin = bin_round_down(node.size);
+    const uint32_t top = bin >> mantissa_bits;
+    const uint32_t leaf = bin & mantissa_mask;
+
+    block->bin_indices[bin] = node.bin_next;
+    if (node.bin_next != invalid_node)
+      block->nodes[node.bin_next].bin_prev = invalid_node;
+
+    if (block->bin_indices[bin] == invalid_node) {
+      block->used_bins[top] &= static_cast<uint8_t>(~(1u << leaf));
+      if (block->used_bins[top] == 0)
+        block->used_bins_top &= ~(1u << top);
+    }
+  }
+  block->free_storage -= node.size;
+}
+
+static void release_node(device_block *block, uint32_t idx) {
+  block->free_nodes[block->free_offset++] = idx;
+}
+
+static bool fits(const device_node &node, uint32_t size, uint32_t alignment) {
+  const uint32_t pad =
+      static_cast<uint32_t>(align_block(alignment, node.offset)) - node.offset;
+  return static_cast<uint64_t>(pad) + size <= node.size;
+}
+
+static bool block_allocate(device_block *block, uint32_t size,
+                           uint32_t alignment, device_allocation *res) {
+  // A split can produce a leading pad and a trailing remainder.
+  if (block->free_offset < 2 || block->free_storage < size)
+    return false;
+
+  uint32_t bin = find_bin(block, size);
+  if (bin != invalid_node &&
+      !fits(block->nodes[block->bin_indices[bin]], size, alignment)) {
+    const uint64_t padded = static_cast<uint64_t>(size) + alignment - 1;
+    bin = padded <= block->size ? find_bin(block, static_cast<uint32_t>(padded))
+                                : invalid_node;
+  }
+  if (bin == invalid_node)
+    return false;
+
+  const uint32_t idx = block->bin_indices[bin];
+  unlink_node(block, idx);
+
+  device_node &node = block->nodes[idx];
+  const uint32_t pad =
+      static_cast<uint32_t>(align_block(alignment, node.offset)) - node.offset;
+
+  if (pad) {
+    const uint32_t p = insert_node(block, node.offset, pad);
+    block->nodes[p].neighbor_prev = node.neighbor_prev;
+    block->nodes[p].neighbor_next = idx;
+    if (node.neighbor_prev != invalid_node)
+      block->nodes[node.neighbor_prev].neighbor_next = p;
+    node.neighbor_prev = p;
+    node.offset += pad;
+    node.size -= pad;
+  }
+
+  const uint32_t remainder = node.size - size;
+  if (remainder) {
+    const uint32_t t = insert_node(block, node.offset + size, remainder);
+    block->nodes[t].neighbor_prev = idx;
+    block->nodes[t].neighbor_next = node.neighbor_next;
+    if (node.neighbor_next != invalid_node)
+      block->nodes[node.neighbor_next].neighbor_prev = t;
+    node.neighbor_next = t;
+    node.size = size;
+  }
+
+  node.used = 1;
+  block->allocation_count++;
+
+  res->memory = block->memory;
+  res->offset = node.offset;
+  res->size = node.size;
+  res->mapped = block->mapped ? block->mapped + node.offset : nullptr;
+  res->block = block;
+  res->node = idx;
+  res->memory_type = block->memory_type;
+  return true;
+}
+
+static void block_free(device_block *block, uint32_t idx) {
+  device_node &node = block->nodes[idx];
+  assert(node.used && "Device allocation was already released");
+
+  uint32_t offset = node.offset;
+  uint32_t size = node.size;
+  uint32_t prev = node.neighbor_prev;
+  uint32_t next = node.neighbor_next;
+
+  if (prev != invalid_node && !block->nodes[prev].used) {
+    const device_node &p = block->nodes[prev];
+    offset = p.offset;
+    size += p.size;
+    unlink_node(block, prev);
+    release_node(block, prev);
+    prev = p.neighbor_prev;
+  }
+
+  if (next != invalid_node && !block->nodes[next].used) {
+    const device_node &n = block->nodes[next];
+    size += n.size;
+    unlink_node(block, next);
+    release_node(block, next);
+    next = n.neighbor_next;
+  }
+
+  release_node(block, idx);
+
+  const uint32_t c = insert_node(block, offset, size);
+  block->nodes[c].neighbor_prev = prev;
+  block->nodes[c].neighbor_next = next;
+  if (prev != invalid_node)
+    block->nodes[prev].neighbor_next = c;
+  if (next != invalid_node)
+    block->nodes[next].neighbor_prev = c;
+
+  block->allocation_count--;
+}
+
+size_t device_memory_block_footprint(uint32_t max_allocations_per_block) {
+  const uint32_t count = max_allocations_per_block ? max_allocations_per_block
+                                                   : default_max_allocations;
+  return align_block(16, sizeof(device_block)) +
+         align_block(16, sizeof(device_node) * count) +
+         sizeof(uint32_t) * count;
+}
+
+static device_block *create_block(device_memory *memory, uint32_t memory_type) {
+  uint64_t handle{0};
+  if (!memory->backend.allocate(memory->backend.user_data, memory_type,
+                                memory->block_size, &handle))
+    return nullptr;
+
+  blk b = allocate(memory->alloc,
+                   device_memory_block_footprint(memory->max_nodes));
+  if (!b.ptr) {
+    memory->backend.free(memory->backend.user_data, memory_type, handle);
+    return nullptr;
+  }
+
+  uint8_t *raw = static_cast<uint8_t *>(b.ptr);
+  device_block *block = reinterpret_cast<device_block *>(raw);
+  raw += align_block(16, sizeof(device_block));
+
+  block->next = nullptr;
+  block->storage = b;
+  block->memory = handle;
+  block->mapped = nullptr;
+  block->size = static_cast<uint32_t>(memory->block_size);
+  block->free_storage = 0;
+  block->memory_type = memory_type;
+  block->allocation_count = 0;
+  block->max_nodes = memory->max_nodes;
+  block->used_bins_top = 0;
+  memset(block->used_bins, 0, sizeof(block->used_bins));
+  memset(block->bin_indices, 0xff, sizeof(block->bin_indices));
+  block->nodes = reinterpret_cast<device_node *>(raw);
+  raw += align_block(16, sizeof(device_node) * memory->max_nodes);
+  block->free_nodes = reinterpret_cast<uint32_t *>(raw);
+
+  for (uint32_t i = 0; i < block->max_nodes; i++) {
+    block->free_nodes[i] = block->max_nodes - i - 1;
+  }
+  block->free_offset = block->max_nodes;
+
+  insert_node(block, 0, block->size);
+
+  if (memory->memory_type_flags[memory_type] & DEVICE_MEMORY_HOST_VISIBLE) {
+    block->mapped = static_cast<uint8_t *>(memory->backend.map(
+        memory->backend.user_data, handle, memory->block_size));
+  }
+
+  return block;
+}
+
+static void destroy_block(device_memory *memory, device_block *block) {
+  if (block->mapped)
+    memory->backend.unmap(memory->backend.user_data, block->memory);
+  memory->backend.free(memory->backend.user_data, block->memory_type,
+                       block->memory);
+  deallocate(memory->alloc, block->storage);
+}
+
+static device_allocation dedicated_allocate(device_memory *memory,
+                                            uint32_t memory_type,
+                                            size_t size) {
+  device_allocation res{};
+  uint64_t handle{0};
+  if (!memory->backend.allocate(memory->backend.user_data, memory_type, size,
+                                &handle))
+    return res;
+
+  res.memory = handle;
+  res.offset = 0;
+  res.size = size;
+  res.block = nullptr;
+  res.node = invalid_node;
+  res.memory_type = memory_type;
+  if (memory->memory_type_flags[memory_type] & DEVICE_MEMORY_HOST_VISIBLE) {
+    res.mapped = memory->backend.map(memory->backend.user_data, handle, size);
+  }
+
+  memory->dedicated_count++;
+  memory->dedicated_bytes += size;
+  return res;
+}
+
+device_memory *create_device_memory(allocator *alloc,
+                                    const device_memory_create_info *info) {
+  assert(alloc && "Requires a valid allocator");
+  assert(info && info->backend.allocate && info->backend.free &&
+         "Device memory backend is incomplete");
+  assert(info->memory_type_count <= device_memory_max_types &&
+         "Too many device memory types");
+
+  blk b = allocate(alloc, sizeof(device_memory));
+  assert(b.ptr && "Failed to allocated data");
+
+  device_memory *memory = static_cast<device_memory *>(b.ptr);
+  memset(memory, 0, sizeof(device_memory));
+  memory->alloc = alloc;
+  memory->storage = b;
+  memory->backend = info->backend;
+  memory->memory_type_count = info->memory_type_count;
+  memcpy(memory->memory_type_flags, info->memory_type_flags,
+         sizeof(memory->memory_type_flags));
+  memory->block_size = info->block_size ? info->block_size : default_block_size;
+  memory->granularity =
+      info->buffer_image_granularity ? info->buffer_image_granularity : 1;
+  memory->dedicated_threshold = info->dedicated_threshold
+                                    ? info->dedicated_threshold
+                                    : memory->block_size / 2;
+  memory->max_nodes = info->max_allocations_per_block
+                          ? info->max_allocations_per_block
+                          : default_max_allocations;
+
+  assert(memory->block_size <= max_block_size &&
+         "Device block size exceeded 2Gb");
+  assert((memory->granularity & (memory->granularity - 1)) == 0 &&
+         "Granularity must be a power of two");
+  return memory;
+}
+
+void destroy_device_memory(device_memory *memory) {
+  assert(memory && "Device memory is null");
+  for (uint32_t i = 0; i < memory->memory_type_count; i++) {
+    device_block *block = memory->blocks[i];
+    while (block) {
+      device_block *next = block->next;
+      destroy_block(memory, block);
+      block = next;
+    }
+  }
+  deallocate(memory->alloc, memory->storage);
+}
+
+device_allocation device_allocate(device_memory *memory, uint32_t memory_type,
+                                  size_t size, size_t alignment,
+                                  device_resource_kind kind, bool dedicated) {
+  assert(memory && "Device memory is null");
+  assert(memory_type < memory->memory_type_count &&
+         "Memory type is out of range");
+  assert(size > 0 && "Zero sized device allocation");
+
+  if (alignment == 0)
+    alignment = 1;
+  assert((alignment & (alignment - 1)) == 0 &&
+         "Alignment must be a power of two");
+
+  // Optimal resources own every granularity page they touch, so a linear
+  // resource can never alias one on the same page.
+  if (kind == DEVICE_RESOURCE_OPTIMAL && memory->granularity > 1) {
+    alignment = max(static_cast<uint64_t>(alignment),
+                    static_cast<uint64_t>(memory->granularity));
+    size = align_block(memory->granularity, size);
+  }
+
+  device_allocation res{};
+  if (dedicated || size >= memory->dedicated_threshold ||
+      size > memory->block_size) {
+    res = dedicated_allocate(memory, memory_type, size);
+  } else {
+    const uint32_t s = static_cast<uint32_t>(size);
+    const uint32_t a = static_cast<uint32_t>(alignment);
+
+    bool found = false;
+    for (device_block *block = memory->blocks[memory_type]; block && !found;
+         block = block->next) {
+      found = block_allocate(block, s, a, &res);
+    }
+
+    if (!found) {
+      device_block *block = create_block(memory, memory_type);
+      if (block) {
+        block->next = memory->blocks[memory_type];
+        memory->blocks[memory_type] = block;
+        found = block_allocate(block, s, a, &res);
+      }
+    }
+
+    if (!found) {
+      res = dedicated_allocate(memory, memory_type, size);
+    }
+  }
+
+  if (res.memory) {
+    memory->allocation_count++;
+    memory->bytes_used += res.size;
+  }
+  return res;
+}
+
+void device_deallocate(device_memory *memory, device_allocation allocation) {
+  assert(memory && "Device memory is null");
+  if (!allocation.memory)
+    return;
+
+  memory->allocation_count--;
+  memory->bytes_used -= allocation.size;
+
+  if (!allocation.block) {
+    if (allocation.mapped)
+      memory->backend.unmap(memory->backend.user_data, allocation.memory);
+    memory->backend.free(memory->backend.user_data, allocation.memory_type,
+                         allocation.memory);
+    memory->dedicated_count--;
+    memory->dedicated_bytes -= allocation.size;
+    return;
+  }
+
+  device_block *block = allocation.block;
+  block_free(block, allocation.node);
+
+  // Keep one warm block per memory type, release any other empty block.
+  if (block->allocation_count == 0) {
+    device_block **link = &memory->blocks[allocation.memory_type];
+    bool other_empty = false;
+    for (device_block *b = *link; b; b = b->next)
+      other_empty |= b != block && b->allocation_count == 0;
+    if (other_empty) {
+      while (*link != block)
+        link = &(*link)->next;
+      *link = block->next;
+      destroy_block(memory, block);
+    }
+  }
+}
+
+device_memory_stats get_device_memory_stats(const device_memory *memory) {
+  assert(memory && "Device memory is null");
+  device_memory_stats stats{};
+  stats.dedicated_count = memory->dedicated_count;
+  stats.allocation_count = memory->allocation_count;
+  stats.bytes_used = memory->bytes_used;
+  stats.bytes_reserved = memory->dedicated_bytes;
+  for (uint32_t i = 0; i < memory->memory_type_count; i++) {
+    for (device_block *b = memory->blocks[i]; b; b = b->next) {
+      stats.block_count++;
+      stats.bytes_reserved += b->size;
+    }
+  }
+  return stats;
+}
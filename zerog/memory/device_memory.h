@@ -0,0 +1,77 @@
+#ifndef DEVICE_MEMORY_H
+#define DEVICE_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "memory.h"
+
+constexpr uint32_t device_memory_max_types{32};
+
+/**
+ * Device side of the sub-allocator. Blocks are opaque 64-bit handles, so the
+ * same bookkeeping runs over Vulkan or over a fake device in tests.
+ */
+struct device_memory_backend {
+  void *user_data;
+  bool (*allocate)(void *user_data, uint32_t memory_type, size_t size,
+                   uint64_t *memory);
+  void (*free)(void *user_data, uint32_t memory_type, uint64_t memory);
+  void *(*map)(void *user_data, uint64_t memory, size_t size);
+  void (*unmap)(void *user_data, uint64_t memory);
+};
+
+enum device_memory_flags : uint32_t { DEVICE_MEMORY_HOST_VISIBLE = 0x1 };
+
+enum device_resource_kind : uint32_t {
+  DEVICE_RESOURCE_LINEAR,
+  DEVICE_RESOURCE_OPTIMAL
+};
+
+struct device_memory_create_info {
+  device_memory_backend backend;
+  uint32_t memory_type_flags[device_memory_max_types];
+  uint32_t memory_type_count;
+  size_t block_size;
+  size_t buffer_image_granularity;
+  size_t dedicated_threshold;
+  uint32_t max_allocations_per_block;
+};
+
+struct device_block;
+
+struct device_allocation {
+  uint64_t memory;
+  size_t offset;
+  size_t size;
+  void *mapped;
+  device_block *block;
+  uint32_t node;
+  uint32_t memory_type;
+};
+
+struct device_memory_stats {
+  size_t block_count;
+  size_t dedicated_count;
+  size_t allocation_count;
+  size_t bytes_reserved;
+  size_t bytes_used;
+};
+
+struct device_memory;
+
+size_t device_memory_block_footprint(uint32_t max_allocations_per_block);
+
+device_memory *create_device_memory(allocator *alloc,
+                                    const device_memory_create_info *info);
+void destroy_device_memory(device_memory *memory);
+
+device_allocation device_allocate(device_memory *memory, uint32_t memory_type,
+                                  size_t size, size_t alignment,
+                                  device_resource_kind kind,
+                                  bool dedicated = false);
+void device_deallocate(device_memory *memory, device_allocation allocation);
+
+device_memory_stats get_device_memory_stats(const device_memory *memory);
+
+#endif // DEVICE_MEMORY_H
@@ -0,0 +1,155 @@
+#include "heap_snapshot.h"
+
+#include "memory.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+struct snapshot_builder {
+  heap_snapshot_allocator *allocators;
+  size_t allocator_count;
+  size_t allocator_capacity;
+  heap_snapshot_range *ranges;
+  size_t range_count;
+  size_t range_capacity;
+};
+
+template <typename T> static T *grow(T *data, size_t *capacity) {
+  *capacity = *capacity ? *capacity * 2 : 64;
+  T *res = static_cast<T *>(realloc(data, *capacity * sizeof(T)));
+  assert(res && "Failed to allocated data");
+  return res;
+}
+
+static void on_visit(void *user_data, const allocator_layout *layout) {
+  auto builder = static_cast<snapshot_builder *>(user_data);
+  if (builder->allocator_count == builder->allocator_capacity)
+    builder->allocators =
+        grow(builder->allocators, &builder->allocator_capacity);
+
+  heap_snapshot_allocator &record =
+      builder->allocators[builder->allocator_count++];
+  record.id = reinterpret_cast<uint64_t>(layout->self);
+  record.parent = reinterpret_cast<uint64_t>(layout->parent);
+  record.type = layout->type;
+  record.depth = layout->depth;
+  record.base = reinterpret_cast<uint64_t>(layout->data);
+  record.size = layout->size;
+  record.unit = layout->unit;
+  record.cached = layout->cached;
+  record.range_count = 0;
+}
+
+static void on_live_range(void *user_data, size_t offset, size_t size) {
+  auto builder = static_cast<snapshot_builder *>(user_data);
+  assert(builder->allocator_count && "Range reported before its allocator");
+  if (builder->range_count == builder->range_capacity)
+    builder->ranges = grow(builder->ranges, &builder->range_capacity);
+
+  builder->ranges[builder->range_count++] = {offset, size};
+  builder->allocators[builder->allocator_count - 1].range_count++;
+}
+
+bool write_heap_snapshot(allocator *root, FILE *file) {
+  assert(file && "File is null");
+
+  snapshot_builder builder{};
+  allocator_visitor visitor{&builder, on_visit, on_live_range};
+  walk_allocators(root, &visitor);
+
+  heap_snapshot_header header{};
+  header.magic = heap_snapshot_magic;
+  header.version = heap_snapshot_version;
+  header.timestamp_ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+  header.allocator_count = static_cast<uint32_t>(builder.allocator_count);
+  header.range_count = static_cast<uint32_t>(builder.range_count);
+
+  bool res = fwrite(&header, sizeof(header), 1, file) == 1;
+  size_t range = 0;
+  for (size_t i = 0; res && i < builder.allocator_count; i++) {
+    const heap_snapshot_allocator &record = builder.allocators[i];
+    res = fwrite(&record, sizeof(record), 1, file) == 1;
+    if (res && record.range_count) {
+      res = fwrite(&builder.ranges[range], sizeof(heap_snapshot_range),
+                   record.range_count, file) == record.range_count;
+    }
+    range += record.range_count;
+  }
+
+  free(builder.allocators);
+  free(builder.ranges);
+  return res;
+}
+
+/**
+ * Bytes from the position of file to its end, SIZE_MAX when it can not
+ * seek.
+ */
+static size_t bytes_left(FILE *file) {
+  const long pos = ftell(file);
+  if (pos < 0 || fseek(file, 0, SEEK_END) != 0)
+    return SIZE_MAX;
+  const long end = ftell(file);
+  if (end < pos || fseek(file, pos, SEEK_SET) != 0)
+    return SIZE_MAX;
+  return static_cast<size_t>(end - pos);
+}
+
+bool read_heap_snapshot(FILE *file, heap_snapshot *snapshot) {
+  assert(file && "File is null");
+  assert(snapshot && "Snapshot is null");
+  *snapshot = {};
+
+  heap_snapshot_header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != heap_snapshot_magic ||
+      header.version != heap_snapshot_version)
+    return false;
+
+  // Counts of a truncated or corrupt file must not size the buffers.
+  const size_t allocator_bytes =
+      size_t{header.allocator_count} * sizeof(heap_snapshot_allocator);
+  const size_t range_bytes =
+      size_t{header.range_count} * sizeof(heap_snapshot_range);
+  if (allocator_bytes + range_bytes > bytes_left(file))
+    return false;
+
+  auto allocators =
+      static_cast<heap_snapshot_allocator *>(malloc(allocator_bytes));
+  auto ranges = static_cast<heap_snapshot_range *>(malloc(range_bytes));
+
+  bool res = (allocators || !allocator_bytes) && (ranges || !range_bytes);
+  size_t range = 0;
+  for (uint32_t i = 0; res && i < header.allocator_count; i++) {
+    heap_snapshot_allocator &record = allocators[i];
+    res = fread(&record, sizeof(record), 1, file) == 1 &&
+          record.range_count <= header.range_count - range;
+    if (res && record.range_count) {
+      res = fread(&ranges[range], sizeof(heap_snapshot_range),
+                  record.range_count, file) == record.range_count;
+    }
+    range += record.range_count;
+  }
+
+  if (!res) {
+    free(allocators);
+    free(ranges);
+    return false;
+  }
+  snapshot->header = header;
+  snapshot->allocators = allocators;
+  snapshot->ranges = ranges;
+  return true;
+}
+
+void free_heap_snapshot(heap_snapshot *snapshot) {
+  assert(snapshot && "Snapshot is null");
+  free(snapshot->allocators);
+  free(snapshot->ranges);
+  *snapshot = {};
+}
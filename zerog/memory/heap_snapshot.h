@@ -0,0 +1,59 @@
+#ifndef HEAP_SNAPSHOT_H
+#define HEAP_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+struct allocator;
+
+/**
+ * Binary heap snapshot. A file is a sequence of snapshots, each a header
+ * followed by allocator records in depth first order; every record is
+ * followed by its live ranges. Appending periodic snapshots to one file
+ * gives the offline viewer a timeline.
+ */
+constexpr uint32_t heap_snapshot_magic{0x5348475a}; // "ZGHS"
+constexpr uint32_t heap_snapshot_version{1};
+
+struct heap_snapshot_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t timestamp_ns;
+  uint32_t allocator_count;
+  uint32_t range_count;
+};
+
+struct heap_snapshot_allocator {
+  uint64_t id;
+  uint64_t parent;
+  uint32_t type;
+  uint32_t depth;
+  uint64_t base;
+  uint64_t size;
+  uint64_t unit;
+  uint64_t cached;
+  uint64_t range_count;
+};
+
+struct heap_snapshot_range {
+  uint64_t offset;
+  uint64_t size;
+};
+
+bool write_heap_snapshot(allocator *root, FILE *file);
+
+/**
+ * Reads the next snapshot of a file. Ranges of allocator i follow the
+ * ranges of allocator i - 1 in a single array.
+ */
+struct heap_snapshot {
+  heap_snapshot_header header;
+  heap_snapshot_allocator *allocators;
+  heap_snapshot_range *ranges;
+};
+
+bool read_heap_snapshot(FILE *file, heap_snapshot *snapshot);
+void free_heap_snapshot(heap_snapshot *snapshot);
+
+#endif // HEAP_SNAPSHOT_H
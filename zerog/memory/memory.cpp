@@ -1,22 +1,42 @@
 #include "memory.h"
 
+#include "address_map.h"
+#include "numa.h"
+
 #include "common/bitop.h"
 #include "common/math.h"
+#include "common/metrics.h"
+#include "common/profiler.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstring>
+#include <new>
+
+enum allocator_type : size_t {
+  NONE,
+  STACK,
+  FREE_LIST,
+  POOL,
+  BITMAPED_BLOCK,
+  CONCURRENT_STACK
+};
 
-constexpr size_t align_block(size_t alignment, size_t size) {
-  return (size + (alignment - 1)) & ~(alignment - 1);
-}
-
-enum allocator_type : size_t { NONE, STACK, FREE_LIST, POOL, BITMAPED_BLOCK };
+struct remote_block {
+  remote_block *next;
+};
 
 struct allocator {
   allocator_type type;
   allocator *parent;
   uint8_t *data;
   size_t size;
+  int32_t node;
+  address_range range;
+  const void *owner_thread;
+  std::atomic<remote_block *> remote_frees;
+  allocator *children;
+  allocator *sibling;
 };
 
 struct stack_allocator : allocator {
@@ -43,16 +63,92 @@ struct pool_allocator : allocator {
 struct bitmapped_block_allocator : allocator {
   size_t block_size;
   uint64_t used_mask;
+  uint64_t start_mask;
+};
+
+/**
+ * Shared by many threads. The cursor sits on its own cache line so bumping
+ * it does not evict the read-mostly header from the other cores. Threads
+ * claim chunk_size pieces of the arena into a thread local window and bump
+ * inside it without touching shared state; a new epoch on reset invalidates
+ * every window. Epochs are unique across arenas. Each thread keeps a few
+ * windows looked up by arena, so alternating between up to that many
+ * arenas keeps them all.
+ */
+struct concurrent_stack_allocator : allocator {
+  size_t chunk_size;
+  uint8_t head_pad[64];
+  std::atomic<size_t> offset;
+  std::atomic<uint32_t> epoch;
+  uint8_t tail_pad[64];
+};
+
+struct concurrent_stack_window {
+  const concurrent_stack_allocator *owner;
+  uint32_t epoch;
+  uint8_t *cursor;
+  uint8_t *end;
 };
 
+static std::atomic<uint32_t> concurrent_stack_epoch{0};
+static constexpr uint32_t concurrent_window_count{8};
+static thread_local concurrent_stack_window
+    concurrent_windows[concurrent_window_count]{};
+// The window used last, checked first, and the next one to replace.
+static thread_local uint32_t concurrent_window_last{0};
+static thread_local uint32_t concurrent_window_victim{0};
+
 static constexpr size_t max_allocator_size_aligned{align_block(
-    16,
-    max(sizeof(stack_allocator),
-        max(sizeof(free_list_allocator),
-            max(sizeof(pool_allocator), sizeof(bitmapped_block_allocator)))))};
+    16, max(sizeof(stack_allocator),
+            max(sizeof(free_list_allocator),
+                max(sizeof(pool_allocator),
+                    max(sizeof(bitmapped_block_allocator),
+                        sizeof(concurrent_stack_allocator))))))};
 
 static constexpr size_t allocator_alignment{64};
 
+static thread_local uint8_t thread_token;
+
+static const common::metric_counter allocation_count{
+    common::register_counter("memory.allocations")};
+static const common::metric_counter allocated_bytes{
+    common::register_counter("memory.allocated_bytes")};
+static const common::metric_counter deallocation_count{
+    common::register_counter("memory.deallocations")};
+static const common::metric_gauge live_allocators{
+    common::register_gauge("memory.allocators")};
+
+static void track_allocator(allocator *alloc) {
+  common::gauge_add(live_allocators, 1);
+  alloc->owner_thread = &thread_token;
+  new (&alloc->remote_frees) std::atomic<remote_block *>(nullptr);
+  alloc->range = {alloc->data, alloc->data + alloc->size, alloc};
+  if (alloc->data && alloc->size) {
+    register_address_range(&alloc->range);
+  }
+
+  alloc->children = nullptr;
+  alloc->sibling = nullptr;
+  if (alloc->parent) {
+    alloc->sibling = alloc->parent->children;
+    alloc->parent->children = alloc;
+  }
+}
+
+static void untrack_allocator(allocator *alloc) {
+  common::gauge_add(live_allocators, -1);
+  if (alloc->data && alloc->size) {
+    unregister_address_range(&alloc->range);
+  }
+
+  if (alloc->parent) {
+    allocator **link = &alloc->parent->children;
+    while (*link != alloc)
+      link = &(*link)->sibling;
+    *link = alloc->sibling;
+  }
+}
+
 static blk _alloc(stack_allocator *allocator, size_t size) {
   blk res{};
   constexpr size_t alignment{16};
@@ -125,6 +221,18 @@ static void _free(pool_allocator *allocator, blk data) {
   }
 }
 
+static void link_pool_nodes(pool_allocator *allocator) {
+  const size_t block_count = allocator->size / allocator->node_size;
+  pool_allocator::node_t *prev = nullptr;
+  for (size_t i = block_count; i > 0; i--) {
+    auto node = reinterpret_cast<pool_allocator::node_t *>(
+        &allocator->data[(i - 1) * allocator->node_size]);
+    node->next = prev;
+    prev = node;
+  }
+  allocator->root = prev;
+}
+
 static int32_t bitmapped_block_multiplier(size_t block_size, size_t size) {
 
   if (size == 0)
@@ -169,6 +277,7 @@ static blk _alloc(bitmapped_block_allocator *allocator, size_t size) {
   const int32_t idx = find_mask_bits(allocator->used_mask, count);
   if (idx >= 0) {
     allocator->used_mask = set_mask(allocator->used_mask, idx, count);
+    allocator->start_mask = set_mask(allocator->start_mask, idx);
     res = {&allocator->data[block_size * static_cast<size_t>(idx)], blocks};
   }
   return res;
@@ -192,10 +301,103 @@ static void _free(bitmapped_block_allocator *allocator, blk data) {
       bitmapped_block_multiplier(block_size, len); // len / block_size;
 
   allocator->used_mask = unset_mask(allocator->used_mask, idx, count);
+  allocator->start_mask = unset_mask(allocator->start_mask, idx);
+}
+
+static size_t bitmapped_block_length(const bitmapped_block_allocator *allocator,
+                                     int32_t idx) {
+  // Blocks that are used but do not start an allocation continue the one
+  // before them.
+  const uint64_t tail = allocator->used_mask & ~allocator->start_mask;
+  const uint64_t after = idx < sizeof64 - 1 ? tail >> (idx + 1) : 0;
+  const size_t count = 1 + static_cast<size_t>(__builtin_ctzl(~after));
+  return count * allocator->block_size;
+}
+
+/**
+ * The calling thread's window on allocator. Misses return the window the
+ * arena had before a reset, or else replace the windows in turn; owner
+ * may be a destroyed arena there and is only compared.
+ */
+static concurrent_stack_window &
+find_window(const concurrent_stack_allocator *allocator, uint32_t epoch) {
+  concurrent_stack_window *window =
+      &concurrent_windows[concurrent_window_last];
+  if (window->owner == allocator && window->epoch == epoch)
+    return *window;
+  uint32_t slot = concurrent_window_count;
+  for (uint32_t i = 0; i < concurrent_window_count; i++) {
+    if (concurrent_windows[i].owner == allocator) {
+      slot = i;
+      if (concurrent_windows[i].epoch == epoch)
+        break;
+    }
+  }
+  if (slot == concurrent_window_count) {
+    slot = concurrent_window_victim;
+    concurrent_window_victim = (slot + 1) % concurrent_window_count;
+  }
+  concurrent_window_last = slot;
+  return concurrent_windows[slot];
+}
+
+static blk _alloc(concurrent_stack_allocator *allocator, size_t size) {
+  constexpr size_t alignment{16};
+  size_t asize = align_block(alignment, size);
+
+  if (asize <= allocator->chunk_size / 4) {
+    const uint32_t epoch = allocator->epoch.load(std::memory_order_relaxed);
+    concurrent_stack_window &window = find_window(allocator, epoch);
+    if (window.owner != allocator || window.epoch != epoch ||
+        window.cursor + asize > window.end) {
+      profile_zone("concurrent_stack_refill");
+      const size_t chunk = allocator->chunk_size;
+      size_t off =
+          allocator->offset.fetch_add(chunk, std::memory_order_relaxed);
+      if (off + chunk > allocator->size) {
+        return {nullptr, 0};
+      }
+      window = {allocator, epoch, &allocator->data[off],
+                &allocator->data[off + chunk]};
+    }
+    blk res{window.cursor, asize};
+    window.cursor += asize;
+    return res;
+  }
+
+  size_t off = allocator->offset.fetch_add(asize, std::memory_order_relaxed);
+  if (off + asize > allocator->size) {
+    return {nullptr, 0};
+  }
+  return {&allocator->data[off], asize};
+}
+
+static void _free(concurrent_stack_allocator *allocator, blk data) {
+  assert(data.ptr >= allocator->data &&
+         data.ptr < &allocator->data[allocator->size] &&
+         "Current concurrent stack allocator does not own a given block");
+  (void)allocator;
+  (void)data;
+}
+
+static void init_concurrent_stack(concurrent_stack_allocator *alloc,
+                                  size_t chunk_size) {
+  alloc->chunk_size = align_block(allocator_alignment, chunk_size);
+  new (&alloc->offset) std::atomic<size_t>(0);
+  new (&alloc->epoch) std::atomic<uint32_t>(
+      concurrent_stack_epoch.fetch_add(1, std::memory_order_relaxed) + 1);
 }
 
 blk allocate(allocator *allocator, size_t size) {
   assert(allocator && "Allocator is null");
+  common::metric_add(allocation_count);
+  common::metric_add(allocated_bytes, size);
+  // Other threads may allocate under their own lock, the queue waits for
+  // the owner then.
+  if (allocator->remote_frees.load(std::memory_order_relaxed) &&
+      allocator->owner_thread == &thread_token) {
+    drain_remote_frees(allocator);
+  }
   switch (allocator->type) {
   case NONE: {
     assert(0 && "Allocator is not valid");
@@ -213,6 +415,9 @@ blk allocate(allocator *allocator, size_t size) {
   case BITMAPED_BLOCK: {
     return _alloc(static_cast<bitmapped_block_allocator *>(allocator), size);
   }
+  case CONCURRENT_STACK: {
+    return _alloc(static_cast<concurrent_stack_allocator *>(allocator), size);
+  }
   }
   assert(0 && "No allocation strategy matched");
   return {nullptr, 0};
@@ -220,6 +425,7 @@ blk allocate(allocator *allocator, size_t size) {
 
 void deallocate(allocator *allocator, blk block) {
   assert(allocator && "Allocator is null");
+  common::metric_add(deallocation_count);
   switch (allocator->type) {
   case NONE: {
     assert(0 && "Allocator is not valid");
@@ -241,15 +447,24 @@ void deallocate(allocator *allocator, blk block) {
     _free(static_cast<bitmapped_block_allocator *>(allocator), block);
     break;
   }
+  case CONCURRENT_STACK: {
+    _free(static_cast<concurrent_stack_allocator *>(allocator), block);
+    break;
+  }
   }
 }
 
 allocator *create_stack_allocator(size_t size) {
+  return create_stack_allocator_on_node(size, numa_any_node);
+}
+
+allocator *create_stack_allocator_on_node(size_t size, int32_t node) {
+  profile_function();
 
   size_t asize = align_block(allocator_alignment, size);
   size_t full_size = max_allocator_size_aligned + asize;
 
-  uint8_t *raw = static_cast<uint8_t *>(malloc(full_size));
+  uint8_t *raw = static_cast<uint8_t *>(numa_reserve(full_size, node));
 
   assert(raw && "Failed to allocated data");
 
@@ -258,9 +473,11 @@ allocator *create_stack_allocator(size_t size) {
   stack_allocator *alloc = reinterpret_cast<stack_allocator *>(raw);
   alloc->type = STACK;
   alloc->parent = nullptr;
+  alloc->node = node;
   alloc->data = data;
   alloc->size = asize;
   alloc->cursor = data;
+  track_allocator(alloc);
   return alloc;
 }
 
@@ -283,6 +500,63 @@ allocator *create_stack_allocator(size_t size, allocator *parent) {
   alloc->data = data;
   alloc->size = b.size - max_allocator_size_aligned;
   alloc->cursor = data;
+  track_allocator(alloc);
+  return alloc;
+}
+
+allocator *create_concurrent_stack_allocator(size_t size, size_t chunk_size) {
+  return create_concurrent_stack_allocator_on_node(size, chunk_size,
+                                                   numa_any_node);
+}
+
+allocator *create_concurrent_stack_allocator_on_node(size_t size,
+                                                     size_t chunk_size,
+                                                     int32_t node) {
+  profile_function();
+
+  size_t asize = align_block(allocator_alignment, size);
+  size_t full_size = max_allocator_size_aligned + asize;
+
+  uint8_t *raw = static_cast<uint8_t *>(numa_reserve(full_size, node));
+
+  assert(raw && "Failed to allocated data");
+
+  uint8_t *data = raw + max_allocator_size_aligned;
+
+  concurrent_stack_allocator *alloc =
+      reinterpret_cast<concurrent_stack_allocator *>(raw);
+  alloc->type = CONCURRENT_STACK;
+  alloc->parent = nullptr;
+  alloc->node = node;
+  alloc->data = data;
+  alloc->size = asize;
+  init_concurrent_stack(alloc, chunk_size);
+  track_allocator(alloc);
+  return alloc;
+}
+
+allocator *create_concurrent_stack_allocator(size_t size, size_t chunk_size,
+                                             allocator *parent) {
+  assert(parent && "Requires a valid parent allocator");
+
+  size_t asize = align_block(allocator_alignment, size);
+  size_t full_size = max_allocator_size_aligned + asize;
+
+  blk b = allocate(parent, full_size);
+
+  assert(b.ptr && "Failed to allocated data");
+
+  uint8_t *raw = static_cast<uint8_t *>(b.ptr);
+  uint8_t *data = raw + max_allocator_size_aligned;
+
+  concurrent_stack_allocator *alloc =
+      reinterpret_cast<concurrent_stack_allocator *>(raw);
+  alloc->type = CONCURRENT_STACK;
+  alloc->parent = parent;
+  alloc->data = data;
+  alloc->size = b.size - max_allocator_size_aligned;
+  init_concurrent_stack(alloc, chunk_size);
+  track_allocator(alloc);
   return alloc;
 }
 
@@ -302,36 +576,40 @@ allocator *create_free_list_allocator(size_t min_block, size_t max_block,
   alloc->min_size = min_block;
   alloc->max_size = max_block;
   alloc->root = nullptr;
+  track_allocator(alloc);
   return alloc;
 }
 
 allocator *create_pool_allocator(size_t block_size, size_t block_count) {
+  return create_pool_allocator_on_node(block_size, block_count, numa_any_node);
+}
+
+allocator *create_pool_allocator_on_node(size_t block_size,
+                                         size_t block_count, int32_t node) {
+  profile_function();
 
   constexpr size_t alignment{64};
   size_t asize = align_block(alignment, block_size);
   size_t full_size = max_allocator_size_aligned + (asize * block_count);
 
-  uint8_t *raw = static_cast<uint8_t *>(malloc(full_size));
+  uint8_t *raw = static_cast<uint8_t *>(numa_reserve(full_size, node));
 
   assert(raw && "Failed to allocated data");
 
   uint8_t *data = raw + max_allocator_size_aligned;
 
-  pool_allocator::node_t *nodes =
-      reinterpret_cast<pool_allocator::node_t *>(data);
   pool_allocator *allocator = reinterpret_cast<pool_allocator *>(raw);
 
   allocator->type = POOL;
   allocator->parent = nullptr;
-  allocator->root = &nodes[0];
+  allocator->node = node;
   allocator->node_size = asize;
   allocator->data = data;
   allocator->size = asize * block_count;
 
-  for (size_t i = 1; i < block_count; i++) {
-    nodes[i - 1].next = &nodes[i];
-  }
+  link_pool_nodes(allocator);
 
+  track_allocator(allocator);
   return allocator;
 }
 
@@ -348,24 +626,21 @@ allocator *create_pool_allocator(size_t block_size, size_t block_count,
   uint8_t *raw = static_cast<uint8_t *>(b.ptr);
   uint8_t *data = raw + max_allocator_size_aligned;
 
-  pool_allocator::node_t *nodes =
-      reinterpret_cast<pool_allocator::node_t *>(data);
   pool_allocator *allocator = reinterpret_cast<pool_allocator *>(raw);
 
   allocator->type = POOL;
   allocator->parent = parent;
   allocator->data = data;
   allocator->size = b.size - max_allocator_size_aligned;
-  allocator->root = &nodes[0];
   allocator->node_size = asize;
 
-  for (size_t i = 1; i < block_count; i++) {
-    nodes[i - 1].next = &nodes[i];
-  }
+  link_pool_nodes(allocator);
+  track_allocator(allocator);
   return allocator;
 }
 
 allocator *create_bitmapped_allocator(size_t block_size) {
+  profile_function();
   constexpr size_t alignment{sizeof64};
 
   size_t asize = align_block(alignment, block_size);
@@ -380,10 +655,13 @@ allocator *create_bitmapped_allocator(size_t block_size) {
 
   alloc->type = BITMAPED_BLOCK;
   alloc->parent = nullptr;
+  alloc->node = numa_any_node;
   alloc->data = data;
   alloc->size = full_size - max_allocator_size_aligned;
   alloc->block_size = asize;
   alloc->used_mask = 0;
+  alloc->start_mask = 0;
+  track_allocator(alloc);
   return alloc;
 }
 
@@ -407,11 +685,67 @@ allocator *create_bitmapped_allocator(size_t block_size, allocator *parent) {
   alloc->size = b.size - max_allocator_size_aligned;
   alloc->block_size = asize;
   alloc->used_mask = 0;
+  alloc->start_mask = 0;
+  track_allocator(alloc);
   return alloc;
 }
 
+static bool _expand(stack_allocator *allocator, blk *block, size_t size) {
+  constexpr size_t alignment{16};
+  size_t asize = align_block(alignment, size);
+  uint8_t *ptr = static_cast<uint8_t *>(block->ptr);
+
+  if (ptr + block->size != allocator->cursor ||
+      ptr + asize > &allocator->data[allocator->size])
+    return false;
+  allocator->cursor = ptr + asize;
+  block->size = asize;
+  return true;
+}
+
+static bool _expand(bitmapped_block_allocator *allocator, blk *block,
+                    size_t size) {
+  const size_t block_size = allocator->block_size;
+  const size_t offset =
+      static_cast<size_t>(static_cast<uint8_t *>(block->ptr) - allocator->data);
+  const int32_t idx = static_cast<int32_t>(offset / block_size);
+  const int32_t count = static_cast<int32_t>(block->size / block_size);
+  const int32_t new_count =
+      static_cast<int32_t>(align_block(block_size, size) / block_size);
+
+  if (idx + new_count > sizeof64 ||
+      test_mask(allocator->used_mask, idx + count, new_count - count))
+    return false;
+  allocator->used_mask =
+      set_mask(allocator->used_mask, idx + count, new_count - count);
+  block->size = static_cast<size_t>(new_count) * block_size;
+  return true;
+}
+
+bool expand(allocator *allocator, blk *block, size_t size) {
+  assert(allocator && "Allocator is null");
+  assert(block && block->ptr && "Block is null");
+  if (size <= block->size)
+    return true;
+
+  switch (allocator->type) {
+  case STACK: {
+    return _expand(static_cast<stack_allocator *>(allocator), block, size);
+  }
+  case BITMAPED_BLOCK: {
+    return _expand(static_cast<bitmapped_block_allocator *>(allocator), block,
+                   size);
+  }
+  default: {
+    return false;
+  }
+  }
+}
+
 void reset_allocator(allocator *allocator) {
   assert(allocator && "Allocator is null");
+  // Queued frees point into memory the reset hands out again.
+  allocator->remote_frees.store(nullptr, std::memory_order_relaxed);
   switch (allocator->type) {
   case NONE: {
     assert(0 && "Allocator is not valid");
@@ -429,19 +763,23 @@ void reset_allocator(allocator *allocator) {
     break;
   }
   case POOL: {
-    pool_allocator *alloc = static_cast<pool_allocator *>(allocator);
-    pool_allocator::node_t *nodes =
-        reinterpret_cast<pool_allocator::node_t *>(alloc->data);
-    size_t block_count = alloc->size / alloc->node_size;
-    for (size_t i = 1; i < block_count; i++) {
-      nodes[i - 1].next = &nodes[i];
-    }
+    link_pool_nodes(static_cast<pool_allocator *>(allocator));
     break;
   }
   case BITMAPED_BLOCK: {
     bitmapped_block_allocator *alloc =
         static_cast<bitmapped_block_allocator *>(allocator);
     alloc->used_mask = 0;
+    alloc->start_mask = 0;
+    break;
+  }
+  case CONCURRENT_STACK: {
+    concurrent_stack_allocator *alloc =
+        static_cast<concurrent_stack_allocator *>(allocator);
+    alloc->offset.store(0, std::memory_order_relaxed);
+    alloc->epoch.store(
+        concurrent_stack_epoch.fetch_add(1, std::memory_order_relaxed) + 1,
+        std::memory_order_release);
     break;
   }
   }
@@ -449,10 +787,215 @@ void reset_allocator(allocator *allocator) {
 
 void destroy_allocator(allocator *allocator) {
   assert(allocator && "Allocator is null");
+  profile_function();
+  untrack_allocator(allocator);
   if (allocator->parent) {
     deallocate(allocator->parent,
                {allocator, allocator->size + max_allocator_size_aligned});
   } else {
-    free(allocator);
+    numa_release(allocator, allocator->size + max_allocator_size_aligned,
+                 allocator->node);
+  }
+}
+
+static void _free_any(allocator *owner, void *ptr) {
+  switch (owner->type) {
+  case POOL: {
+    pool_allocator *alloc = static_cast<pool_allocator *>(owner);
+    _free(alloc, {ptr, alloc->node_size});
+    break;
+  }
+  case BITMAPED_BLOCK: {
+    bitmapped_block_allocator *alloc =
+        static_cast<bitmapped_block_allocator *>(owner);
+    const size_t len =
+        static_cast<size_t>(static_cast<uint8_t *>(ptr) - alloc->data);
+    assert(len % alloc->block_size == 0 &&
+           "Pointer is not the start of a bitmaped allocation");
+    const int32_t idx = static_cast<int32_t>(len / alloc->block_size);
+    _free(alloc, {ptr, bitmapped_block_length(alloc, idx)});
+    break;
   }
+  default: {
+    // Stack like arenas give memory back on reset.
+    break;
+  }
+  }
+}
+
+allocator *find_owner(const void *ptr) {
+  address_range range;
+  if (!find_address_range(ptr, &range))
+    return nullptr;
+  return static_cast<allocator *>(range.owner);
+}
+
+void claim_allocator(allocator *allocator) {
+  assert(allocator && "Allocator is null");
+  allocator->owner_thread = &thread_token;
+}
+
+void deallocate_any(void *ptr) {
+  allocator *owner = find_owner(ptr);
+  assert(owner && "Pointer is not owned by any allocator");
+
+  if (owner->type != POOL && owner->type != BITMAPED_BLOCK) {
+    return;
+  }
+
+  if (owner->owner_thread == &thread_token) {
+    _free_any(owner, ptr);
+    return;
+  }
+
+  remote_block *node = static_cast<remote_block *>(ptr);
+  remote_block *head = owner->remote_frees.load(std::memory_order_relaxed);
+  do {
+    node->next = head;
+  } while (!owner->remote_frees.compare_exchange_weak(
+      head, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void drain_remote_frees(allocator *allocator) {
+  assert(allocator && "Allocator is null");
+  assert(allocator->owner_thread == &thread_token &&
+         "Remote frees must be drained by the owning thread");
+  profile_function();
+
+  remote_block *node =
+      allocator->remote_frees.exchange(nullptr, std::memory_order_acquire);
+  while (node) {
+    remote_block *next = node->next;
+    _free_any(allocator, node);
+    node = next;
+  }
+}
+
+const char *allocator_type_name(uint32_t type) {
+  switch (type) {
+  case STACK:
+    return "stack";
+  case FREE_LIST:
+    return "free_list";
+  case POOL:
+    return "pool";
+  case BITMAPED_BLOCK:
+    return "bitmaped";
+  case CONCURRENT_STACK:
+    return "concurrent_stack";
+  default:
+    return "none";
+  }
+}
+
+static void walk_ranges(const pool_allocator *alloc,
+                        const allocator_visitor *visitor) {
+  const size_t count = alloc->size / alloc->node_size;
+  uint8_t *free_nodes = static_cast<uint8_t *>(calloc(count, 1));
+  assert(free_nodes && "Failed to allocated data");
+
+  for (auto node = alloc->root; node; node = node->next) {
+    const size_t offset = static_cast<size_t>(
+        reinterpret_cast<uint8_t *>(node) - alloc->data);
+    free_nodes[offset / alloc->node_size] = 1;
+  }
+
+  size_t i = 0;
+  while (i < count) {
+    if (free_nodes[i]) {
+      i++;
+      continue;
+    }
+    size_t end = i;
+    while (end < count && !free_nodes[end])
+      end++;
+    visitor->live_range(visitor->user_data, i * alloc->node_size,
+                        (end - i) * alloc->node_size);
+    i = end;
+  }
+  free(free_nodes);
+}
+
+static void walk_ranges(const bitmapped_block_allocator *alloc,
+                        const allocator_visitor *visitor) {
+  int32_t i = 0;
+  while (i < sizeof64) {
+    if (!test_mask(alloc->used_mask, i)) {
+      i++;
+      continue;
+    }
+    int32_t end = i;
+    while (end < sizeof64 && test_mask(alloc->used_mask, end))
+      end++;
+    visitor->live_range(visitor->user_data,
+                        static_cast<size_t>(i) * alloc->block_size,
+                        static_cast<size_t>(end - i) * alloc->block_size);
+    i = end;
+  }
+}
+
+static void walk_allocator(allocator *alloc, uint32_t depth,
+                           const allocator_visitor *visitor) {
+  allocator_layout layout{};
+  layout.self = alloc;
+  layout.parent = alloc->parent;
+  layout.type = alloc->type;
+  layout.depth = depth;
+  layout.data = alloc->data;
+  layout.size = alloc->size;
+  layout.unit = 1;
+
+  switch (alloc->type) {
+  case STACK: {
+    auto stack = static_cast<stack_allocator *>(alloc);
+    visitor->visit(visitor->user_data, &layout);
+    if (stack->cursor > stack->data)
+      visitor->live_range(visitor->user_data, 0,
+                          static_cast<size_t>(stack->cursor - stack->data));
+    break;
+  }
+  case CONCURRENT_STACK: {
+    auto stack = static_cast<concurrent_stack_allocator *>(alloc);
+    size_t used = stack->offset.load(std::memory_order_relaxed);
+    used = used < stack->size ? used : stack->size;
+    visitor->visit(visitor->user_data, &layout);
+    if (used)
+      visitor->live_range(visitor->user_data, 0, used);
+    break;
+  }
+  case FREE_LIST: {
+    // Cached blocks live in the parent range, only their count is reported.
+    auto list = static_cast<free_list_allocator *>(alloc);
+    for (auto node = list->root; node; node = node->next)
+      layout.cached++;
+    visitor->visit(visitor->user_data, &layout);
+    break;
+  }
+  case POOL: {
+    auto pool = static_cast<pool_allocator *>(alloc);
+    layout.unit = pool->node_size;
+    visitor->visit(visitor->user_data, &layout);
+    walk_ranges(pool, visitor);
+    break;
+  }
+  case BITMAPED_BLOCK: {
+    auto bitmap = static_cast<bitmapped_block_allocator *>(alloc);
+    layout.unit = bitmap->block_size;
+    visitor->visit(visitor->user_data, &layout);
+    walk_ranges(bitmap, visitor);
+    break;
+  }
+  default: {
+    assert(0 && "Allocator is not valid");
+  }
+  }
+
+  for (allocator *child = alloc->children; child; child = child->sibling)
+    walk_allocator(child, depth + 1, visitor);
+}
+
+void walk_allocators(allocator *root, const allocator_visitor *visitor) {
+  assert(root && "Allocator is null");
+  assert(visitor && "Visitor is null");
+  walk_allocator(root, 0, visitor);
 }
@@ -14,13 +14,31 @@ constexpr size_t Kb{1024};
 constexpr size_t Mb{1024 * Kb};
 constexpr size_t Gb{1024 * Mb};
 
+constexpr size_t align_block(size_t alignment, size_t size) {
+  return (size + (alignment - 1)) & ~(alignment - 1);
+}
+
 struct allocator;
 
 blk allocate(allocator *allocator, size_t size);
 void deallocate(allocator *allocator, blk block);
 
+/**
+ * Grows a block in place when the memory behind it is free, updating
+ * block->size. Returns false when the block has to move.
+ */
+bool expand(allocator *allocator, blk *block, size_t size);
+
 allocator *create_stack_allocator(size_t size);
 allocator *create_stack_allocator(size_t size, allocator *parent);
+allocator *create_stack_allocator_on_node(size_t size, int32_t node);
+
+allocator *create_concurrent_stack_allocator(size_t size, size_t chunk_size);
+allocator *create_concurrent_stack_allocator(size_t size, size_t chunk_size,
+                                             allocator *parent);
+allocator *create_concurrent_stack_allocator_on_node(size_t size,
+                                                     size_t chunk_size,
+                                                     int32_t node);
 
 allocator *create_free_list_allocator(size_t min_block, size_t max_block,
                                       allocator *parent);
@@ -28,6 +46,8 @@ allocator *create_free_list_allocator(size_t min_block, size_t max_block,
 allocator *create_pool_allocator(size_t block_size, size_t block_count);
 allocator *create_pool_allocator(size_t block_size, size_t block_count,
                                  allocator *parent);
+allocator *create_pool_allocator_on_node(size_t block_size,
+                                         size_t block_count, int32_t node);
 
 allocator *create_bitmapped_allocator(size_t block_size);
 allocator *create_bitmapped_allocator(size_t block_size, allocator *parent);
@@ -35,38 +55,45 @@ allocator *create_bitmapped_allocator(size_t block_size, allocator *parent);
 void reset_allocator(allocator *allocator);
 void destroy_allocator(allocator *allocator);
 
-#define ARRAY_DEFINITION(name, type)                                           \
-  struct name {                                                                \
-    typedef type __T;                                                          \
-    typedef __T *iterator;                                                     \
-    typedef const __T *const_iterator;                                         \
-    __T *data;                                                                 \
-    size_t count;                                                              \
-    size_t size;                                                               \
-    iterator begin();                                                          \
-    const_iterator begin() const;                                              \
-    iterator end();                                                            \
-    const_iterator end() const;                                                \
-  };                                                                           \
-  name create_##name(allocator *alloc, size_t size);                           \
-  void destroy_##name(allocator *alloc, name array)
-
-#define ARRAY_IMPLEMENTATION(name)                                             \
-  name::iterator name::begin() { return &data[0]; }                            \
-  name::const_iterator name::begin() const { return &data[0]; }                \
-  name::iterator name::end() { return &data[count]; }                          \
-  name::const_iterator name::end() const { return &data[count]; }              \
-  name create_##name(allocator *alloc, size_t size) {                          \
-    name t;                                                                    \
-    blk b = allocate(alloc, sizeof(name::__T) * size);                         \
-    t.data = static_cast<name::__T *>(b.ptr);                                  \
-    t.count = size;                                                            \
-    t.size = b.size;                                                           \
-    return t;                                                                  \
-  }                                                                            \
-  void destroy_##name(allocator *alloc, name array) {                          \
-    deallocate(alloc, {array.data, array.size});                               \
-  }
+allocator *find_owner(const void *ptr);
+
+/**
+ * Every allocator is owned by the thread that created it. deallocate_any
+ * called on another thread queues the block instead of touching the
+ * allocator, and only the owner returns queued blocks: on its next
+ * allocate or through drain_remote_frees. Other threads may still
+ * allocate under a lock of their own, the queue then waits for the owner.
+ * A thread taking over an allocator for good calls claim_allocator first,
+ * while no other thread uses it.
+ */
+void claim_allocator(allocator *allocator);
+void deallocate_any(void *ptr);
+void drain_remote_frees(allocator *allocator);
+
+/**
+ * Layout of one allocator in the tree. Live ranges are reported after the
+ * allocator they belong to as offsets from data, in runs of whole units
+ * (pool nodes, bitmaped blocks, bytes for stacks).
+ */
+struct allocator_layout {
+  const allocator *self;
+  const allocator *parent;
+  uint32_t type;
+  uint32_t depth;
+  const uint8_t *data;
+  size_t size;
+  size_t unit;
+  size_t cached;
+};
+
+struct allocator_visitor {
+  void *user_data;
+  void (*visit)(void *user_data, const allocator_layout *layout);
+  void (*live_range)(void *user_data, size_t offset, size_t size);
+};
+
+void walk_allocators(allocator *root, const allocator_visitor *visitor);
+const char *allocator_type_name(uint32_t type);
 
 #define PTR_DEFINITION(type)                                                   \
   struct type##_ptr {                                                          \
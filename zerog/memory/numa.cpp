@@ -0,0 +1,158 @@
+#include "numa.h"
+
+#include "memory.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static constexpr int32_t max_numa_nodes{64};
+static constexpr int mpol_bind{2};
+
+/**
+ * /sys/devices/system/node/online holds a list like "0" or "0-1,3", the node
+ * count is the highest listed node plus one.
+ */
+static int32_t read_node_count() {
+#if defined(__linux__)
+  FILE *file = fopen("/sys/devices/system/node/online", "r");
+  if (!file)
+    return 1;
+
+  int32_t highest = 0;
+  int32_t value = 0;
+  bool in_number = false;
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (c >= '0' && c <= '9') {
+      value = value * 10 + (c - '0');
+      in_number = true;
+    } else {
+      if (in_number && value > highest)
+        highest = value;
+      value = 0;
+      in_number = false;
+    }
+  }
+  if (in_number && value > highest)
+    highest = value;
+  fclose(file);
+
+  const int32_t count = highest + 1;
+  return count < max_numa_nodes ? count : max_numa_nodes;
+#else
+  return 1;
+#endif
+}
+
+int32_t numa_node_count() {
+  static const int32_t count = read_node_count();
+  return count;
+}
+
+int32_t numa_current_node() {
+#if defined(__linux__)
+  unsigned cpu{0};
+  unsigned node{0};
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 &&
+      static_cast<int32_t>(node) < numa_node_count())
+    return static_cast<int32_t>(node);
+#endif
+  return 0;
+}
+
+#if defined(__linux__)
+static size_t page_aligned(size_t size) {
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return align_block(page, size);
+}
+#endif
+
+void *numa_reserve(size_t size, int32_t node) {
+  if (node == numa_any_node)
+    return malloc(size);
+
+  assert(node >= 0 && node < numa_node_count() && "Invalid NUMA node");
+#if defined(__linux__)
+  const size_t asize = page_aligned(size);
+  void *ptr = mmap(nullptr, asize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+    return nullptr;
+
+  if (numa_node_count() > 1) {
+    // A refused policy (no NUMA support, cgroup limits) leaves the pages to
+    // the default first touch placement.
+    unsigned long mask = 1ul << node;
+    syscall(SYS_mbind, ptr, asize, mpol_bind, &mask, sizeof(mask) * 8 + 1, 0);
+  }
+  return ptr;
+#else
+  return malloc(size);
+#endif
+}
+
+void numa_release(void *ptr, size_t size, int32_t node) {
+  if (!ptr)
+    return;
+#if defined(__linux__)
+  if (node != numa_any_node) {
+    munmap(ptr, page_aligned(size));
+    return;
+  }
+#endif
+  free(ptr);
+}
+
+struct node_arenas {
+  int32_t count;
+  allocator *arenas[max_numa_nodes];
+};
+
+node_arenas *create_node_arenas(size_t size_per_node, size_t chunk_size) {
+  node_arenas *arenas =
+      static_cast<node_arenas *>(malloc(sizeof(node_arenas)));
+  assert(arenas && "Failed to allocated data");
+
+  arenas->count = numa_node_count();
+  for (int32_t i = 0; i < arenas->count; i++) {
+    arenas->arenas[i] =
+        create_concurrent_stack_allocator_on_node(size_per_node, chunk_size, i);
+  }
+  return arenas;
+}
+
+void destroy_node_arenas(node_arenas *arenas) {
+  assert(arenas && "Node arenas are null");
+  for (int32_t i = 0; i < arenas->count; i++)
+    destroy_allocator(arenas->arenas[i]);
+  free(arenas);
+}
+
+allocator *node_arena(node_arenas *arenas, int32_t node) {
+  assert(arenas && "Node arenas are null");
+  assert(node >= 0 && node < arenas->count && "Invalid NUMA node");
+  return arenas->arenas[node];
+}
+
+static thread_local int32_t thread_node{numa_any_node};
+
+allocator *local_arena(node_arenas *arenas) {
+  assert(arenas && "Node arenas are null");
+  if (thread_node == numa_any_node)
+    thread_node = numa_current_node();
+  const int32_t node = thread_node < arenas->count ? thread_node : 0;
+  return arenas->arenas[node];
+}
+
+void reset_node_arenas(node_arenas *arenas) {
+  assert(arenas && "Node arenas are null");
+  for (int32_t i = 0; i < arenas->count; i++)
+    reset_allocator(arenas->arenas[i]);
+}
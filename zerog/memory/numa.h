@@ -0,0 +1,41 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct allocator;
+
+/**
+ * Node placement for allocator backing memory. On machines with a single
+ * node, or where the kernel refuses the memory policy, every call degrades
+ * to plain process memory so callers never need a separate code path.
+ */
+constexpr int32_t numa_any_node{-1};
+
+int32_t numa_node_count();
+int32_t numa_current_node();
+
+/**
+ * Page backed memory bound to a node. Pages are bound before anything
+ * touches them, so first touch lands on the node whatever thread does it.
+ * numa_any_node falls back to malloc/free.
+ */
+void *numa_reserve(size_t size, int32_t node);
+void numa_release(void *ptr, size_t size, int32_t node);
+
+/**
+ * One concurrent stack arena per node. Workers allocate from the arena of
+ * the node they run on; the node is resolved once per thread, so workers
+ * are expected to be pinned.
+ */
+struct node_arenas;
+
+node_arenas *create_node_arenas(size_t size_per_node, size_t chunk_size);
+void destroy_node_arenas(node_arenas *arenas);
+
+allocator *node_arena(node_arenas *arenas, int32_t node);
+allocator *local_arena(node_arenas *arenas);
+void reset_node_arenas(node_arenas *arenas);
+
+#endif // NUMA_H
@@ -1,7 +1,17 @@
 #include <gmock/gmock-matchers.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "memory/device_memory.h"
+#include "memory/heap_snapshot.h"
 #include "memory/memory.h"
+#include "memory/numa.h"
+
+#include <unistd.h>
 
 using namespace testing;
 
@@ -310,3 +320,810 @@ TEST(allocator, bitmapped_allocator_allocate_all_in_parts) {
 
   destroy_allocator(alloc);
 }
+
+TEST(allocator, expand_in_place) {
+  allocator *stack = create_stack_allocator(Kb);
+  blk a = allocate(stack, 64);
+  EXPECT_TRUE(expand(stack, &a, 256));
+  EXPECT_EQ(a.size, 256);
+  blk b = allocate(stack, 64);
+  EXPECT_FALSE(expand(stack, &a, 512));
+  EXPECT_TRUE(expand(stack, &b, 768));
+  EXPECT_FALSE(expand(stack, &b, Kb));
+  destroy_allocator(stack);
+
+  allocator *bitmap = create_bitmapped_allocator(Kb);
+  blk c = allocate(bitmap, Kb);
+  EXPECT_TRUE(expand(bitmap, &c, Kb * 3));
+  EXPECT_EQ(c.size, Kb * 3);
+  blk d = allocate(bitmap, Kb);
+  EXPECT_EQ(static_cast<uint8_t *>(d.ptr),
+            static_cast<uint8_t *>(c.ptr) + c.size);
+  EXPECT_FALSE(expand(bitmap, &c, Kb * 4));
+  deallocate_any(c.ptr);
+  blk e = allocate(bitmap, Kb * 3);
+  EXPECT_EQ(e.ptr, c.ptr);
+  destroy_allocator(bitmap);
+}
+
+TEST(allocator, concurrent_stack_allocator_alloc) {
+  allocator *alloc = create_concurrent_stack_allocator(Mb, Kb * 64);
+  EXPECT_NE(alloc, nullptr);
+
+  blk small = allocate(alloc, 75);
+  EXPECT_EQ(small.size, 80);
+  EXPECT_NE(small.ptr, nullptr);
+
+  blk large = allocate(alloc, Kb * 512);
+  EXPECT_EQ(large.size, Kb * 512);
+  EXPECT_NE(large.ptr, nullptr);
+
+  blk over = allocate(alloc, Kb * 512);
+  EXPECT_EQ(over.size, 0);
+  EXPECT_EQ(over.ptr, nullptr);
+
+  reset_allocator(alloc);
+
+  blk again = allocate(alloc, Kb * 512);
+  EXPECT_EQ(again.size, Kb * 512);
+  EXPECT_NE(again.ptr, nullptr);
+
+  destroy_allocator(alloc);
+}
+
+TEST(allocator, concurrent_stack_allocator_reset_drops_windows) {
+  allocator *alloc = create_concurrent_stack_allocator(Kb * 256, Kb * 64);
+  blk a = allocate(alloc, 64);
+  reset_allocator(alloc);
+  blk b = allocate(alloc, 64);
+  EXPECT_EQ(a.ptr, b.ptr);
+  destroy_allocator(alloc);
+}
+
+TEST(allocator, concurrent_stack_allocator_alternating_arenas) {
+  // Each arena holds four chunks, enough only if windows survive switches.
+  allocator *a = create_concurrent_stack_allocator(Kb * 256, Kb * 64);
+  allocator *b = create_concurrent_stack_allocator(Kb * 256, Kb * 64);
+  for (int i = 0; i < 1024; i++) {
+    ASSERT_NE(allocate(a, 64).ptr, nullptr) << i;
+    ASSERT_NE(allocate(b, 64).ptr, nullptr) << i;
+  }
+  destroy_allocator(b);
+  destroy_allocator(a);
+}
+
+TEST(allocator, concurrent_stack_allocator_arenas_eight_epochs_apart) {
+  allocator *a = create_concurrent_stack_allocator(Kb * 256, Kb * 64);
+  for (int i = 0; i < 7; i++)
+    destroy_allocator(create_concurrent_stack_allocator(Kb * 64, Kb * 16));
+  allocator *b = create_concurrent_stack_allocator(Kb * 256, Kb * 64);
+  for (int i = 0; i < 1024; i++) {
+    ASSERT_NE(allocate(a, 64).ptr, nullptr) << i;
+    ASSERT_NE(allocate(b, 64).ptr, nullptr) << i;
+  }
+  destroy_allocator(b);
+  destroy_allocator(a);
+}
+
+TEST(allocator, concurrent_stack_allocator_threads) {
+  constexpr int thread_count = 8;
+  constexpr int per_thread = 4096;
+  allocator *alloc = create_concurrent_stack_allocator(Mb * 64, Kb * 16);
+
+  std::vector<blk> blocks[thread_count];
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([alloc, t, &blocks] {
+      for (int i = 0; i < per_thread; i++) {
+        size_t size = static_cast<size_t>((i % 7) + 1) * 48;
+        blk b = allocate(alloc, size);
+        memset(b.ptr, t, b.size);
+        blocks[t].push_back(b);
+      }
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+
+  std::vector<blk> all;
+  for (int t = 0; t < thread_count; t++) {
+    for (const blk &b : blocks[t]) {
+      EXPECT_NE(b.ptr, nullptr);
+      EXPECT_EQ(static_cast<uint8_t *>(b.ptr)[0], t);
+      EXPECT_EQ(static_cast<uint8_t *>(b.ptr)[b.size - 1], t);
+      all.push_back(b);
+    }
+  }
+  std::sort(all.begin(), all.end(),
+            [](const blk &l, const blk &r) { return l.ptr < r.ptr; });
+  for (size_t i = 1; i < all.size(); i++) {
+    EXPECT_LE(static_cast<uint8_t *>(all[i - 1].ptr) + all[i - 1].size,
+              static_cast<uint8_t *>(all[i].ptr));
+  }
+
+  destroy_allocator(alloc);
+}
+
+TEST(allocator, find_owner_many_ranges_in_a_chunk) {
+  // More small children than a chunk has slots in one row.
+  allocator *root = create_stack_allocator(Kb * 64);
+  allocator *children[12];
+  blk blocks[12];
+  for (int i = 0; i < 12; i++) {
+    children[i] = create_stack_allocator(Kb, root);
+    ASSERT_NE(children[i], nullptr);
+    blocks[i] = allocate(children[i], 64);
+  }
+  for (int i = 0; i < 12; i++)
+    EXPECT_EQ(find_owner(blocks[i].ptr), children[i]) << i;
+
+  for (int i = 0; i < 12; i += 2)
+    destroy_allocator(children[i]);
+  for (int i = 1; i < 12; i += 2)
+    EXPECT_EQ(find_owner(blocks[i].ptr), children[i]) << i;
+  EXPECT_EQ(find_owner(blocks[0].ptr), root);
+  for (int i = 1; i < 12; i += 2)
+    destroy_allocator(children[i]);
+  destroy_allocator(root);
+}
+
+TEST(allocator, find_owner_while_neighbours_come_and_go) {
+  allocator *stable = create_stack_allocator(Kb * 4);
+  blk b = allocate(stable, 64);
+  std::atomic<bool> done{false};
+  std::thread churn([&done] {
+    // Small arenas from malloc land next to stable and are freed again.
+    for (int i = 0; i < 20000; i++)
+      destroy_allocator(create_stack_allocator(Kb));
+    done.store(true);
+  });
+  size_t lookups = 0;
+  while (!done.load() || lookups < 1000) {
+    ASSERT_EQ(find_owner(b.ptr), stable);
+    lookups++;
+  }
+  churn.join();
+  destroy_allocator(stable);
+}
+
+TEST(allocator, find_owner_innermost) {
+  allocator *outer = create_bitmapped_allocator(Kb * 64);
+  allocator *inner = create_pool_allocator(Kb, 16, outer);
+  allocator *stack = create_stack_allocator(Kb * 4);
+
+  blk b = allocate(inner, 64);
+  blk s = allocate(stack, 64);
+  EXPECT_EQ(find_owner(b.ptr), inner);
+  EXPECT_EQ(find_owner(s.ptr), stack);
+
+  int local{0};
+  EXPECT_EQ(find_owner(&local), nullptr);
+
+  destroy_allocator(inner);
+  EXPECT_EQ(find_owner(b.ptr), outer);
+  destroy_allocator(stack);
+  destroy_allocator(outer);
+}
+
+TEST(allocator, deallocate_any_same_thread) {
+  allocator *pool = create_pool_allocator(Kb, 4);
+  blk p[4];
+  for (int i = 0; i < 4; i++)
+    p[i] = allocate(pool, Kb);
+  deallocate_any(p[2].ptr);
+  blk again = allocate(pool, Kb);
+  EXPECT_EQ(again.ptr, p[2].ptr);
+  destroy_allocator(pool);
+
+  allocator *bitmap = create_bitmapped_allocator(Kb);
+  blk b1 = allocate(bitmap, Kb * 3);
+  blk b2 = allocate(bitmap, Kb * 60);
+  blk full = allocate(bitmap, Kb * 2);
+  EXPECT_EQ(full.ptr, nullptr);
+
+  deallocate_any(b1.ptr);
+  blk b3 = allocate(bitmap, Kb * 2);
+  EXPECT_EQ(b3.ptr, b1.ptr);
+  EXPECT_EQ(b3.size, Kb * 2);
+
+  deallocate_any(b2.ptr);
+  deallocate_any(b3.ptr);
+  blk all = allocate(bitmap, Kb * 64);
+  EXPECT_NE(all.ptr, nullptr);
+  destroy_allocator(bitmap);
+}
+
+TEST(allocator, deallocate_any_remote_threads) {
+  constexpr int thread_count = 4;
+  constexpr int per_thread = 256;
+  allocator *pool = create_pool_allocator(64, thread_count * per_thread);
+
+  std::vector<void *> ptrs;
+  for (int i = 0; i < thread_count * per_thread; i++)
+    ptrs.push_back(allocate(pool, 64).ptr);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([&ptrs, t] {
+      for (int i = 0; i < per_thread; i++)
+        deallocate_any(ptrs[static_cast<size_t>(t * per_thread + i)]);
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+
+  // Nothing is reclaimed until the owner drains on its next allocate.
+  for (int i = 0; i < thread_count * per_thread; i++) {
+    blk b = allocate(pool, 64);
+    EXPECT_NE(b.ptr, nullptr);
+  }
+  blk b = allocate(pool, 64);
+  EXPECT_EQ(b.ptr, nullptr);
+  destroy_allocator(pool);
+}
+
+TEST(allocator, allocate_elsewhere_leaves_remote_frees_to_the_owner) {
+  allocator *pool = create_pool_allocator(64, 2);
+  void *a = allocate(pool, 64).ptr;
+  void *b = allocate(pool, 64).ptr;
+  std::thread([a] { deallocate_any(a); }).join();
+
+  // Another thread allocating under external synchronisation.
+  blk other{};
+  std::thread([pool, &other] { other = allocate(pool, 64); }).join();
+  EXPECT_EQ(other.ptr, nullptr);
+
+  EXPECT_EQ(allocate(pool, 64).ptr, a);
+  deallocate(pool, {b, 64});
+  destroy_allocator(pool);
+}
+
+TEST(allocator, deallocate_any_reset_drops_remote) {
+  allocator *pool = create_pool_allocator(64, 2);
+  void *a = allocate(pool, 64).ptr;
+  std::thread([a] { deallocate_any(a); }).join();
+
+  reset_allocator(pool);
+  EXPECT_NE(allocate(pool, 64).ptr, nullptr);
+  EXPECT_NE(allocate(pool, 64).ptr, nullptr);
+  EXPECT_EQ(allocate(pool, 64).ptr, nullptr);
+  destroy_allocator(pool);
+}
+
+TEST(numa, node_count_and_current) {
+  EXPECT_GE(numa_node_count(), 1);
+  EXPECT_GE(numa_current_node(), 0);
+  EXPECT_LT(numa_current_node(), numa_node_count());
+}
+
+TEST(numa, allocators_on_node) {
+  const int32_t last = numa_node_count() - 1;
+  allocator *stack = create_stack_allocator_on_node(Mb, last);
+  allocator *pool = create_pool_allocator_on_node(Kb, 64, 0);
+  allocator *any = create_stack_allocator_on_node(Kb, numa_any_node);
+
+  blk s = allocate(stack, Kb * 4);
+  EXPECT_NE(s.ptr, nullptr);
+  memset(s.ptr, 1, s.size);
+  EXPECT_EQ(find_owner(s.ptr), stack);
+
+  blk p[64];
+  for (int i = 0; i < 64; i++) {
+    p[i] = allocate(pool, Kb);
+    EXPECT_NE(p[i].ptr, nullptr);
+  }
+  EXPECT_EQ(allocate(pool, Kb).ptr, nullptr);
+  deallocate_any(p[10].ptr);
+  EXPECT_EQ(allocate(pool, Kb).ptr, p[10].ptr);
+
+  EXPECT_NE(allocate(any, 64).ptr, nullptr);
+
+  destroy_allocator(any);
+  destroy_allocator(pool);
+  destroy_allocator(stack);
+}
+
+TEST(numa, local_arena_threads) {
+  constexpr int thread_count = 4;
+  node_arenas *arenas = create_node_arenas(Mb * 4, Kb * 16);
+  for (int32_t i = 0; i < numa_node_count(); i++)
+    EXPECT_NE(node_arena(arenas, i), nullptr);
+
+  std::vector<std::thread> threads;
+  allocator *used[thread_count];
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([arenas, t, &used] {
+      allocator *arena = local_arena(arenas);
+      EXPECT_EQ(arena, local_arena(arenas));
+      blk b = allocate(arena, 256);
+      EXPECT_NE(b.ptr, nullptr);
+      memset(b.ptr, t, b.size);
+      used[t] = find_owner(b.ptr);
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+
+  for (int t = 0; t < thread_count; t++) {
+    bool found = false;
+    for (int32_t i = 0; i < numa_node_count(); i++)
+      found = found || used[t] == node_arena(arenas, i);
+    EXPECT_TRUE(found);
+  }
+
+  reset_node_arenas(arenas);
+  destroy_node_arenas(arenas);
+}
+
+TEST(heap_snapshot, walk_tree) {
+  allocator *root = create_bitmapped_allocator(Kb * 16);
+  allocator *stack = create_stack_allocator(Kb * 8, root);
+  allocator *pool = create_pool_allocator(64, 32, root);
+
+  allocate(stack, 100);
+  blk p[4];
+  for (int i = 0; i < 4; i++)
+    p[i] = allocate(pool, 64);
+  deallocate(pool, p[1]);
+
+  struct walk_result {
+    size_t allocators;
+    size_t ranges;
+    uint32_t max_depth;
+    size_t pool_live;
+  } result{};
+
+  allocator_visitor visitor{
+      &result,
+      [](void *user, const allocator_layout *layout) {
+        auto r = static_cast<walk_result *>(user);
+        r->allocators++;
+        r->max_depth = std::max(r->max_depth, layout->depth);
+      },
+      [](void *user, size_t, size_t size) {
+        auto r = static_cast<walk_result *>(user);
+        r->ranges++;
+        r->pool_live += size;
+      }};
+  walk_allocators(root, &visitor);
+
+  EXPECT_EQ(result.allocators, 3);
+  EXPECT_EQ(result.max_depth, 1);
+  // Root blocks holding both children, stack bytes, pool nodes 0 and 2-3.
+  EXPECT_EQ(result.ranges, 4);
+
+  destroy_allocator(pool);
+  result = {};
+  walk_allocators(root, &visitor);
+  EXPECT_EQ(result.allocators, 2);
+
+  destroy_allocator(stack);
+  destroy_allocator(root);
+}
+
+TEST(heap_snapshot, write_read_roundtrip) {
+  allocator *root = create_bitmapped_allocator(Kb);
+  allocator *pool = create_pool_allocator(128, 8, root);
+  blk b = allocate(root, Kb * 3);
+  blk p[3];
+  for (int i = 0; i < 3; i++)
+    p[i] = allocate(pool, 128);
+  deallocate(pool, p[0]);
+
+  FILE *file = tmpfile();
+  ASSERT_NE(file, nullptr);
+  EXPECT_TRUE(write_heap_snapshot(root, file));
+  deallocate(root, b);
+  EXPECT_TRUE(write_heap_snapshot(root, file));
+  rewind(file);
+
+  heap_snapshot first;
+  ASSERT_TRUE(read_heap_snapshot(file, &first));
+  ASSERT_EQ(first.header.allocator_count, 2u);
+  const heap_snapshot_allocator &r = first.allocators[0];
+  EXPECT_STREQ(allocator_type_name(r.type), "bitmaped");
+  EXPECT_EQ(r.unit, Kb);
+  EXPECT_EQ(r.size, Kb * 64);
+  EXPECT_EQ(r.parent, 0u);
+  const heap_snapshot_allocator &c = first.allocators[1];
+  EXPECT_STREQ(allocator_type_name(c.type), "pool");
+  EXPECT_EQ(c.parent, r.id);
+  EXPECT_EQ(c.depth, 1u);
+  ASSERT_EQ(c.range_count, 1u);
+  const heap_snapshot_range &live = first.ranges[r.range_count];
+  EXPECT_EQ(live.offset, 128u);
+  EXPECT_EQ(live.size, 256u);
+
+  heap_snapshot second;
+  ASSERT_TRUE(read_heap_snapshot(file, &second));
+  EXPECT_GE(second.header.timestamp_ns, first.header.timestamp_ns);
+  EXPECT_EQ(second.allocators[0].range_count, 1u);
+  EXPECT_LT(second.ranges[0].size, first.ranges[0].size);
+
+  heap_snapshot end;
+  EXPECT_FALSE(read_heap_snapshot(file, &end));
+
+  free_heap_snapshot(&first);
+  free_heap_snapshot(&second);
+  fclose(file);
+  destroy_allocator(pool);
+  destroy_allocator(root);
+}
+
+TEST(heap_snapshot, corrupt_counts_fail_to_read) {
+  allocator *root = create_pool_allocator(128, 8);
+  FILE *file = tmpfile();
+  ASSERT_NE(file, nullptr);
+  EXPECT_TRUE(write_heap_snapshot(root, file));
+  const long size = ftell(file);
+
+  heap_snapshot_header header;
+  rewind(file);
+  ASSERT_EQ(fread(&header, sizeof(header), 1, file), 1u);
+  const heap_snapshot_header good = header;
+  header.allocator_count = 0xffffffffu;
+  header.range_count = 0xffffffffu;
+  rewind(file);
+  ASSERT_EQ(fwrite(&header, sizeof(header), 1, file), 1u);
+  rewind(file);
+  heap_snapshot snapshot;
+  EXPECT_FALSE(read_heap_snapshot(file, &snapshot));
+
+  // Counts that fit, but a file cut short.
+  rewind(file);
+  ASSERT_EQ(fwrite(&good, sizeof(good), 1, file), 1u);
+  fflush(file);
+  ASSERT_EQ(ftruncate(fileno(file), size - 8), 0);
+  rewind(file);
+  EXPECT_FALSE(read_heap_snapshot(file, &snapshot));
+
+  fclose(file);
+  destroy_allocator(root);
+}
+
+struct fake_device {
+  size_t live_blocks;
+  size_t live_bytes;
+  size_t live_maps;
+  size_t limit;
+  size_t allocate_calls;
+};
+
+static bool fake_device_allocate(void *user_data, uint32_t, size_t size,
+                                 uint64_t *memory) {
+  fake_device *dev = static_cast<fake_device *>(user_data);
+  if (dev->limit && dev->live_bytes + size > dev->limit)
+    return false;
+  size_t *raw = static_cast<size_t *>(malloc(size + 16));
+  if (!raw)
+    return false;
+  raw[0] = size;
+  dev->allocate_calls++;
+  dev->live_blocks++;
+  dev->live_bytes += size;
+  *memory = reinterpret_cast<uint64_t>(raw);
+  return true;
+}
+
+static void fake_device_free(void *user_data, uint32_t, uint64_t memory) {
+  fake_device *dev = static_cast<fake_device *>(user_data);
+  size_t *raw = reinterpret_cast<size_t *>(memory);
+  dev->live_blocks--;
+  dev->live_bytes -= raw[0];
+  free(raw);
+}
+
+static void *fake_device_map(void *user_data, uint64_t memory, size_t) {
+  fake_device *dev = static_cast<fake_device *>(user_data);
+  dev->live_maps++;
+  return reinterpret_cast<uint8_t *>(memory) + 16;
+}
+
+static void fake_device_unmap(void *user_data, uint64_t) {
+  fake_device *dev = static_cast<fake_device *>(user_data);
+  dev->live_maps--;
+}
+
+static device_memory_create_info fake_device_info(fake_device *dev) {
+  device_memory_create_info info{};
+  info.backend = {dev, fake_device_allocate, fake_device_free, fake_device_map,
+                  fake_device_unmap};
+  info.memory_type_count = 2;
+  info.memory_type_flags[1] = DEVICE_MEMORY_HOST_VISIBLE;
+  info.block_size = Mb * 16;
+  info.buffer_image_granularity = Kb;
+  info.max_allocations_per_block = 256;
+  return info;
+}
+
+TEST(device_memory, create_destroy) {
+  fake_device dev{};
+  allocator *alloc = create_stack_allocator(Mb);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+  EXPECT_NE(memory, nullptr);
+  EXPECT_EQ(dev.live_blocks, 0);
+  destroy_device_memory(memory);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, sub_allocate_one_block) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation a[64];
+  for (int i = 0; i < 64; i++) {
+    a[i] = device_allocate(memory, 0, Kb * 100, 256, DEVICE_RESOURCE_LINEAR);
+    EXPECT_NE(a[i].memory, 0);
+    EXPECT_EQ(a[i].offset % 256, 0);
+    EXPECT_EQ(a[i].size, Kb * 100);
+    EXPECT_EQ(a[i].mapped, nullptr);
+  }
+  EXPECT_EQ(dev.live_blocks, 1);
+  for (int i = 1; i < 64; i++) {
+    EXPECT_EQ(a[i].memory, a[0].memory);
+    EXPECT_GE(a[i].offset, a[i - 1].offset + a[i - 1].size);
+  }
+
+  device_memory_stats stats = get_device_memory_stats(memory);
+  EXPECT_EQ(stats.block_count, 1);
+  EXPECT_EQ(stats.allocation_count, 64);
+  EXPECT_EQ(stats.bytes_used, Kb * 100 * 64);
+  EXPECT_EQ(stats.bytes_reserved, Mb * 16);
+
+  for (int i = 0; i < 64; i++) {
+    device_deallocate(memory, a[i]);
+  }
+  stats = get_device_memory_stats(memory);
+  EXPECT_EQ(stats.allocation_count, 0);
+  EXPECT_EQ(stats.bytes_used, 0);
+
+  destroy_device_memory(memory);
+  EXPECT_EQ(dev.live_blocks, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, free_ranges_merge) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation a[8];
+  for (int i = 0; i < 8; i++) {
+    a[i] = device_allocate(memory, 0, Mb * 2, 256, DEVICE_RESOURCE_LINEAR);
+    EXPECT_NE(a[i].memory, 0);
+  }
+  EXPECT_EQ(dev.live_blocks, 1);
+
+  device_deallocate(memory, a[1]);
+  device_deallocate(memory, a[0]);
+  device_deallocate(memory, a[2]);
+
+  device_allocation e =
+      device_allocate(memory, 0, Mb * 6, 256, DEVICE_RESOURCE_LINEAR);
+  EXPECT_EQ(e.memory, a[3].memory);
+  EXPECT_EQ(e.offset, 0);
+  EXPECT_EQ(dev.live_blocks, 1);
+
+  device_deallocate(memory, e);
+  for (int i = 3; i < 8; i++) {
+    device_deallocate(memory, a[i]);
+  }
+  destroy_device_memory(memory);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, new_block_when_full) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation a[6];
+  for (int i = 0; i < 6; i++) {
+    a[i] = device_allocate(memory, 0, Mb * 7, 256, DEVICE_RESOURCE_LINEAR);
+    EXPECT_NE(a[i].memory, 0);
+  }
+  EXPECT_EQ(dev.live_blocks, 3);
+
+  for (int i = 0; i < 6; i++) {
+    device_deallocate(memory, a[i]);
+  }
+  EXPECT_EQ(dev.live_blocks, 1);
+
+  destroy_device_memory(memory);
+  EXPECT_EQ(dev.live_blocks, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, warm_block_next_to_a_full_one) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation a[2];
+  for (int i = 0; i < 2; i++) {
+    a[i] = device_allocate(memory, 0, Mb * 7, 256, DEVICE_RESOURCE_LINEAR);
+    EXPECT_NE(a[i].memory, 0);
+  }
+  for (int i = 0; i < 10; i++) {
+    device_allocation b =
+        device_allocate(memory, 0, Mb * 7, 256, DEVICE_RESOURCE_LINEAR);
+    EXPECT_NE(b.memory, a[0].memory);
+    device_deallocate(memory, b);
+  }
+  EXPECT_EQ(dev.allocate_calls, 2);
+  EXPECT_EQ(dev.live_blocks, 2);
+
+  for (int i = 0; i < 2; i++) {
+    device_deallocate(memory, a[i]);
+  }
+  EXPECT_EQ(dev.live_blocks, 1);
+
+  destroy_device_memory(memory);
+  EXPECT_EQ(dev.live_blocks, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, dedicated_allocation) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation big =
+      device_allocate(memory, 0, Mb * 9, 256, DEVICE_RESOURCE_OPTIMAL);
+  EXPECT_NE(big.memory, 0);
+  EXPECT_EQ(big.block, nullptr);
+  EXPECT_EQ(big.offset, 0);
+
+  device_allocation forced =
+      device_allocate(memory, 0, Kb, 256, DEVICE_RESOURCE_LINEAR, true);
+  EXPECT_NE(forced.memory, 0);
+  EXPECT_EQ(forced.block, nullptr);
+
+  device_memory_stats stats = get_device_memory_stats(memory);
+  EXPECT_EQ(stats.dedicated_count, 2);
+  EXPECT_EQ(stats.block_count, 0);
+
+  device_deallocate(memory, big);
+  device_deallocate(memory, forced);
+  EXPECT_EQ(dev.live_blocks, 0);
+
+  destroy_device_memory(memory);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, buffer_image_granularity) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation buffer =
+      device_allocate(memory, 0, 100, 16, DEVICE_RESOURCE_LINEAR);
+  device_allocation image =
+      device_allocate(memory, 0, 100, 16, DEVICE_RESOURCE_OPTIMAL);
+  device_allocation buffer2 =
+      device_allocate(memory, 0, 100, 16, DEVICE_RESOURCE_LINEAR);
+
+  EXPECT_EQ(image.offset % Kb, 0);
+  EXPECT_EQ(image.size, Kb);
+  EXPECT_NE(buffer.offset / Kb, image.offset / Kb);
+  EXPECT_NE(buffer2.offset / Kb, image.offset / Kb);
+
+  device_deallocate(memory, buffer);
+  device_deallocate(memory, image);
+  device_deallocate(memory, buffer2);
+  destroy_device_memory(memory);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, persistent_mapping) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation a =
+      device_allocate(memory, 1, Kb, 256, DEVICE_RESOURCE_LINEAR);
+  device_allocation b =
+      device_allocate(memory, 1, Kb, 256, DEVICE_RESOURCE_LINEAR);
+  EXPECT_NE(a.mapped, nullptr);
+  EXPECT_EQ(static_cast<uint8_t *>(b.mapped) - static_cast<uint8_t *>(a.mapped),
+            static_cast<ptrdiff_t>(b.offset - a.offset));
+  EXPECT_EQ(dev.live_maps, 1);
+  memset(a.mapped, 0xab, a.size);
+  memset(b.mapped, 0xcd, b.size);
+
+  device_deallocate(memory, a);
+  device_deallocate(memory, b);
+  destroy_device_memory(memory);
+  EXPECT_EQ(dev.live_maps, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, out_of_device_memory) {
+  fake_device dev{};
+  dev.limit = Mb * 16;
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 8);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  device_allocation a =
+      device_allocate(memory, 0, Mb * 6, 256, DEVICE_RESOURCE_LINEAR);
+  device_allocation b =
+      device_allocate(memory, 0, Mb * 6, 256, DEVICE_RESOURCE_LINEAR);
+  device_allocation c =
+      device_allocate(memory, 0, Mb * 6, 256, DEVICE_RESOURCE_LINEAR);
+  EXPECT_NE(a.memory, 0);
+  EXPECT_NE(b.memory, 0);
+  EXPECT_EQ(c.memory, 0);
+  EXPECT_EQ(c.size, 0);
+
+  device_deallocate(memory, a);
+  device_deallocate(memory, b);
+  destroy_device_memory(memory);
+  destroy_allocator(alloc);
+}
+
+TEST(device_memory, random_churn_no_overlap) {
+  fake_device dev{};
+  allocator *alloc = create_pool_allocator(
+      device_memory_block_footprint(256), 16);
+  device_memory_create_info info = fake_device_info(&dev);
+  device_memory *memory = create_device_memory(alloc, &info);
+
+  constexpr int count = 128;
+  device_allocation live[count]{};
+  uint32_t seed = 1234;
+  for (int iter = 0; iter < 20000; iter++) {
+    seed = seed * 1664525u + 1013904223u;
+    int idx = static_cast<int>((seed >> 8) % count);
+    if (live[idx].memory) {
+      device_deallocate(memory, live[idx]);
+      live[idx] = {};
+    } else {
+      size_t size = ((seed >> 16) % (Kb * 512)) + 1;
+      size_t alignment = size_t{1} << ((seed >> 4) % 12);
+      device_resource_kind kind =
+          (seed & 1) ? DEVICE_RESOURCE_OPTIMAL : DEVICE_RESOURCE_LINEAR;
+      live[idx] = device_allocate(memory, 0, size, alignment, kind);
+      ASSERT_NE(live[idx].memory, 0);
+      ASSERT_EQ(live[idx].offset % alignment, 0);
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    for (int j = i + 1; j < count; j++) {
+      if (!live[i].memory || live[i].memory != live[j].memory)
+        continue;
+      bool disjoint = live[i].offset + live[i].size <= live[j].offset ||
+                      live[j].offset + live[j].size <= live[i].offset;
+      EXPECT_TRUE(disjoint);
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    device_deallocate(memory, live[i]);
+  }
+  device_memory_stats stats = get_device_memory_stats(memory);
+  EXPECT_EQ(stats.allocation_count, 0);
+  EXPECT_EQ(stats.block_count, 1);
+
+  destroy_device_memory(memory);
+  EXPECT_EQ(dev.live_blocks, 0);
+  destroy_allocator(alloc);
+}
@@ -0,0 +1,202 @@
+#include "memory/heap_snapshot.h"
+#include "memory/memory.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * Offline viewer for heap snapshots. Prints per allocator occupancy and
+ * fragmentation for every snapshot in a file, with an address strip where
+ * '#' is a fully live bucket, '+' a partly live one and '.' a free one.
+ * With --ppm a timeline image is written as well: one row per allocator per
+ * snapshot, time going down, brightness showing how much of a bucket is
+ * live.
+ */
+
+struct allocator_stats {
+  uint64_t live;
+  uint64_t holes;
+  uint64_t largest_hole;
+};
+
+static allocator_stats
+compute_stats(const heap_snapshot_allocator &record,
+              const heap_snapshot_range *ranges) {
+  allocator_stats stats{};
+  uint64_t cursor = 0;
+  for (uint64_t i = 0; i < record.range_count; i++) {
+    const heap_snapshot_range &range = ranges[i];
+    if (range.offset > cursor) {
+      const uint64_t hole = range.offset - cursor;
+      stats.holes++;
+      stats.largest_hole =
+          hole > stats.largest_hole ? hole : stats.largest_hole;
+    }
+    stats.live += range.size;
+    cursor = range.offset + range.size;
+  }
+  if (record.size > cursor) {
+    const uint64_t hole = record.size - cursor;
+    stats.holes++;
+    stats.largest_hole = hole > stats.largest_hole ? hole : stats.largest_hole;
+  }
+  return stats;
+}
+
+/**
+ * Fraction of every bucket covered by live ranges, buckets split the
+ * allocator range evenly.
+ */
+static void fill_buckets(const heap_snapshot_allocator &record,
+                         const heap_snapshot_range *ranges, double *buckets,
+                         uint32_t width) {
+  for (uint32_t i = 0; i < width; i++)
+    buckets[i] = 0.0;
+  if (!record.size)
+    return;
+
+  const double bucket_size = static_cast<double>(record.size) / width;
+  for (uint64_t i = 0; i < record.range_count; i++) {
+    const double begin = static_cast<double>(ranges[i].offset);
+    const double end = begin + static_cast<double>(ranges[i].size);
+    uint32_t first = static_cast<uint32_t>(begin / bucket_size);
+    for (uint32_t b = first; b < width; b++) {
+      const double lo = b * bucket_size;
+      const double hi = lo + bucket_size;
+      if (lo >= end)
+        break;
+      const double covered = (end < hi ? end : hi) - (begin > lo ? begin : lo);
+      buckets[b] += covered / bucket_size;
+    }
+  }
+}
+
+static void print_snapshot(const heap_snapshot &snapshot, uint64_t start_ns,
+                           double *buckets, uint32_t width) {
+  printf("snapshot +%.3f ms, %u allocators\n",
+         static_cast<double>(snapshot.header.timestamp_ns - start_ns) / 1e6,
+         snapshot.header.allocator_count);
+
+  const heap_snapshot_range *ranges = snapshot.ranges;
+  for (uint32_t i = 0; i < snapshot.header.allocator_count; i++) {
+    const heap_snapshot_allocator &record = snapshot.allocators[i];
+    const allocator_stats stats = compute_stats(record, ranges);
+    const uint64_t free_bytes = record.size - stats.live;
+    const double fragmentation =
+        free_bytes ? 1.0 - static_cast<double>(stats.largest_hole) / free_bytes
+                   : 0.0;
+
+    printf("%*s%-16s %10llu bytes  live %5.1f%%  holes %-4llu largest %-10llu "
+           "frag %.2f",
+           static_cast<int>(record.depth * 2), "",
+           allocator_type_name(record.type),
+           static_cast<unsigned long long>(record.size),
+           record.size ? 100.0 * stats.live / record.size : 0.0,
+           static_cast<unsigned long long>(stats.holes),
+           static_cast<unsigned long long>(stats.largest_hole), fragmentation);
+    if (record.cached)
+      printf("  cached %llu", static_cast<unsigned long long>(record.cached));
+    printf("\n");
+
+    if (record.size) {
+      fill_buckets(record, ranges, buckets, width);
+      printf("%*s|", static_cast<int>(record.depth * 2), "");
+      for (uint32_t b = 0; b < width; b++)
+        putchar(buckets[b] >= 0.999 ? '#' : buckets[b] > 0.0 ? '+' : '.');
+      printf("|\n");
+    }
+    ranges += record.range_count;
+  }
+}
+
+static void write_ppm_rows(FILE *ppm, const heap_snapshot &snapshot,
+                           double *buckets, uint32_t width) {
+  const heap_snapshot_range *ranges = snapshot.ranges;
+  for (uint32_t i = 0; i < snapshot.header.allocator_count; i++) {
+    const heap_snapshot_allocator &record = snapshot.allocators[i];
+    fill_buckets(record, ranges, buckets, width);
+    for (uint32_t b = 0; b < width; b++) {
+      const uint8_t v = static_cast<uint8_t>(buckets[b] * 255.0);
+      const uint8_t pixel[3]{v, static_cast<uint8_t>(v / 2), 32};
+      fwrite(pixel, 3, 1, ppm);
+    }
+    ranges += record.range_count;
+  }
+  // Separator between snapshots.
+  for (uint32_t b = 0; b < width; b++) {
+    const uint8_t pixel[3]{0, 0, 96};
+    fwrite(pixel, 3, 1, ppm);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *input{nullptr};
+  const char *ppm_path{nullptr};
+  uint32_t width{64};
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--ppm") && i + 1 < argc)
+      ppm_path = argv[++i];
+    else if (!strcmp(argv[i], "--width") && i + 1 < argc)
+      width = static_cast<uint32_t>(atoi(argv[++i]));
+    else
+      input = argv[i];
+  }
+  if (!input || !width) {
+    fprintf(stderr, "usage: heap-view <snapshots> [--width N] [--ppm out]\n");
+    return 1;
+  }
+
+  FILE *file = fopen(input, "rb");
+  if (!file) {
+    fprintf(stderr, "heap-view: failed to open %s\n", input);
+    return 1;
+  }
+
+  double *buckets = static_cast<double *>(malloc(width * sizeof(double)));
+
+  // Rows are only known after reading every snapshot, so the image body is
+  // spooled to a temporary file first.
+  FILE *body = ppm_path ? tmpfile() : nullptr;
+  uint32_t rows{0};
+  uint64_t start_ns{0};
+  uint32_t count{0};
+
+  heap_snapshot snapshot;
+  while (read_heap_snapshot(file, &snapshot)) {
+    if (!count)
+      start_ns = snapshot.header.timestamp_ns;
+    print_snapshot(snapshot, start_ns, buckets, width);
+    if (body) {
+      write_ppm_rows(body, snapshot, buckets, width);
+      rows += snapshot.header.allocator_count + 1;
+    }
+    free_heap_snapshot(&snapshot);
+    count++;
+  }
+  fclose(file);
+
+  if (body) {
+    FILE *ppm = fopen(ppm_path, "wb");
+    if (ppm) {
+      fprintf(ppm, "P6\n%u %u\n255\n", width, rows);
+      rewind(body);
+      char chunk[4096];
+      size_t n;
+      while ((n = fread(chunk, 1, sizeof(chunk), body)) > 0)
+        fwrite(chunk, 1, n, ppm);
+      fclose(ppm);
+    } else {
+      fprintf(stderr, "heap-view: failed to open %s\n", ppm_path);
+    }
+    fclose(body);
+  }
+
+  free(buckets);
+  if (!count) {
+    fprintf(stderr, "heap-view: no snapshots in %s\n", input);
+    return 1;
+  }
+  return 0;
+}
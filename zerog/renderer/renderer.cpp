@@ -2,12 +2,15 @@
 
 #include "vk/initializer.h"
 
+#include "common/profiler.h"
+
 namespace ZeroG {
 PTR_DEFINITION(Kernel);
 PTR_IMPLEMENTATION(Kernel);
 
 struct renderer {
   allocator *renderer_allocator;
+  allocator *memory_allocator;
   Kernel kernel;
   size_t size;
 };
@@ -30,6 +33,7 @@ void ZeroG::deinit_renderer(ZeroG::renderer *instance) {
 
 void ZeroG::create_kernel(renderer *instance,
                           const ZeroG::KernelCreateInfo *kinfo) {
+  profile_function();
   allocator *buffer = create_stack_allocator(Mb, instance->renderer_allocator);
   instance->kernel.window = vk::create_window(kinfo->window_info);
   instance->kernel.instance = vk::create_instance(buffer, kinfo->app_info);
@@ -39,10 +43,16 @@ void ZeroG::create_kernel(renderer *instance,
       buffer, instance->kernel.instance.instance, instance->kernel.surface);
   instance->kernel.logical_device =
       vk::create_device(buffer, instance->kernel.physical_device);
+  instance->memory_allocator = create_pool_allocator(
+      device_memory_block_footprint(0), 32, instance->renderer_allocator);
+  instance->kernel.memory = vk::create_memory_allocator(
+      instance->memory_allocator, &instance->kernel);
   destroy_allocator(buffer);
 }
 
 void ZeroG::destry_kernel(renderer *instance) {
+  vk::destroy_memory_allocator(instance->kernel.memory);
+  destroy_allocator(instance->memory_allocator);
   vk::destroy_device(instance->kernel.logical_device);
   vk::destroy_surface(instance->kernel.instance.instance,
                       instance->kernel.surface);
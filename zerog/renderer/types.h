@@ -58,13 +58,28 @@ struct DescriptorSetCreateInfo {
 
 enum DataInputRate { PER_VERTEX = 0, PER_INSTANCE = 1 };
 
+/**
+ * Values are the matching VkFormat. The packed types are filled with the
+ * encoders in common/vertex_pack.h and read as floats by the shader, OCT16
+ * is an octahedral normal the shader decodes itself.
+ */
 enum DataType {
   UINT = 98,
   INT = 99,
   FLOAT = 100,
   VEC2 = 103,
   VEC3 = 106,
-  VEC4 = 109
+  VEC4 = 109,
+  HALF2 = 83,
+  HALF4 = 97,
+  SNORM16X2 = 78,
+  SNORM16X4 = 92,
+  UNORM16X2 = 77,
+  UNORM16X4 = 91,
+  SNORM8X4 = 38,
+  UNORM8X4 = 37,
+  A2B10G10R10 = 64,
+  OCT16 = SNORM16X2
 };
 
 struct DataAttribute {
@@ -0,0 +1,132 @@
+#include "initializer.h"
+
+#include <cassert>
+
+static VkDeviceMemory to_vk(uint64_t memory) {
+  return reinterpret_cast<VkDeviceMemory>(memory);
+}
+
+static bool vk_allocate(void *user_data, uint32_t memory_type, size_t size,
+                        uint64_t *memory) {
+  VkMemoryAllocateInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  info.allocationSize = size;
+  info.memoryTypeIndex = memory_type;
+
+  VkDeviceMemory mem{VK_NULL_HANDLE};
+  if (vkAllocateMemory(static_cast<VkDevice>(user_data), &info, nullptr,
+                       &mem) != VK_SUCCESS)
+    return false;
+  *memory = reinterpret_cast<uint64_t>(mem);
+  return true;
+}
+
+static void vk_free(void *user_data, uint32_t, uint64_t memory) {
+  vkFreeMemory(static_cast<VkDevice>(user_data), to_vk(memory), nullptr);
+}
+
+static void *vk_map(void *user_data, uint64_t memory, size_t size) {
+  void *data{nullptr};
+  vkMapMemory(static_cast<VkDevice>(user_data), to_vk(memory), 0, size, 0,
+              &data);
+  return data;
+}
+
+static void vk_unmap(void *user_data, uint64_t memory) {
+  vkUnmapMemory(static_cast<VkDevice>(user_data), to_vk(memory));
+}
+
+namespace ZeroG {
+namespace vk {
+
+device_memory *create_memory_allocator(allocator *alloc, const Kernel *kernel) {
+  VkPhysicalDeviceMemoryProperties mem_properties;
+  vkGetPhysicalDeviceMemoryProperties(kernel->physical_device.device,
+                                      &mem_properties);
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(kernel->physical_device.device, &properties);
+
+  device_memory_create_info info{};
+  info.backend = {kernel->logical_device.device, vk_allocate, vk_free, vk_map,
+                  vk_unmap};
+  info.memory_type_count = mem_properties.memoryTypeCount;
+  for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
+    if (mem_properties.memoryTypes[i].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+      info.memory_type_flags[i] = DEVICE_MEMORY_HOST_VISIBLE;
+  }
+  info.buffer_image_granularity =
+      static_cast<size_t>(properties.limits.bufferImageGranularity);
+
+  return create_device_memory(alloc, &info);
+}
+
+void destroy_memory_allocator(device_memory *memory) {
+  destroy_device_memory(memory);
+}
+
+int32_t find_memory_type(const Kernel *kernel, uint32_t type_bits,
+                         VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties mem_properties;
+  vkGetPhysicalDeviceMemoryProperties(kernel->physical_device.device,
+                                      &mem_properties);
+  for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
+    if ((type_bits & (1u << i)) &&
+        (mem_properties.memoryTypes[i].propertyFlags & properties) ==
+            properties) {
+      return static_cast<int32_t>(i);
+    }
+  }
+  return -1;
+}
+
+device_allocation allocate_buffer_memory(const Kernel *kernel, VkBuffer buffer,
+                                         VkMemoryPropertyFlags properties) {
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(kernel->logical_device.device, buffer,
+                                &requirements);
+
+  int32_t type =
+      find_memory_type(kernel, requirements.memoryTypeBits, properties);
+  if (type < 0)
+    return {};
+
+  device_allocation res = device_allocate(
+      kernel->memory, static_cast<uint32_t>(type),
+      static_cast<size_t>(requirements.size),
+      static_cast<size_t>(requirements.alignment), DEVICE_RESOURCE_LINEAR);
+  if (res.memory) {
+    vkBindBufferMemory(kernel->logical_device.device, buffer, to_vk(res.memory),
+                       res.offset);
+  }
+  return res;
+}
+
+device_allocation allocate_image_memory(const Kernel *kernel, VkImage image,
+                                        VkMemoryPropertyFlags properties) {
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(kernel->logical_device.device, image,
+                               &requirements);
+
+  int32_t type =
+      find_memory_type(kernel, requirements.memoryTypeBits, properties);
+  if (type < 0)
+    return {};
+
+  device_allocation res = device_allocate(
+      kernel->memory, static_cast<uint32_t>(type),
+      static_cast<size_t>(requirements.size),
+      static_cast<size_t>(requirements.alignment), DEVICE_RESOURCE_OPTIMAL);
+  if (res.memory) {
+    vkBindImageMemory(kernel->logical_device.device, image, to_vk(res.memory),
+                      res.offset);
+  }
+  return res;
+}
+
+void free_memory(const Kernel *kernel, device_allocation allocation) {
+  device_deallocate(kernel->memory, allocation);
+}
+
+} // namespace vk
+} // namespace ZeroG
@@ -5,37 +5,37 @@
 
 #include <cassert>
 #include <cstdio>
-#include <cstring>
 #include <limits>
 
+#include "common/hash.h"
+#include "common/id_set.h"
+#include "common/log.h"
 #include "common/math.h"
+#include "common/perfect_hash.h"
+#include "utils/string_table.h"
 
 #ifndef NDEBUG
-#include <cstdio>
-
+/**
+ * Validation layers call this on whichever thread hit the problem, the
+ * logger keeps them from waiting on the terminal. Errors are written out
+ * before the driver goes on, in case it crashes next.
+ */
 static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
     VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT, uint64_t, size_t,
     int32_t code, const char *layerPrefix, const char *msg, void *) {
 
-  if (flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT) {
-    printf("VINFO: [%s] Code %d : %s\n", layerPrefix, code, msg);
+  if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) {
+    log_error("[%s] Code %d : %s", layerPrefix, code, msg);
   } else if (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT) {
-    printf("VWARNING: [%s] Code %d : %s\n", layerPrefix, code, msg);
-
+    log_warning("[%s] Code %d : %s", layerPrefix, code, msg);
   } else if (flags & VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT) {
-    printf("VPERF: [%s] Code %d : %s\n", layerPrefix, code, msg);
-
-  } else if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) {
-    printf("VERROR: [%s] Code %d : %s\n", layerPrefix, code, msg);
-
+    log_warning("[%s] Code %d : performance: %s", layerPrefix, code, msg);
   } else if (flags & VK_DEBUG_REPORT_DEBUG_BIT_EXT) {
-    printf("VDEBUG: [%s] Code %d : %s\n", layerPrefix, code, msg);
-
+    log_debug("[%s] Code %d : %s", layerPrefix, code, msg);
   } else {
-    printf("VINFO: [%s] Code %d : %s\n", layerPrefix, code, msg);
+    log_info("[%s] Code %d : %s", layerPrefix, code, msg);
   }
 
-  fflush(stdout);
   return VK_FALSE;
 }
 
@@ -62,38 +62,16 @@ VKAPI_ATTR void VKAPI_CALL vkDestroyDebugReportCallbackEXT(
   }
 }
 
-constexpr const char *validation_layers[]{
-    "VK_LAYER_LUNARG_standard_validation"};
-
-constexpr int32_t validation_layer_count{sizeof(validation_layers) /
-                                         sizeof(const char *)};
+declare_id_set(validation_layers, "VK_LAYER_LUNARG_standard_validation");
+declare_perfect_hash(validation_layer_table, validation_layers);
+static_assert(validation_layers.size() < 64, "Too many validation layers");
 #endif
 
-constexpr const char *device_extensions[]{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-constexpr int32_t device_extension_count{sizeof(device_extensions) /
-                                         sizeof(const char *)};
-
-ARRAY_DEFINITION(string_array, const char *);
-ARRAY_DEFINITION(vk_lp_array, VkLayerProperties);
-ARRAY_DEFINITION(vk_qfp_array, VkQueueFamilyProperties);
-ARRAY_DEFINITION(vk_ep_array, VkExtensionProperties);
-ARRAY_DEFINITION(vk_pd_array, VkPhysicalDevice);
-ARRAY_DEFINITION(vk_format_array, VkFormat);
-ARRAY_DEFINITION(vk_dsl_array, VkDescriptorSetLayoutBinding);
-ARRAY_DEFINITION(vk_pss_array, VkPipelineShaderStageCreateInfo);
-ARRAY_DEFINITION(vk_vibd_array, VkVertexInputBindingDescription);
-ARRAY_DEFINITION(vk_viad_array, VkVertexInputAttributeDescription);
-
-ARRAY_IMPLEMENTATION(string_array);
-ARRAY_IMPLEMENTATION(vk_lp_array);
-ARRAY_IMPLEMENTATION(vk_qfp_array);
-ARRAY_IMPLEMENTATION(vk_ep_array);
-ARRAY_IMPLEMENTATION(vk_pd_array);
-ARRAY_IMPLEMENTATION(vk_format_array);
-ARRAY_IMPLEMENTATION(vk_dsl_array);
-ARRAY_IMPLEMENTATION(vk_pss_array);
-ARRAY_IMPLEMENTATION(vk_vibd_array);
-ARRAY_IMPLEMENTATION(vk_viad_array);
+declare_id_set(device_extensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+declare_perfect_hash(device_extension_table, device_extensions);
+static_assert(device_extensions.size() < 64, "Too many device extensions");
+
+typedef ZeroG::vector<const char *, 8> string_array;
 
 void print_string_array(const string_array &a) {
   for (const auto &m : a) {
@@ -117,15 +95,15 @@ static string_array get_extensions(allocator *alloc) {
   const char **extension_names;
   extension_names = glfwGetRequiredInstanceExtensions(&extesion_count);
 
-  auto res = create_string_array(alloc, extesion_count + 1);
+  string_array res(alloc);
   int32_t ext_count = static_cast<int32_t>(extesion_count);
 
   for (int32_t i = 0; i < ext_count; i++) {
-    res.data[i] = extension_names[i];
+    res.push_back(extension_names[i]);
   }
 
 #ifndef NDEBUG
-  res.data[extesion_count] = VK_EXT_DEBUG_REPORT_EXTENSION_NAME;
+  res.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 #endif
   return res;
 }
@@ -135,38 +113,30 @@ static string_array get_validation_layers(allocator *alloc) {
   uint32_t layer_count;
   vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
 
-  auto res = create_string_array(alloc, validation_layer_count);
-  auto layers = create_vk_lp_array(alloc, layer_count);
+  string_array res(alloc, validation_layers.size());
+  ZeroG::vector<VkLayerProperties> layers(alloc, layer_count);
 
-  vkEnumerateInstanceLayerProperties(&layer_count, layers.data);
+  vkEnumerateInstanceLayerProperties(&layer_count, layers.data());
 
-  int32_t i;
-  for (i = 0; i < validation_layer_count; i++) {
-    bool layer_found{false};
-    size_t j;
-    for (j = 0; j < layer_count; j++) {
-      if (strcmp(validation_layers[i], layers.data[j].layerName) == 0) {
-        res.data[i] = validation_layers[i];
-        layer_found = true;
-        break;
-      }
-    }
-    if (j == layer_count) {
-      break;
+  // One bit per required layer, drivers may list a layer twice.
+  uint64_t found = 0;
+  for (const auto &layer : layers) {
+    const int32_t i = validation_layer_table.find(layer.layerName);
+    if (i >= 0) {
+      res[static_cast<size_t>(i)] = validation_layers.names[i];
+      found |= uint64_t{1} << i;
     }
   }
 
-  destroy_vk_lp_array(alloc, layers);
-
-  if (i != validation_layer_count) {
-    res = {nullptr, 0, 0};
+  if (found != (uint64_t{1} << validation_layers.size()) - 1) {
+    res.clear();
   }
 
   return res;
 }
 #else
-static string_array get_validation_layers(allocator *) {
-  return {nullptr, 0, 0};
+static string_array get_validation_layers(allocator *alloc) {
+  return string_array(alloc);
 }
 #endif
 
@@ -203,29 +173,27 @@ get_queue_family_indeces(allocator *alloc, VkPhysicalDevice device,
   uint32_t family_count = 0;
   vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, nullptr);
 
-  auto properties = create_vk_qfp_array(alloc, family_count);
+  ZeroG::vector<VkQueueFamilyProperties, 8> properties(alloc, family_count);
   vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count,
-                                           properties.data);
+                                           properties.data());
 
   int32_t fm_count = static_cast<int32_t>(family_count);
 
   for (int32_t i = 0; i < fm_count; i++) {
-    if (properties.data[i].queueCount > 0 &&
-        properties.data[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    if (properties[i].queueCount > 0 &&
+        properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
       result.graphics = i;
     }
     VkBool32 present_support = false;
     vkGetPhysicalDeviceSurfaceSupportKHR(device, static_cast<uint32_t>(i),
                                          surface, &present_support);
-    if (properties.data[i].queueCount > 0 && present_support) {
+    if (properties[i].queueCount > 0 && present_support) {
       result.present = i;
     }
     if (result.graphics >= 0 && result.present >= 0)
       break;
   }
 
-  destroy_vk_qfp_array(alloc, properties);
-
   return result;
 }
 
@@ -234,20 +202,17 @@ static bool verify_extensions(allocator *alloc, VkPhysicalDevice device) {
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count,
                                        nullptr);
 
-  auto extensions = create_vk_ep_array(alloc, extension_count);
+  ZeroG::vector<VkExtensionProperties> extensions(alloc, extension_count);
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count,
-                                       extensions.data);
-  int32_t found = 0;
-  for (int32_t i = 0; i < device_extension_count; ++i) {
-    for (auto ext : extensions) {
-      if (strcmp(device_extensions[i], ext.extensionName) == 0) {
-        ++found;
-        break;
-      }
-    }
+                                       extensions.data());
+  // One bit per required extension, drivers may list one twice.
+  uint64_t found = 0;
+  for (const auto &ext : extensions) {
+    const int32_t i = device_extension_table.find(ext.extensionName);
+    if (i >= 0)
+      found |= uint64_t{1} << i;
   }
-  destroy_vk_ep_array(alloc, extensions);
-  return found == device_extension_count;
+  return found == (uint64_t{1} << device_extensions.size()) - 1;
 }
 
 static bool verify_swapchain(VkPhysicalDevice device, VkSurfaceKHR surface) {
@@ -265,10 +230,11 @@ static bool verify_swapchain(VkPhysicalDevice device, VkSurfaceKHR surface) {
 }
 
 static VkFormat selectSupportedFormat(VkPhysicalDevice device,
-                                      vk_format_array formats,
+                                      const VkFormat *formats, size_t count,
                                       VkImageTiling tiling,
                                       VkFormatFeatureFlags features) {
-  for (VkFormat format : formats) {
+  for (size_t i = 0; i < count; i++) {
+    VkFormat format = formats[i];
     VkFormatProperties props;
     vkGetPhysicalDeviceFormatProperties(device, format, &props);
 
@@ -287,17 +253,11 @@ static VkFormat selectDepthFormat(VkPhysicalDevice device) {
 
   VkFormat formats[3]{VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
                       VK_FORMAT_D24_UNORM_S8_UINT};
-  vk_format_array format_array;
-  format_array.data = formats;
-  format_array.count = 3;
-  format_array.size = 0;
-  return selectSupportedFormat(device, format_array, VK_IMAGE_TILING_OPTIMAL,
+  return selectSupportedFormat(device, formats, 3, VK_IMAGE_TILING_OPTIMAL,
                                VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 }
 
 namespace ZeroG {
-ARRAY_IMPLEMENTATION(vk_image_array);
-ARRAY_IMPLEMENTATION(vk_image_view_array);
 namespace vk {
 
 VkWindow create_window(const WindowCreateInfo *info) {
@@ -339,13 +299,19 @@ ZeroG::InstanceExt create_instance(allocator *alloc,
   instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   instance_info.pApplicationInfo = &app_info;
 
+#ifndef NDEBUG
+  register_id_set(validation_layers);
+#endif
+  register_id_set(device_extensions);
+
   auto extensions = get_extensions(alloc);
-  instance_info.ppEnabledExtensionNames = extensions.data;
-  instance_info.enabledExtensionCount = static_cast<uint32_t>(extensions.count);
+  instance_info.ppEnabledExtensionNames = extensions.data();
+  instance_info.enabledExtensionCount =
+      static_cast<uint32_t>(extensions.size());
 
   auto val_layers = get_validation_layers(alloc);
-  instance_info.ppEnabledLayerNames = val_layers.data;
-  instance_info.enabledLayerCount = static_cast<uint32_t>(val_layers.count);
+  instance_info.ppEnabledLayerNames = val_layers.data();
+  instance_info.enabledLayerCount = static_cast<uint32_t>(val_layers.size());
 
   printf("Extensions\n");
   print_string_array(extensions);
@@ -376,10 +342,6 @@ ZeroG::InstanceExt create_instance(allocator *alloc,
 #endif
   }
 
-  if (val_layers.data)
-    destroy_string_array(alloc, val_layers);
-  destroy_string_array(alloc, extensions);
-
   return {instance, debug};
 }
 
@@ -408,8 +370,8 @@ ZeroG::PhysicalDeviceExt select_physical_device(allocator *alloc,
   uint32_t device_count = 0;
   vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
 
-  auto devices = create_vk_pd_array(alloc, device_count);
-  vkEnumeratePhysicalDevices(instance, &device_count, devices.data);
+  ZeroG::vector<VkPhysicalDevice, 4> devices(alloc, device_count);
+  vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
 
   int32_t max_score = 0;
   for (auto dev : devices) {
@@ -456,12 +418,13 @@ ZeroG::LogicalDeviceExt create_device(allocator *alloc,
   device_info.pQueueCreateInfos = queue_info;
   device_info.queueCreateInfoCount = queue_info_count;
   device_info.pEnabledFeatures = &features;
-  device_info.enabledExtensionCount = device_extension_count;
-  device_info.ppEnabledExtensionNames = device_extensions;
+  device_info.enabledExtensionCount =
+      static_cast<uint32_t>(device_extensions.size());
+  device_info.ppEnabledExtensionNames = device_extensions.names;
 
   auto val_layers = get_validation_layers(alloc);
-  device_info.ppEnabledLayerNames = val_layers.data;
-  device_info.enabledLayerCount = static_cast<uint32_t>(val_layers.count);
+  device_info.ppEnabledLayerNames = val_layers.data();
+  device_info.enabledLayerCount = static_cast<uint32_t>(val_layers.size());
 
   if (vkCreateDevice(device.device, &device_info, nullptr, &result.device) ==
       VK_SUCCESS) {
@@ -472,8 +435,6 @@ ZeroG::LogicalDeviceExt create_device(allocator *alloc,
                      static_cast<uint32_t>(device.indics.present), 0,
                      &result.present);
   }
-  if (val_layers.data)
-    destroy_string_array(alloc, val_layers);
 
   return result;
 }
@@ -486,12 +447,6 @@ void destroy_device(LogicalDeviceExt device) {
  * USER SPACE FUNCTIONS
  */
 
-ARRAY_DEFINITION(vk_sf_array, VkSurfaceFormatKHR);
-ARRAY_DEFINITION(vk_pm_array, VkPresentModeKHR);
-
-ARRAY_IMPLEMENTATION(vk_sf_array);
-ARRAY_IMPLEMENTATION(vk_pm_array);
-
 ZeroG::SwapChainExt create_swap_chain(allocator *alloc,
                                       const ZeroG::Kernel *kernel,
                                       VkPresentModeKHR prefered_present_mode) {
@@ -504,7 +459,10 @@ ZeroG::SwapChainExt create_swap_chain(allocator *alloc,
   vkGetPhysicalDeviceSurfaceFormatsKHR(kernel->physical_device.device,
                                        kernel->surface, &format_count, nullptr);
   if (format_count > 0) {
-    vk_sf_array formats = create_vk_sf_array(alloc, format_count);
+    ZeroG::vector<VkSurfaceFormatKHR> formats(alloc, format_count);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(kernel->physical_device.device,
+                                         kernel->surface, &format_count,
+                                         formats.data());
     VkSurfaceFormatKHR format{VK_FORMAT_UNDEFINED,
                               VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
     for (const auto &f : formats) {
@@ -516,15 +474,17 @@ ZeroG::SwapChainExt create_swap_chain(allocator *alloc,
       }
     }
     if (format.format == VK_FORMAT_UNDEFINED)
-      format = formats.data[0];
+      format = formats[0];
     properties.format = format;
-    destroy_vk_sf_array(alloc, formats);
   }
   uint32_t mode_count = 0;
   vkGetPhysicalDeviceSurfacePresentModesKHR(
       kernel->physical_device.device, kernel->surface, &mode_count, nullptr);
   if (mode_count > 0) {
-    vk_pm_array modes = create_vk_pm_array(alloc, mode_count);
+    ZeroG::vector<VkPresentModeKHR, 8> modes(alloc, mode_count);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(kernel->physical_device.device,
+                                              kernel->surface, &mode_count,
+                                              modes.data());
     VkPresentModeKHR mode{VK_PRESENT_MODE_FIFO_KHR};
     for (const auto &m : modes) {
       if (m == prefered_present_mode) {
@@ -609,30 +569,28 @@ create_swap_chain_images(allocator *alloc, const ZeroG::Kernel *kernel,
   uint32_t count = 0;
   vkGetSwapchainImagesKHR(kernel->logical_device.device, swap_chain->swap_chain,
                           &count, nullptr);
-  vk_image_array images = create_vk_image_array(alloc, count);
+  vector<VkImage, 4> images(alloc, count);
 
   vkGetSwapchainImagesKHR(kernel->logical_device.device, swap_chain->swap_chain,
-                          &count, images.data);
+                          &count, images.data());
 
-  vk_image_view_array views = create_vk_image_view_array(alloc, count);
+  vector<VkImageView, 4> views(alloc, count);
   int32_t len = static_cast<int32_t>(count);
   for (int32_t i = 0; i < len; i++) {
-    views.data[i] = util::create_image_view(
-        kernel, images.data[i], swap_chain->properties.format.format,
-        VK_IMAGE_ASPECT_COLOR_BIT);
+    views[i] = util::create_image_view(kernel, images[i],
+                                       swap_chain->properties.format.format,
+                                       VK_IMAGE_ASPECT_COLOR_BIT);
   }
 
-  return {images, views};
+  return {std::move(images), std::move(views)};
 }
 
-void destroy_swap_chain_images(allocator *alloc, const ZeroG::Kernel *kernel,
+void destroy_swap_chain_images(allocator *, const ZeroG::Kernel *kernel,
                                const ZeroG::SwapChainImagesExt *images) {
 
   for (const auto &v : images->views) {
     util::destroy_image_view(kernel, v);
   }
-  destroy_vk_image_view_array(alloc, images->views);
-  destroy_vk_image_array(alloc, images->images);
 }
 
 VkRenderPass create_render_pass_color_depth(const Kernel *kernel,
@@ -700,20 +658,48 @@ void destroy_render_pass(const Kernel *kernel, VkRenderPass render_pass) {
   vkDestroyRenderPass(kernel->logical_device.device, render_pass, nullptr);
 }
 
+/**
+ * Packed attribute formats are optional, the device has to read every one
+ * from a vertex buffer.
+ */
+static bool vertex_formats_supported(const Kernel *kernel,
+                                     const DataLayoutCreateInfo *dlci) {
+  for (uint32_t i = 0; i < dlci->binding_count; i++) {
+    const DataBinding &binding = dlci->bindings[i];
+    for (uint32_t k = 0; k < binding.attr_count; k++) {
+      const VkFormat format =
+          static_cast<VkFormat>(binding.attributes[k].type);
+      VkFormatProperties props;
+      vkGetPhysicalDeviceFormatProperties(kernel->physical_device.device,
+                                          format, &props);
+      if (!(props.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
+        log_error("Vertex attribute format %d is not supported by the device",
+                  static_cast<int32_t>(format));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 PipelineExt create_graphics_pipeline(
     allocator *alloc, const Kernel *kernel, const SwapChainExt *swapchain,
     VkRenderPass render_pass, const PipelineCreateInfo *pipeline_layout_info) {
-  vk_pss_array pss =
-      create_vk_pss_array(alloc, pipeline_layout_info->shader_count);
+  if (!vertex_formats_supported(kernel,
+                                pipeline_layout_info->data_layout_info))
+    return {VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE};
+
+  vector<VkPipelineShaderStageCreateInfo, 4> pss(
+      alloc, pipeline_layout_info->shader_count);
   int32_t sc = static_cast<int32_t>(pipeline_layout_info->shader_count);
   for (int32_t i = 0; i < sc; i++) {
-    pss.data[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    pss.data[i].stage = static_cast<VkShaderStageFlagBits>(
+    pss[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pss[i].stage = static_cast<VkShaderStageFlagBits>(
         pipeline_layout_info->shaders[i].stage);
-    pss.data[i].module = util::create_shader_module(
+    pss[i].module = util::create_shader_module(
         kernel, pipeline_layout_info->shaders[i].code,
         pipeline_layout_info->shaders[i].length);
-    pss.data[i].pName = "main";
+    pss[i].pName = "main";
   }
 
   DataLayoutCreateInfo *dlci = pipeline_layout_info->data_layout_info;
@@ -723,24 +709,24 @@ PipelineExt create_graphics_pipeline(
     ac += dlci->bindings[i].attr_count;
   }
 
-  vk_vibd_array vibd = create_vk_vibd_array(alloc, dlci->binding_count);
-  vk_viad_array viad = create_vk_viad_array(alloc, ac);
+  vector<VkVertexInputBindingDescription, 4> vibd(alloc, dlci->binding_count);
+  vector<VkVertexInputAttributeDescription, 8> viad(alloc, ac);
 
   for (int32_t i = 0, j = 0; i < bc; ++i) {
 
     DataBinding &binding = dlci->bindings[i];
     uint32_t binding_idx = static_cast<uint32_t>(i);
 
-    vibd.data[i].binding = binding_idx;
-    vibd.data[i].inputRate = static_cast<VkVertexInputRate>(binding.rate);
-    vibd.data[i].stride = binding.stride;
+    vibd[i].binding = binding_idx;
+    vibd[i].inputRate = static_cast<VkVertexInputRate>(binding.rate);
+    vibd[i].stride = binding.stride;
 
     int32_t iac = static_cast<int32_t>(binding.attr_count);
     for (int32_t k = 0; k < iac; k++, j++) {
-      viad.data[j].binding = binding_idx;
-      viad.data[j].location = static_cast<uint32_t>(k);
-      viad.data[j].format = static_cast<VkFormat>(binding.attributes[k].type);
-      viad.data[j].offset = binding.attributes[k].offset;
+      viad[j].binding = binding_idx;
+      viad[j].location = static_cast<uint32_t>(k);
+      viad[j].format = static_cast<VkFormat>(binding.attributes[k].type);
+      viad[j].offset = binding.attributes[k].offset;
     }
   }
 
@@ -755,9 +741,9 @@ PipelineExt create_graphics_pipeline(
   vertex_input_info.sType =
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
   vertex_input_info.vertexBindingDescriptionCount = dlci->binding_count;
-  vertex_input_info.pVertexBindingDescriptions = vibd.data;
+  vertex_input_info.pVertexBindingDescriptions = vibd.data();
   vertex_input_info.vertexAttributeDescriptionCount = ac;
-  vertex_input_info.pVertexAttributeDescriptions = viad.data;
+  vertex_input_info.pVertexAttributeDescriptions = viad.data();
 
   VkPipelineInputAssemblyStateCreateInfo input_assembly{};
   input_assembly.sType =
@@ -854,8 +840,8 @@ PipelineExt create_graphics_pipeline(
 
   VkGraphicsPipelineCreateInfo pipeline_info{};
   pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipeline_info.stageCount = static_cast<uint32_t>(pss.count);
-  pipeline_info.pStages = pss.data;
+  pipeline_info.stageCount = static_cast<uint32_t>(pss.size());
+  pipeline_info.pStages = pss.data();
   pipeline_info.pVertexInputState = &vertex_input_info;
   pipeline_info.pInputAssemblyState = &input_assembly;
   pipeline_info.pViewportState = &viewport_state;
@@ -875,10 +861,6 @@ PipelineExt create_graphics_pipeline(
   vkCreateGraphicsPipelines(kernel->logical_device.device, VK_NULL_HANDLE, 1,
                             &pipeline_info, nullptr, &pipeline);
 
-  destroy_vk_viad_array(alloc, viad);
-  destroy_vk_vibd_array(alloc, vibd);
-  destroy_vk_pss_array(alloc, pss);
-
   return {pipeline, pipeline_layout, descriptor_set_layout};
 }
 
@@ -933,26 +915,25 @@ void destroy_image_view(const ZeroG::Kernel *kernel, VkImageView view) {
 VkDescriptorSetLayout
 create_descriptor_set_layout(allocator *alloc, const Kernel *kernel,
                              const DescriptorSetCreateInfo *desc_info) {
-  vk_dsl_array ds_array =
-      create_vk_dsl_array(alloc, desc_info->descriptor_count);
+  vector<VkDescriptorSetLayoutBinding, 8> ds_array(
+      alloc, desc_info->descriptor_count);
   for (uint32_t i = 0; i < desc_info->descriptor_count; i++) {
-    ds_array.data[i].binding = i;
-    ds_array.data[i].descriptorCount = 1;
-    ds_array.data[i].descriptorType =
+    ds_array[i].binding = i;
+    ds_array[i].descriptorCount = 1;
+    ds_array[i].descriptorType =
         static_cast<VkDescriptorType>(desc_info->types[i]);
-    ds_array.data[i].stageFlags =
+    ds_array[i].stageFlags =
         static_cast<VkShaderStageFlagBits>(desc_info->stages[i]);
-    ds_array.data[i].pImmutableSamplers = nullptr;
+    ds_array[i].pImmutableSamplers = nullptr;
   }
   VkDescriptorSetLayoutCreateInfo layout_info{};
   layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
   layout_info.bindingCount = desc_info->descriptor_count;
-  layout_info.pBindings = ds_array.data;
+  layout_info.pBindings = ds_array.data();
 
   VkDescriptorSetLayout layout;
   vkCreateDescriptorSetLayout(kernel->logical_device.device, &layout_info,
                               nullptr, &layout);
-  destroy_vk_dsl_array(alloc, ds_array);
   return layout;
 }
 
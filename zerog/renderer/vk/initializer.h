@@ -6,16 +6,15 @@
 
 #include "vulkan/vulkan.h"
 
+#include "memory/device_memory.h"
 #include "memory/memory.h"
 #include "renderer/types.h"
+#include "utils/containers/vector.h"
 
 typedef struct GLFWwindow *VkWindow;
 
 namespace ZeroG {
 
-ARRAY_DEFINITION(vk_image_array, VkImage);
-ARRAY_DEFINITION(vk_image_view_array, VkImageView);
-
 struct InstanceExt {
   VkInstance instance;
   VkDebugReportCallbackEXT debug;
@@ -43,6 +42,7 @@ struct Kernel {
   VkSurfaceKHR surface;
   PhysicalDeviceExt physical_device;
   LogicalDeviceExt logical_device;
+  device_memory *memory;
 };
 
 enum PresentMode { IMMEDIATE = 0, MAILBOX = 1, FIFO = 2, FIFO_RELAXED = 3 };
@@ -60,8 +60,8 @@ struct SwapChainExt {
 };
 
 struct SwapChainImagesExt {
-  vk_image_array images;
-  vk_image_view_array views;
+  vector<VkImage, 4> images;
+  vector<VkImageView, 4> views;
 };
 
 struct PipelineExt {
@@ -104,12 +104,28 @@ VkRenderPass create_render_pass_color_depth(const Kernel *kernel,
 
 void destroy_render_pass(const Kernel *kernel, VkRenderPass render_pass);
 
+/**
+ * Null handles when the device can not read one of the vertex attribute
+ * formats.
+ */
 PipelineExt create_graphics_pipeline(
     allocator *alloc, const Kernel *kernel, const SwapChainExt *swapchain,
     VkRenderPass render_pass, const PipelineCreateInfo *pipeline_layout_info);
 
 void destroy_graphics_pipeline(const Kernel *kernel, PipelineExt pipeline);
 
+device_memory *create_memory_allocator(allocator *alloc, const Kernel *kernel);
+void destroy_memory_allocator(device_memory *memory);
+
+int32_t find_memory_type(const Kernel *kernel, uint32_t type_bits,
+                         VkMemoryPropertyFlags properties);
+
+device_allocation allocate_buffer_memory(const Kernel *kernel, VkBuffer buffer,
+                                         VkMemoryPropertyFlags properties);
+device_allocation allocate_image_memory(const Kernel *kernel, VkImage image,
+                                        VkMemoryPropertyFlags properties);
+void free_memory(const Kernel *kernel, device_allocation allocation);
+
 VkCommandPool create_graphics_commad_pool(const Kernel *kernel);
 
 void destroy_graphics_command_pool(const Kernel *kernel,
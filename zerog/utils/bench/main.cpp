@@ -0,0 +1,455 @@
+
+#include "benchmark/benchmark.h"
+#include "memory/memory.h"
+#include "utils/containers/bitset.h"
+#include "utils/containers/hash_map.h"
+#include "utils/containers/mpmc_queue.h"
+#include "utils/containers/slot_map.h"
+#include "utils/containers/soa.h"
+#include "utils/containers/spsc_queue.h"
+#include "utils/containers/vector.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct vertex {
+  float position[3];
+  float normal[3];
+  float uv[2];
+};
+
+static void std_vector_push_back_int(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  while (state.KeepRunning()) {
+    std::vector<int> v;
+    for (size_t i = 0; i < count; i++)
+      v.push_back(static_cast<int>(i));
+    benchmark::DoNotOptimize(v.data());
+  }
+}
+
+static void vector_push_back_int(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_stack_allocator(Mb * 16);
+  while (state.KeepRunning()) {
+    ZeroG::vector<int> v(alloc);
+    for (size_t i = 0; i < count; i++)
+      v.push_back(static_cast<int>(i));
+    benchmark::DoNotOptimize(v.data());
+  }
+  destroy_allocator(alloc);
+}
+
+static void vector_push_back_int_bitmapped(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Kb * 64);
+  while (state.KeepRunning()) {
+    ZeroG::vector<int> v(alloc);
+    for (size_t i = 0; i < count; i++)
+      v.push_back(static_cast<int>(i));
+    benchmark::DoNotOptimize(v.data());
+  }
+  destroy_allocator(alloc);
+}
+
+static void vector_push_back_int_inline(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_stack_allocator(Mb * 16);
+  while (state.KeepRunning()) {
+    ZeroG::vector<int, 16> v(alloc);
+    for (size_t i = 0; i < count; i++)
+      v.push_back(static_cast<int>(i));
+    benchmark::DoNotOptimize(v.data());
+  }
+  destroy_allocator(alloc);
+}
+
+static void std_vector_push_back_vertex(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  while (state.KeepRunning()) {
+    std::vector<vertex> v;
+    for (size_t i = 0; i < count; i++)
+      v.push_back({{1, 2, 3}, {0, 1, 0}, {0.5f, 0.5f}});
+    benchmark::DoNotOptimize(v.data());
+  }
+}
+
+static void vector_push_back_vertex(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Kb * 64);
+  while (state.KeepRunning()) {
+    ZeroG::vector<vertex> v(alloc);
+    for (size_t i = 0; i < count; i++)
+      v.push_back({{1, 2, 3}, {0, 1, 0}, {0.5f, 0.5f}});
+    benchmark::DoNotOptimize(v.data());
+  }
+  destroy_allocator(alloc);
+}
+
+static uint32_t bench_key(size_t i) {
+  return static_cast<uint32_t>(i) * 0x9e3779b1u + 0x7f4a7c15u;
+}
+
+static void std_unordered_map_insert(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  while (state.KeepRunning()) {
+    std::unordered_map<uint32_t, uint32_t> map;
+    for (size_t i = 0; i < count; i++)
+      map[bench_key(i)] = static_cast<uint32_t>(i);
+    benchmark::DoNotOptimize(map.size());
+  }
+}
+
+static void hash_map_insert(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  while (state.KeepRunning()) {
+    ZeroG::hash_map<uint32_t, uint32_t> map(alloc);
+    for (size_t i = 0; i < count; i++)
+      map[bench_key(i)] = static_cast<uint32_t>(i);
+    benchmark::DoNotOptimize(map.size());
+  }
+  destroy_allocator(alloc);
+}
+
+static void std_unordered_map_find(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  std::unordered_map<uint32_t, uint32_t> map;
+  for (size_t i = 0; i < count; i++)
+    map[bench_key(i)] = static_cast<uint32_t>(i);
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    // Every other lookup misses.
+    auto it = map.find(bench_key(i >> 1) + (i & 1));
+    benchmark::DoNotOptimize(it);
+    i = (i + 1) % (count * 2);
+  }
+}
+
+static void hash_map_find(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    ZeroG::hash_map<uint32_t, uint32_t> map(alloc);
+    for (size_t i = 0; i < count; i++)
+      map[bench_key(i)] = static_cast<uint32_t>(i);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+      auto v = map.find(bench_key(i >> 1) + (i & 1));
+      benchmark::DoNotOptimize(v);
+      i = (i + 1) % (count * 2);
+    }
+  }
+  destroy_allocator(alloc);
+}
+
+static void std_unordered_map_find_string(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  std::vector<std::string> names;
+  for (size_t i = 0; i < count; i++)
+    names.push_back("resources/textures/asset_" + std::to_string(i));
+  std::unordered_map<std::string, uint32_t> map;
+  for (size_t i = 0; i < count; i++)
+    map[names[i]] = static_cast<uint32_t>(i);
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    auto it = map.find(names[i]);
+    benchmark::DoNotOptimize(it);
+    i = (i + 1) % count;
+  }
+}
+
+static void hash_map_find_hashed_string(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    std::vector<std::string> names;
+    std::vector<uint32_t> hashes;
+    for (size_t i = 0; i < count; i++) {
+      names.push_back("resources/textures/asset_" + std::to_string(i));
+      hashes.push_back(common::runtime_hash(names.back().c_str()));
+    }
+    ZeroG::hash_map<const char *, uint32_t, ZeroG::string_hasher,
+                    ZeroG::string_equal>
+        map(alloc);
+    for (size_t i = 0; i < count; i++)
+      map.insert(names[i].c_str(), static_cast<uint32_t>(i));
+    size_t i = 0;
+    while (state.KeepRunning()) {
+      auto v = map.find_hashed(hashes[i], names[i].c_str());
+      benchmark::DoNotOptimize(v);
+      i = (i + 1) % count;
+    }
+  }
+  destroy_allocator(alloc);
+}
+
+struct particle {
+  float position[3];
+  float velocity[3];
+  float color[4];
+  float age;
+  float size;
+  uint32_t flags;
+  uint32_t material;
+};
+
+static void slot_map_find(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Mb * 8);
+  {
+    ZeroG::slot_map<uint32_t> map(alloc);
+    std::vector<ZeroG::slot_handle> handles;
+    for (size_t i = 0; i < count; i++)
+      handles.push_back(map.insert(static_cast<uint32_t>(i)));
+    size_t i = 0;
+    while (state.KeepRunning()) {
+      benchmark::DoNotOptimize(map.find(handles[i]));
+      i = (i + 7919) % count;
+    }
+  }
+  destroy_allocator(alloc);
+}
+
+static void slot_map_iterate(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Mb * 8);
+  {
+    ZeroG::slot_map<uint32_t> map(alloc);
+    std::vector<ZeroG::slot_handle> handles;
+    for (size_t i = 0; i < count; i++)
+      handles.push_back(map.insert(static_cast<uint32_t>(i)));
+    for (size_t i = 0; i < count; i += 2)
+      map.erase(handles[i]);
+    while (state.KeepRunning()) {
+      uint32_t sum = 0;
+      for (uint32_t v : map)
+        sum += v;
+      benchmark::DoNotOptimize(sum);
+    }
+  }
+  destroy_allocator(alloc);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(count / 2 * sizeof(uint32_t)));
+}
+
+static void bitset_count(benchmark::State &state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    ZeroG::bitset bits(alloc, size);
+    for (size_t i = 0; i < size; i += 3)
+      bits.set(i);
+    while (state.KeepRunning())
+      benchmark::DoNotOptimize(bits.count());
+  }
+  destroy_allocator(alloc);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(size / 8));
+}
+
+static void bitset_find_unset_run(benchmark::State &state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    ZeroG::bitset bits(alloc, size);
+    // Holes of 7 bits, a request for 8 has to scan the whole set.
+    for (size_t i = 0; i < size; i += 8)
+      bits.set(i);
+    while (state.KeepRunning())
+      benchmark::DoNotOptimize(bits.find_unset_run(8));
+  }
+  destroy_allocator(alloc);
+}
+
+static void aos_integrate(benchmark::State &state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  std::vector<particle> particles(count, particle{});
+  for (size_t i = 0; i < count; i++)
+    particles[i].velocity[1] = static_cast<float>(i);
+  while (state.KeepRunning()) {
+    for (particle &p : particles) {
+      p.position[0] += p.velocity[0] * 0.016f;
+      p.position[1] += p.velocity[1] * 0.016f;
+      p.position[2] += p.velocity[2] * 0.016f;
+    }
+    benchmark::DoNotOptimize(particles.data());
+  }
+}
+
+static void soa_integrate(benchmark::State &state) {
+  typedef ZeroG::soa<float, float, float, float, float, float, float, float,
+                     uint32_t>
+      particles_soa;
+  const size_t count = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_stack_allocator(Mb * 16);
+  {
+    particles_soa particles(alloc, count);
+    for (size_t i = 0; i < count; i++)
+      particles.add(0, 0, 0, 0, static_cast<float>(i), 0, 0, 1, 0);
+    while (state.KeepRunning()) {
+      particles.for_each_chunk([](const particles_soa::view &c) {
+        for (size_t i = 0; i < particles_soa::chunk_size; i++) {
+          c.stream<0>()[i] += c.stream<3>()[i] * 0.016f;
+          c.stream<1>()[i] += c.stream<4>()[i] * 0.016f;
+          c.stream<2>()[i] += c.stream<5>()[i] * 0.016f;
+        }
+      });
+      benchmark::DoNotOptimize(particles.stream<0>());
+    }
+  }
+  destroy_allocator(alloc);
+}
+
+static constexpr uint64_t queue_items{1 << 20};
+
+// Failed attempts give up the core, the benches may have more threads than
+// there are cores.
+static void backoff() { std::this_thread::yield(); }
+
+static void spsc_queue_throughput(benchmark::State &state) {
+  const size_t batch = static_cast<size_t>(state.range(0));
+  allocator *alloc = create_stack_allocator(Mb);
+  {
+    ZeroG::spsc_queue<uint64_t> q(alloc, 4096);
+    while (state.KeepRunning()) {
+      std::thread producer([&] {
+        std::vector<uint64_t> values(batch);
+        for (uint64_t i = 0; i < queue_items;) {
+          const size_t n = queue_items - i < batch ? queue_items - i : batch;
+          const size_t pushed = q.push_batch(values.data(), n);
+          if (!pushed)
+            backoff();
+          i += pushed;
+        }
+      });
+      std::vector<uint64_t> values(batch);
+      for (uint64_t i = 0; i < queue_items;) {
+        const size_t popped = q.pop_batch(values.data(), batch);
+        if (!popped)
+          backoff();
+        i += popped;
+      }
+      producer.join();
+    }
+  }
+  destroy_allocator(alloc);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(queue_items));
+}
+
+static void mpmc_queue_throughput(benchmark::State &state) {
+  const uint32_t producers = static_cast<uint32_t>(state.range(0));
+  const uint32_t consumers = static_cast<uint32_t>(state.range(1));
+  allocator *alloc = create_stack_allocator(Mb);
+  {
+    ZeroG::mpmc_queue<uint64_t> q(alloc, 4096);
+    while (state.KeepRunning()) {
+      std::atomic<uint64_t> popped{0};
+      std::vector<std::thread> threads;
+      for (uint32_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+          const uint64_t begin = queue_items * p / producers;
+          const uint64_t end = queue_items * (p + 1) / producers;
+          for (uint64_t i = begin; i < end;) {
+            if (q.push(i))
+              i++;
+            else
+              backoff();
+          }
+        });
+      }
+      for (uint32_t c = 0; c < consumers; c++) {
+        threads.emplace_back([&] {
+          uint64_t value;
+          while (popped.load(std::memory_order_relaxed) < queue_items) {
+            if (q.pop(&value))
+              popped.fetch_add(1, std::memory_order_relaxed);
+            else
+              backoff();
+          }
+        });
+      }
+      for (std::thread &t : threads)
+        t.join();
+    }
+  }
+  destroy_allocator(alloc);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(queue_items));
+}
+
+/**
+ * Round trip of one value through a pair of queues, reported per trip.
+ */
+template <typename __Q> static void queue_ping_pong(benchmark::State &state) {
+  const uint64_t trips = 1 << 14;
+  allocator *alloc = create_stack_allocator(Mb);
+  {
+    __Q ping(alloc, 16);
+    __Q pong(alloc, 16);
+    while (state.KeepRunning()) {
+      std::thread echo([&] {
+        uint64_t value;
+        for (uint64_t i = 0; i < trips; i++) {
+          while (!ping.pop(&value)) {
+            backoff();
+          }
+          while (!pong.push(value)) {
+            backoff();
+          }
+        }
+      });
+      uint64_t value;
+      for (uint64_t i = 0; i < trips; i++) {
+        while (!ping.push(i)) {
+          backoff();
+        }
+        while (!pong.pop(&value)) {
+          backoff();
+        }
+      }
+      echo.join();
+    }
+  }
+  destroy_allocator(alloc);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trips));
+}
+
+BENCHMARK(std_vector_push_back_int)->Arg(8)->Arg(256)->Arg(16384);
+BENCHMARK(vector_push_back_int)->Arg(8)->Arg(256)->Arg(16384);
+BENCHMARK(vector_push_back_int_bitmapped)->Arg(8)->Arg(256)->Arg(16384);
+BENCHMARK(vector_push_back_int_inline)->Arg(8)->Arg(256)->Arg(16384);
+BENCHMARK(std_vector_push_back_vertex)->Arg(8)->Arg(256)->Arg(16384);
+BENCHMARK(vector_push_back_vertex)->Arg(8)->Arg(256)->Arg(16384);
+BENCHMARK(std_unordered_map_insert)->Arg(64)->Arg(4096)->Arg(262144);
+BENCHMARK(hash_map_insert)->Arg(64)->Arg(4096)->Arg(262144);
+BENCHMARK(std_unordered_map_find)->Arg(64)->Arg(4096)->Arg(262144);
+BENCHMARK(hash_map_find)->Arg(64)->Arg(4096)->Arg(262144);
+BENCHMARK(std_unordered_map_find_string)->Arg(64)->Arg(4096);
+BENCHMARK(hash_map_find_hashed_string)->Arg(64)->Arg(4096);
+
+BENCHMARK(slot_map_find)->Arg(64)->Arg(4096)->Arg(262144);
+BENCHMARK(slot_map_iterate)->Arg(4096)->Arg(262144);
+BENCHMARK(bitset_count)->Arg(1024)->Arg(1 << 20);
+BENCHMARK(bitset_find_unset_run)->Arg(1024)->Arg(1 << 20);
+BENCHMARK(aos_integrate)->Arg(1024)->Arg(65536);
+BENCHMARK(soa_integrate)->Arg(1024)->Arg(65536);
+BENCHMARK(spsc_queue_throughput)->Arg(1)->Arg(64)->UseRealTime();
+BENCHMARK(mpmc_queue_throughput)
+    ->Args({1, 1})
+    ->Args({2, 2})
+    ->Args({4, 1})
+    ->Args({1, 4})
+    ->Args({4, 4})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(queue_ping_pong, ZeroG::spsc_queue<uint64_t>)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(queue_ping_pong, ZeroG::mpmc_queue<uint64_t>)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,93 @@
+#ifndef CONTAINERS_BITSET_H
+#define CONTAINERS_BITSET_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "common/bitset.h"
+#include "memory/memory.h"
+#include "utils/containers/vector.h"
+
+namespace ZeroG {
+
+/**
+ * Resizable bit array on an allocator, a thin owner around the word
+ * functions of common/bitset.h. Bits above size() in the last word are
+ * kept unset so growing never exposes stale bits.
+ */
+struct bitset {
+  bitset() : bitset(nullptr) {}
+  explicit bitset(allocator *alloc) : words_{alloc}, size_{0} {}
+  bitset(allocator *alloc, size_t size) : bitset(alloc) { resize(size); }
+
+  bitset(bitset &&other) = default;
+  bitset &operator=(bitset &&other) = default;
+
+  size_t size() const { return size_; }
+  uint64_t *words() { return words_.data(); }
+  const uint64_t *words() const { return words_.data(); }
+  size_t word_count() const { return words_.size(); }
+
+  /**
+   * New bits start unset.
+   */
+  void resize(size_t size) {
+    words_.resize(bit_words(size));
+    size_ = size;
+    if (size & 63)
+      words_.back() &= (1ul << (size & 63)) - 1ul;
+  }
+
+  void set(size_t i) {
+    assert(i < size_ && "Bit index out of range");
+    words_[i / 64] |= 1ul << (i & 63);
+  }
+  void unset(size_t i) {
+    assert(i < size_ && "Bit index out of range");
+    words_[i / 64] &= ~(1ul << (i & 63));
+  }
+  bool test(size_t i) const {
+    assert(i < size_ && "Bit index out of range");
+    return (words_[i / 64] >> (i & 63)) & 1ul;
+  }
+
+  void set(size_t first, size_t count) {
+    assert(first + count <= size_ && "Bit range out of range");
+    set_bits(words_.data(), first, count);
+  }
+  void unset(size_t first, size_t count) {
+    assert(first + count <= size_ && "Bit range out of range");
+    unset_bits(words_.data(), first, count);
+  }
+  void set_all() { set(0, size_); }
+  void unset_all() { unset(0, size_); }
+
+  size_t count() const { return count_bits(words_.data(), size_); }
+  size_t rank(size_t pos) const {
+    assert(pos <= size_ && "Bit index out of range");
+    return rank_bits(words_.data(), pos);
+  }
+  size_t select(size_t n) const { return select_bit(words_.data(), size_, n); }
+
+  size_t find_first_set() const {
+    return find_set_bit(words_.data(), size_, 0);
+  }
+  size_t find_next_set(size_t pos) const {
+    return find_set_bit(words_.data(), size_, pos + 1);
+  }
+  size_t find_first_unset() const {
+    return find_unset_bit(words_.data(), size_, 0);
+  }
+  size_t find_unset_run(size_t len) const {
+    return find_unset_bits(words_.data(), size_, len);
+  }
+
+private:
+  vector<uint64_t> words_;
+  size_t size_;
+};
+
+} // namespace ZeroG
+
+#endif // CONTAINERS_BITSET_H
@@ -0,0 +1,432 @@
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common/hash.h"
+#include "memory/memory.h"
+
+namespace ZeroG {
+
+/**
+ * Hashers produce the 32 bit hash the map probes with. Ids made with the
+ * _h literal or common::hash already are crc32 hashes, so uint32_t keys
+ * are used as is.
+ */
+template <typename __K> struct hasher;
+
+template <> struct hasher<uint32_t> {
+  uint32_t operator()(uint32_t key) const { return key; }
+};
+
+template <> struct hasher<uint64_t> {
+  uint32_t operator()(uint64_t key) const {
+    return static_cast<uint32_t>(key ^ (key >> 32));
+  }
+};
+
+template <typename __P> struct hasher<__P *> {
+  uint32_t operator()(const __P *key) const {
+    const uintptr_t v = reinterpret_cast<uintptr_t>(key);
+    return static_cast<uint32_t>(v ^ (v >> 32)) >> 4;
+  }
+};
+
+/**
+ * C strings hash by contents, the map stores the pointer only.
+ */
+struct string_hasher {
+  uint32_t operator()(const char *key) const {
+    return common::runtime_hash(key);
+  }
+};
+
+template <typename __K> struct key_equal {
+  template <typename __Q> bool operator()(const __K &a, const __Q &b) const {
+    return a == b;
+  }
+};
+
+struct string_equal {
+  bool operator()(const char *a, const char *b) const {
+    return a == b || strcmp(a, b) == 0;
+  }
+};
+
+namespace internal {
+constexpr int8_t ctrl_empty{-128};
+constexpr int8_t ctrl_deleted{-2};
+constexpr size_t group_width{16};
+
+/**
+ * One bit per control byte of a 16 byte group.
+ */
+struct group {
+  const int8_t *ctrl;
+
+  uint32_t match(int8_t h2) const {
+#if defined(__SSE2__)
+    const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(h2))));
+#else
+    uint32_t res = 0;
+    for (uint32_t i = 0; i < group_width; i++)
+      res |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+    return res;
+#endif
+  }
+
+  uint32_t match_empty() const { return match(ctrl_empty); }
+
+  uint32_t match_empty_or_deleted() const {
+#if defined(__SSE2__)
+    // Empty and deleted are the only negative values below -1.
+    const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmplt_epi8(g, _mm_set1_epi8(-1))));
+#else
+    uint32_t res = 0;
+    for (uint32_t i = 0; i < group_width; i++)
+      res |= static_cast<uint32_t>(ctrl[i] < -1) << i;
+    return res;
+#endif
+  }
+};
+} // namespace internal
+
+/**
+ * Open addressing map in the style of a swiss table. Control bytes are kept
+ * apart from the slots: a byte holds 7 bits of the hash for a full slot, so
+ * a probe compares 16 candidates with one SSE2 instruction and touches the
+ * slots only on a likely match. Control bytes and slots share one block
+ * from the allocator.
+ *
+ * The *_hashed() calls take a hash computed ahead of time (an _h literal,
+ * a cached pipeline state hash) and skip the hasher. It has to be the
+ * value __H gives for the key: the map keeps no hashes and rehashes keys
+ * with __H when it grows, emplace_hashed and erase_hashed assert so.
+ */
+template <typename __K, typename __V, typename __H = hasher<__K>,
+          typename __E = key_equal<__K>>
+struct hash_map {
+  struct slot {
+    __K key;
+    __V value;
+  };
+
+  struct iterator {
+    hash_map *map;
+    size_t index;
+
+    slot &operator*() const { return map->slots_[index]; }
+    slot *operator->() const { return &map->slots_[index]; }
+    iterator &operator++() {
+      index = map->next_full(index + 1);
+      return *this;
+    }
+    bool operator!=(const iterator &other) const {
+      return index != other.index;
+    }
+  };
+
+  hash_map() : hash_map(nullptr) {}
+  explicit hash_map(allocator *alloc)
+      : alloc_{alloc}, ctrl_{empty_group()}, slots_{nullptr}, capacity_{0},
+        size_{0}, growth_left_{0}, block_{nullptr, 0} {}
+
+  hash_map(const hash_map &) = delete;
+  hash_map &operator=(const hash_map &) = delete;
+
+  hash_map(hash_map &&other) : hash_map(other.alloc_) { take(other); }
+  hash_map &operator=(hash_map &&other) {
+    if (this != &other) {
+      release();
+      alloc_ = other.alloc_;
+      take(other);
+    }
+    return *this;
+  }
+
+  ~hash_map() { release(); }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+
+  iterator begin() { return {this, next_full(0)}; }
+  iterator end() { return {this, capacity_}; }
+
+  template <typename __Q> __V *find_hashed(uint32_t hash, const __Q &key) {
+    const size_t idx = find_index(hash, key);
+    return idx < capacity_ ? &slots_[idx].value : nullptr;
+  }
+
+  __V *find(const __K &key) { return find_hashed(__H()(key), key); }
+
+  bool contains(const __K &key) { return find(key) != nullptr; }
+
+  /**
+   * Returns the value for key and whether it was inserted, an existing
+   * value is left untouched.
+   */
+  template <typename... Args>
+  std::pair<__V *, bool> emplace_hashed(uint32_t hash, const __K &key,
+                                        Args &&... args) {
+    assert(hash == __H()(key) && "Hash differs from the map's hasher");
+    const size_t found = find_index(hash, key);
+    if (found < capacity_)
+      return {&slots_[found].value, false};
+
+    if (capacity_) {
+      const size_t idx = find_insert_slot(hash);
+      if (growth_left_ || ctrl_[idx] == internal::ctrl_deleted) {
+        return place(idx, hash, key, std::forward<Args>(args)...);
+      }
+    }
+
+    // Arguments may point into the slots that are about to move.
+    __K key_copy(key);
+    __V value(std::forward<Args>(args)...);
+    if (!capacity_)
+      resize(internal::group_width);
+    else
+      rehash_for_insert();
+    return place(find_insert_slot(hash), hash, std::move(key_copy),
+                 std::move(value));
+  }
+
+  template <typename... Args>
+  std::pair<__V *, bool> emplace(const __K &key, Args &&... args) {
+    return emplace_hashed(__H()(key), key, std::forward<Args>(args)...);
+  }
+
+  std::pair<__V *, bool> insert(const __K &key, const __V &value) {
+    return emplace(key, value);
+  }
+
+  __V &operator[](const __K &key) { return *emplace(key).first; }
+
+  bool erase_hashed(uint32_t hash, const __K &key) {
+    assert(hash == __H()(key) && "Hash differs from the map's hasher");
+    const size_t idx = find_index(hash, key);
+    if (idx >= capacity_)
+      return false;
+    destroy_slot(idx);
+    set_ctrl(idx, internal::ctrl_deleted);
+    size_--;
+    return true;
+  }
+
+  bool erase(const __K &key) { return erase_hashed(__H()(key), key); }
+
+  void reserve(size_t count) {
+    size_t capacity = internal::group_width;
+    while (max_load(capacity) < count)
+      capacity *= 2;
+    if (capacity > capacity_)
+      resize(capacity);
+  }
+
+  void clear() {
+    for (size_t i = 0; i < capacity_; i++) {
+      if (ctrl_[i] >= 0)
+        destroy_slot(i);
+    }
+    if (capacity_) {
+      memset(ctrl_, internal::ctrl_empty, capacity_ + internal::group_width);
+      growth_left_ = max_load(capacity_);
+    }
+    size_ = 0;
+  }
+
+private:
+  static int8_t *empty_group() {
+    alignas(16) static int8_t group[internal::group_width]{
+        internal::ctrl_empty, internal::ctrl_empty, internal::ctrl_empty,
+        internal::ctrl_empty, internal::ctrl_empty, internal::ctrl_empty,
+        internal::ctrl_empty, internal::ctrl_empty, internal::ctrl_empty,
+        internal::ctrl_empty, internal::ctrl_empty, internal::ctrl_empty,
+        internal::ctrl_empty, internal::ctrl_empty, internal::ctrl_empty,
+        internal::ctrl_empty};
+    return group;
+  }
+
+  static size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+
+  // The multiply moves entropy to the high bits, probing uses bits 7 and up
+  // and the control byte the top 7.
+  static uint32_t mix(uint32_t hash) { return hash * 0x9e3779b1u; }
+  static size_t h1(uint32_t hash) { return mix(hash) >> 7; }
+  static int8_t h2(uint32_t hash) {
+    return static_cast<int8_t>(mix(hash) >> 25);
+  }
+
+  template <typename __Q>
+  size_t find_index(uint32_t hash, const __Q &key) const {
+    if (!capacity_)
+      return capacity_;
+    const size_t mask = capacity_ - 1;
+    const int8_t tag = h2(hash);
+    size_t pos = h1(hash) & mask;
+    for (size_t probe = internal::group_width;;
+         probe += internal::group_width) {
+      internal::group g{ctrl_ + pos};
+      for (uint32_t m = g.match(tag); m; m &= m - 1) {
+        const size_t idx = (pos + static_cast<size_t>(__builtin_ctz(m))) & mask;
+        if (__E()(slots_[idx].key, key))
+          return idx;
+      }
+      if (g.match_empty())
+        return capacity_;
+      pos = (pos + probe) & mask;
+    }
+  }
+
+  size_t find_insert_slot(uint32_t hash) const {
+    const size_t mask = capacity_ - 1;
+    size_t pos = h1(hash) & mask;
+    for (size_t probe = internal::group_width;;
+         probe += internal::group_width) {
+      internal::group g{ctrl_ + pos};
+      const uint32_t m = g.match_empty_or_deleted();
+      if (m)
+        return (pos + static_cast<size_t>(__builtin_ctz(m))) & mask;
+      pos = (pos + probe) & mask;
+    }
+  }
+
+  // The first group is mirrored past the end so an unaligned group load
+  // near the end wraps around without a branch.
+  void set_ctrl(size_t idx, int8_t value) {
+    ctrl_[idx] = value;
+    if (idx < internal::group_width)
+      ctrl_[capacity_ + idx] = value;
+  }
+
+  size_t next_full(size_t idx) const {
+    while (idx < capacity_ && ctrl_[idx] < 0)
+      idx++;
+    return idx;
+  }
+
+  template <typename __Q, typename... Args>
+  std::pair<__V *, bool> place(size_t idx, uint32_t hash, __Q &&key,
+                               Args &&... args) {
+    if (ctrl_[idx] == internal::ctrl_empty)
+      growth_left_--;
+    set_ctrl(idx, h2(hash));
+    new (&slots_[idx].key) __K(std::forward<__Q>(key));
+    new (&slots_[idx].value) __V(std::forward<Args>(args)...);
+    size_++;
+    return {&slots_[idx].value, true};
+  }
+
+  void destroy_slot(size_t idx) {
+    slots_[idx].key.~__K();
+    slots_[idx].value.~__V();
+  }
+
+  static size_t slots_offset(size_t capacity) {
+    return align_block(alignof(slot) > 16 ? alignof(slot) : 16,
+                       capacity + internal::group_width);
+  }
+
+  void rehash_for_insert() {
+    // Mostly tombstones: clean them up in a table of the same size.
+    if (capacity_ && size_ < max_load(capacity_) / 2)
+      resize(capacity_);
+    else
+      resize(capacity_ ? capacity_ * 2 : internal::group_width);
+  }
+
+  void resize(size_t capacity) {
+    assert(alloc_ && "Hash map has no allocator to grow with");
+    static_assert(alignof(slot) <= 16, "Allocators only align to 16 bytes");
+
+    blk b = allocate(alloc_, slots_offset(capacity) + capacity * sizeof(slot));
+    assert(b.ptr && "Failed to allocated data");
+
+    int8_t *old_ctrl = ctrl_;
+    slot *old_slots = slots_;
+    const size_t old_capacity = capacity_;
+    const blk old_block = block_;
+
+    block_ = b;
+    ctrl_ = static_cast<int8_t *>(b.ptr);
+    slots_ = reinterpret_cast<slot *>(static_cast<uint8_t *>(b.ptr) +
+                                      slots_offset(capacity));
+    capacity_ = capacity;
+    growth_left_ = max_load(capacity) - size_;
+    memset(ctrl_, internal::ctrl_empty, capacity + internal::group_width);
+
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old_ctrl[i] < 0)
+        continue;
+      slot &from = old_slots[i];
+      const uint32_t hash = __H()(from.key);
+      const size_t idx = find_insert_slot(hash);
+      set_ctrl(idx, h2(hash));
+      if (std::is_trivially_copyable<slot>::value) {
+        memcpy(static_cast<void *>(&slots_[idx]),
+               static_cast<const void *>(&from), sizeof(slot));
+      } else {
+        new (&slots_[idx].key) __K(std::move(from.key));
+        new (&slots_[idx].value) __V(std::move(from.value));
+        from.key.~__K();
+        from.value.~__V();
+      }
+    }
+
+    if (old_block.ptr)
+      deallocate(alloc_, old_block);
+  }
+
+  void release() {
+    clear();
+    if (block_.ptr)
+      deallocate(alloc_, block_);
+    ctrl_ = empty_group();
+    slots_ = nullptr;
+    capacity_ = 0;
+    growth_left_ = 0;
+    block_ = {nullptr, 0};
+  }
+
+  void take(hash_map &other) {
+    ctrl_ = other.ctrl_;
+    slots_ = other.slots_;
+    capacity_ = other.capacity_;
+    size_ = other.size_;
+    growth_left_ = other.growth_left_;
+    block_ = other.block_;
+    other.ctrl_ = empty_group();
+    other.slots_ = nullptr;
+    other.capacity_ = 0;
+    other.size_ = 0;
+    other.growth_left_ = 0;
+    other.block_ = {nullptr, 0};
+  }
+
+  allocator *alloc_;
+  int8_t *ctrl_;
+  slot *slots_;
+  size_t capacity_;
+  size_t size_;
+  size_t growth_left_;
+  blk block_;
+};
+
+} // namespace ZeroG
+
+#endif // HASH_MAP_H
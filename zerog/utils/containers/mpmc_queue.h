@@ -0,0 +1,145 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "memory/memory.h"
+#include "utils/containers/spsc_queue.h"
+
+namespace ZeroG {
+
+/**
+ * Bounded multi producer multi consumer queue after Dmitry Vyukov. Every
+ * cell carries a sequence number that says whose turn it is: a producer
+ * may fill cell i when its sequence is i, a consumer may drain it when it
+ * is i + 1. Claiming a cell is one CAS on the shared position, there are
+ * no locks and no allocation after construction. Capacity is rounded up
+ * to a power of two.
+ */
+template <typename __T> struct mpmc_queue {
+  mpmc_queue(allocator *alloc, size_t capacity)
+      : alloc_{alloc}, mask_{internal::queue_capacity(capacity) - 1},
+        enqueue_pos_{0}, dequeue_pos_{0} {
+    static_assert(alignof(__T) <= 16, "Allocators only align to 16 bytes");
+    block_ = allocate(alloc_, (mask_ + 1) * sizeof(cell));
+    assert(block_.ptr && "Failed to allocated data");
+    cells_ = static_cast<cell *>(block_.ptr);
+    for (size_t i = 0; i <= mask_; i++)
+      new (&cells_[i].sequence) std::atomic<size_t>(i);
+  }
+
+  mpmc_queue(const mpmc_queue &) = delete;
+  mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+  ~mpmc_queue() {
+    for (size_t pos = dequeue_pos_.load(std::memory_order_relaxed);; pos++) {
+      cell &c = cells_[pos & mask_];
+      if (c.sequence.load(std::memory_order_acquire) != pos + 1)
+        break;
+      c.value()->~__T();
+    }
+    deallocate(alloc_, block_);
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  template <typename... Args> bool emplace(Args &&... args) {
+    cell *c = claim_push();
+    if (!c)
+      return false;
+    const size_t pos = c->sequence.load(std::memory_order_relaxed);
+    new (c->value()) __T(std::forward<Args>(args)...);
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool push(const __T &value) { return emplace(value); }
+  bool push(__T &&value) { return emplace(std::move(value)); }
+
+  bool pop(__T *value) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell *c = &cells_[pos & mask_];
+      const size_t seq = c->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          __T *slot = c->value();
+          *value = std::move(*slot);
+          slot->~__T();
+          c->sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * Batches are a run of single pushes that stops at the first full cell.
+   * Values of one batch stay in order but may interleave with other
+   * producers. Returns how many were pushed.
+   */
+  size_t push_batch(const __T *values, size_t count) {
+    size_t n = 0;
+    while (n < count && push(values[n]))
+      n++;
+    return n;
+  }
+
+  size_t pop_batch(__T *values, size_t count) {
+    size_t n = 0;
+    while (n < count && pop(values + n))
+      n++;
+    return n;
+  }
+
+private:
+  struct cell {
+    std::atomic<size_t> sequence;
+    alignas(__T) uint8_t storage[sizeof(__T)];
+
+    __T *value() { return reinterpret_cast<__T *>(storage); }
+  };
+
+  cell *claim_push() {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell *c = &cells_[pos & mask_];
+      const size_t seq = c->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          return c;
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  allocator *alloc_;
+  blk block_;
+  cell *cells_;
+  size_t mask_;
+
+  alignas(internal::cache_line) std::atomic<size_t> enqueue_pos_;
+  alignas(internal::cache_line) std::atomic<size_t> dequeue_pos_;
+};
+
+} // namespace ZeroG
+
+#endif // MPMC_QUEUE_H
@@ -0,0 +1,155 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "memory/memory.h"
+#include "utils/containers/vector.h"
+
+namespace ZeroG {
+
+/**
+ * Stable reference into a slot_map. The generation changes every time the
+ * slot is released, so a handle to an erased value never finds the value
+ * that reuses its slot. Generation 0 is never handed out, a zeroed handle
+ * is always invalid.
+ */
+struct slot_handle {
+  uint32_t index;
+  uint32_t generation;
+};
+
+inline bool operator==(slot_handle a, slot_handle b) {
+  return a.index == b.index && a.generation == b.generation;
+}
+
+inline bool operator!=(slot_handle a, slot_handle b) { return !(a == b); }
+
+/**
+ * Sparse set of values addressed by handles. Slots map a handle to the
+ * position of its value in a packed array, values are kept dense so
+ * iteration is a linear walk. Erase moves the last value into the hole,
+ * insert reuses the most recently freed slot. Every operation is O(1).
+ *
+ * Slots, values and the value to slot back references are vectors on the
+ * same allocator; a pool or bitmapped allocator suits the repeated growth
+ * and release.
+ */
+template <typename __T> struct slot_map {
+  typedef __T *iterator;
+  typedef const __T *const_iterator;
+
+  slot_map() : slot_map(nullptr) {}
+  explicit slot_map(allocator *alloc)
+      : slots_{alloc}, values_{alloc}, owners_{alloc}, free_{no_slot} {}
+
+  iterator begin() { return values_.begin(); }
+  const_iterator begin() const { return values_.begin(); }
+  iterator end() { return values_.end(); }
+  const_iterator end() const { return values_.end(); }
+
+  __T *data() { return values_.data(); }
+  const __T *data() const { return values_.data(); }
+  size_t size() const { return values_.size(); }
+  bool empty() const { return values_.empty(); }
+
+  void reserve(size_t count) {
+    slots_.reserve(count);
+    values_.reserve(count);
+    owners_.reserve(count);
+  }
+
+  template <typename... Args> slot_handle emplace(Args &&... args) {
+    uint32_t index = free_;
+    if (index == no_slot) {
+      index = static_cast<uint32_t>(slots_.size());
+      slots_.push_back(slot{0, 1});
+    } else {
+      free_ = slots_[index].dense;
+    }
+
+    slot &s = slots_[index];
+    s.dense = static_cast<uint32_t>(values_.size());
+    values_.emplace_back(std::forward<Args>(args)...);
+    owners_.push_back(index);
+    return {index, s.generation};
+  }
+
+  slot_handle insert(const __T &value) { return emplace(value); }
+  slot_handle insert(__T &&value) { return emplace(std::move(value)); }
+
+  bool contains(slot_handle h) const {
+    return h.index < slots_.size() &&
+           slots_[h.index].generation == h.generation;
+  }
+
+  __T *find(slot_handle h) {
+    return contains(h) ? &values_[slots_[h.index].dense] : nullptr;
+  }
+  const __T *find(slot_handle h) const {
+    return contains(h) ? &values_[slots_[h.index].dense] : nullptr;
+  }
+
+  /**
+   * Handle of the value at a position of the dense array, used while
+   * iterating.
+   */
+  slot_handle handle_at(size_t dense) const {
+    const uint32_t index = owners_[dense];
+    return {index, slots_[index].generation};
+  }
+
+  bool erase(slot_handle h) {
+    if (!contains(h))
+      return false;
+
+    slot &s = slots_[h.index];
+    const uint32_t last = static_cast<uint32_t>(values_.size() - 1);
+    if (s.dense != last) {
+      values_[s.dense] = std::move(values_.back());
+      owners_[s.dense] = owners_[last];
+      slots_[owners_[last]].dense = s.dense;
+    }
+    values_.pop_back();
+    owners_.pop_back();
+
+    s.generation = s.generation + 1 ? s.generation + 1 : 1;
+    s.dense = free_;
+    free_ = h.index;
+    return true;
+  }
+
+  /**
+   * Drops every value. Outstanding handles all become stale.
+   */
+  void clear() {
+    while (!values_.empty())
+      erase(handle_at(values_.size() - 1));
+  }
+
+private:
+  static constexpr uint32_t no_slot{~0u};
+
+  /**
+   * dense is the value position while the slot is live and the next free
+   * slot while it is not.
+   */
+  struct slot {
+    uint32_t dense;
+    uint32_t generation;
+  };
+
+  vector<slot> slots_;
+  vector<__T> values_;
+  vector<uint32_t> owners_;
+  uint32_t free_;
+};
+
+template <typename __T> constexpr uint32_t slot_map<__T>::no_slot;
+
+} // namespace ZeroG
+
+#endif // SLOT_MAP_H
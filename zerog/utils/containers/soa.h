@@ -0,0 +1,254 @@
+#ifndef SOA_H
+#define SOA_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+#include "memory/memory.h"
+
+namespace ZeroG {
+
+namespace internal {
+template <typename... __Ts> struct all_trivially_copyable;
+
+template <> struct all_trivially_copyable<> : std::true_type {};
+
+template <typename __T, typename... __Ts>
+struct all_trivially_copyable<__T, __Ts...>
+    : std::integral_constant<bool,
+                             std::is_trivially_copyable<__T>::value &&
+                                 all_trivially_copyable<__Ts...>::value> {};
+} // namespace internal
+
+/**
+ * Non owning window over the streams of a soa container. Streams hold
+ * size() valid elements and are readable and writable up to padded_size(),
+ * the padding holds unspecified values.
+ */
+template <typename... __Ts> struct soa_view {
+  static constexpr size_t field_count{sizeof...(__Ts)};
+  template <size_t I>
+  using field_type = typename std::tuple_element<I, std::tuple<__Ts...>>::type;
+
+  template <size_t I> field_type<I> *stream() const {
+    return static_cast<field_type<I> *>(streams[I]);
+  }
+  template <size_t I> field_type<I> &get(size_t i) const {
+    assert(i < count && "Soa index out of range");
+    return stream<I>()[i];
+  }
+
+  size_t size() const { return count; }
+  size_t padded_size() const { return padded; }
+
+  void *streams[sizeof...(__Ts)];
+  size_t count;
+  size_t padded;
+};
+
+/**
+ * Structure of arrays: every field type gets its own stream so bulk passes
+ * over one field read only that field. All streams share one allocation,
+ * each stream starts on a cache line and capacity is kept a multiple of
+ * chunk_size, so chunk_size elements can always be loaded from the start
+ * of a chunk without running off the end of a stream.
+ *
+ * Removal moves the last element into the hole, indices are not stable.
+ * Fields are relocated with memcpy and must be trivially copyable.
+ */
+template <typename... __Ts> struct soa {
+  static_assert(sizeof...(__Ts) > 0, "Soa needs at least one field");
+  static_assert(internal::all_trivially_copyable<__Ts...>::value,
+                "Soa fields must be trivially copyable");
+
+  typedef soa_view<__Ts...> view;
+  static constexpr size_t field_count{sizeof...(__Ts)};
+  static constexpr size_t stream_alignment{64};
+  static constexpr size_t chunk_size{16};
+  template <size_t I>
+  using field_type = typename std::tuple_element<I, std::tuple<__Ts...>>::type;
+
+  soa() : soa(nullptr) {}
+  explicit soa(allocator *alloc)
+      : alloc_{alloc}, count_{0}, capacity_{0}, block_{nullptr, 0} {
+    for (size_t f = 0; f < field_count; f++)
+      streams_[f] = nullptr;
+  }
+  soa(allocator *alloc, size_t capacity) : soa(alloc) { reserve(capacity); }
+
+  soa(const soa &) = delete;
+  soa &operator=(const soa &) = delete;
+
+  soa(soa &&other) : soa(other.alloc_) { take(other); }
+  soa &operator=(soa &&other) {
+    if (this != &other) {
+      release();
+      alloc_ = other.alloc_;
+      take(other);
+    }
+    return *this;
+  }
+
+  ~soa() { release(); }
+
+  size_t size() const { return count_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return count_ == 0; }
+  allocator *get_allocator() const { return alloc_; }
+
+  template <size_t I> field_type<I> *stream() {
+    return static_cast<field_type<I> *>(streams_[I]);
+  }
+  template <size_t I> const field_type<I> *stream() const {
+    return static_cast<const field_type<I> *>(streams_[I]);
+  }
+  template <size_t I> field_type<I> &get(size_t i) {
+    assert(i < count_ && "Soa index out of range");
+    return stream<I>()[i];
+  }
+  template <size_t I> const field_type<I> &get(size_t i) const {
+    assert(i < count_ && "Soa index out of range");
+    return stream<I>()[i];
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_)
+      grow(capacity);
+  }
+
+  /**
+   * Appends one element and returns its index.
+   */
+  size_t add(const __Ts &... values) {
+    if (count_ == capacity_)
+      grow(capacity_ * 2 > count_ + chunk_size ? capacity_ * 2
+                                               : count_ + chunk_size);
+    assign<0>(count_, values...);
+    return count_++;
+  }
+
+  /**
+   * Removes element i by moving the last element into its place. Returns
+   * the index the moved element had, or i when i was the last one.
+   */
+  size_t remove(size_t i) {
+    assert(i < count_ && "Soa index out of range");
+    const size_t last = --count_;
+    if (i != last) {
+      const size_t sizes[] = {sizeof(__Ts)...};
+      for (size_t f = 0; f < field_count; f++) {
+        uint8_t *s = static_cast<uint8_t *>(streams_[f]);
+        memcpy(s + i * sizes[f], s + last * sizes[f], sizes[f]);
+      }
+    }
+    return last;
+  }
+
+  void clear() { count_ = 0; }
+
+  view get_view() const { return sub_view(0, count_, capacity_); }
+
+  /**
+   * Calls fn(view) for consecutive chunk_size element windows. Every window
+   * starts chunk_size elements after the previous one, so a stream of 4
+   * byte fields hands out cache line aligned windows. Only the last window
+   * can have size() < padded_size().
+   */
+  template <typename __F> void for_each_chunk(__F &&fn) const {
+    for (size_t begin = 0; begin < count_; begin += chunk_size) {
+      size_t count = count_ - begin;
+      if (count > chunk_size)
+        count = chunk_size;
+      fn(sub_view(begin, count, chunk_size));
+    }
+  }
+
+private:
+  template <size_t I> void assign(size_t) {}
+  template <size_t I, typename __F, typename... __Rest>
+  void assign(size_t i, const __F &value, const __Rest &... rest) {
+    stream<I>()[i] = value;
+    assign<I + 1>(i, rest...);
+  }
+
+  view sub_view(size_t begin, size_t count, size_t padded) const {
+    const size_t sizes[] = {sizeof(__Ts)...};
+    view v;
+    for (size_t f = 0; f < field_count; f++)
+      v.streams[f] = static_cast<uint8_t *>(streams_[f]) + begin * sizes[f];
+    v.count = count;
+    v.padded = padded;
+    return v;
+  }
+
+  void grow(size_t capacity) {
+    assert(alloc_ && "Soa has no allocator to grow with");
+    capacity = align_block(chunk_size, capacity);
+
+    const size_t sizes[] = {sizeof(__Ts)...};
+    size_t offsets[field_count];
+    size_t bytes = 0;
+    for (size_t f = 0; f < field_count; f++) {
+      offsets[f] = bytes;
+      bytes += align_block(stream_alignment, capacity * sizes[f]);
+    }
+
+    // Allocators align to 16 bytes, the slack lets streams start on a line.
+    blk b = allocate(alloc_, bytes + stream_alignment - 16);
+    assert(b.ptr && "Failed to allocated data");
+    uint8_t *base = reinterpret_cast<uint8_t *>(
+        align_block(stream_alignment, reinterpret_cast<uintptr_t>(b.ptr)));
+    for (size_t f = 0; f < field_count; f++) {
+      if (count_)
+        memcpy(base + offsets[f], streams_[f], count_ * sizes[f]);
+      streams_[f] = base + offsets[f];
+    }
+
+    if (block_.ptr)
+      deallocate(alloc_, block_);
+    block_ = b;
+    capacity_ = capacity;
+  }
+
+  void release() {
+    if (block_.ptr)
+      deallocate(alloc_, block_);
+    for (size_t f = 0; f < field_count; f++)
+      streams_[f] = nullptr;
+    count_ = 0;
+    capacity_ = 0;
+    block_ = {nullptr, 0};
+  }
+
+  void take(soa &other) {
+    for (size_t f = 0; f < field_count; f++) {
+      streams_[f] = other.streams_[f];
+      other.streams_[f] = nullptr;
+    }
+    count_ = other.count_;
+    capacity_ = other.capacity_;
+    block_ = other.block_;
+    other.count_ = 0;
+    other.capacity_ = 0;
+    other.block_ = {nullptr, 0};
+  }
+
+  allocator *alloc_;
+  void *streams_[sizeof...(__Ts)];
+  size_t count_;
+  size_t capacity_;
+  blk block_;
+};
+
+template <typename... __Ts> constexpr size_t soa_view<__Ts...>::field_count;
+template <typename... __Ts> constexpr size_t soa<__Ts...>::field_count;
+template <typename... __Ts> constexpr size_t soa<__Ts...>::stream_alignment;
+template <typename... __Ts> constexpr size_t soa<__Ts...>::chunk_size;
+
+} // namespace ZeroG
+
+#endif // SOA_H
@@ -0,0 +1,149 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "memory/memory.h"
+
+namespace ZeroG {
+
+namespace internal {
+constexpr size_t cache_line{64};
+
+inline size_t queue_capacity(size_t capacity) {
+  size_t res = 2;
+  while (res < capacity)
+    res <<= 1;
+  return res;
+}
+} // namespace internal
+
+/**
+ * Bounded single producer single consumer ring. Each side owns one index
+ * on its own cache line and keeps a private copy of the other side's
+ * index, the shared one is only reloaded when the copy says the ring is
+ * full (or empty). Capacity is rounded up to a power of two.
+ *
+ * Exactly one thread may push and exactly one thread may pop.
+ */
+template <typename __T> struct spsc_queue {
+  spsc_queue(allocator *alloc, size_t capacity)
+      : alloc_{alloc}, mask_{internal::queue_capacity(capacity) - 1},
+        head_{0}, tail_cache_{0}, tail_{0}, head_cache_{0} {
+    static_assert(alignof(__T) <= 16, "Allocators only align to 16 bytes");
+    block_ = allocate(alloc_, (mask_ + 1) * sizeof(__T));
+    assert(block_.ptr && "Failed to allocated data");
+    data_ = static_cast<__T *>(block_.ptr);
+  }
+
+  spsc_queue(const spsc_queue &) = delete;
+  spsc_queue &operator=(const spsc_queue &) = delete;
+
+  ~spsc_queue() {
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    for (size_t i = head_.load(std::memory_order_relaxed); i != tail; i++)
+      data_[i & mask_].~__T();
+    deallocate(alloc_, block_);
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  /**
+   * Number of queued elements, exact only when both sides are idle.
+   */
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  template <typename... Args> bool emplace(Args &&... args) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_)
+        return false;
+    }
+    new (data_ + (tail & mask_)) __T(std::forward<Args>(args)...);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool push(const __T &value) { return emplace(value); }
+  bool push(__T &&value) { return emplace(std::move(value)); }
+
+  bool pop(__T *value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_)
+        return false;
+    }
+    __T *slot = data_ + (head & mask_);
+    *value = std::move(*slot);
+    slot->~__T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Pushes up to count values with a single publish, returns how many fit.
+   */
+  size_t push_batch(const __T *values, size_t count) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t free = mask_ + 1 - (tail - head_cache_);
+    if (free < count) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      free = mask_ + 1 - (tail - head_cache_);
+    }
+    const size_t n = count < free ? count : free;
+    for (size_t i = 0; i < n; i++)
+      new (data_ + ((tail + i) & mask_)) __T(values[i]);
+    if (n)
+      tail_.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  /**
+   * Pops up to count values with a single release, returns how many.
+   */
+  size_t pop_batch(__T *values, size_t count) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    size_t ready = tail_cache_ - head;
+    if (ready < count) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      ready = tail_cache_ - head;
+    }
+    const size_t n = count < ready ? count : ready;
+    for (size_t i = 0; i < n; i++) {
+      __T *slot = data_ + ((head + i) & mask_);
+      values[i] = std::move(*slot);
+      slot->~__T();
+    }
+    if (n)
+      head_.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+private:
+  allocator *alloc_;
+  blk block_;
+  __T *data_;
+  size_t mask_;
+
+  // Consumer side.
+  alignas(internal::cache_line) std::atomic<size_t> head_;
+  size_t tail_cache_;
+
+  // Producer side.
+  alignas(internal::cache_line) std::atomic<size_t> tail_;
+  size_t head_cache_;
+};
+
+} // namespace ZeroG
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,192 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "memory/memory.h"
+
+namespace ZeroG {
+
+/**
+ * Growable array backed by an allocator. The first N elements live inside
+ * the vector itself, so short lists never touch the allocator. Growth first
+ * asks the allocator to extend the block in place and only then moves to a
+ * new block, trivially copyable elements are relocated with memcpy.
+ *
+ * Allocation failure asserts, there are no exceptions to report it with.
+ */
+template <typename __T, size_t N = 0> struct vector {
+  typedef __T *iterator;
+  typedef const __T *const_iterator;
+
+  vector() : vector(nullptr) {}
+  explicit vector(allocator *alloc)
+      : alloc_{alloc}, data_{inline_data()}, count_{0}, capacity_{N},
+        block_{nullptr, 0} {}
+  vector(allocator *alloc, size_t count) : vector(alloc) { resize(count); }
+
+  vector(const vector &) = delete;
+  vector &operator=(const vector &) = delete;
+
+  vector(vector &&other) : vector(other.alloc_) { take(other); }
+  vector &operator=(vector &&other) {
+    if (this != &other) {
+      release();
+      alloc_ = other.alloc_;
+      take(other);
+    }
+    return *this;
+  }
+
+  ~vector() { release(); }
+
+  iterator begin() { return data_; }
+  const_iterator begin() const { return data_; }
+  iterator end() { return data_ + count_; }
+  const_iterator end() const { return data_ + count_; }
+
+  __T *data() { return data_; }
+  const __T *data() const { return data_; }
+  size_t size() const { return count_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return count_ == 0; }
+  allocator *get_allocator() const { return alloc_; }
+
+  __T &operator[](size_t i) {
+    assert(i < count_ && "Vector index out of range");
+    return data_[i];
+  }
+  const __T &operator[](size_t i) const {
+    assert(i < count_ && "Vector index out of range");
+    return data_[i];
+  }
+  __T &back() { return (*this)[count_ - 1]; }
+  const __T &back() const { return (*this)[count_ - 1]; }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_)
+      grow(capacity);
+  }
+
+  void resize(size_t count) {
+    reserve(count);
+    if (std::is_trivially_default_constructible<__T>::value) {
+      if (count > count_)
+        memset(static_cast<void *>(data_ + count_), 0,
+               (count - count_) * sizeof(__T));
+    } else {
+      for (size_t i = count_; i < count; i++)
+        new (data_ + i) __T();
+    }
+    destroy_range(count, count_);
+    count_ = count;
+  }
+
+  template <typename... Args> __T &emplace_back(Args &&... args) {
+    if (count_ == capacity_) {
+      // Arguments may point into the storage that is about to move.
+      __T value(std::forward<Args>(args)...);
+      grow(capacity_ * 2 > count_ + 4 ? capacity_ * 2 : count_ + 4);
+      return *new (data_ + count_++) __T(std::move(value));
+    }
+    return *new (data_ + count_++) __T(std::forward<Args>(args)...);
+  }
+
+  void push_back(const __T &value) { emplace_back(value); }
+  void push_back(__T &&value) { emplace_back(std::move(value)); }
+
+  void pop_back() {
+    assert(count_ && "Vector is empty");
+    count_--;
+    data_[count_].~__T();
+  }
+
+  void clear() {
+    destroy_range(0, count_);
+    count_ = 0;
+  }
+
+private:
+  __T *inline_data() { return reinterpret_cast<__T *>(inline_storage_); }
+
+  void destroy_range(size_t from, size_t to) {
+    if (!std::is_trivially_destructible<__T>::value) {
+      for (size_t i = from; i < to; i++)
+        data_[i].~__T();
+    }
+  }
+
+  static void relocate(__T *dst, __T *src, size_t count) {
+    if (std::is_trivially_copyable<__T>::value) {
+      memcpy(static_cast<void *>(dst), static_cast<const void *>(src),
+             count * sizeof(__T));
+    } else {
+      for (size_t i = 0; i < count; i++) {
+        new (dst + i) __T(std::move(src[i]));
+        src[i].~__T();
+      }
+    }
+  }
+
+  void grow(size_t capacity) {
+    assert(alloc_ && "Vector has no allocator to grow with");
+    static_assert(alignof(__T) <= 16, "Allocators only align to 16 bytes");
+
+    const size_t bytes = capacity * sizeof(__T);
+    if (block_.ptr && expand(alloc_, &block_, bytes)) {
+      capacity_ = block_.size / sizeof(__T);
+      return;
+    }
+
+    blk b = allocate(alloc_, bytes);
+    assert(b.ptr && "Failed to allocated data");
+    relocate(static_cast<__T *>(b.ptr), data_, count_);
+    if (block_.ptr)
+      deallocate(alloc_, block_);
+    block_ = b;
+    data_ = static_cast<__T *>(b.ptr);
+    capacity_ = b.size / sizeof(__T);
+  }
+
+  void release() {
+    destroy_range(0, count_);
+    if (block_.ptr)
+      deallocate(alloc_, block_);
+    data_ = inline_data();
+    count_ = 0;
+    capacity_ = N;
+    block_ = {nullptr, 0};
+  }
+
+  void take(vector &other) {
+    if (other.block_.ptr) {
+      data_ = other.data_;
+      block_ = other.block_;
+      capacity_ = other.capacity_;
+    } else {
+      relocate(data_, other.data_, other.count_);
+    }
+    count_ = other.count_;
+    other.data_ = other.inline_data();
+    other.count_ = 0;
+    other.capacity_ = N;
+    other.block_ = {nullptr, 0};
+  }
+
+  allocator *alloc_;
+  __T *data_;
+  size_t count_;
+  size_t capacity_;
+  blk block_;
+  alignas(__T) uint8_t inline_storage_[N ? N * sizeof(__T) : 1];
+};
+
+} // namespace ZeroG
+
+#endif // VECTOR_H
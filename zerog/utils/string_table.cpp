@@ -0,0 +1,112 @@
+#include "string_table.h"
+
+#include "memory/memory.h"
+#include "utils/containers/hash_map.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+static constexpr size_t string_chunk_size{64 * Kb};
+
+/**
+ * Strings go into a chain of stack arenas that are never reset, lookups go
+ * through a hash map keyed by the id. Writers are rare after start up, one
+ * spin lock covers both.
+ */
+struct string_table {
+  allocator *map_allocator;
+  ZeroG::hash_map<string_id, const char *> ids;
+  allocator *chunk;
+  size_t collisions;
+
+  string_table()
+      : map_allocator{create_bitmapped_allocator(Kb * 64)},
+        ids{map_allocator}, chunk{nullptr}, collisions{0} {}
+};
+
+static std::atomic_flag table_lock = ATOMIC_FLAG_INIT;
+
+static string_table &table() {
+  static string_table instance;
+  return instance;
+}
+
+static void lock() {
+  while (table_lock.test_and_set(std::memory_order_acquire)) {
+  }
+}
+
+static void unlock() { table_lock.clear(std::memory_order_release); }
+
+static const char *store(string_table &t, const char *str, size_t length) {
+  blk b = t.chunk ? allocate(t.chunk, length + 1) : blk{nullptr, 0};
+  if (!b.ptr) {
+    const size_t size = length + 1 > string_chunk_size ? length + 1
+                                                       : string_chunk_size;
+    // Older chunks stay alive, ids hand out pointers into them.
+    t.chunk = create_stack_allocator(size);
+    b = allocate(t.chunk, length + 1);
+    assert(b.ptr && "Failed to allocated data");
+  }
+  char *copy = static_cast<char *>(b.ptr);
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+bool try_intern(const char *str, size_t length, string_id *id) {
+  assert(str && "String is null");
+  *id = common::runtime_hash(str, length);
+
+  lock();
+  string_table &t = table();
+  bool res = true;
+  const char **found = t.ids.find(*id);
+  if (found) {
+    if (strncmp(*found, str, length) != 0 || (*found)[length] != '\0') {
+      t.collisions++;
+      res = false;
+    }
+  } else {
+    t.ids.insert(*id, store(t, str, length));
+  }
+  unlock();
+  return res;
+}
+
+bool try_intern(const char *str, string_id *id) {
+  return try_intern(str, strlen(str), id);
+}
+
+string_id intern(const char *str, size_t length) {
+  string_id id;
+  const bool interned = try_intern(str, length, &id);
+  assert(interned && "Interned strings collide on their id");
+  (void)interned;
+  return id;
+}
+
+string_id intern(const char *str) { return intern(str, strlen(str)); }
+
+const char *interned_string(string_id id) {
+  lock();
+  const char **found = table().ids.find(id);
+  const char *res = found ? *found : nullptr;
+  unlock();
+  return res;
+}
+
+size_t interned_count() {
+  lock();
+  const size_t res = table().ids.size();
+  unlock();
+  return res;
+}
+
+size_t intern_collisions() {
+  lock();
+  const size_t res = table().collisions;
+  unlock();
+  return res;
+}
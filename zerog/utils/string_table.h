@@ -0,0 +1,53 @@
+#ifndef STRING_TABLE_H
+#define STRING_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common/hash.h"
+#include "common/id_set.h"
+
+/**
+ * Process wide intern table. Every unique string is stored once and named
+ * by its crc32, the same value the _h literal and common::hash produce, so
+ * an interned string compares equal to a compile time id with an integer
+ * compare. Two different strings hashing to the same id are a collision and
+ * assert; the first string keeps the id.
+ */
+typedef uint32_t string_id;
+
+string_id intern(const char *str);
+string_id intern(const char *str, size_t length);
+
+/**
+ * Same as intern, but a collision is returned instead of asserted: false
+ * means id already names a different string, and str was not stored.
+ * Release builds of intern let the colliding string share that id, input
+ * that is not known ahead, like names read from assets, goes through here.
+ */
+bool try_intern(const char *str, string_id *id);
+bool try_intern(const char *str, size_t length, string_id *id);
+
+/**
+ * Returns the stored copy for id, or nullptr when nothing with that id was
+ * interned. The pointer stays valid for the life of the process.
+ */
+const char *interned_string(string_id id);
+
+size_t interned_count();
+size_t intern_collisions();
+
+/**
+ * Interns the names of an id set in debug builds, so interned_string can
+ * name ids in logs and tools. Release builds keep only the ids.
+ */
+template <size_t __N> void register_id_set(const common::id_set<__N> &set) {
+#ifndef NDEBUG
+  for (size_t i = 0; i < __N; i++)
+    intern(set.names[i]);
+#else
+  (void)set;
+#endif
+}
+
+#endif // STRING_TABLE_H
@@ -0,0 +1,706 @@
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "memory/memory.h"
+#include "utils/containers/bitset.h"
+#include "utils/containers/hash_map.h"
+#include "utils/containers/mpmc_queue.h"
+#include "utils/containers/slot_map.h"
+#include "utils/containers/soa.h"
+#include "utils/containers/spsc_queue.h"
+#include "utils/containers/vector.h"
+#include "utils/string_table.h"
+
+using namespace testing;
+using namespace ZeroG;
+
+struct tracked {
+  static int alive;
+  int value;
+  tracked() : value{0} { alive++; }
+  explicit tracked(int v) : value{v} { alive++; }
+  tracked(const tracked &o) : value{o.value} { alive++; }
+  tracked(tracked &&o) : value{o.value} {
+    o.value = -1;
+    alive++;
+  }
+  tracked &operator=(tracked &&o) {
+    value = o.value;
+    o.value = -1;
+    return *this;
+  }
+  ~tracked() { alive--; }
+};
+int tracked::alive = 0;
+
+TEST(vector, inline_storage_skips_allocator) {
+  allocator *alloc = create_stack_allocator(Kb);
+  {
+    vector<int, 4> v(alloc);
+    for (int i = 0; i < 4; i++)
+      v.push_back(i);
+    EXPECT_EQ(v.capacity(), 4);
+    EXPECT_EQ(find_owner(v.data()), nullptr);
+
+    v.push_back(4);
+    EXPECT_EQ(find_owner(v.data()), alloc);
+    for (int i = 0; i < 5; i++)
+      EXPECT_EQ(v[static_cast<size_t>(i)], i);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(vector, grows_in_place) {
+  allocator *alloc = create_stack_allocator(Mb);
+  {
+    vector<uint32_t> v(alloc);
+    v.push_back(0);
+    const uint32_t *first = v.data();
+    for (uint32_t i = 1; i < 10000; i++)
+      v.push_back(i);
+    EXPECT_EQ(v.data(), first);
+    EXPECT_EQ(v.size(), 10000);
+    for (uint32_t i = 0; i < 10000; i++)
+      EXPECT_EQ(v[i], i);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(vector, grows_by_moving) {
+  allocator *alloc = create_bitmapped_allocator(Kb);
+  {
+    vector<uint64_t> v(alloc);
+    v.resize(128);
+    blk blocker = allocate(alloc, Kb);
+    const uint64_t *first = v.data();
+    for (uint64_t i = 0; i < 128; i++)
+      v[i] = i * 3;
+    v.push_back(7);
+    EXPECT_NE(v.data(), first);
+    EXPECT_EQ(v.size(), 129);
+    for (uint64_t i = 0; i < 128; i++)
+      EXPECT_EQ(v[i], i * 3);
+    EXPECT_EQ(v.back(), 7);
+    deallocate(alloc, blocker);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(vector, non_trivial_elements) {
+  allocator *alloc = create_bitmapped_allocator(Kb);
+  {
+    vector<tracked, 2> v(alloc);
+    for (int i = 0; i < 100; i++)
+      v.emplace_back(i);
+    EXPECT_EQ(tracked::alive, 100);
+    for (int i = 0; i < 100; i++)
+      EXPECT_EQ(v[static_cast<size_t>(i)].value, i);
+    v.pop_back();
+    EXPECT_EQ(tracked::alive, 99);
+    v.resize(10);
+    EXPECT_EQ(tracked::alive, 10);
+    v.resize(12);
+    EXPECT_EQ(v[11].value, 0);
+  }
+  EXPECT_EQ(tracked::alive, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(vector, push_back_own_element) {
+  allocator *alloc = create_bitmapped_allocator(Kb);
+  {
+    vector<tracked, 1> v(alloc);
+    v.emplace_back(42);
+    for (int i = 0; i < 20; i++)
+      v.push_back(v[0]);
+    for (const tracked &t : v)
+      EXPECT_EQ(t.value, 42);
+    v.clear();
+    EXPECT_EQ(tracked::alive, 0);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(vector, move_inline_and_heap) {
+  allocator *alloc = create_bitmapped_allocator(Kb);
+  {
+    vector<tracked, 4> small(alloc);
+    small.emplace_back(1);
+    small.emplace_back(2);
+    vector<tracked, 4> moved(std::move(small));
+    EXPECT_EQ(small.size(), 0);
+    EXPECT_EQ(moved.size(), 2);
+    EXPECT_EQ(moved[1].value, 2);
+    EXPECT_EQ(tracked::alive, 2);
+
+    vector<tracked, 4> large(alloc);
+    for (int i = 0; i < 10; i++)
+      large.emplace_back(i);
+    const tracked *heap = large.data();
+    moved = std::move(large);
+    EXPECT_EQ(moved.data(), heap);
+    EXPECT_EQ(moved.size(), 10);
+    EXPECT_EQ(tracked::alive, 10);
+    moved = vector<tracked, 4>(alloc);
+    EXPECT_EQ(tracked::alive, 0);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(vector, resize_zero_initialises) {
+  allocator *alloc = create_stack_allocator(Kb * 4);
+  {
+    vector<uint32_t> v(alloc, 16);
+    for (uint32_t x : v)
+      EXPECT_EQ(x, 0);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(hash_map, insert_find_erase) {
+  allocator *alloc = create_bitmapped_allocator(Kb * 4);
+  {
+    hash_map<uint32_t, uint32_t> map(alloc);
+    for (uint32_t i = 0; i < 5000; i++)
+      EXPECT_TRUE(map.insert(i * 7919, i).second);
+    EXPECT_EQ(map.size(), 5000);
+    EXPECT_FALSE(map.insert(7919, 0).second);
+    EXPECT_EQ(*map.find(7919), 1);
+
+    for (uint32_t i = 0; i < 5000; i++) {
+      uint32_t *v = map.find(i * 7919);
+      ASSERT_NE(v, nullptr);
+      EXPECT_EQ(*v, i);
+    }
+    EXPECT_EQ(map.find(1), nullptr);
+
+    for (uint32_t i = 0; i < 5000; i += 2)
+      EXPECT_TRUE(map.erase(i * 7919));
+    EXPECT_FALSE(map.erase(0));
+    EXPECT_EQ(map.size(), 2500);
+    for (uint32_t i = 0; i < 5000; i++)
+      EXPECT_EQ(map.contains(i * 7919), (i & 1) == 1);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(hash_map, tombstones_do_not_grow_table) {
+  allocator *alloc = create_bitmapped_allocator(Kb * 4);
+  {
+    hash_map<uint32_t, uint32_t> map(alloc);
+    map.reserve(64);
+    const size_t capacity = map.capacity();
+    for (uint32_t round = 0; round < 100; round++) {
+      for (uint32_t i = 0; i < 32; i++)
+        map.insert(round * 1000 + i, i);
+      for (uint32_t i = 0; i < 32; i++)
+        map.erase(round * 1000 + i);
+    }
+    EXPECT_EQ(map.size(), 0);
+    EXPECT_EQ(map.capacity(), capacity);
+  }
+  destroy_allocator(alloc);
+}
+
+struct constant_hasher {
+  uint32_t operator()(uint32_t) const { return 42; }
+};
+
+TEST(hash_map, full_collisions) {
+  allocator *alloc = create_bitmapped_allocator(Kb * 4);
+  {
+    hash_map<uint32_t, uint32_t, constant_hasher> map(alloc);
+    for (uint32_t i = 0; i < 300; i++)
+      map[i] = i + 1;
+    for (uint32_t i = 0; i < 300; i++)
+      EXPECT_EQ(*map.find(i), i + 1);
+    for (uint32_t i = 0; i < 300; i += 3)
+      map.erase(i);
+    for (uint32_t i = 0; i < 300; i++)
+      EXPECT_EQ(map.contains(i), i % 3 != 0);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(hash_map, precomputed_hash_lookup) {
+  allocator *alloc = create_bitmapped_allocator(Kb * 4);
+  {
+    hash_map<const char *, int, string_hasher, string_equal> map(alloc);
+    map.insert("albedo", 1);
+    map.insert("normal", 2);
+    map.insert("roughness", 3);
+
+    char name[]{"normal"};
+    EXPECT_EQ(*map.find(name), 2);
+    EXPECT_EQ(*map.find_hashed("roughness"_h, "roughness"), 3);
+    EXPECT_EQ(map.find_hashed("metallic"_h, "metallic"), nullptr);
+
+    hash_map<uint32_t, int> ids(alloc);
+    ids.insert("albedo"_h, 1);
+    EXPECT_EQ(*ids.find(common::hash("albedo")), 1);
+  }
+  destroy_allocator(alloc);
+}
+
+#ifndef NDEBUG
+TEST(hash_map, precomputed_hash_must_match_the_hasher) {
+  allocator *alloc = create_bitmapped_allocator(Kb * 4);
+  {
+    hash_map<const char *, int, string_hasher, string_equal> map(alloc);
+    EXPECT_TRUE(map.emplace_hashed("albedo"_h, "albedo", 1).second);
+    // Unreachable after the next grow if it were let in.
+    EXPECT_DEATH(map.emplace_hashed("normal"_h, "albedo", 2),
+                 "Hash differs from the map's hasher");
+  }
+  destroy_allocator(alloc);
+}
+#endif
+
+TEST(hash_map, non_trivial_values_and_iteration) {
+  allocator *alloc = create_bitmapped_allocator(Kb * 4);
+  {
+    hash_map<uint32_t, tracked> map(alloc);
+    for (uint32_t i = 0; i < 200; i++)
+      map.emplace(i, static_cast<int>(i));
+    EXPECT_EQ(tracked::alive, 200);
+
+    uint64_t sum = 0;
+    size_t count = 0;
+    for (auto &s : map) {
+      EXPECT_EQ(static_cast<uint32_t>(s.value.value), s.key);
+      sum += s.key;
+      count++;
+    }
+    EXPECT_EQ(count, 200);
+    EXPECT_EQ(sum, 199 * 200 / 2);
+
+    map.erase(5);
+    EXPECT_EQ(tracked::alive, 199);
+    hash_map<uint32_t, tracked> moved(std::move(map));
+    EXPECT_EQ(map.size(), 0);
+    EXPECT_EQ(moved.size(), 199);
+    EXPECT_EQ(moved.find(7)->value, 7);
+  }
+  EXPECT_EQ(tracked::alive, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(hash_map, grows_through_a_self_referencing_insert) {
+  allocator *alloc = create_bitmapped_allocator(Kb * 4);
+  {
+    hash_map<uint32_t, tracked> map(alloc);
+    map.emplace(0, 1000);
+    for (uint32_t i = 1; i < 200; i++)
+      map.emplace(i, *map.find(i - 1));
+    for (uint32_t i = 0; i < 200; i++)
+      EXPECT_EQ(map.find(i)->value, 1000) << i;
+
+    hash_map<uint32_t, uint32_t> chain(alloc);
+    chain.insert(0, 1);
+    for (uint32_t i = 0; i < 200; i++)
+      chain.emplace(*chain.find(i), i + 2);
+    for (uint32_t i = 0; i <= 200; i++)
+      EXPECT_EQ(*chain.find(i), i + 1) << i;
+  }
+  EXPECT_EQ(tracked::alive, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(string_table, ids_match_compile_time_hashes) {
+  const size_t before = interned_count();
+  string_id a = intern("VK_KHR_swapchain");
+  EXPECT_EQ(a, "VK_KHR_swapchain"_h);
+  EXPECT_EQ(a, common::hash("VK_KHR_swapchain"));
+  EXPECT_STREQ(interned_string(a), "VK_KHR_swapchain");
+
+  char copy[]{"VK_KHR_swapchain"};
+  EXPECT_EQ(intern(copy), a);
+  EXPECT_EQ(interned_string(intern(copy)), interned_string(a));
+  EXPECT_EQ(interned_count(), before + 1);
+
+  EXPECT_EQ(intern("shaders/main.vert", 7), "shaders"_h);
+  EXPECT_STREQ(interned_string("shaders"_h), "shaders");
+  EXPECT_EQ(interned_string("never interned"_h), nullptr);
+}
+
+TEST(string_table, large_strings_and_many_chunks) {
+  std::vector<char> big(200 * 1024, 'x');
+  big.back() = '\0';
+  string_id id = intern(big.data());
+  EXPECT_EQ(strlen(interned_string(id)), big.size() - 1);
+
+  char name[32];
+  for (int i = 0; i < 20000; i++) {
+    snprintf(name, sizeof(name), "asset_%d", i);
+    intern(name);
+  }
+  EXPECT_STREQ(interned_string(common::hash("asset_19999")), "asset_19999");
+}
+
+TEST(string_table, concurrent_interning) {
+  constexpr int thread_count = 8;
+  const char *results[thread_count][64];
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([t, &results] {
+      char name[32];
+      for (int i = 0; i < 64; i++) {
+        snprintf(name, sizeof(name), "shared_%d", i);
+        results[t][i] = interned_string(intern(name));
+      }
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+  for (int t = 1; t < thread_count; t++) {
+    for (int i = 0; i < 64; i++)
+      EXPECT_EQ(results[t][i], results[0][i]);
+  }
+}
+
+TEST(string_table, try_intern_reports_collisions) {
+  const size_t collisions = intern_collisions();
+  string_id first;
+  string_id second;
+  EXPECT_TRUE(try_intern("plumless", &first));
+  EXPECT_FALSE(try_intern("buckeroo", &second));
+  EXPECT_EQ(first, second);
+  EXPECT_STREQ(interned_string(second), "plumless");
+  EXPECT_EQ(intern_collisions(), collisions + 1);
+}
+
+#ifndef NDEBUG
+TEST(string_table, collision_is_detected) {
+  // Both strings have the crc32 0x4ddb0c25.
+  EXPECT_EQ("plumless"_h, "buckeroo"_h);
+  intern("plumless");
+  EXPECT_DEATH(intern("buckeroo"), "collide");
+}
+
+declare_id_set(test_passes, "shadow", "gbuffer", "lighting");
+
+TEST(string_table, registered_id_sets_map_back) {
+  EXPECT_EQ(interned_string(test_passes[1]), nullptr);
+  register_id_set(test_passes);
+  for (size_t i = 0; i < test_passes.size(); i++)
+    EXPECT_STREQ(interned_string(test_passes[i]), test_passes.names[i]);
+}
+#endif
+
+struct bounds {
+  float min[3];
+  float max[3];
+};
+
+TEST(soa, add_get_and_swap_back_remove) {
+  allocator *alloc = create_stack_allocator(Mb);
+  {
+    soa<float, uint32_t, bounds> s(alloc);
+    for (uint32_t i = 0; i < 100; i++) {
+      const float f = static_cast<float>(i);
+      EXPECT_EQ(s.add(f, i, bounds{{f, f, f}, {f, f, f}}), i);
+    }
+    EXPECT_EQ(s.size(), 100);
+    EXPECT_EQ(s.capacity() % s.chunk_size, 0);
+
+    EXPECT_EQ(s.remove(10), 99);
+    EXPECT_EQ(s.size(), 99);
+    EXPECT_EQ(s.get<0>(10), 99.0f);
+    EXPECT_EQ(s.get<1>(10), 99);
+    EXPECT_EQ(s.get<2>(10).max[2], 99.0f);
+    EXPECT_EQ(s.remove(98), 98);
+    EXPECT_EQ(s.size(), 98);
+    for (uint32_t i = 0; i < 98; i++) {
+      if (i != 10) {
+        EXPECT_EQ(s.get<1>(i), i);
+      }
+    }
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(soa, streams_are_aligned_and_survive_growth) {
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    soa<uint8_t, double> s(alloc);
+    for (uint32_t i = 0; i < 1000; i++) {
+      s.add(static_cast<uint8_t>(i), static_cast<double>(i));
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(s.stream<0>()) % 64, 0);
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(s.stream<1>()) % 64, 0);
+    }
+    for (uint32_t i = 0; i < 1000; i++) {
+      EXPECT_EQ(s.get<0>(i), static_cast<uint8_t>(i));
+      EXPECT_EQ(s.get<1>(i), static_cast<double>(i));
+    }
+
+    soa<uint8_t, double> moved(std::move(s));
+    EXPECT_EQ(s.size(), 0);
+    EXPECT_EQ(moved.size(), 1000);
+    EXPECT_EQ(moved.get<1>(999), 999.0);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(soa, chunks_cover_every_element) {
+  allocator *alloc = create_stack_allocator(Mb);
+  {
+    soa<float, float> s(alloc);
+    for (uint32_t i = 0; i < 123; i++)
+      s.add(static_cast<float>(i), 1.0f);
+
+    size_t seen = 0;
+    s.for_each_chunk([&](const soa<float, float>::view &chunk) {
+      EXPECT_EQ(chunk.padded_size(), s.chunk_size);
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(chunk.stream<0>()) % 64, 0);
+      // Full width over the padding, the tail is never out of bounds.
+      for (size_t i = 0; i < chunk.padded_size(); i++)
+        chunk.stream<0>()[i] += chunk.stream<1>()[i];
+      seen += chunk.size();
+    });
+    EXPECT_EQ(seen, 123);
+
+    soa<float, float>::view v = s.get_view();
+    EXPECT_EQ(v.size(), 123);
+    for (size_t i = 0; i < v.size(); i++)
+      EXPECT_EQ(v.get<0>(i), static_cast<float>(i) + 1.0f);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(spsc_queue, fills_wraps_and_batches) {
+  allocator *alloc = create_stack_allocator(Kb * 16);
+  {
+    spsc_queue<uint32_t> q(alloc, 6);
+    EXPECT_EQ(q.capacity(), 8);
+    uint32_t value = 0;
+    EXPECT_FALSE(q.pop(&value));
+
+    for (uint32_t round = 0; round < 5; round++) {
+      for (uint32_t i = 0; i < 8; i++)
+        EXPECT_TRUE(q.push(round * 8 + i));
+      EXPECT_FALSE(q.push(0));
+      for (uint32_t i = 0; i < 8; i++) {
+        EXPECT_TRUE(q.pop(&value));
+        EXPECT_EQ(value, round * 8 + i);
+      }
+    }
+
+    const uint32_t in[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    uint32_t out[12] = {};
+    EXPECT_EQ(q.push_batch(in, 12), 8);
+    EXPECT_EQ(q.size(), 8);
+    EXPECT_EQ(q.pop_batch(out, 3), 3);
+    EXPECT_EQ(q.push_batch(in + 8, 4), 3);
+    EXPECT_EQ(q.pop_batch(out + 3, 12), 8);
+    for (uint32_t i = 0; i < 11; i++)
+      EXPECT_EQ(out[i], i);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(spsc_queue, producer_consumer_threads) {
+  allocator *alloc = create_stack_allocator(Kb * 16);
+  {
+    spsc_queue<uint64_t> q(alloc, 64);
+    const uint64_t count = 200000;
+    std::thread producer([&] {
+      for (uint64_t i = 0; i < count;) {
+        if (q.push(i))
+          i++;
+      }
+    });
+    uint64_t expected = 0;
+    uint64_t batch[16];
+    while (expected < count) {
+      const size_t n = q.pop_batch(batch, 16);
+      for (size_t i = 0; i < n; i++)
+        ASSERT_EQ(batch[i], expected++);
+    }
+    producer.join();
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(spsc_queue, destroys_queued_elements) {
+  allocator *alloc = create_stack_allocator(Kb * 16);
+  tracked::alive = 0;
+  {
+    spsc_queue<tracked> q(alloc, 4);
+    q.emplace(1);
+    q.emplace(2);
+    q.emplace(3);
+    tracked t;
+    EXPECT_TRUE(q.pop(&t));
+    EXPECT_EQ(t.value, 1);
+    EXPECT_EQ(tracked::alive, 3);
+  }
+  EXPECT_EQ(tracked::alive, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(mpmc_queue, full_and_empty) {
+  allocator *alloc = create_stack_allocator(Kb * 16);
+  tracked::alive = 0;
+  {
+    mpmc_queue<tracked> q(alloc, 4);
+    EXPECT_EQ(q.capacity(), 4);
+    for (int i = 0; i < 4; i++)
+      EXPECT_TRUE(q.emplace(i));
+    EXPECT_FALSE(q.emplace(4));
+    tracked t;
+    for (int i = 0; i < 2; i++) {
+      EXPECT_TRUE(q.pop(&t));
+      EXPECT_EQ(t.value, i);
+    }
+    EXPECT_TRUE(q.emplace(4));
+    EXPECT_EQ(tracked::alive, 4);
+  }
+  EXPECT_EQ(tracked::alive, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(mpmc_queue, many_producers_and_consumers) {
+  allocator *alloc = create_stack_allocator(Kb * 64);
+  {
+    mpmc_queue<uint64_t> q(alloc, 256);
+    const uint64_t per_producer = 50000;
+    const uint32_t producers = 4;
+    const uint32_t consumers = 4;
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> popped{0};
+
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; p++) {
+      threads.emplace_back([&, p] {
+        uint64_t batch[8];
+        for (uint64_t i = 0; i < per_producer;) {
+          size_t n = 0;
+          for (; n < 8 && i + n < per_producer; n++)
+            batch[n] = p * per_producer + i + n;
+          i += q.push_batch(batch, n);
+        }
+      });
+    }
+    for (uint32_t c = 0; c < consumers; c++) {
+      threads.emplace_back([&] {
+        uint64_t value;
+        while (popped.load() < producers * per_producer) {
+          if (q.pop(&value)) {
+            sum += value;
+            popped++;
+          }
+        }
+      });
+    }
+    for (std::thread &t : threads)
+      t.join();
+
+    const uint64_t n = producers * per_producer;
+    EXPECT_EQ(popped.load(), n);
+    EXPECT_EQ(sum.load(), n * (n - 1) / 2);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(slot_map, stale_handles_miss) {
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    slot_map<uint32_t> map(alloc);
+    EXPECT_FALSE(map.contains(slot_handle{0, 0}));
+
+    slot_handle a = map.insert(10);
+    slot_handle b = map.insert(20);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(*map.find(a), 10);
+    EXPECT_EQ(*map.find(b), 20);
+
+    EXPECT_TRUE(map.erase(a));
+    EXPECT_FALSE(map.erase(a));
+    EXPECT_EQ(map.find(a), nullptr);
+
+    slot_handle c = map.insert(30);
+    EXPECT_EQ(c.index, a.index);
+    EXPECT_NE(c.generation, a.generation);
+    EXPECT_EQ(map.find(a), nullptr);
+    EXPECT_EQ(*map.find(c), 30);
+    EXPECT_EQ(*map.find(b), 20);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(slot_map, values_stay_dense) {
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    slot_map<uint32_t> map(alloc);
+    std::vector<slot_handle> handles;
+    for (uint32_t i = 0; i < 1000; i++)
+      handles.push_back(map.insert(i));
+    for (uint32_t i = 0; i < 1000; i += 3)
+      EXPECT_TRUE(map.erase(handles[i]));
+
+    EXPECT_EQ(map.size(), 666);
+    uint64_t sum = 0;
+    for (uint32_t v : map)
+      sum += v;
+    uint64_t expected = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+      if (i % 3) {
+        expected += i;
+        EXPECT_EQ(*map.find(handles[i]), i);
+      }
+    }
+    EXPECT_EQ(sum, expected);
+
+    for (size_t i = 0; i < map.size(); i++)
+      EXPECT_EQ(map.find(map.handle_at(i)), map.data() + i);
+  }
+  destroy_allocator(alloc);
+}
+
+TEST(slot_map, clear_destroys_values) {
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  tracked::alive = 0;
+  {
+    slot_map<tracked> map(alloc);
+    slot_handle h = map.emplace(1);
+    map.emplace(2);
+    map.emplace(3);
+    EXPECT_EQ(tracked::alive, 3);
+    map.clear();
+    EXPECT_EQ(tracked::alive, 0);
+    EXPECT_FALSE(map.contains(h));
+    map.emplace(4);
+  }
+  EXPECT_EQ(tracked::alive, 0);
+  destroy_allocator(alloc);
+}
+
+TEST(bitset, resize_keeps_new_bits_unset) {
+  allocator *alloc = create_bitmapped_allocator(Mb);
+  {
+    ZeroG::bitset bits(alloc, 100);
+    bits.set_all();
+    EXPECT_EQ(bits.count(), 100);
+    bits.resize(70);
+    bits.resize(200);
+    EXPECT_EQ(bits.count(), 70);
+    EXPECT_EQ(bits.find_first_unset(), 70);
+    EXPECT_EQ(bits.find_unset_run(130), 70);
+
+    bits.unset(10, 20);
+    EXPECT_FALSE(bits.test(10));
+    EXPECT_TRUE(bits.test(30));
+    EXPECT_EQ(bits.find_unset_run(15), 10);
+    EXPECT_EQ(bits.find_next_set(5), 6);
+    EXPECT_EQ(bits.find_next_set(9), 30);
+    EXPECT_EQ(bits.rank(40), 20);
+    EXPECT_EQ(bits.select(10), 30);
+  }
+  destroy_allocator(alloc);
+}